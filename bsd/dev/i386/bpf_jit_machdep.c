@@ -0,0 +1,614 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * x86_64 back end for the BPF JIT; see net/bpf_jitter.h.
+ *
+ * Register assignment, following the SysV calling convention for
+ * bpf_filter_func(pkt, wirelen, buflen):
+ *
+ *	%rdi	packet
+ *	%esi	buflen (moved from %edx)
+ *	%r9d	wirelen (moved from %esi)
+ *	%eax	A
+ *	%edx	X
+ *	%rcx, %r8	scratch
+ *
+ * X is only ever written with 32-bit operations, so the upper half
+ * of %rdx stays clear and it can be used directly in 64-bit offset
+ * arithmetic; likewise %rsi.  Packet offsets are computed in 64 bits
+ * so that X + k can't wrap, then checked against buflen exactly as
+ * bpf_filter() does.  Failed checks, division by zero and stores
+ * past the scratch memory branch to a shared "return 0" exit.  The
+ * scratch memory words live on the stack and are zeroed on entry,
+ * but only for programs that use them.
+ *
+ * Every instruction has a fixed encoding (branches always use rel32),
+ * so one pass with no buffer sizes the code and records the offset
+ * of each BPF instruction, and a second pass emits it.
+ */
+
+#include <sys/param.h>
+#ifdef KERNEL
+#include <sys/systm.h>
+#include <sys/malloc.h>
+#include <mach/vm_param.h>
+#include <kern/kext_alloc.h>
+#include <vm/vm_map.h>
+#else
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <net/bpf.h>
+#include <net/bpf_jitter.h>
+
+#if BPF_JITTER
+
+#define	BPF_JIT_MEMSIZE	(BPF_MEMWORDS * sizeof (int32_t))
+
+typedef struct {
+	u_char	*buf;		/* NULL while sizing */
+	u_int	off;		/* current offset */
+	u_int	*insn_off;	/* offset of each BPF instruction */
+	u_int	ret0_off;	/* offset of the "return 0" exit */
+	int	usemem;		/* program touches scratch memory */
+} bpf_jit_state;
+
+static void
+emit1(bpf_jit_state *s, u_char b)
+{
+	if (s->buf != NULL)
+		s->buf[s->off] = b;
+	s->off++;
+}
+
+static void
+emit2(bpf_jit_state *s, u_char b0, u_char b1)
+{
+	emit1(s, b0);
+	emit1(s, b1);
+}
+
+static void
+emit3(bpf_jit_state *s, u_char b0, u_char b1, u_char b2)
+{
+	emit2(s, b0, b1);
+	emit1(s, b2);
+}
+
+static void
+emit4(bpf_jit_state *s, u_char b0, u_char b1, u_char b2, u_char b3)
+{
+	emit2(s, b0, b1);
+	emit2(s, b2, b3);
+}
+
+/* little-endian 32-bit immediate */
+static void
+emit_imm32(bpf_jit_state *s, u_int32_t v)
+{
+	emit4(s, v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, v >> 24);
+}
+
+/* opcode (1 or 2 bytes) followed by an immediate */
+static void
+emit_op_imm32(bpf_jit_state *s, u_char op, u_int32_t v)
+{
+	emit1(s, op);
+	emit_imm32(s, v);
+}
+
+/*
+ * Branch to "target": jmp if cc is 0, else the two-byte jcc 0x0f cc.
+ * While sizing, target offsets aren't known yet and the displacement
+ * is garbage, but it is never stored.
+ */
+static void
+emit_jmp(bpf_jit_state *s, u_char cc, u_int target)
+{
+	u_int end;
+
+	if (cc == 0) {
+		end = s->off + 5;
+		emit1(s, 0xe9);
+	} else {
+		end = s->off + 6;
+		emit2(s, 0x0f, cc);
+	}
+	emit_imm32(s, (u_int32_t)(target - end));
+}
+
+#define	JCC_JA		0x87
+#define	JCC_JBE		0x86
+#define	JCC_JAE		0x83
+#define	JCC_JB		0x82
+#define	JCC_JE		0x84
+#define	JCC_JNE		0x85
+
+static void
+emit_ret(bpf_jit_state *s)
+{
+	if (s->usemem)
+		emit4(s, 0x48, 0x83, 0xc4, BPF_JIT_MEMSIZE);	/* add $MEM, %rsp */
+	emit1(s, 0xc3);						/* ret */
+}
+
+/*
+ * Bounds-check a load of "size" bytes at offset k (+ X if "ind"),
+ * leaving the 64-bit offset in %rcx.
+ */
+static void
+emit_check(bpf_jit_state *s, u_int32_t k, int ind, u_char size)
+{
+	emit_op_imm32(s, 0xb9, k);			/* mov $k, %ecx */
+	if (ind)
+		emit3(s, 0x48, 0x01, 0xd1);		/* add %rdx, %rcx */
+	emit4(s, 0x4c, 0x8d, 0x41, size);		/* lea size(%rcx), %r8 */
+	emit3(s, 0x49, 0x39, 0xf0);			/* cmp %rsi, %r8 */
+	emit_jmp(s, JCC_JA, s->ret0_off);
+}
+
+static void
+emit_load(bpf_jit_state *s, struct bpf_insn *ins)
+{
+	int ind = (BPF_MODE(ins->code) == BPF_IND);
+
+	switch (BPF_SIZE(ins->code)) {
+	case BPF_W:
+		emit_check(s, ins->k, ind, 4);
+		emit3(s, 0x8b, 0x04, 0x0f);		/* mov (%rdi,%rcx), %eax */
+		emit2(s, 0x0f, 0xc8);			/* bswap %eax */
+		break;
+	case BPF_H:
+		emit_check(s, ins->k, ind, 2);
+		emit4(s, 0x0f, 0xb7, 0x04, 0x0f);	/* movzwl (%rdi,%rcx), %eax */
+		emit4(s, 0x66, 0xc1, 0xc0, 0x08);	/* rol $8, %ax */
+		break;
+	case BPF_B:
+		emit_check(s, ins->k, ind, 1);
+		emit4(s, 0x0f, 0xb6, 0x04, 0x0f);	/* movzbl (%rdi,%rcx), %eax */
+		break;
+	}
+}
+
+/*
+ * Emit the conditional jump of a BPF_JMP instruction whose comparison
+ * has just set the flags; cc is the condition for "true", ncc its
+ * negation.
+ */
+static void
+emit_cond(bpf_jit_state *s, u_int i, struct bpf_insn *ins, u_char cc,
+    u_char ncc)
+{
+	u_int jt = s->insn_off[i + 1 + ins->jt];
+	u_int jf = s->insn_off[i + 1 + ins->jf];
+
+	if (ins->jt == ins->jf) {
+		if (ins->jt != 0)
+			emit_jmp(s, 0, jt);
+	} else if (ins->jt == 0) {
+		emit_jmp(s, ncc, jf);
+	} else {
+		emit_jmp(s, cc, jt);
+		if (ins->jf != 0)
+			emit_jmp(s, 0, jf);
+	}
+}
+
+/*
+ * One pass over the program.  Returns 0 if it contains something we
+ * don't compile.
+ */
+static int
+bpf_jit_pass(bpf_jit_state *s, struct bpf_insn *prog, u_int nins)
+{
+	struct bpf_insn *ins;
+	u_int i;
+
+	s->off = 0;
+
+	/* prologue */
+	emit3(s, 0x41, 0x89, 0xf1);			/* mov %esi, %r9d */
+	emit2(s, 0x89, 0xd6);				/* mov %edx, %esi */
+	emit2(s, 0x31, 0xc0);				/* xor %eax, %eax */
+	emit2(s, 0x31, 0xd2);				/* xor %edx, %edx */
+	if (s->usemem) {
+		emit4(s, 0x48, 0x83, 0xec, BPF_JIT_MEMSIZE); /* sub $MEM, %rsp */
+		emit3(s, 0x45, 0x31, 0xc0);		/* xor %r8d, %r8d */
+		for (i = 0; i < BPF_JIT_MEMSIZE; i += 8) {
+			/* mov %r8, i(%rsp) */
+			emit4(s, 0x4c, 0x89, 0x44, 0x24);
+			emit1(s, i);
+		}
+	}
+
+	for (i = 0; i < nins; i++) {
+		ins = &prog[i];
+		s->insn_off[i] = s->off;
+
+		switch (ins->code) {
+		case BPF_RET|BPF_K:
+			emit_op_imm32(s, 0xb8, ins->k);	/* mov $k, %eax */
+			emit_ret(s);
+			break;
+
+		case BPF_RET|BPF_A:
+			emit_ret(s);
+			break;
+
+		case BPF_LD|BPF_W|BPF_ABS:
+		case BPF_LD|BPF_H|BPF_ABS:
+		case BPF_LD|BPF_B|BPF_ABS:
+		case BPF_LD|BPF_W|BPF_IND:
+		case BPF_LD|BPF_H|BPF_IND:
+		case BPF_LD|BPF_B|BPF_IND:
+			emit_load(s, ins);
+			break;
+
+		case BPF_LD|BPF_W|BPF_LEN:
+			emit3(s, 0x44, 0x89, 0xc8);	/* mov %r9d, %eax */
+			break;
+
+		case BPF_LDX|BPF_W|BPF_LEN:
+			emit3(s, 0x44, 0x89, 0xca);	/* mov %r9d, %edx */
+			break;
+
+		case BPF_LDX|BPF_MSH|BPF_B:
+			emit_check(s, ins->k, 0, 1);
+			emit4(s, 0x0f, 0xb6, 0x14, 0x0f); /* movzbl (%rdi,%rcx), %edx */
+			emit3(s, 0x83, 0xe2, 0x0f);	/* and $0xf, %edx */
+			emit3(s, 0xc1, 0xe2, 0x02);	/* shl $2, %edx */
+			break;
+
+		case BPF_LD|BPF_IMM:
+			emit_op_imm32(s, 0xb8, ins->k);	/* mov $k, %eax */
+			break;
+
+		case BPF_LDX|BPF_IMM:
+			emit_op_imm32(s, 0xba, ins->k);	/* mov $k, %edx */
+			break;
+
+		case BPF_LD|BPF_MEM:
+			if (ins->k >= BPF_MEMWORDS)
+				return (0);
+			/* mov k*4(%rsp), %eax */
+			emit4(s, 0x8b, 0x44, 0x24, ins->k * 4);
+			break;
+
+		case BPF_LDX|BPF_MEM:
+			if (ins->k >= BPF_MEMWORDS)
+				return (0);
+			/* mov k*4(%rsp), %edx */
+			emit4(s, 0x8b, 0x54, 0x24, ins->k * 4);
+			break;
+
+		case BPF_ST:
+			if (ins->k >= BPF_MEMWORDS) {
+				emit_jmp(s, 0, s->ret0_off);
+				break;
+			}
+			/* mov %eax, k*4(%rsp) */
+			emit4(s, 0x89, 0x44, 0x24, ins->k * 4);
+			break;
+
+		case BPF_STX:
+			if (ins->k >= BPF_MEMWORDS) {
+				emit_jmp(s, 0, s->ret0_off);
+				break;
+			}
+			/* mov %edx, k*4(%rsp) */
+			emit4(s, 0x89, 0x54, 0x24, ins->k * 4);
+			break;
+
+		case BPF_JMP|BPF_JA:
+			if (ins->k >= nins - i - 1)
+				return (0);
+			if (ins->k != 0)
+				emit_jmp(s, 0, s->insn_off[i + 1 + ins->k]);
+			break;
+
+		case BPF_JMP|BPF_JGT|BPF_K:
+		case BPF_JMP|BPF_JGE|BPF_K:
+		case BPF_JMP|BPF_JEQ|BPF_K:
+		case BPF_JMP|BPF_JSET|BPF_K:
+		case BPF_JMP|BPF_JGT|BPF_X:
+		case BPF_JMP|BPF_JGE|BPF_X:
+		case BPF_JMP|BPF_JEQ|BPF_X:
+		case BPF_JMP|BPF_JSET|BPF_X:
+			if (ins->jt >= nins - i - 1 || ins->jf >= nins - i - 1)
+				return (0);
+			if (BPF_OP(ins->code) == BPF_JSET) {
+				if (BPF_SRC(ins->code) == BPF_K)
+					emit_op_imm32(s, 0xa9, ins->k); /* test $k, %eax */
+				else
+					emit2(s, 0x85, 0xd0);	/* test %edx, %eax */
+			} else {
+				if (BPF_SRC(ins->code) == BPF_K)
+					emit_op_imm32(s, 0x3d, ins->k); /* cmp $k, %eax */
+				else
+					emit2(s, 0x39, 0xd0);	/* cmp %edx, %eax */
+			}
+			switch (BPF_OP(ins->code)) {
+			case BPF_JGT:
+				emit_cond(s, i, ins, JCC_JA, JCC_JBE);
+				break;
+			case BPF_JGE:
+				emit_cond(s, i, ins, JCC_JAE, JCC_JB);
+				break;
+			case BPF_JEQ:
+				emit_cond(s, i, ins, JCC_JE, JCC_JNE);
+				break;
+			case BPF_JSET:
+				emit_cond(s, i, ins, JCC_JNE, JCC_JE);
+				break;
+			}
+			break;
+
+		case BPF_ALU|BPF_ADD|BPF_X:
+			emit2(s, 0x01, 0xd0);		/* add %edx, %eax */
+			break;
+
+		case BPF_ALU|BPF_SUB|BPF_X:
+			emit2(s, 0x29, 0xd0);		/* sub %edx, %eax */
+			break;
+
+		case BPF_ALU|BPF_MUL|BPF_X:
+			emit3(s, 0x0f, 0xaf, 0xc2);	/* imul %edx, %eax */
+			break;
+
+		case BPF_ALU|BPF_DIV|BPF_X:
+			emit2(s, 0x85, 0xd2);		/* test %edx, %edx */
+			emit_jmp(s, JCC_JE, s->ret0_off);
+			emit2(s, 0x89, 0xd1);		/* mov %edx, %ecx */
+			emit2(s, 0x31, 0xd2);		/* xor %edx, %edx */
+			emit2(s, 0xf7, 0xf1);		/* div %ecx */
+			emit2(s, 0x89, 0xca);		/* mov %ecx, %edx */
+			break;
+
+		case BPF_ALU|BPF_AND|BPF_X:
+			emit2(s, 0x21, 0xd0);		/* and %edx, %eax */
+			break;
+
+		case BPF_ALU|BPF_OR|BPF_X:
+			emit2(s, 0x09, 0xd0);		/* or %edx, %eax */
+			break;
+
+		case BPF_ALU|BPF_LSH|BPF_X:
+			emit2(s, 0x89, 0xd1);		/* mov %edx, %ecx */
+			emit2(s, 0xd3, 0xe0);		/* shl %cl, %eax */
+			break;
+
+		case BPF_ALU|BPF_RSH|BPF_X:
+			emit2(s, 0x89, 0xd1);		/* mov %edx, %ecx */
+			emit2(s, 0xd3, 0xe8);		/* shr %cl, %eax */
+			break;
+
+		case BPF_ALU|BPF_ADD|BPF_K:
+			emit_op_imm32(s, 0x05, ins->k);	/* add $k, %eax */
+			break;
+
+		case BPF_ALU|BPF_SUB|BPF_K:
+			emit_op_imm32(s, 0x2d, ins->k);	/* sub $k, %eax */
+			break;
+
+		case BPF_ALU|BPF_MUL|BPF_K:
+			emit2(s, 0x69, 0xc0);		/* imul $k, %eax, %eax */
+			emit_imm32(s, ins->k);
+			break;
+
+		case BPF_ALU|BPF_DIV|BPF_K:
+			/* bpf_validate() rejects this; so do we */
+			if (ins->k == 0)
+				return (0);
+			emit3(s, 0x41, 0x89, 0xd0);	/* mov %edx, %r8d */
+			emit_op_imm32(s, 0xb9, ins->k);	/* mov $k, %ecx */
+			emit2(s, 0x31, 0xd2);		/* xor %edx, %edx */
+			emit2(s, 0xf7, 0xf1);		/* div %ecx */
+			emit3(s, 0x44, 0x89, 0xc2);	/* mov %r8d, %edx */
+			break;
+
+		case BPF_ALU|BPF_AND|BPF_K:
+			emit_op_imm32(s, 0x25, ins->k);	/* and $k, %eax */
+			break;
+
+		case BPF_ALU|BPF_OR|BPF_K:
+			emit_op_imm32(s, 0x0d, ins->k);	/* or $k, %eax */
+			break;
+
+		/* like the interpreter's shift, the count is taken mod 32 */
+		case BPF_ALU|BPF_LSH|BPF_K:
+			emit3(s, 0xc1, 0xe0, ins->k & 0x1f); /* shl $k, %eax */
+			break;
+
+		case BPF_ALU|BPF_RSH|BPF_K:
+			emit3(s, 0xc1, 0xe8, ins->k & 0x1f); /* shr $k, %eax */
+			break;
+
+		case BPF_ALU|BPF_NEG:
+			emit2(s, 0xf7, 0xd8);		/* neg %eax */
+			break;
+
+		case BPF_MISC|BPF_TAX:
+			emit2(s, 0x89, 0xc2);		/* mov %eax, %edx */
+			break;
+
+		case BPF_MISC|BPF_TXA:
+			emit2(s, 0x89, 0xd0);		/* mov %edx, %eax */
+			break;
+
+		default:
+			return (0);
+		}
+	}
+
+	/* shared "return 0" exit, also reached by falling off the end */
+	s->ret0_off = s->off;
+	emit2(s, 0x31, 0xc0);				/* xor %eax, %eax */
+	emit_ret(s);
+
+	return (1);
+}
+
+#ifdef KERNEL
+/*
+ * The kernel heap isn't executable, so the code goes in the kext map
+ * (which is within branch range of kernel text anyway), wired since
+ * filters run with bpf_mlock held, and is sealed read/execute before
+ * it is used.
+ */
+extern vm_map_t g_kext_map;
+
+static void *
+bpf_jit_alloc(size_t size)
+{
+	vm_offset_t addr;
+
+	if (kext_alloc(&addr, size, FALSE) != KERN_SUCCESS)
+		return (NULL);
+	if (vm_map_wire(g_kext_map, addr, addr + size,
+	    VM_PROT_READ | VM_PROT_WRITE, FALSE) != KERN_SUCCESS) {
+		kext_free(addr, size);
+		return (NULL);
+	}
+	return ((void *)addr);
+}
+
+static int
+bpf_jit_seal(void *code, size_t size)
+{
+	vm_offset_t addr = (vm_offset_t)code;
+
+	return (vm_map_protect(g_kext_map, addr, addr + size,
+	    VM_PROT_READ | VM_PROT_EXECUTE, FALSE) == KERN_SUCCESS);
+}
+
+void
+bpf_jit_free(bpf_filter_func func, size_t size)
+{
+	vm_offset_t addr = (vm_offset_t)func;
+
+	(void) vm_map_unwire(g_kext_map, addr, addr + size, FALSE);
+	kext_free(addr, size);
+}
+#else /* !KERNEL */
+#ifndef round_page
+#define	round_page(x)	(((x) + getpagesize() - 1) & ~(getpagesize() - 1))
+#endif
+
+static void *
+bpf_jit_alloc(size_t size)
+{
+	void *code;
+
+	code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE,
+	    -1, 0);
+	return (code == MAP_FAILED ? NULL : code);
+}
+
+static int
+bpf_jit_seal(void *code, size_t size)
+{
+	return (mprotect(code, size, PROT_READ | PROT_EXEC) == 0);
+}
+
+void
+bpf_jit_free(bpf_filter_func func, size_t size)
+{
+	munmap((void *)func, size);
+}
+#endif /* !KERNEL */
+
+/*
+ * Compile "nins" instructions at "prog", returning the native filter
+ * and the size of its allocation in *sizep, or NULL if the program
+ * can't be compiled.
+ */
+bpf_filter_func
+bpf_jit_compile(struct bpf_insn *prog, u_int nins, size_t *sizep)
+{
+	bpf_jit_state s;
+	size_t size;
+	u_int i;
+	void *code = NULL;
+
+	if (nins == 0 || nins > BPF_MAXINSNS)
+		return (NULL);
+
+	bzero(&s, sizeof (s));
+#ifdef KERNEL
+	s.insn_off = (u_int *)_MALLOC(nins * sizeof (u_int), M_TEMP, M_WAIT);
+#else
+	s.insn_off = (u_int *)malloc(nins * sizeof (u_int));
+#endif
+	if (s.insn_off == NULL)
+		return (NULL);
+	for (i = 0; i < nins; i++) {
+		switch (BPF_CLASS(prog[i].code)) {
+		case BPF_ST:
+		case BPF_STX:
+			s.usemem = 1;
+			break;
+		case BPF_LD:
+		case BPF_LDX:
+			if (BPF_MODE(prog[i].code) == BPF_MEM)
+				s.usemem = 1;
+			break;
+		}
+	}
+
+	/* size the code and find the instruction offsets */
+	if (!bpf_jit_pass(&s, prog, nins))
+		goto done;
+
+	size = round_page(s.off);
+	if ((code = bpf_jit_alloc(size)) == NULL)
+		goto done;
+
+	/* emit it; the layout is the same as in the sizing pass */
+	s.buf = code;
+	(void) bpf_jit_pass(&s, prog, nins);
+
+	if (!bpf_jit_seal(code, size)) {
+		bpf_jit_free((bpf_filter_func)code, size);
+		code = NULL;
+		goto done;
+	}
+	*sizep = size;
+done:
+#ifdef KERNEL
+	FREE(s.insn_off, M_TEMP);
+#else
+	free(s.insn_off);
+#endif
+	return ((bpf_filter_func)code);
+}
+
+#endif /* BPF_JITTER */
@@ -145,10 +145,14 @@ static const struct fileops kqueueops = {
 static int kevent_internal(struct proc *p, int iskev64, user_addr_t changelist,
     int nchanges, user_addr_t eventlist, int nevents, int fd,
     user_addr_t utimeout, unsigned int flags, int32_t *retval);
-static int kevent_copyin(user_addr_t *addrp, struct kevent64_s *kevp,
+static int kevent_import(const char *buf, struct kevent64_s *kevp,
     struct proc *p, int iskev64);
-static int kevent_copyout(struct kevent64_s *kevp, user_addr_t *addrp,
+static int kevent_export(struct kevent64_s *kevp, char *buf,
     struct proc *p, int iskev64);
+static int kevent_size(struct proc *p, int iskev64);
+static int kevent_copyin(user_addr_t *addrp, int nchanges, char *buf,
+    int *countp, struct proc *p, int iskev64);
+static int kevent_flush(struct _kevent *cont_args);
 char * kevent_description(struct kevent64_s *kevp, char *s, size_t n);
 
 static int kevent_callback(struct kqueue *kq, struct kevent64_s *kevp,
@@ -1299,60 +1303,53 @@ kqueue(struct proc *p, __unused struct kqueue_args *uap, int32_t *retval)
 	return (kqueue_body(p, fileproc_alloc_init, NULL, retval));
 }
 
+/*
+ * kevent_import/kevent_export - convert a kevent between the
+ * caller's layout (kevent64_s, user64_kevent or user32_kevent)
+ * and our kevent64_s.  Both return the size of the caller's
+ * record.  The kernel-side buffer need not be aligned.
+ */
 static int
-kevent_copyin(user_addr_t *addrp, struct kevent64_s *kevp, struct proc *p,
+kevent_import(const char *buf, struct kevent64_s *kevp, struct proc *p,
     int iskev64)
 {
-	int advance;
-	int error;
-
 	if (iskev64) {
-		advance = sizeof (struct kevent64_s);
-		error = copyin(*addrp, (caddr_t)kevp, advance);
+		bcopy(buf, kevp, sizeof (struct kevent64_s));
+		return (sizeof (struct kevent64_s));
 	} else if (IS_64BIT_PROCESS(p)) {
 		struct user64_kevent kev64;
-		bzero(kevp, sizeof (struct kevent64_s));
 
-		advance = sizeof (kev64);
-		error = copyin(*addrp, (caddr_t)&kev64, advance);
-		if (error)
-			return (error);
+		bcopy(buf, &kev64, sizeof (kev64));
+		bzero(kevp, sizeof (struct kevent64_s));
 		kevp->ident = kev64.ident;
 		kevp->filter = kev64.filter;
 		kevp->flags = kev64.flags;
 		kevp->fflags = kev64.fflags;
 		kevp->data = kev64.data;
 		kevp->udata = kev64.udata;
+		return (sizeof (kev64));
 	} else {
 		struct user32_kevent kev32;
-		bzero(kevp, sizeof (struct kevent64_s));
 
-		advance = sizeof (kev32);
-		error = copyin(*addrp, (caddr_t)&kev32, advance);
-		if (error)
-			return (error);
+		bcopy(buf, &kev32, sizeof (kev32));
+		bzero(kevp, sizeof (struct kevent64_s));
 		kevp->ident = (uintptr_t)kev32.ident;
 		kevp->filter = kev32.filter;
 		kevp->flags = kev32.flags;
 		kevp->fflags = kev32.fflags;
 		kevp->data = (intptr_t)kev32.data;
 		kevp->udata = CAST_USER_ADDR_T(kev32.udata);
+		return (sizeof (kev32));
 	}
-	if (!error)
-		*addrp += advance;
-	return (error);
 }
 
 static int
-kevent_copyout(struct kevent64_s *kevp, user_addr_t *addrp, struct proc *p,
+kevent_export(struct kevent64_s *kevp, char *buf, struct proc *p,
     int iskev64)
 {
-	int advance;
-	int error;
-
 	if (iskev64) {
-		advance = sizeof (struct kevent64_s);
-		error = copyout((caddr_t)kevp, *addrp, advance);
+		bcopy(kevp, buf, sizeof (struct kevent64_s));
+		return (sizeof (struct kevent64_s));
 	} else if (IS_64BIT_PROCESS(p)) {
 		struct user64_kevent kev64;
 
@@ -1368,8 +1365,8 @@ kevent_copyout(struct kevent64_s *kevp, user_addr_t *addrp, struct proc *p,
 		kev64.fflags = kevp->fflags;
 		kev64.data = (int64_t) kevp->data;
 		kev64.udata = kevp->udata;
-		advance = sizeof (kev64);
-		error = copyout((caddr_t)&kev64, *addrp, advance);
+		bcopy(&kev64, buf, sizeof (kev64));
+		return (sizeof (kev64));
 	} else {
 		struct user32_kevent kev32;
 
@@ -1379,11 +1376,66 @@ kevent_copyout(struct kevent64_s *kevp, user_addr_t *addrp, struct proc *p,
 		kev32.fflags = kevp->fflags;
 		kev32.data = (int32_t)kevp->data;
 		kev32.udata = kevp->udata;
-		advance = sizeof (kev32);
-		error = copyout((caddr_t)&kev32, *addrp, advance);
+		bcopy(&kev32, buf, sizeof (kev32));
+		return (sizeof (kev32));
+	}
+}
+
+static int
+kevent_size(struct proc *p, int iskev64)
+{
+	if (iskev64)
+		return (sizeof (struct kevent64_s));
+	else if (IS_64BIT_PROCESS(p))
+		return (sizeof (struct user64_kevent));
+	else
+		return (sizeof (struct user32_kevent));
+}
+
+/*
+ * kevent_copyin - copy in a batch of up to KQ_NEVENTS changes
+ *
+ *	One copyin for the whole batch instead of one per change.
+ *	If the batch faults, retry with just the first change so
+ *	that the changes ahead of the bad address still get
+ *	registered, as they did when each was copied in alone.
+ *	The raw records are left in buf for kevent_import().
+ */
+static int
+kevent_copyin(user_addr_t *addrp, int nchanges, char *buf, int *countp,
+    struct proc *p, int iskev64)
+{
+	int size = kevent_size(p, iskev64);
+	int count = MIN(nchanges, KQ_NEVENTS);
+	int error;
+
+	error = copyin(*addrp, buf, count * size);
+	if (error && count > 1) {
+		count = 1;
+		error = copyin(*addrp, buf, size);
+	}
+	if (!error) {
+		*addrp += count * size;
+		*countp = count;
+	}
+	return (error);
+}
+
+/*
+ * kevent_flush - copy out the events staged by kevent_callback()
+ */
+static int
+kevent_flush(struct _kevent *cont_args)
+{
+	int error = 0;
+
+	if (cont_args->eventbuflen > 0) {
+		error = copyout(cont_args->eventbuf, cont_args->eventlist,
+		    cont_args->eventbuflen);
+		if (!error)
+			cont_args->eventlist += cont_args->eventbuflen;
+		cont_args->eventbuflen = 0;
 	}
-	if (!error)
-		*addrp += advance;
 	return (error);
 }
 
@@ -1404,6 +1456,16 @@ kevent_continue(__unused struct kqueue *kq, void *data, int error)
 	struct proc *p = current_proc();
 
 	cont_args = (struct _kevent *)data;
+
+	/* copy out whatever kevent_callback() left staged */
+	if (kevent_flush(cont_args) != 0 &&
+	    (error == 0 || error == EWOULDBLOCK))
+		error = EFAULT;
+	if (cont_args->eventbuf != NULL) {
+		FREE(cont_args->eventbuf, M_KQUEUE);
+		cont_args->eventbuf = NULL;
+	}
+
 	noutputs = cont_args->eventout;
 	retval = cont_args->retval;
 	fd = cont_args->fd;
@@ -1466,7 +1528,8 @@ kevent_internal(struct proc *p, int iskev64, user_addr_t changelist,
 	struct kqueue *kq;
 	struct fileproc *fp;
 	struct kevent64_s kev;
-	int error, noutputs;
+	char changebuf[KQ_NEVENTS * sizeof (struct kevent64_s)];
+	int error, noutputs, nbatch, noutbatch, inoff, outoff, i;
 	struct timeval atv;
 
 	/* convert timeout to absolute - if we have one */
@@ -1513,25 +1576,50 @@ kevent_internal(struct proc *p, int iskev64, user_addr_t changelist,
 	}
 	kqunlock(kq);
 
-	/* register all the change requests the user provided... */
+	/*
+	 * register all the change requests the user provided, copying
+	 * them in a batch at a time.  Any EV_ERROR/EV_RECEIPT results
+	 * are written back over the changes already consumed from the
+	 * batch (they can't outnumber them) and copied out together.
+	 */
 	noutputs = 0;
 	while (nchanges > 0 && error == 0) {
-		error = kevent_copyin(&changelist, &kev, p, iskev64);
+		error = kevent_copyin(&changelist, nchanges, changebuf,
+		    &nbatch, p, iskev64);
 		if (error)
 			break;
 
-		kev.flags &= ~EV_SYSFLAGS;
-		error = kevent_register(kq, &kev, p);
-		if ((error || (kev.flags & EV_RECEIPT)) && nevents > 0) {
-			kev.flags = EV_ERROR;
-			kev.data = error;
-			error = kevent_copyout(&kev, &ueventlist, p, iskev64);
-			if (error == 0) {
-				nevents--;
-				noutputs++;
+		inoff = outoff = noutbatch = 0;
+		for (i = 0; i < nbatch && error == 0; i++) {
+			inoff += kevent_import(&changebuf[inoff], &kev, p,
+			    iskev64);
+
+			kev.flags &= ~EV_SYSFLAGS;
+			error = kevent_register(kq, &kev, p);
+			if ((error || (kev.flags & EV_RECEIPT)) &&
+			    noutbatch < nevents) {
+				kev.flags = EV_ERROR;
+				kev.data = error;
+				outoff += kevent_export(&kev,
+				    &changebuf[outoff], p, iskev64);
+				noutbatch++;
+				error = 0;
+			}
+			nchanges--;
+		}
+
+		if (noutbatch > 0) {
+			int cerror;
+
+			cerror = copyout(changebuf, ueventlist, outoff);
+			if (cerror == 0) {
+				ueventlist += outoff;
+				nevents -= noutbatch;
+				noutputs += noutbatch;
+			} else if (error == 0) {
+				error = cerror;
 			}
 		}
-		nchanges--;
 	}
 
 	/* store the continuation/completion data in the uthread */
@@ -1544,11 +1632,32 @@ kevent_internal(struct proc *p, int iskev64, user_addr_t changelist,
 	cont_args->eventcount = nevents;
 	cont_args->eventout = noutputs;
 	cont_args->eventsize = iskev64;
+	cont_args->eventbuf = NULL;
+	cont_args->eventbufsize = 0;
+	cont_args->eventbuflen = 0;
 
-	if (nevents > 0 && noutputs == 0 && error == 0)
+	if (nevents > 0 && noutputs == 0 && error == 0) {
+		/*
+		 * The scan may finish on a continuation, so the events it
+		 * stages can't live on this stack.  Allocate room for them
+		 * only for the length of the scan (kevent_continue frees
+		 * it), and only if more than one event can be returned.
+		 * Without it, kevent_callback() copies out each event.
+		 */
+		if (nevents > 1) {
+			int bufsize;
+
+			bufsize = MIN(nevents, KQ_NEVENTS) *
+			    kevent_size(p, iskev64);
+			MALLOC(cont_args->eventbuf, char *, bufsize,
+			    M_KQUEUE, M_WAITOK);
+			if (cont_args->eventbuf != NULL)
+				cont_args->eventbufsize = bufsize;
+		}
 		error = kqueue_scan(kq, kevent_callback,
 		    kevent_continue, cont_args,
 		    &atv, p);
+	}
 	kevent_continue(kq, cont_args, error);
 
 errorout:
@@ -1570,6 +1679,7 @@ kevent_callback(__unused struct kqueue *kq, struct kevent64_s *kevp,
 	struct _kevent *cont_args;
 	int error;
 	int iskev64;
+	int size;
 
 	cont_args = (struct _kevent *)data;
 	assert(cont_args->eventout < cont_args->eventcount);
@@ -1577,10 +1687,27 @@ kevent_callback(__unused struct kqueue *kq, struct kevent64_s *kevp,
 	iskev64 = cont_args->eventsize;
 
 	/*
-	 * Copy out the appropriate amount of event data for this user.
+	 * Stage the appropriate amount of event data for this user,
+	 * copying out only once the staging buffer is full (the rest
+	 * goes out in kevent_continue).  With no staging buffer, copy
+	 * it out now.
 	 */
-	error = kevent_copyout(kevp, &cont_args->eventlist, current_proc(),
-	    iskev64);
+	if (cont_args->eventbuf == NULL) {
+		char buf[sizeof (struct kevent64_s)];
+
+		size = kevent_export(kevp, buf, current_proc(), iskev64);
+		error = copyout(buf, cont_args->eventlist, size);
+		if (error == 0)
+			cont_args->eventlist += size;
+	} else {
+		size = kevent_export(kevp,
+		    &cont_args->eventbuf[cont_args->eventbuflen],
+		    current_proc(), iskev64);
+		cont_args->eventbuflen += size;
+		error = 0;
+		if (cont_args->eventbuflen + size > cont_args->eventbufsize)
+			error = kevent_flush(cont_args);
+	}
 
 	/*
 	 * If there isn't space for additional events, return
@@ -2761,6 +2888,21 @@ knote_activate(struct knote *kn, int propagate)
 {
 	struct kqueue *kq = kn->kn_kq;
 
+	/*
+	 * An already active, queued knote is either still ahead of
+	 * the scan in progress or was delivered by it, so with nobody
+	 * asleep the wakeup would only pre-post the wait queue for a
+	 * scan that won't block.  Skip it, keeping busy producers off
+	 * the wait queue lock while the kqueue is being processed.
+	 */
+	if ((kn->kn_status & (KN_ACTIVE | KN_QUEUED)) ==
+	    (KN_ACTIVE | KN_QUEUED) &&
+	    (kq->kq_state & (KQ_SLEEP | KQ_SEL)) == 0) {
+		if (propagate)
+			KNOTE(&kq->kq_sel.si_note, 0);
+		return;
+	}
+
 	kn->kn_status |= KN_ACTIVE;
 	knote_enqueue(kn);
 	kqueue_wakeup(kq, 0);
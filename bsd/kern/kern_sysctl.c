@@ -3357,6 +3357,77 @@ SYSCTL_STRING(_kern, OID_AUTO, sched,
 			  sched_string, sizeof(sched_string),
 			  "Timeshare scheduler implementation");
 
+extern int sched_handoff_enabled;
+extern uint32_t sched_handoff_count;
+SYSCTL_INT(_kern, OID_AUTO, sched_handoff,
+		CTLFLAG_RW | CTLFLAG_KERN | CTLFLAG_LOCKED,
+		&sched_handoff_enabled, 0,
+		"Switch directly to the receiver of a synchronous Mach RPC");
+SYSCTL_UINT(_kern, OID_AUTO, sched_handoffs,
+		CTLFLAG_RD | CTLFLAG_KERN | CTLFLAG_LOCKED,
+		&sched_handoff_count, 0,
+		"Number of direct handoffs to a Mach message receiver");
+
+/*
+ * Global wait queue (assert_wait/thread_wakeup) event hash statistics.
+ */
+extern void wait_queue_global_stats(uint32_t *, uint32_t *, uint32_t *,
+		uint64_t *, uint64_t *);
+
+#define WQHASH_BUCKETS		0
+#define WQHASH_USED		1
+#define WQHASH_MAX_CHAIN	2
+#define WQHASH_WAITERS		3
+#define WQHASH_CONTENDED	4
+
+STATIC int
+sysctl_wqhash(__unused struct sysctl_oid *oidp, __unused void *arg1, int arg2, struct sysctl_req *req)
+{
+	uint32_t buckets, used, max_chain;
+	uint64_t waiters, contended, value;
+
+	wait_queue_global_stats(&buckets, &used, &max_chain, &waiters, &contended);
+
+	switch (arg2) {
+	case WQHASH_BUCKETS:
+		value = buckets;
+		break;
+	case WQHASH_USED:
+		value = used;
+		break;
+	case WQHASH_MAX_CHAIN:
+		value = max_chain;
+		break;
+	case WQHASH_WAITERS:
+		value = waiters;
+		break;
+	case WQHASH_CONTENDED:
+		value = contended;
+		break;
+	default:
+		return EINVAL;
+	}
+	return sysctl_io_number(req, value, sizeof(value), NULL, NULL);
+}
+
+SYSCTL_NODE(_kern, OID_AUTO, wqhash, CTLFLAG_RD | CTLFLAG_LOCKED, 0,
+		"Global wait queue hash");
+SYSCTL_PROC(_kern_wqhash, OID_AUTO, buckets,
+		CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED,
+		0, WQHASH_BUCKETS, sysctl_wqhash, "Q", "Number of hash buckets");
+SYSCTL_PROC(_kern_wqhash, OID_AUTO, used,
+		CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED,
+		0, WQHASH_USED, sysctl_wqhash, "Q", "Buckets with at least one waiter");
+SYSCTL_PROC(_kern_wqhash, OID_AUTO, max_chain,
+		CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED,
+		0, WQHASH_MAX_CHAIN, sysctl_wqhash, "Q", "Longest bucket chain");
+SYSCTL_PROC(_kern_wqhash, OID_AUTO, waiters,
+		CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED,
+		0, WQHASH_WAITERS, sysctl_wqhash, "Q", "Waiters queued on the hash");
+SYSCTL_PROC(_kern_wqhash, OID_AUTO, contended,
+		CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED,
+		0, WQHASH_CONTENDED, sysctl_wqhash, "Q", "Contended bucket lock acquisitions");
+
 /*
  * Only support runtime modification on embedded platforms
  * with development config enabled
@@ -19,6 +19,7 @@ typedef struct xnu_test {
 #define DEFINE_XNU_TEST(func) { func, #func }
 
 xnu_test_t xnu_tests[] = {
+	DEFINE_XNU_TEST(mcs_lock_stress_test),
 };
 
 #define NUM_XNU_TESTS (sizeof(xnu_tests) / sizeof(xnu_test_t))
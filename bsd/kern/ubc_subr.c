@@ -80,6 +80,11 @@ extern kern_return_t	memory_object_signed(memory_object_control_t control,
 					     boolean_t is_signed);
 extern boolean_t	memory_object_is_slid(memory_object_control_t	control);
 extern boolean_t	memory_object_is_signed(memory_object_control_t);
+extern kern_return_t	memory_object_iopl_request(ipc_port_t port,
+					memory_object_offset_t offset,
+					upl_size_t *upl_size, upl_t *upl_ptr,
+					upl_page_info_array_t user_page_list,
+					unsigned int *page_list_count, int *flags);
 
 extern void Debugger(const char *message);
 
@@ -2247,6 +2252,82 @@ ubc_create_upl(
 }
 		
 					  		      
+/*
+ * ubc_create_iopl
+ *
+ * Given a vnode, wire the pages backing a portion of its vm_object
+ * without marking them busy, so they may be referenced for I/O for an
+ * extended period while remaining accessible through the cache.  The
+ * request fails, rather than faulting, if any page is not resident.
+ *
+ * Parameters:	vp			The vnode from which to create the upl
+ *		f_offset		The page aligned start offset into
+ *					the backing store
+ *		bufsize			The size of the upl to create
+ *		uplp			Pointer to the upl_t to receive the
+ *					created upl; MUST NOT be NULL
+ *		plp			Pointer to receive the internal page
+ *					list for the created upl; MAY be NULL
+ *					to ignore
+ *
+ * Returns:	KERN_SUCCESS		The requested pages are wired
+ *		KERN_INVALID_ARGUMENT	The bufsize argument is not an even
+ *					multiple of the page size, or is too
+ *					large, or there is no memory object
+ *					control associated with the vnode
+ *		KERN_MEMORY_ERROR	Some page in the range is absent or
+ *					busy (e.g. being read in or written)
+ *	vm_object_iopl_request:???	Other failures
+ *
+ * Note:	If successful, the returned *uplp MUST subsequently be freed
+ *		via a call to ubc_upl_commit(), which unwires the pages.
+ */
+kern_return_t
+ubc_create_iopl(
+	struct vnode	*vp,
+	off_t 		f_offset,
+	int		bufsize,
+	upl_t		*uplp,
+	upl_page_info_t	**plp)
+{
+	memory_object_control_t		control;
+	upl_size_t			size = bufsize;
+	int				uplflags;
+	kern_return_t			kr;
+
+	if (plp != NULL)
+		*plp = NULL;
+	*uplp = NULL;
+
+	if ((bufsize & PAGE_MASK) || (f_offset & PAGE_MASK_64))
+		return KERN_INVALID_ARGUMENT;
+
+	if (bufsize > MAX_UPL_TRANSFER * PAGE_SIZE)
+		return KERN_INVALID_ARGUMENT;
+
+	control = ubc_getobject(vp, UBC_FLAGS_NONE);
+	if (control == MEMORY_OBJECT_CONTROL_NULL)
+		return KERN_INVALID_ARGUMENT;
+
+	uplflags = UPL_COPYOUT_FROM | UPL_SET_IO_WIRE | UPL_SET_LITE |
+		   UPL_SET_INTERNAL | UPL_REQUEST_NO_FAULT;
+
+	/* a memory object control doubles as its own port for this call */
+	kr = memory_object_iopl_request((ipc_port_t)control, f_offset, &size,
+					uplp, NULL, NULL, &uplflags);
+	if (kr != KERN_SUCCESS)
+		return kr;
+	if (size != (upl_size_t)bufsize) {
+		ubc_upl_commit(*uplp);
+		*uplp = NULL;
+		return KERN_INVALID_ARGUMENT;
+	}
+	if (plp != NULL)
+		*plp = UPL_GET_INTERNAL_PAGE_LIST(*uplp);
+	return KERN_SUCCESS;
+}
+
+
 /*
  * ubc_upl_maxbufsize
  *
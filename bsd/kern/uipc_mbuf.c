@@ -3550,6 +3550,20 @@ m_mclhasreference(struct mbuf *m)
 	return ((MEXT_FLAGS(m) & EXTF_READONLY) ? 1 : 0);
 }
 
+/*
+ * Mark the external storage of an mbuf read-only, for storage that
+ * isn't ours to write to (e.g. file pages lent to the socket layer);
+ * it then reports no leading or trailing space.
+ */
+__private_extern__ void
+m_ext_setreadonly(struct mbuf *m)
+{
+	VERIFY((m->m_flags & M_EXT) && MEXT_RFA(m) != NULL);
+
+	if (!(MEXT_FLAGS(m) & EXTF_READONLY))
+		(void) OSBitOrAtomic(EXTF_READONLY, &MEXT_FLAGS(m));
+}
+
 __private_extern__ caddr_t
 m_bigalloc(int wait)
 {
@@ -3655,7 +3669,7 @@ m_copy_pkthdr(struct mbuf *to, struct mbuf *from)
  * "from" must have M_PKTHDR set, and "to" must be empty.
  * In particular, this does a deep copy of the packet tags.
  */
-static int
+int
 m_dup_pkthdr(struct mbuf *to, struct mbuf *from, int how)
 {
 	VERIFY(from->m_flags & M_PKTHDR);
@@ -185,6 +185,8 @@ MALLOC_DEFINE(M_PCB, "pcb", "protocol control block");
 #define	DBG_FNC_SOSEND		NETDBG_CODE(DBG_NETSOCK, (4 << 8) | 1)
 #define	DBG_FNC_SORECEIVE	NETDBG_CODE(DBG_NETSOCK, (8 << 8))
 #define	DBG_FNC_SOSHUTDOWN	NETDBG_CODE(DBG_NETSOCK, (9 << 8))
+#define	DBG_FNC_SOSEND_LIST	NETDBG_CODE(DBG_NETSOCK, (11 << 8) | 1)
+#define	DBG_FNC_SORECEIVE_LIST	NETDBG_CODE(DBG_NETSOCK, (12 << 8))
 
 #define	MAX_SOOPTGETM_SIZE	(128 * MCLBYTES)
 
@@ -2056,6 +2058,169 @@ out:
 	return (error);
 }
 
+/*
+ * Copy the data described by "uio" into a new packet.  Small datagrams
+ * get a single mbuf with room left in front for the protocol headers,
+ * larger ones a chain of clusters.
+ *
+ * Returns:	0			Success
+ *		ENOBUFS
+ *	uiomove:EFAULT
+ */
+static int
+sosend_list_copyin(struct uio *uio, struct mbuf **mp)
+{
+	struct mbuf *top = NULL, **np = &top, *m;
+	user_ssize_t resid = uio_resid(uio);
+	int len, error = 0;
+
+	do {
+		if (top == NULL && resid <= MHLEN) {
+			MGETHDR(m, M_WAIT, MT_DATA);
+			if (m != NULL)
+				MH_ALIGN(m, resid);
+		} else {
+			m = m_getcl(M_WAIT, MT_DATA,
+			    (top == NULL) ? M_PKTHDR : 0);
+		}
+		if (m == NULL) {
+			error = ENOBUFS;
+			break;
+		}
+		len = imin((int)resid, m_trailingspace(m));
+		error = uiomove(mtod(m, caddr_t), len, uio);
+		m->m_len = len;
+		*np = m;
+		np = &m->m_next;
+		top->m_pkthdr.len += len;
+		resid = uio_resid(uio);
+	} while (error == 0 && resid > 0);
+
+	if (error != 0 && top != NULL) {
+		m_freem(top);
+		top = NULL;
+	}
+	*mp = top;
+	return (error);
+}
+
+/*
+ * Send a list of datagrams, one per uio, on a connected socket.
+ *
+ * The socket lock and the send buffer lock are taken once for the
+ * whole list.  Each datagram is copied into its own packet and the
+ * packets, linked by m_nextpkt, are passed to the protocol in a single
+ * pru_send_list call.  Only plain datagram sends take this path: no
+ * socket filters, and no flags other than the non-blocking ones.
+ * Anything else gets EOPNOTSUPP before any data is consumed, and the
+ * caller should use sosend() instead.
+ *
+ * Only the leading datagrams that can ever fit the send buffer are
+ * sent; *countp is set to the number handed to the protocol.
+ *
+ * Returns:	0			Success
+ *		EOPNOTSUPP
+ *		EINVAL
+ *		ENOBUFS
+ *	uiomove:EFAULT
+ *	sosendcheck:EPIPE
+ *	sosendcheck:EMSGSIZE
+ *	sosendcheck:EWOULDBLOCK
+ *	sosendcheck:EINTR
+ *	sosendcheck:ENOTCONN
+ *	sosendcheck:???			[value from so_error]
+ *	<pru_send_list>:???
+ */
+int
+sosend_list(struct socket *so, struct uio **uioarray, u_int uiocnt,
+    int flags, u_int *countp)
+{
+	struct mbuf *pktlist = NULL, **pkttail = &pktlist, *m;
+	user_ssize_t resid = 0, maxresid = 0;
+	int error, sblocked = 0;
+	struct proc *p = current_proc();
+	u_int i, npkts = 0;
+
+	*countp = 0;
+
+	KERNEL_DEBUG((DBG_FNC_SOSEND_LIST | DBG_FUNC_START), so, uiocnt,
+	    so->so_snd.sb_cc, so->so_snd.sb_lowat, so->so_snd.sb_hiwat);
+
+	if (so->so_type != SOCK_DGRAM || uiocnt == 0 ||
+	    (flags & ~(MSG_DONTWAIT | MSG_NBIO)) != 0) {
+		error = EOPNOTSUPP;
+		goto out;
+	}
+
+	socket_lock(so, 1);
+	so_update_last_owner_locked(so, p);
+	so_update_policy(so);
+
+	/* Filters see one packet at a time in sosend() */
+	if (so->so_filt != NULL) {
+		error = EOPNOTSUPP;
+		goto release;
+	}
+
+	for (i = 0; i < uiocnt; i++) {
+		resid = uio_resid(uioarray[i]);
+		if (resid < 0 || resid > so->so_snd.sb_hiwat)
+			break;
+		if (resid > maxresid)
+			maxresid = resid;
+	}
+	if (i == 0) {
+		error = (resid < 0) ? EINVAL : EMSGSIZE;
+		goto release;
+	}
+	uiocnt = i;
+
+	/*
+	 * Datagram protocols don't hold on to sent data, so if the largest
+	 * datagram fits they all do.
+	 */
+	error = sosendcheck(so, NULL, maxresid, 0, 1, flags, &sblocked, NULL);
+	if (error)
+		goto release;
+
+	OSAddAtomicLong(uiocnt, &p->p_stats->p_ru.ru_msgsnd);
+
+	/* The send buffer lock keeps other senders out while we copy */
+	socket_unlock(so, 0);
+	for (i = 0; i < uiocnt; i++) {
+		error = sosend_list_copyin(uioarray[i], &m);
+		if (error)
+			break;
+		*pkttail = m;
+		pkttail = &m->m_nextpkt;
+		npkts++;
+	}
+	socket_lock(so, 0);
+
+	/* Send what we have; a copy error is reported after it */
+	if (pktlist != NULL) {
+		int error2;
+
+		error2 = (*so->so_proto->pr_usrreqs->pru_send_list)(so, 0,
+		    pktlist, p);
+		if (error2 == 0)
+			*countp = npkts;
+		else
+			error = error2;
+	}
+
+release:
+	if (sblocked)
+		sbunlock(&so->so_snd, FALSE);	/* will unlock socket */
+	else
+		socket_unlock(so, 1);
+out:
+	KERNEL_DEBUG(DBG_FNC_SOSEND_LIST | DBG_FUNC_END, so, *countp,
+	    so->so_snd.sb_cc, 0, error);
+
+	return (error);
+}
+
 /*
  * Implement receive operations on a socket.
  * We depend on the way that records are added to the sockbuf
@@ -2976,6 +3141,198 @@ release:
 	return (error);
 }
 
+/*
+ * Receive up to uiocnt datagrams, one per recv_msg_elem.
+ *
+ * The socket lock and the receive buffer lock are taken once: we wait
+ * for the first record as soreceive() would, unlink every record that
+ * is already queued (up to uiocnt) in one pass, then drop the locks and
+ * copy the records out.  Control data is discarded, so this is only
+ * for callers that don't want any.  MSG_PEEK, MSG_OOB, MSG_WAITALL,
+ * SO_DONTTRUNC and protocols that externalize rights are left to
+ * soreceive() and get EOPNOTSUPP before anything is dequeued.
+ *
+ * *countp is set to the number of elements filled in.  Records that
+ * were dequeued but not copied out because of an error are dropped.
+ * The caller frees any addresses returned in psa, even on error.
+ *
+ * Returns:	0			Success
+ *		EOPNOTSUPP
+ *		ENOTCONN
+ *		EWOULDBLOCK
+ *	uiomove:EFAULT
+ *	sblock:EWOULDBLOCK
+ *	sblock:EINTR
+ *	sbwait:EBADF
+ *	sbwait:EINTR
+ *	[so_error]:???
+ */
+int
+soreceive_list(struct socket *so, struct recv_msg_elem *msgarray,
+    u_int uiocnt, int flags, u_int *countp)
+{
+	struct mbuf *m, *n, *nextrecord, *records = NULL, **rtail = &records;
+	struct protosw *pr = so->so_proto;
+	struct proc *p = current_proc();
+	struct recv_msg_elem *elem;
+	u_int i, npkts = 0;
+	int len, error = 0;
+#if CONFIG_MACF_SOCKET_SUBSET
+	boolean_t check_mac;
+#endif /* CONFIG_MACF_SOCKET_SUBSET */
+
+	*countp = 0;
+
+	KERNEL_DEBUG(DBG_FNC_SORECEIVE_LIST | DBG_FUNC_START, so, uiocnt,
+	    so->so_rcv.sb_cc, so->so_rcv.sb_lowat, so->so_rcv.sb_hiwat);
+
+	if (!(pr->pr_flags & PR_ATOMIC) || uiocnt == 0 ||
+	    pr->pr_domain->dom_externalize != NULL ||
+	    (flags & ~(MSG_DONTWAIT | MSG_NBIO)) != 0) {
+		error = EOPNOTSUPP;
+		goto out;
+	}
+
+	for (i = 0; i < uiocnt; i++) {
+		msgarray[i].psa = NULL;
+		msgarray[i].which &= ~RECV_MSG_TRUNC;
+	}
+
+	socket_lock(so, 1);
+	so_update_last_owner_locked(so, p);
+	so_update_policy(so);
+
+	if (so->so_options & (SO_DONTTRUNC | SO_WANTOOBFLAG)) {
+		error = EOPNOTSUPP;
+		socket_unlock(so, 1);
+		goto out;
+	}
+
+	if (so->so_flags & SOF_DEFUNCT) {
+		error = ENOTCONN;
+		SODEFUNCTLOG(("%s[%d]: defunct so 0x%llx [%d,%d] (%d)\n",
+		    __func__, proc_pid(p), (uint64_t)VM_KERNEL_ADDRPERM(so),
+		    SOCK_DOM(so), SOCK_TYPE(so), error));
+		socket_unlock(so, 1);
+		goto out;
+	}
+
+restart:
+	/* See soreceive() */
+	if ((so->so_state & (SS_NOFDREF | SS_CANTRCVMORE)) ==
+	    (SS_NOFDREF | SS_CANTRCVMORE) && !(so->so_flags & SOF_MP_SUBFLOW)) {
+		socket_unlock(so, 1);
+		goto out;
+	}
+
+	error = sblock(&so->so_rcv, SBLOCKWAIT(flags));
+	if (error) {
+		socket_unlock(so, 1);
+		goto out;
+	}
+
+	if (so->so_rcv.sb_mb == NULL) {
+		SB_MB_CHECK(&so->so_rcv);
+
+		if (so->so_error) {
+			error = so->so_error;
+			so->so_error = 0;
+			goto release;
+		}
+		if (so->so_state & SS_CANTRCVMORE)
+			goto release;
+		if ((so->so_state & (SS_ISCONNECTED|SS_ISCONNECTING)) == 0 &&
+		    (pr->pr_flags & PR_CONNREQUIRED)) {
+			error = ENOTCONN;
+			goto release;
+		}
+		if ((so->so_state & SS_NBIO) ||
+		    (flags & (MSG_DONTWAIT|MSG_NBIO))) {
+			error = EWOULDBLOCK;
+			goto release;
+		}
+		sbunlock(&so->so_rcv, TRUE);	/* keep socket locked */
+		error = sbwait(&so->so_rcv);
+		if (error) {
+			socket_unlock(so, 1);
+			goto out;
+		}
+		goto restart;
+	}
+
+	/* Unlink whole records from the front of the receive buffer */
+	while (npkts < uiocnt && (m = so->so_rcv.sb_mb) != NULL) {
+		nextrecord = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		for (n = m; n != NULL; n = n->m_next)
+			sbfree(&so->so_rcv, n);
+		so->so_rcv.sb_mb = nextrecord;
+		*rtail = m;
+		rtail = &m->m_nextpkt;
+		npkts++;
+	}
+	SB_EMPTY_FIXUP(&so->so_rcv);
+	SBLASTRECORDCHK(&so->so_rcv, "soreceive_list");
+	SBLASTMBUFCHK(&so->so_rcv, "soreceive_list");
+
+	OSAddAtomicLong(npkts, &p->p_stats->p_ru.ru_msgrcv);
+	if ((pr->pr_flags & PR_WANTRCVD) && so->so_pcb != NULL)
+		(*pr->pr_usrreqs->pru_rcvd)(so, flags);
+#if CONFIG_MACF_SOCKET_SUBSET
+	check_mac = (p != kernproc && !(so->so_state & SS_ISCONNECTED));
+#endif /* CONFIG_MACF_SOCKET_SUBSET */
+
+	sbunlock(&so->so_rcv, FALSE);	/* will unlock socket */
+
+	/* The records are ours now; copy them out unlocked */
+	for (m = records, i = 0; m != NULL; m = nextrecord) {
+		nextrecord = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		if (error != 0) {
+			m_freem(m);
+			continue;
+		}
+		elem = &msgarray[i];
+		n = m;
+		if ((pr->pr_flags & PR_ADDR) && n->m_type == MT_SONAME) {
+#if CONFIG_MACF_SOCKET_SUBSET
+			if (check_mac && mac_socket_check_received(
+			    proc_ucred(p), so, mtod(n, struct sockaddr *))) {
+				m_freem(m);
+				continue;
+			}
+#endif /* CONFIG_MACF_SOCKET_SUBSET */
+			if (elem->which & RECV_MSG_WANTADDR)
+				elem->psa = dup_sockaddr(
+				    mtod(n, struct sockaddr *), 1);
+			n = n->m_next;
+		}
+		while (n != NULL && n->m_type == MT_CONTROL)
+			n = n->m_next;
+		for (; n != NULL && error == 0; n = n->m_next) {
+			len = imin((int)uio_resid(elem->uio), n->m_len);
+			if (len < n->m_len)
+				elem->which |= RECV_MSG_TRUNC;
+			if (len > 0)
+				error = uiomove(mtod(n, caddr_t), len,
+				    elem->uio);
+		}
+		m_freem(m);
+		if (error == 0)
+			i++;
+	}
+	*countp = i;
+	goto out;
+
+release:
+	sbunlock(&so->so_rcv, FALSE);	/* will unlock socket */
+out:
+	KERNEL_DEBUG(DBG_FNC_SORECEIVE_LIST | DBG_FUNC_END, so, *countp,
+	    so->so_rcv.sb_cc, 0, error);
+
+	return (error);
+}
+
 /*
  * Returns:	0			Success
  *	uiomove:EFAULT
@@ -3537,6 +3894,18 @@ sosetoptlock(struct socket *so, struct sockopt *sopt, int dolock)
 				so->so_flags &= ~SOF_REUSESHAREUID;
 			break;
 
+		case SO_REUSEPORT_LB:
+			/* Only looked at when the PCB is bound; see in_pcbinshash */
+			error = sooptcopyin(sopt, &optval, sizeof (optval),
+			    sizeof (optval));
+			if (error != 0)
+				goto out;
+			if (optval != 0)
+				so->so_flags |= SOF_REUSEPORT_LB;
+			else
+				so->so_flags &= ~SOF_REUSEPORT_LB;
+			break;
+
 		case SO_NOTIFYCONFLICT:
 			if (kauth_cred_issuser(kauth_cred_get()) == 0) {
 				error = EPERM;
@@ -4006,6 +4375,10 @@ integer:
 			optval = (so->so_flags & SOF_REUSESHAREUID);
 			goto integer;
 
+		case SO_REUSEPORT_LB:
+			optval = (so->so_flags & SOF_REUSEPORT_LB);
+			goto integer;
+
 
 		case SO_NOTIFYCONFLICT:
 			optval = (so->so_flags & SOF_NOTIFYCONFLICT);
@@ -2018,6 +2018,15 @@ pru_send_notsupp(struct socket *so, int flags, struct mbuf *m,
 	return (EOPNOTSUPP);
 }
 
+int
+pru_send_list_notsupp(struct socket *so, int flags, struct mbuf *m,
+    struct proc *p)
+{
+#pragma unused(so, flags, p)
+	m_freem_list(m);
+	return (EOPNOTSUPP);
+}
+
 /*
  * This isn't really a ``null'' operation, but it's the default one
  * and doesn't do anything destructive.
@@ -2057,6 +2066,25 @@ pru_soreceive_notsupp(struct socket *so, struct sockaddr **paddr,
 	return (EOPNOTSUPP);
 }
 
+int
+pru_soreceive_list_notsupp(struct socket *so,
+    struct recv_msg_elem *recv_msg_array, u_int uiocnt, int flags,
+    u_int *countp)
+{
+#pragma unused(so, recv_msg_array, uiocnt, flags)
+	*countp = 0;
+	return (EOPNOTSUPP);
+}
+
+int
+pru_sosend_list_notsupp(struct socket *so, struct uio **uioarray,
+    u_int uiocnt, int flags, u_int *countp)
+{
+#pragma unused(so, uioarray, uiocnt, flags)
+	*countp = 0;
+	return (EOPNOTSUPP);
+}
+
 int
 pru_shutdown_notsupp(struct socket *so)
 {
@@ -2109,12 +2137,15 @@ pru_sanitize(struct pr_usrreqs *pru)
 	DEFAULT(pru->pru_rcvd, pru_rcvd_notsupp);
 	DEFAULT(pru->pru_rcvoob, pru_rcvoob_notsupp);
 	DEFAULT(pru->pru_send, pru_send_notsupp);
+	DEFAULT(pru->pru_send_list, pru_send_list_notsupp);
 	DEFAULT(pru->pru_sense, pru_sense_null);
 	DEFAULT(pru->pru_shutdown, pru_shutdown_notsupp);
 	DEFAULT(pru->pru_sockaddr, pru_sockaddr_notsupp);
 	DEFAULT(pru->pru_sopoll, pru_sopoll_notsupp);
 	DEFAULT(pru->pru_soreceive, pru_soreceive_notsupp);
+	DEFAULT(pru->pru_soreceive_list, pru_soreceive_list_notsupp);
 	DEFAULT(pru->pru_sosend, pru_sosend_notsupp);
+	DEFAULT(pru->pru_sosend_list, pru_sosend_list_notsupp);
 	DEFAULT(pru->pru_socheckopt, pru_socheckopt_null);
 #undef DEFAULT
 }
@@ -87,7 +87,12 @@
 #include <sys/kernel.h>
 #include <sys/uio_internal.h>
 #include <sys/kauth.h>
+#include <sys/sysctl.h>
+#include <sys/ubc_internal.h>
 #include <kern/task.h>
+#include <kern/thread_call.h>
+#include <libkern/OSAtomic.h>
+#include <machine/machine_routines.h>
 #include <sys/priv.h>
 
 #include <security/audit/audit.h>
@@ -98,9 +103,9 @@
 #include <net/route.h>
 #include <netinet/in_pcb.h>
 
-#if CONFIG_MACF_SOCKET_SUBSET
+#if CONFIG_MACF_SOCKET_SUBSET || CONFIG_MACF
 #include <security/mac_framework.h>
-#endif /* MAC_SOCKET_SUBSET */
+#endif /* MAC_SOCKET_SUBSET || CONFIG_MACF */
 
 #define	f_flag f_fglob->fg_flag
 #define	f_type f_fglob->fg_ops->fo_type
@@ -125,6 +130,8 @@
 #define	DBG_FNC_SENDFILE_WAIT	NETDBG_CODE(DBG_NETSOCK, ((10 << 8) | 1))
 #define	DBG_FNC_SENDFILE_READ	NETDBG_CODE(DBG_NETSOCK, ((10 << 8) | 2))
 #define	DBG_FNC_SENDFILE_SEND	NETDBG_CODE(DBG_NETSOCK, ((10 << 8) | 3))
+#define	DBG_FNC_SENDMMSG	NETDBG_CODE(DBG_NETSOCK, (13 << 8) | 1)
+#define	DBG_FNC_RECVMMSG	NETDBG_CODE(DBG_NETSOCK, (14 << 8))
 
 
 /* TODO: should be in header file */
@@ -1737,6 +1744,434 @@ done:
 	return (error);
 }
 
+/*
+ * Copy in an array of user mmsghdrs and set up a uio for each message.
+ * Stops at the first malformed message; *countp is set to the number of
+ * leading messages that were set up, and an error is only returned if
+ * there are none.  Each msg_hdr.msg_iov keeps the user's pointer.
+ *
+ * Returns:	0			Success
+ *		EMSGSIZE
+ *		ENOMEM
+ *	copyin:EFAULT
+ *	uio_calculateresid:EINVAL
+ */
+static int
+copyin_user_mmsghdr_array(struct proc *p, user_addr_t msgp, u_int cnt,
+    int rw, struct user_mmsghdr *msgs, uio_t *uios, u_int *countp)
+{
+	struct user64_mmsghdr mmsg64;
+	struct user32_mmsghdr mmsg32;
+	struct user_msghdr *mp;
+	struct user_iovec *iovp;
+	int spacetype, size_of_mmsghdr;
+	int error = 0;
+	u_int i;
+
+	if (IS_64BIT_PROCESS(p)) {
+		spacetype = UIO_USERSPACE64;
+		size_of_mmsghdr = sizeof (mmsg64);
+	} else {
+		spacetype = UIO_USERSPACE32;
+		size_of_mmsghdr = sizeof (mmsg32);
+	}
+
+	for (i = 0; i < cnt; i++, msgp += size_of_mmsghdr) {
+		mp = &msgs[i].msg_hdr;
+		if (IS_64BIT_PROCESS(p)) {
+			error = copyin(msgp, (caddr_t)&mmsg64, size_of_mmsghdr);
+			if (error)
+				break;
+			mp->msg_flags = mmsg64.msg_hdr.msg_flags;
+			mp->msg_controllen = mmsg64.msg_hdr.msg_controllen;
+			mp->msg_control = mmsg64.msg_hdr.msg_control;
+			mp->msg_iovlen = mmsg64.msg_hdr.msg_iovlen;
+			mp->msg_iov = mmsg64.msg_hdr.msg_iov;
+			mp->msg_namelen = mmsg64.msg_hdr.msg_namelen;
+			mp->msg_name = mmsg64.msg_hdr.msg_name;
+		} else {
+			error = copyin(msgp, (caddr_t)&mmsg32, size_of_mmsghdr);
+			if (error)
+				break;
+			mp->msg_flags = mmsg32.msg_hdr.msg_flags;
+			mp->msg_controllen = mmsg32.msg_hdr.msg_controllen;
+			mp->msg_control = mmsg32.msg_hdr.msg_control;
+			mp->msg_iovlen = mmsg32.msg_hdr.msg_iovlen;
+			mp->msg_iov = mmsg32.msg_hdr.msg_iov;
+			mp->msg_namelen = mmsg32.msg_hdr.msg_namelen;
+			mp->msg_name = mmsg32.msg_hdr.msg_name;
+		}
+		msgs[i].msg_len = 0;
+
+		if (mp->msg_iovlen <= 0 || mp->msg_iovlen > UIO_MAXIOV) {
+			error = EMSGSIZE;
+			break;
+		}
+		uios[i] = uio_create(mp->msg_iovlen, 0, spacetype, rw);
+		if (uios[i] == NULL) {
+			error = ENOMEM;
+			break;
+		}
+		iovp = uio_iovsaddr(uios[i]);
+		error = copyin_user_iovec_array(mp->msg_iov, spacetype,
+		    mp->msg_iovlen, iovp);
+		if (error == 0)
+			error = uio_calculateresid(uios[i]);
+		if (error) {
+			uio_free(uios[i]);
+			uios[i] = NULL;
+			break;
+		}
+	}
+	*countp = i;
+	return ((i == 0) ? error : 0);
+}
+
+/*
+ * Copy the first cnt mmsghdrs back out: only msg_len for a send,
+ * the whole header for a receive.
+ *
+ * Returns:	0			Success
+ *	copyout:EFAULT
+ */
+static int
+copyout_user_mmsghdr_array(struct proc *p, struct user_mmsghdr *msgs,
+    u_int cnt, user_addr_t msgp, boolean_t len_only)
+{
+	struct user64_mmsghdr mmsg64;
+	struct user32_mmsghdr mmsg32;
+	struct user_msghdr *mp;
+	int size_of_mmsghdr;
+	int error = 0;
+	u_int i;
+
+	size_of_mmsghdr = IS_64BIT_PROCESS(p) ?
+	    sizeof (mmsg64) : sizeof (mmsg32);
+
+	for (i = 0; i < cnt && error == 0; i++, msgp += size_of_mmsghdr) {
+		mp = &msgs[i].msg_hdr;
+		if (len_only) {
+			error = copyout((caddr_t)&msgs[i].msg_len, msgp +
+			    (IS_64BIT_PROCESS(p) ?
+			    offsetof(struct user64_mmsghdr, msg_len) :
+			    offsetof(struct user32_mmsghdr, msg_len)),
+			    sizeof (msgs[i].msg_len));
+		} else if (IS_64BIT_PROCESS(p)) {
+			bzero(&mmsg64, sizeof (mmsg64));
+			mmsg64.msg_hdr.msg_flags = mp->msg_flags;
+			mmsg64.msg_hdr.msg_controllen = mp->msg_controllen;
+			mmsg64.msg_hdr.msg_control = mp->msg_control;
+			mmsg64.msg_hdr.msg_iovlen = mp->msg_iovlen;
+			mmsg64.msg_hdr.msg_iov = mp->msg_iov;
+			mmsg64.msg_hdr.msg_namelen = mp->msg_namelen;
+			mmsg64.msg_hdr.msg_name = mp->msg_name;
+			mmsg64.msg_len = msgs[i].msg_len;
+			error = copyout((caddr_t)&mmsg64, msgp, size_of_mmsghdr);
+		} else {
+			bzero(&mmsg32, sizeof (mmsg32));
+			mmsg32.msg_hdr.msg_flags = mp->msg_flags;
+			mmsg32.msg_hdr.msg_controllen = mp->msg_controllen;
+			mmsg32.msg_hdr.msg_control = mp->msg_control;
+			mmsg32.msg_hdr.msg_iovlen = mp->msg_iovlen;
+			mmsg32.msg_hdr.msg_iov = mp->msg_iov;
+			mmsg32.msg_hdr.msg_namelen = mp->msg_namelen;
+			mmsg32.msg_hdr.msg_name = mp->msg_name;
+			mmsg32.msg_len = msgs[i].msg_len;
+			error = copyout((caddr_t)&mmsg32, msgp, size_of_mmsghdr);
+		}
+	}
+	return (error);
+}
+
+/*
+ * Returns:	>= 0			Number of messages sent
+ *		EBADF
+ *		EMSGSIZE
+ *		ENOMEM
+ *	copyin:EFAULT
+ *	copyout:EFAULT
+ *	file_socket:ENOTSOCK
+ *	file_socket:EBADF
+ *	sendit:???			[see sendit definition in this file]
+ *	<pru_sosend_list>:???		[see sosend_list]
+ *
+ * Notes:	Sends up to cnt messages (at most UIO_MAXIOV) and returns the
+ *		number sent; an error is returned only if none was.  Runs of
+ *		messages with neither an address nor control data are passed
+ *		to the protocol's pru_sosend_list in one call, which takes
+ *		the socket lock once and lets the protocol build a packet
+ *		chain.  Other messages, and all messages on protocols without
+ *		list support, are sent one at a time through sendit().
+ */
+int
+sendmmsg(struct proc *p, struct sendmmsg_args *uap, int32_t *retval)
+{
+	struct user_mmsghdr *msgs = NULL;
+	uio_t *uios = NULL;
+	struct socket *so;
+	boolean_t list = TRUE;
+	u_int cnt, i, n, sent;
+	int32_t len;
+	int error;
+
+	__pthread_testcancel(1);
+
+	KERNEL_DEBUG(DBG_FNC_SENDMMSG | DBG_FUNC_START, 0, 0, 0, 0, 0);
+	AUDIT_ARG(fd, uap->s);
+
+	*retval = 0;
+	cnt = MIN(uap->cnt, UIO_MAXIOV);
+	if (cnt == 0) {
+		KERNEL_DEBUG(DBG_FNC_SENDMMSG | DBG_FUNC_END, 0, 0, 0, 0, 0);
+		return (0);
+	}
+
+	error = file_socket(uap->s, &so);
+	if (error) {
+		KERNEL_DEBUG(DBG_FNC_SENDMMSG | DBG_FUNC_END, error,
+		    0, 0, 0, 0);
+		return (error);
+	}
+	if (so == NULL) {
+		error = EBADF;
+		goto out;
+	}
+
+	MALLOC(msgs, struct user_mmsghdr *, cnt * sizeof (*msgs), M_TEMP,
+	    M_WAITOK | M_ZERO);
+	MALLOC(uios, uio_t *, cnt * sizeof (*uios), M_TEMP,
+	    M_WAITOK | M_ZERO);
+	if (msgs == NULL || uios == NULL) {
+		error = ENOMEM;
+		goto out;
+	}
+	error = copyin_user_mmsghdr_array(p, uap->msgp, cnt, UIO_WRITE,
+	    msgs, uios, &cnt);
+	if (error)
+		goto out;
+
+	for (i = 0; i < cnt; ) {
+		/* msg_flags is ignored for send */
+		for (n = i; list && n < cnt &&
+		    msgs[n].msg_hdr.msg_name == USER_ADDR_NULL &&
+		    msgs[n].msg_hdr.msg_control == USER_ADDR_NULL; n++)
+			msgs[n].msg_len = (unsigned int)uio_resid(uios[n]);
+
+		if (n > i) {
+			error = so->so_proto->pr_usrreqs->pru_sosend_list(so,
+			    &uios[i], n - i, uap->flags, &sent);
+			i += sent;
+			if (error == EOPNOTSUPP && sent == 0) {
+				/* the protocol wants them one at a time */
+				list = FALSE;
+				error = 0;
+				continue;
+			}
+			if (error == EPIPE && !(so->so_flags & SOF_NOSIGPIPE))
+				psignal(p, SIGPIPE);
+			if (error)
+				break;
+			continue;
+		}
+
+		msgs[i].msg_hdr.msg_flags = 0;
+		error = sendit(p, uap->s, &msgs[i].msg_hdr, uios[i],
+		    uap->flags, &len);
+		if (error)
+			break;
+		msgs[i].msg_len = len;
+		i++;
+	}
+
+	if (i > 0) {
+		error = copyout_user_mmsghdr_array(p, msgs, i, uap->msgp,
+		    TRUE);
+		if (error == 0)
+			*retval = i;
+	}
+out:
+	if (uios != NULL) {
+		for (i = 0; i < cnt; i++) {
+			if (uios[i] != NULL)
+				uio_free(uios[i]);
+		}
+		FREE(uios, M_TEMP);
+	}
+	if (msgs != NULL)
+		FREE(msgs, M_TEMP);
+	KERNEL_DEBUG(DBG_FNC_SENDMMSG | DBG_FUNC_END, error, *retval,
+	    0, 0, 0);
+	file_drop(uap->s);
+	return (error);
+}
+
+/*
+ * Returns:	>= 0			Number of messages received
+ *		EBADF
+ *		EMSGSIZE
+ *		ENOMEM
+ *		EACCES			Mandatory Access Control failure
+ *	copyin:EFAULT
+ *	copyout:EFAULT
+ *	file_socket:ENOTSOCK
+ *	file_socket:EBADF
+ *	recvit:???			[see recvit definition in this file]
+ *	<pru_soreceive_list>:???	[see soreceive_list]
+ *
+ * Notes:	Blocks (unless non-blocking) until one message is available,
+ *		then returns as many as are queued, up to cnt (at most
+ *		UIO_MAXIOV); an error is returned only if none was received.
+ *		Runs of messages that don't ask for control data are filled
+ *		by the protocol's pru_soreceive_list, which dequeues all of
+ *		them under one acquisition of the socket lock.  Other
+ *		messages, and all messages on protocols without list
+ *		support, are received one at a time through recvit().
+ */
+int
+recvmmsg(struct proc *p, struct recvmmsg_args *uap, int32_t *retval)
+{
+	struct user_mmsghdr *msgs = NULL;
+	struct recv_msg_elem *elems = NULL;
+	struct user_msghdr *mp;
+	struct sockaddr *fromsa;
+	uio_t *uios = NULL;
+	struct socket *so;
+	boolean_t list = TRUE;
+	u_int cnt, i, j, n, got, want;
+	socklen_t sa_len;
+	int32_t len;
+	int error, flags;
+
+	__pthread_testcancel(1);
+
+	KERNEL_DEBUG(DBG_FNC_RECVMMSG | DBG_FUNC_START, 0, 0, 0, 0, 0);
+	AUDIT_ARG(fd, uap->s);
+
+	*retval = 0;
+	cnt = MIN(uap->cnt, UIO_MAXIOV);
+	if (cnt == 0) {
+		KERNEL_DEBUG(DBG_FNC_RECVMMSG | DBG_FUNC_END, 0, 0, 0, 0, 0);
+		return (0);
+	}
+
+	error = file_socket(uap->s, &so);
+	if (error) {
+		KERNEL_DEBUG(DBG_FNC_RECVMMSG | DBG_FUNC_END, error,
+		    0, 0, 0, 0);
+		return (error);
+	}
+	if (so == NULL) {
+		error = EBADF;
+		goto out;
+	}
+
+	MALLOC(msgs, struct user_mmsghdr *, cnt * sizeof (*msgs), M_TEMP,
+	    M_WAITOK | M_ZERO);
+	MALLOC(uios, uio_t *, cnt * sizeof (*uios), M_TEMP,
+	    M_WAITOK | M_ZERO);
+	MALLOC(elems, struct recv_msg_elem *, cnt * sizeof (*elems), M_TEMP,
+	    M_WAITOK | M_ZERO);
+	if (msgs == NULL || uios == NULL || elems == NULL) {
+		error = ENOMEM;
+		goto out;
+	}
+	error = copyin_user_mmsghdr_array(p, uap->msgp, cnt, UIO_READ,
+	    msgs, uios, &cnt);
+	if (error)
+		goto out;
+
+#if CONFIG_MACF_SOCKET_SUBSET
+	/* As in recvit(), which does its own check */
+	if (!(so->so_state & SS_DEFUNCT) &&
+	    !(so->so_state & SS_ISCONNECTED) &&
+	    !(so->so_proto->pr_flags & PR_CONNREQUIRED) &&
+	    (error = mac_socket_check_receive(kauth_cred_get(), so)) != 0)
+		goto out;
+#endif /* MAC_SOCKET_SUBSET */
+
+	flags = uap->flags;
+	for (i = 0; i < cnt; ) {
+		for (n = i; list && n < cnt &&
+		    msgs[n].msg_hdr.msg_control == USER_ADDR_NULL; n++) {
+			elems[n].uio = uios[n];
+			elems[n].which = (msgs[n].msg_hdr.msg_name !=
+			    USER_ADDR_NULL) ? RECV_MSG_WANTADDR : 0;
+			msgs[n].msg_len = (unsigned int)uio_resid(uios[n]);
+		}
+
+		if (n > i) {
+			want = n - i;
+			error = so->so_proto->pr_usrreqs->pru_soreceive_list(so,
+			    &elems[i], want, flags, &got);
+			for (j = i; j < i + got; j++) {
+				mp = &msgs[j].msg_hdr;
+				msgs[j].msg_len -= uio_resid(uios[j]);
+				mp->msg_flags = (elems[j].which &
+				    RECV_MSG_TRUNC) ? MSG_TRUNC : 0;
+				mp->msg_controllen = 0;
+				if (mp->msg_name == USER_ADDR_NULL)
+					continue;
+				fromsa = elems[j].psa;
+				sa_len = (fromsa != NULL) ? fromsa->sa_len : 0;
+				len = MIN(mp->msg_namelen, sa_len);
+				if (len > 0 && error == 0)
+					error = copyout(fromsa, mp->msg_name,
+					    (unsigned)len);
+				/* the actual, untruncated address length */
+				mp->msg_namelen = sa_len;
+			}
+			for (j = i; j < n; j++) {
+				if (elems[j].psa != NULL) {
+					FREE(elems[j].psa, M_SONAME);
+					elems[j].psa = NULL;
+				}
+			}
+			if (error == EOPNOTSUPP && got == 0) {
+				/* the protocol wants them one at a time */
+				list = FALSE;
+				error = 0;
+				continue;
+			}
+			i += got;
+			if (error || got < want)
+				break;
+			/* Don't wait for more than we already have */
+			flags |= MSG_DONTWAIT;
+			continue;
+		}
+
+		msgs[i].msg_hdr.msg_flags = flags;
+		error = recvit(p, uap->s, &msgs[i].msg_hdr, uios[i], 0, &len);
+		if (error)
+			break;
+		msgs[i].msg_len = len;
+		i++;
+		flags |= MSG_DONTWAIT;
+	}
+	if (i > 0) {
+		error = copyout_user_mmsghdr_array(p, msgs, i, uap->msgp,
+		    FALSE);
+		if (error == 0)
+			*retval = i;
+	}
+out:
+	if (uios != NULL) {
+		for (i = 0; i < cnt; i++) {
+			if (uios[i] != NULL)
+				uio_free(uios[i]);
+		}
+		FREE(uios, M_TEMP);
+	}
+	if (elems != NULL)
+		FREE(elems, M_TEMP);
+	if (msgs != NULL)
+		FREE(msgs, M_TEMP);
+	KERNEL_DEBUG(DBG_FNC_RECVMMSG | DBG_FUNC_END, error, *retval,
+	    0, 0, 0);
+	file_drop(uap->s);
+	return (error);
+}
+
 /*
  * Returns:	0			Success
  *		EBADF
@@ -2327,6 +2762,153 @@ alloc_sendpkt(int how, size_t pktlen, unsigned int *maxchunks,
 	*maxchunks = needed;
 }
 
+#if defined(__x86_64__)
+/*
+ * Zero-copy sendfile: rather than reading file data into mbuf clusters,
+ * wire the file's resident pages in the UBC and attach them, through
+ * the physical map, to the socket as read-only external mbuf storage.
+ * The pages stay wired until the last mbuf referring to them is freed.
+ * Ranges with pages that are not resident, or are busy (being read in
+ * or written), go through the copying path instead.
+ */
+int sendfile_zerocopy = 1;
+SYSCTL_INT(_kern_ipc, OID_AUTO, sendfile_zerocopy,
+	CTLFLAG_RW | CTLFLAG_LOCKED, &sendfile_zerocopy, 0, "");
+
+/* Wired range shared by the mbufs of one sendfile packet */
+struct sendfile_zc {
+	upl_t			sz_upl;
+	volatile SInt32		sz_refs;
+	struct sendfile_zc	*sz_next;	/* on sendfile_zc_done */
+};
+
+/*
+ * The last mbuf may well be freed from interrupt context (driver
+ * transmit completion), where we can't commit the UPL; completed
+ * ranges are queued here and released from a thread call.
+ */
+static struct sendfile_zc * volatile sendfile_zc_done;
+static thread_call_t sendfile_zc_call;
+
+static void
+sendfile_zc_release(__unused thread_call_param_t p0,
+    __unused thread_call_param_t p1)
+{
+	struct sendfile_zc *sz, *next;
+
+	do {
+		sz = sendfile_zc_done;
+	} while (!OSCompareAndSwapPtr(sz, NULL, (void * volatile *)&sendfile_zc_done));
+
+	for (; sz != NULL; sz = next) {
+		next = sz->sz_next;
+		ubc_upl_commit(sz->sz_upl);
+		FREE(sz, M_TEMP);
+	}
+}
+
+static void
+sendfile_zc_free(__unused caddr_t buf, __unused u_int size, caddr_t arg)
+{
+	struct sendfile_zc *sz = (struct sendfile_zc *)arg;
+	struct sendfile_zc *head;
+
+	if (OSDecrementAtomic(&sz->sz_refs) != 1)
+		return;
+
+	do {
+		head = sendfile_zc_done;
+		sz->sz_next = head;
+	} while (!OSCompareAndSwapPtr(head, sz, (void * volatile *)&sendfile_zc_done));
+	thread_call_enter(sendfile_zc_call);
+}
+
+/*
+ * Build a packet referring to the file pages backing [off, off + xfsize)
+ * in place.  Returns 0 and the packet in *m on success; on failure the
+ * caller falls back to reading the data into clusters.
+ */
+static int
+sendfile_zc_attach(struct vnode *vp, off_t off, off_t xfsize, struct mbuf **m)
+{
+	struct sendfile_zc *sz;
+	struct mbuf *m0 = NULL, *n, **mp = &m0;
+	upl_page_info_t *pl;
+	upl_t upl;
+	off_t start, pgoff, resid;
+	int len, npages, i;
+
+	*m = NULL;
+
+	if (sendfile_zc_call == NULL) {
+		thread_call_t call;
+
+		call = thread_call_allocate(sendfile_zc_release, NULL);
+		if (!OSCompareAndSwapPtr(NULL, call,
+		    (void * volatile *)&sendfile_zc_call))
+			thread_call_free(call);
+	}
+
+	start = trunc_page_64(off);
+	len = (int)(round_page_64(off + xfsize) - start);
+	npages = atop(len);
+
+	if (vnode_getwithref(vp) != 0)
+		return (EIO);
+	if (ubc_create_iopl(vp, start, len, &upl, &pl) != KERN_SUCCESS) {
+		vnode_put(vp);
+		return (EAGAIN);
+	}
+	vnode_put(vp);
+
+	MALLOC(sz, struct sendfile_zc *, sizeof (*sz), M_TEMP, M_WAITOK);
+	sz->sz_upl = upl;
+	sz->sz_refs = 1;	/* ours, until the packet is built */
+	sz->sz_next = NULL;
+
+	pgoff = off & PAGE_MASK_64;
+	resid = xfsize;
+	for (i = 0; i < npages; i++) {
+		caddr_t buf;
+
+		buf = (caddr_t)ml_physmap_ptovirt(ptoa_64(upl_phys_page(pl, i)));
+		n = (i == 0) ? m_gethdr(M_WAIT, MT_DATA) : m_get(M_WAIT, MT_DATA);
+		if (n == NULL)
+			break;
+		OSIncrementAtomic(&sz->sz_refs);
+		if (m_clattach(n, MT_DATA, buf, sendfile_zc_free, PAGE_SIZE,
+		    (caddr_t)sz, M_WAIT) == NULL) {
+			OSDecrementAtomic(&sz->sz_refs);
+			break;
+		}
+		m_ext_setreadonly(n);
+		n->m_data += pgoff;
+		n->m_len = (int)MIN(PAGE_SIZE_64 - pgoff, resid);
+		resid -= n->m_len;
+		pgoff = 0;
+
+		*mp = n;
+		mp = &n->m_next;
+	}
+
+	if (i < npages) {
+		/* the mbufs attached so far drop their references here */
+		if (m0 != NULL)
+			m_freem(m0);
+		m0 = NULL;
+	} else {
+		m0->m_pkthdr.len = (int)xfsize;
+		m0->m_pkthdr.rcvif = NULL;
+	}
+	sendfile_zc_free(NULL, 0, (caddr_t)sz);
+
+	if (m0 == NULL)
+		return (ENOBUFS);
+	*m = m0;
+	return (0);
+}
+#endif /* __x86_64__ */
+
 /*
  * sendfile(2).
  * int sendfile(int fd, int s, off_t offset, off_t *nbytes,
@@ -2354,6 +2936,9 @@ sendfile(struct proc *p, struct sendfile_args *uap, __unused int *retval)
 	size_t sizeof_hdtr;
 	off_t file_size;
 	struct vfs_context context = *vfs_context_current();
+#if defined(__x86_64__)
+	int zerocopy;
+#endif
 #define ENXIO_10146739_DBG(err_str) {	\
 	if (error == ENXIO) {		\
 		printf(err_str,		\
@@ -2486,10 +3071,27 @@ sendfile(struct proc *p, struct sendfile_args *uap, __unused int *retval)
 		goto done2;
 	}
 
+#if defined(__x86_64__)
+	/*
+	 * Zero-copy bypasses fo_read(), so do its read check up front.
+	 */
+	zerocopy = sendfile_zerocopy;
+#if CONFIG_MACF
+	if (zerocopy) {
+		if ((error = vnode_getwithref(vp)) != 0)
+			goto done2;
+		error = mac_vnode_check_read(&context, context.vc_ucred, vp);
+		vnode_put(vp);
+		if (error)
+			goto done2;
+	}
+#endif
+#endif /* __x86_64__ */
+
 	/*
-	 * Simply read file data into a chain of mbufs that used with scatter
-	 * gather reads. We're not (yet?) setup to use zero copy external
-	 * mbufs that point to the file pages.
+	 * Attach resident file pages to the socket in place where we can;
+	 * otherwise read file data into a chain of mbufs that used with
+	 * scatter gather reads.
 	 */
 	socket_lock(so, 1);
 	error = sblock(&so->so_snd, SBL_WAIT);
@@ -2553,6 +3155,12 @@ sendfile(struct proc *p, struct sendfile_args *uap, __unused int *retval)
 		    ((so->so_flags & SOF_MULTIPAGES) || sosendjcl_ignore_capab);
 
 		socket_unlock(so, 0);
+#if defined(__x86_64__)
+		if (zerocopy && sendfile_zc_attach(vp, off, xfsize, &m0) == 0) {
+			socket_lock(so, 0);
+			goto retry_space;
+		}
+#endif /* __x86_64__ */
 		alloc_sendpkt(M_WAIT, xfsize, &nbufs, &m0, jumbocl);
 		pktlen = mbuf_pkt_maxlen(m0);
 		if (pktlen < (size_t)xfsize)
@@ -106,6 +106,7 @@
 #include <net/if.h>
 #include <net/bpf.h>
 #include <net/bpfdesc.h>
+#include <net/bpf_jitter.h>
 
 #include <netinet/in.h>
 #include <netinet/in_pcb.h>
@@ -150,6 +151,15 @@ SYSCTL_INT(_debug, OID_AUTO, bpf_maxbufsize, CTLFLAG_RW | CTLFLAG_LOCKED,
 static unsigned int bpf_maxdevices = 256;
 SYSCTL_UINT(_debug, OID_AUTO, bpf_maxdevices, CTLFLAG_RW | CTLFLAG_LOCKED,
 	&bpf_maxdevices, 0, "");
+#if BPF_JITTER
+/*
+ * Compile filters to native code when they are set; applies to
+ * filters set after it is changed.
+ */
+int bpf_jitter_enable = 1;
+SYSCTL_INT(_debug, OID_AUTO, bpf_jitter, CTLFLAG_RW | CTLFLAG_LOCKED,
+	&bpf_jitter_enable, 0, "");
+#endif
 
 /*
  *  bpf_iflist is the list of interfaces; each corresponds to an ifnet
@@ -1653,6 +1663,9 @@ static int
 bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns, dev_t dev, u_long cmd)
 {
 	struct bpf_insn *fcode, *old;
+#if BPF_JITTER
+	bpf_jit_filter *jfunc, *ofunc;
+#endif
 	u_int flen, size;
 
 	while (d->bd_hbuf_read) 
@@ -1663,13 +1676,23 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns, dev_t dev, u_long
 		return (ENXIO);
 	
 	old = d->bd_filter;
+#if BPF_JITTER
+	ofunc = d->bd_bfilter;
+#endif
 	if (bf_insns == USER_ADDR_NULL) {
 		if (bf_len != 0)
 			return (EINVAL);
 		d->bd_filter = NULL;
+#if BPF_JITTER
+		d->bd_bfilter = NULL;
+#endif
 		reset_d(d);
 		if (old != 0)
 			FREE((caddr_t)old, M_DEVBUF);
+#if BPF_JITTER
+		if (ofunc != NULL)
+			bpf_destroy_jit_filter(ofunc);
+#endif
 		return (0);
 	}
 	flen = bf_len;
@@ -1684,6 +1707,11 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns, dev_t dev, u_long
 #endif
 	if (copyin(bf_insns, (caddr_t)fcode, size) == 0 &&
 	    bpf_validate(fcode, (int)flen)) {
+#if BPF_JITTER
+		/* NULL if it can't be compiled; bpf_filter() runs it then */
+		jfunc = bpf_jitter_enable ? bpf_jitter(fcode, (int)flen) : NULL;
+		d->bd_bfilter = jfunc;
+#endif
 		d->bd_filter = fcode;
 	
 		if (cmd == BIOCSETF32 || cmd == BIOCSETF64)
@@ -1691,6 +1719,10 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns, dev_t dev, u_long
 	
 		if (old != 0)
 			FREE((caddr_t)old, M_DEVBUF);
+#if BPF_JITTER
+		if (ofunc != NULL)
+			bpf_destroy_jit_filter(ofunc);
+#endif
 
 		return (0);
 	}
@@ -2149,6 +2181,13 @@ bpf_tap_imp(
 			if (outbound && !d->bd_seesent)
 				continue;
 			++d->bd_rcount;
+#if BPF_JITTER
+			/* native code only handles contiguous packets */
+			if (d->bd_bfilter != NULL && m->m_next == NULL)
+				slen = (*d->bd_bfilter->func)(mtod(m, u_char *),
+				    pktlen, pktlen);
+			else
+#endif
 			slen = bpf_filter(d->bd_filter, (u_char *)m, pktlen, 0);
 			if (slen != 0) {
 #if CONFIG_MACF_NET
@@ -2361,6 +2400,10 @@ bpf_freed(struct bpf_d *d)
 	}
 	if (d->bd_filter)
 		FREE((caddr_t)d->bd_filter, M_DEVBUF);
+#if BPF_JITTER
+	if (d->bd_bfilter != NULL)
+		bpf_destroy_jit_filter(d->bd_bfilter);
+#endif
 }
 
 /*
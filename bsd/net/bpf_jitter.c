@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Machine-independent half of the BPF JIT; see net/bpf_jitter.h.
+ */
+
+#include <sys/param.h>
+#ifdef KERNEL
+#include <sys/systm.h>
+#include <sys/malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+#include <net/bpf.h>
+#include <net/bpf_jitter.h>
+
+#if BPF_JITTER
+
+bpf_jit_filter *
+bpf_jitter(struct bpf_insn *fp, int nins)
+{
+	bpf_jit_filter *filter;
+
+#ifdef KERNEL
+	filter = (bpf_jit_filter *)_MALLOC(sizeof (*filter), M_DEVBUF, M_WAIT);
+#else
+	filter = (bpf_jit_filter *)malloc(sizeof (*filter));
+#endif
+	if (filter == NULL)
+		return (NULL);
+
+	filter->func = bpf_jit_compile(fp, nins, &filter->size);
+	if (filter->func == NULL) {
+#ifdef KERNEL
+		FREE(filter, M_DEVBUF);
+#else
+		free(filter);
+#endif
+		return (NULL);
+	}
+	return (filter);
+}
+
+void
+bpf_destroy_jit_filter(bpf_jit_filter *filter)
+{
+	bpf_jit_free(filter->func, filter->size);
+#ifdef KERNEL
+	FREE(filter, M_DEVBUF);
+#else
+	free(filter);
+#endif
+}
+
+#endif /* BPF_JITTER */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * BPF just-in-time compiler.
+ *
+ * bpf_jitter() translates a validated filter program into native code
+ * with the same semantics as bpf_filter() on a contiguous buffer
+ * (buflen != 0): out-of-bounds loads and division by zero reject the
+ * packet.  It returns NULL for programs the back end can't compile, in
+ * which case the caller keeps using the interpreter.  Packets held in
+ * mbuf chains must still go through bpf_filter().
+ *
+ * The back end lives with the machine-dependent code and supplies
+ * bpf_jit_compile() and bpf_jit_free().  This file is also built into
+ * the userland differential test, tools/tests/unit_tests/bpf_jit_test.
+ */
+
+#ifndef _NET_BPF_JITTER_H_
+#define _NET_BPF_JITTER_H_
+
+#include <sys/types.h>
+
+#if defined(__x86_64__)
+#define	BPF_JITTER	1
+#else
+#define	BPF_JITTER	0
+#endif
+
+struct bpf_insn;
+
+/* Same arguments as bpf_filter(), minus the program */
+typedef u_int (*bpf_filter_func)(u_char *, u_int, u_int);
+
+typedef struct bpf_jit_filter {
+	bpf_filter_func	func;		/* native code */
+	size_t		size;		/* bytes allocated for it */
+} bpf_jit_filter;
+
+#ifdef KERNEL
+extern int bpf_jitter_enable;
+#endif
+
+extern bpf_jit_filter	*bpf_jitter(struct bpf_insn *, int);
+extern void		bpf_destroy_jit_filter(bpf_jit_filter *);
+
+/* machine-dependent back end */
+extern bpf_filter_func	bpf_jit_compile(struct bpf_insn *, u_int, size_t *);
+extern void		bpf_jit_free(bpf_filter_func, size_t);
+
+#endif /* _NET_BPF_JITTER_H_ */
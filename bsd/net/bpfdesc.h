@@ -77,6 +77,7 @@
 
 #include <sys/select.h>
 #include <kern/thread_call.h>
+#include <net/bpf_jitter.h>
 
 /*
  * Descriptor associated with each open bpf file.
@@ -104,6 +105,9 @@ struct bpf_d {
 	struct bpf_if  *bd_bif;		/* interface descriptor */
 	u_int32_t		bd_rtout;	/* Read timeout in 'ticks' */
 	struct bpf_insn *bd_filter; 	/* filter code */
+#if BPF_JITTER
+	bpf_jit_filter	*bd_bfilter;	/* compiled filter, if any */
+#endif
 	u_int32_t		bd_rcount;	/* number of packets received */
 	u_int32_t		bd_dcount;	/* number of packets dropped */
 
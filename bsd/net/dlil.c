@@ -77,6 +77,7 @@
 #if INET
 #include <netinet/in_var.h>
 #include <netinet/igmp_var.h>
+#include <netinet/ip.h>
 #include <netinet/ip_var.h>
 #include <netinet/tcp.h>
 #include <netinet/tcp_var.h>
@@ -84,10 +85,13 @@
 #include <netinet/udp_var.h>
 #include <netinet/if_ether.h>
 #include <netinet/in_pcb.h>
+#include <netinet/lro_ext.h>
 #endif /* INET */
 
 #if INET6
+#include <netinet/ip6.h>
 #include <netinet6/in6_var.h>
+#include <netinet6/ip6_var.h>
 #include <netinet6/nd6.h>
 #include <netinet6/mld6_var.h>
 #include <netinet6/scope6_var.h>
@@ -206,6 +210,7 @@ struct dlil_ifnet {
 	} dl_if_lladdr;
 	u_int8_t dl_if_descstorage[IF_DESCSIZE]; /* desc storage */
 	struct dlil_threading_info dl_if_inpstorage; /* input thread storage */
+	struct dlil_threading_info *dl_if_rxqstorage; /* input queues 1..n-1 */
 	ctrace_t	dl_if_attach;		/* attach PC stacktrace */
 	ctrace_t	dl_if_detach;		/* detach PC stacktrace */
 };
@@ -381,13 +386,22 @@ static void dlil_input_thread_func(void *, wait_result_t);
 static void dlil_rxpoll_input_thread_func(void *, wait_result_t);
 static int dlil_create_input_thread(ifnet_t, struct dlil_threading_info *);
 static void dlil_terminate_input_thread(struct dlil_threading_info *);
+static void dlil_rxq_attach(struct ifnet *, struct dlil_ifnet *);
+static void dlil_rxq_detach(struct ifnet *);
+static u_int32_t dlil_rxq_flowhash(struct ifnet *, struct mbuf *);
+static struct mbuf *ifnet_input_steer(struct ifnet *, struct mbuf *,
+    struct mbuf **, u_int32_t *, u_int32_t *);
 static void dlil_input_stats_add(const struct ifnet_stat_increment_param *,
     struct dlil_threading_info *, boolean_t);
 static void dlil_input_stats_sync(struct ifnet *, struct dlil_threading_info *);
 static void dlil_input_packet_list_common(struct ifnet *, struct mbuf *,
-    u_int32_t, ifnet_model_t, boolean_t);
+    u_int32_t, ifnet_model_t, boolean_t, boolean_t);
+static boolean_t dlil_gro_enabled(struct ifnet *);
+static struct mbuf *dlil_gro_input(struct dlil_threading_info *,
+    struct mbuf *, u_int32_t *);
 static errno_t ifnet_input_common(struct ifnet *, struct mbuf *, struct mbuf *,
     const struct ifnet_stat_increment_param *, boolean_t, boolean_t);
+static struct mbuf *dlil_gso_segment(struct ifnet *, struct mbuf *, int *);
 
 #if DEBUG
 static void dlil_verify_sum16(void);
@@ -422,6 +436,7 @@ static int sysctl_rxpoll_wlowat SYSCTL_HANDLER_ARGS;
 static int sysctl_rxpoll_whiwat SYSCTL_HANDLER_ARGS;
 static int sysctl_sndq_maxlen SYSCTL_HANDLER_ARGS;
 static int sysctl_rcvq_maxlen SYSCTL_HANDLER_ARGS;
+static int sysctl_rxq_count SYSCTL_HANDLER_ARGS;
 static int sysctl_hwcksum_dbg_mode SYSCTL_HANDLER_ARGS;
 static int sysctl_hwcksum_dbg_partial_rxoff_forced SYSCTL_HANDLER_ARGS;
 static int sysctl_hwcksum_dbg_partial_rxoff_adj SYSCTL_HANDLER_ARGS;
@@ -595,6 +610,44 @@ SYSCTL_UINT(_net_link_generic_system, OID_AUTO, dlil_input_threads,
     CTLFLAG_RD | CTLFLAG_LOCKED, &cur_dlil_input_threads , 0,
     "Current number of DLIL input threads");
 
+/*
+ * Number of input queues (and threads) per interface with a dedicated
+ * input thread; inbound packets are spread across them by flow hash.
+ * Takes effect for interfaces attached afterwards.  0 or 1 disables
+ * receive steering.
+ */
+static u_int32_t if_rxq_count = 0;
+SYSCTL_PROC(_net_link_generic_system, OID_AUTO, rxq_count,
+    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_LOCKED, &if_rxq_count, 0,
+    sysctl_rxq_count, "I", "input queues per interface");
+
+static u_int32_t dlil_rxq_seed;
+
+static u_int32_t if_gro = 1;
+SYSCTL_UINT(_net_link_generic_system, OID_AUTO, gro,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &if_gro, 0,
+    "coalesce inbound TCP segments and IPv4 UDP fragments");
+
+static u_int32_t if_gro_max = 32;
+SYSCTL_UINT(_net_link_generic_system, OID_AUTO, gro_max,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &if_gro_max, 0,
+    "max TCP segments coalesced into one");
+
+u_int32_t if_gso = 1;
+SYSCTL_UINT(_net_link_generic_system, OID_AUTO, gso,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &if_gso, 0,
+    "segment TCP in software for interfaces without TSO");
+
+static uint64_t gso_packets = 0;
+SYSCTL_QUAD(_net_link_generic_system, OID_AUTO, gso_packets,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &gso_packets,
+    "TCP super-segments segmented in software");
+
+static uint64_t gso_segments = 0;
+SYSCTL_QUAD(_net_link_generic_system, OID_AUTO, gso_segments,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &gso_segments,
+    "TCP segments produced by software segmentation");
+
 #if IFNET_INPUT_SANITY_CHK
 SYSCTL_UINT(_net_link_generic_system, OID_AUTO, dlil_input_sanity_check,
     CTLFLAG_RW | CTLFLAG_LOCKED, &dlil_input_sanity_check , 0,
@@ -696,6 +749,7 @@ unsigned int net_affinity = 1;
 static kern_return_t dlil_affinity_set(struct thread *, u_int32_t);
 
 extern u_int32_t	inject_buckets;
+extern u_int32_t	kipf_count;
 
 static	lck_grp_attr_t	*dlil_grp_attributes = NULL;
 static	lck_attr_t	*dlil_lck_attributes = NULL;
@@ -1076,6 +1130,12 @@ dlil_create_input_thread(ifnet_t ifp, struct dlil_threading_info *inp)
 		VERIFY(inp == dlil_main_input_thread);
 		(void) strlcat(inp->input_name,
 		    "main_input", DLIL_THREADNAME_LEN);
+	} else if (inp->rxq_index != 0) {
+		/* Secondary input queue; see dlil_rxq_attach() */
+		func = dlil_input_thread_func;
+		VERIFY(inp != ifp->if_inp);
+		(void) snprintf(inp->input_name, DLIL_THREADNAME_LEN,
+		    "%s_input%u", if_name(ifp), inp->rxq_index);
 	} else if (net_rxpoll && (ifp->if_eflags & IFEF_RXPOLL)) {
 		func = dlil_rxpoll_input_thread_func;
 		VERIFY(inp != dlil_main_input_thread);
@@ -1178,6 +1238,9 @@ dlil_terminate_input_thread(struct dlil_threading_info *inp)
 	VERIFY(qhead(&inp->rcvq_pkts) == NULL && qempty(&inp->rcvq_pkts));
 	qlimit(&inp->rcvq_pkts) = 0;
 	bzero(&inp->stats, sizeof (inp->stats));
+	bzero(&inp->rxq_stats, sizeof (inp->rxq_stats));
+	inp->rxq_wakeups = 0;
+	bzero(&inp->gro_stats, sizeof (inp->gro_stats));
 
 	VERIFY(!inp->net_affinity);
 	inp->input_thr = THREAD_NULL;
@@ -1213,6 +1276,95 @@ dlil_terminate_input_thread(struct dlil_threading_info *inp)
 	/* NOTREACHED */
 }
 
+/*
+ * Start the secondary input threads of an interface with a dedicated
+ * input thread, if receive steering is enabled.  The storage is kept
+ * with the dlil_ifnet across recycling, like dl_if_inpstorage.
+ * Interfaces using opportunistic polling are left alone, since their
+ * input thread also drives the polling mode decisions.
+ */
+static void
+dlil_rxq_attach(struct ifnet *ifp, struct dlil_ifnet *dl_if)
+{
+	struct dlil_threading_info *inp;
+	u_int32_t i, cnt;
+
+	VERIFY(ifp->if_rxq == NULL && ifp->if_rxq_cnt == 0);
+
+	cnt = MIN(if_rxq_count, IF_RXQ_MAX);
+	if (cnt <= 1 || ifp->if_inp == NULL ||
+	    (net_rxpoll && (ifp->if_eflags & IFEF_RXPOLL)))
+		return;
+
+	if (dl_if->dl_if_rxqstorage == NULL) {
+		dl_if->dl_if_rxqstorage = _MALLOC(sizeof (*inp) *
+		    (IF_RXQ_MAX - 1), M_DEVBUF, M_WAITOK | M_ZERO);
+		if (dl_if->dl_if_rxqstorage == NULL) {
+			printf("%s: no memory for input queues\n",
+			    if_name(ifp));
+			return;
+		}
+	}
+
+	for (i = 1; i < cnt; i++) {
+		inp = &dl_if->dl_if_rxqstorage[i - 1];
+		bzero(&inp->stats, sizeof (inp->stats));
+		VERIFY(inp->input_waiting == 0);
+		VERIFY(inp->wtot == 0);
+		VERIFY(inp->ifp == NULL);
+		VERIFY(qhead(&inp->rcvq_pkts) == NULL &&
+		    qempty(&inp->rcvq_pkts));
+		VERIFY(qlimit(&inp->rcvq_pkts) == 0);
+		VERIFY(!inp->net_affinity);
+		VERIFY(inp->input_thr == THREAD_NULL);
+		VERIFY(inp->tag == 0);
+		inp->rxq_index = i;
+		(void) dlil_create_input_thread(ifp, inp);
+	}
+
+	ifp->if_rxq = dl_if->dl_if_rxqstorage;
+	ifp->if_rxq_cnt = cnt;
+}
+
+/*
+ * Tear down the affinity of the secondary input threads and tell them
+ * to terminate; called once there are no more IO references.
+ */
+static void
+dlil_rxq_detach(struct ifnet *ifp)
+{
+	struct dlil_threading_info *inp;
+	u_int32_t i, cnt;
+
+	cnt = ifp->if_rxq_cnt;
+	ifp->if_rxq_cnt = 0;
+
+	for (i = 1; i < cnt; i++) {
+		inp = &ifp->if_rxq[i - 1];
+
+		if (inp->net_affinity) {
+			struct thread *tp;
+
+			lck_mtx_lock_spin(&inp->input_lck);
+			tp = inp->input_thr;	/* don't nullify now */
+			inp->tag = 0;
+			inp->net_affinity = FALSE;
+			lck_mtx_unlock(&inp->input_lck);
+
+			(void) dlil_affinity_set(tp, THREAD_AFFINITY_TAG_NULL);
+			thread_deallocate(tp);
+		}
+
+		lck_mtx_lock_spin(&inp->input_lck);
+		inp->input_waiting |= DLIL_INPUT_TERMINATE;
+		if (!(inp->input_waiting & DLIL_INPUT_RUNNING)) {
+			wakeup_one((caddr_t)&inp->input_waiting);
+		}
+		lck_mtx_unlock(&inp->input_lck);
+	}
+	ifp->if_rxq = NULL;
+}
+
 static kern_return_t
 dlil_affinity_set(struct thread *tp, u_int32_t tag)
 {
@@ -1341,6 +1493,11 @@ dlil_init(void)
 
 	PE_parse_boot_argn("net_rxpoll", &net_rxpoll, sizeof (net_rxpoll));
 
+	PE_parse_boot_argn("net_rxq", &if_rxq_count, sizeof (if_rxq_count));
+	if (if_rxq_count > IF_RXQ_MAX)
+		if_rxq_count = IF_RXQ_MAX;
+	read_random(&dlil_rxq_seed, sizeof (dlil_rxq_seed));
+
 	PE_parse_boot_argn("net_rtref", &net_rtref, sizeof (net_rtref));
 
 	PE_parse_boot_argn("ifnet_debug", &ifnet_debug, sizeof (ifnet_debug));
@@ -1853,9 +2010,14 @@ dlil_input_thread_func(void *v, wait_result_t w)
 		* We should think about putting some thread starvation
 		* safeguards if we deal with long chains of packets.
 		*/
-		if (m != NULL)
-			dlil_input_packet_list_extended(NULL, m,
-			    m_cnt, inp->mode);
+		if (m != NULL) {
+			boolean_t gro = dlil_gro_enabled(ifp);
+
+			if (gro)
+				m = dlil_gro_input(inp, m, &m_cnt);
+			dlil_input_packet_list_common(NULL, m, m_cnt,
+			    inp->mode, TRUE, gro);
+		}
 	}
 
 	/* NOTREACHED */
@@ -2099,8 +2261,14 @@ skip:
 		* We should think about putting some thread starvation
 		* safeguards if we deal with long chains of packets.
 		*/
-		if (m != NULL)
-			dlil_input_packet_list_extended(NULL, m, m_cnt, mode);
+		if (m != NULL) {
+			boolean_t gro = dlil_gro_enabled(ifp);
+
+			if (gro)
+				m = dlil_gro_input(inp, m, &m_cnt);
+			dlil_input_packet_list_common(NULL, m, m_cnt,
+			    mode, TRUE, gro);
+		}
 	}
 
 	/* NOTREACHED */
@@ -2262,6 +2430,142 @@ ifnet_input_extended(struct ifnet *ifp, struct mbuf *m_head,
 	return (ifnet_input_common(ifp, m_head, m_tail, s, TRUE, FALSE));
 }
 
+/*
+ * Flow hash used to pick the input queue of an inbound packet: the
+ * driver's own flow ID if it supplied one, otherwise a hash of the IP
+ * addresses and, for unfragmented TCP and UDP, the ports.  Anything
+ * else, including traffic we can't parse cheaply, hashes to 0 and
+ * stays on the primary input queue.
+ */
+static u_int32_t
+dlil_rxq_flowhash(struct ifnet *ifp, struct mbuf *m)
+{
+	struct {
+		u_int32_t	addrs[8];
+		u_int32_t	ports;
+		u_int32_t	proto;
+	} key;
+	struct ether_header *eh;
+	u_int8_t *l4 = NULL;
+
+	if ((m->m_pkthdr.pkt_flags & PKTF_FLOW_ID) &&
+	    m->m_pkthdr.pkt_flowsrc == FLOWSRC_IFNET)
+		return (m->m_pkthdr.pkt_flowid);
+
+	/* At this point the frame header is pkt_hdr and m_data is L3 */
+	if (ifp->if_type != IFT_ETHER ||
+	    (eh = m->m_pkthdr.pkt_hdr) == NULL)
+		return (0);
+
+	bzero(&key, sizeof (key));
+	switch (ntohs(eh->ether_type)) {
+#if INET
+	case ETHERTYPE_IP: {
+		struct ip *ip = mtod(m, struct ip *);
+		int hlen;
+
+		if (m->m_len < (int)sizeof (*ip) || !IP_HDR_ALIGNED_P(ip))
+			return (0);
+		hlen = ip->ip_hl << 2;
+		bcopy(&ip->ip_src, &key.addrs[0], sizeof (ip->ip_src));
+		bcopy(&ip->ip_dst, &key.addrs[1], sizeof (ip->ip_dst));
+		key.proto = ip->ip_p;
+		if ((ip->ip_p == IPPROTO_TCP || ip->ip_p == IPPROTO_UDP) &&
+		    !(ip->ip_off & htons(IP_MF | IP_OFFMASK)) &&
+		    m->m_len >= hlen + (int)sizeof (key.ports))
+			l4 = (u_int8_t *)ip + hlen;
+		break;
+	}
+#endif /* INET */
+#if INET6
+	case ETHERTYPE_IPV6: {
+		struct ip6_hdr *ip6 = mtod(m, struct ip6_hdr *);
+
+		if (m->m_len < (int)sizeof (*ip6))
+			return (0);
+		bcopy(&ip6->ip6_src, &key.addrs[0], sizeof (ip6->ip6_src));
+		bcopy(&ip6->ip6_dst, &key.addrs[4], sizeof (ip6->ip6_dst));
+		key.proto = ip6->ip6_nxt;
+		if ((ip6->ip6_nxt == IPPROTO_TCP ||
+		    ip6->ip6_nxt == IPPROTO_UDP) &&
+		    m->m_len >= (int)(sizeof (*ip6) + sizeof (key.ports)))
+			l4 = (u_int8_t *)(ip6 + 1);
+		break;
+	}
+#endif /* INET6 */
+	default:
+		return (0);
+	}
+
+	/* Source and destination ports, in place */
+	if (l4 != NULL)
+		bcopy(l4, &key.ports, sizeof (key.ports));
+
+	return (net_flowhash(&key, sizeof (key), dlil_rxq_seed));
+}
+
+/*
+ * Receive steering: split the chain by flow hash across the input
+ * queues of the interface, queueing the packets for queues 1..n-1 and
+ * waking up their threads here.  Returns the packets that belong to
+ * the primary queue, with their tail, count and size.
+ */
+static struct mbuf *
+ifnet_input_steer(struct ifnet *ifp, struct mbuf *m_head,
+    struct mbuf **m_tail, u_int32_t *m_cnt, u_int32_t *m_size)
+{
+	struct {
+		struct mbuf	*head;
+		struct mbuf	*tail;
+		u_int32_t	cnt;
+		u_int32_t	size;
+	} q[IF_RXQ_MAX];
+	struct dlil_threading_info *inp;
+	struct mbuf *m, *n;
+	u_int32_t i, cnt = ifp->if_rxq_cnt;
+
+	VERIFY(cnt > 1 && cnt <= IF_RXQ_MAX);
+	bzero(q, sizeof (q[0]) * cnt);
+
+	for (m = m_head; m != NULL; m = n) {
+		n = mbuf_nextpkt(m);
+		mbuf_setnextpkt(m, NULL);
+
+		i = dlil_rxq_flowhash(ifp, m) % cnt;
+		if (q[i].head == NULL)
+			q[i].head = m;
+		else
+			mbuf_setnextpkt(q[i].tail, m);
+		q[i].tail = m;
+		q[i].cnt++;
+		q[i].size += m_pktlen(m);
+	}
+
+	for (i = 1; i < cnt; i++) {
+		if (q[i].head == NULL)
+			continue;
+
+		inp = &ifp->if_rxq[i - 1];
+		lck_mtx_lock_spin(&inp->input_lck);
+		_addq_multi(&inp->rcvq_pkts, q[i].head, q[i].tail,
+		    q[i].cnt, q[i].size);
+		inp->rxq_stats.packets += q[i].cnt;
+		inp->rxq_stats.bytes += q[i].size;
+		inp->input_waiting |= DLIL_INPUT_WAITING;
+		if (!(inp->input_waiting & DLIL_INPUT_RUNNING)) {
+			inp->wtot++;
+			inp->rxq_wakeups++;
+			wakeup_one((caddr_t)&inp->input_waiting);
+		}
+		lck_mtx_unlock(&inp->input_lck);
+	}
+
+	*m_tail = q[0].tail;
+	*m_cnt = q[0].cnt;
+	*m_size = q[0].size;
+	return (q[0].head);
+}
+
 static errno_t
 ifnet_input_common(struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail,
     const struct ifnet_stat_increment_param *s, boolean_t ext, boolean_t poll)
@@ -2349,6 +2653,16 @@ ifnet_input_common(struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail,
 		    s->packets_in, m_cnt);
 	}
 
+	/*
+	 * Spread the chain across the input queues of the interface, if
+	 * it has more than one; what's left here is for the primary one.
+	 * The driver's statistics are all accounted there.
+	 */
+	if (ifp->if_rxq_cnt > 1 && m_head != NULL) {
+		m_head = ifnet_input_steer(ifp, m_head, &m_tail,
+		    &m_cnt, &m_size);
+	}
+
 	if ((inp = ifp->if_inp) == NULL)
 		inp = dlil_main_input_thread;
 
@@ -2403,6 +2717,8 @@ ifnet_input_common(struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail,
 			_addq_multi(&inp->rcvq_pkts, m_head, m_tail,
 			    m_cnt, m_size);
 		}
+		inp->rxq_stats.packets += m_cnt;
+		inp->rxq_stats.bytes += m_size;
 	}
 
 #if IFNET_INPUT_SANITY_CHK
@@ -2439,6 +2755,7 @@ ifnet_input_common(struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail,
 	inp->input_waiting |= DLIL_INPUT_WAITING;
 	if (!(inp->input_waiting & DLIL_INPUT_RUNNING)) {
 		inp->wtot++;
+		inp->rxq_wakeups++;
 		wakeup_one((caddr_t)&inp->input_waiting);
 	}
 	lck_mtx_unlock(&inp->input_lck);
@@ -3232,19 +3549,565 @@ __private_extern__ void
 dlil_input_packet_list(struct ifnet *ifp, struct mbuf *m)
 {
 	return (dlil_input_packet_list_common(ifp, m, 0,
-	    IFNET_MODEL_INPUT_POLL_OFF, FALSE));
+	    IFNET_MODEL_INPUT_POLL_OFF, FALSE, FALSE));
 }
 
 __private_extern__ void
 dlil_input_packet_list_extended(struct ifnet *ifp, struct mbuf *m,
     u_int32_t cnt, ifnet_model_t mode)
 {
-	return (dlil_input_packet_list_common(ifp, m, cnt, mode, TRUE));
+	return (dlil_input_packet_list_common(ifp, m, cnt, mode, TRUE, FALSE));
+}
+
+/*
+ * Generic receive offload.
+ *
+ * Before a batch dequeued by a dedicated input thread goes up the
+ * stack, in-order TCP segments of the same connection are merged into
+ * one large segment, and consecutive IPv4 fragments of the same UDP
+ * datagram into one large fragment (or the whole datagram.)  Only
+ * packets of the same batch are merged, so nothing is held back and
+ * no timer is needed; the end of the batch is the flush.  A TCP merge
+ * also ends on PSH, on any change of the TCP options (timestamps
+ * included), on an out-of-order or unmergeable segment of the flow,
+ * and at the size limits.
+ *
+ * Merged segments go to tcp_input like the ones built by tcp_lro,
+ * with PKTF_SW_LRO_PKT and the segment count in lro_npkts; the
+ * checksum of every segment has been verified here.  We stay out of
+ * the way of anything that expects to see the packets as they were
+ * received: forwarding, bridging, interface and IP filters, PF, and
+ * tcp_lro itself.
+ */
+#define	DLIL_GRO_FLOWS	8	/* flows being merged at once */
+
+struct dlil_gro_pkt {
+	caddr_t		gp_l3;		/* IP header */
+	struct tcphdr	*gp_th;		/* TCP header, NULL for fragments */
+	u_int32_t	gp_hash;	/* flow hash */
+	u_int16_t	gp_hlen;	/* IP header length */
+	u_int16_t	gp_thlen;	/* TCP header length */
+	u_int16_t	gp_plen;	/* TCP or fragment payload length */
+	u_int8_t	gp_af;		/* AF_INET or AF_INET6 */
+	u_int8_t	gp_ok;		/* checksums good, may be merged */
+};
+
+struct dlil_gro_flow {
+	struct mbuf	*gf_head;	/* packet being built, NULL if free */
+	struct mbuf	*gf_tail;	/* last mbuf of its chain */
+	caddr_t		gf_l3;		/* its IP header */
+	struct tcphdr	*gf_th;		/* its TCP header, NULL for fragments */
+	u_int32_t	gf_hash;	/* flow hash */
+	u_int32_t	gf_next;	/* next sequence number or offset */
+	u_int32_t	gf_len;		/* IP payload length so far */
+	u_int16_t	gf_mss;		/* payload length of the first segment */
+	u_int16_t	gf_maxseg;	/* largest TCP segment merged */
+	u_int8_t	gf_af;
+	u_int8_t	gf_npkts;	/* # of packets merged */
+};
+
+static boolean_t
+dlil_gro_enabled(struct ifnet *ifp)
+{
+	if (!if_gro || ifp->if_type != IFT_ETHER || ifp->if_bridge != NULL ||
+	    !TAILQ_EMPTY(&ifp->if_flt_head) || kipf_count != 0 || sw_lro)
+		return (FALSE);
+#if PF
+	if (PF_IS_ENABLED)
+		return (FALSE);
+#endif /* PF */
+	return (TRUE);
+}
+
+#if INET
+static boolean_t
+dlil_gro_ip_cksum_ok(struct mbuf *m, struct ip *ip)
+{
+	if (m->m_pkthdr.csum_flags & CSUM_IP_CHECKED)
+		return ((m->m_pkthdr.csum_flags & CSUM_IP_VALID) != 0);
+	if (in_cksum_hdr(ip) != 0)
+		return (FALSE);
+	/* Spare ip_input the trouble */
+	m->m_pkthdr.csum_flags |= (CSUM_IP_CHECKED | CSUM_IP_VALID);
+	return (TRUE);
+}
+#endif /* INET */
+
+static boolean_t
+dlil_gro_tcp_cksum_ok(struct mbuf *m, struct dlil_gro_pkt *gp)
+{
+	u_int32_t tlen = gp->gp_thlen + gp->gp_plen;
+
+	/* Full checksum from the hardware, as tcp_input_checksum() */
+	if (hwcksum_rx && (m->m_pkthdr.csum_flags &
+	    (CSUM_DATA_VALID | CSUM_PSEUDO_HDR | CSUM_PARTIAL)) ==
+	    (CSUM_DATA_VALID | CSUM_PSEUDO_HDR))
+		return (m->m_pkthdr.csum_rx_val == 0xffff);
+
+	switch (gp->gp_af) {
+#if INET
+	case AF_INET:
+		return (inet_cksum(m, IPPROTO_TCP, gp->gp_hlen, tlen) == 0);
+#endif /* INET */
+#if INET6
+	case AF_INET6:
+		return (inet6_cksum(m, IPPROTO_TCP, gp->gp_hlen, tlen) == 0);
+#endif /* INET6 */
+	default:
+		return (FALSE);
+	}
+}
+
+/*
+ * Locate the headers of an IPv4 or IPv6 TCP segment, or of an IPv4
+ * UDP fragment, at the front of m; the link-layer header is pkt_hdr.
+ * Returns FALSE if m is neither; otherwise gp_ok tells whether it may
+ * be merged.
+ */
+static boolean_t
+dlil_gro_parse(struct mbuf *m, struct dlil_gro_pkt *gp,
+    struct if_gro_stats *gs)
+{
+	struct ether_header *eh = m->m_pkthdr.pkt_hdr;
+	struct tcphdr *th;
+	u_int32_t tlen;
+	u_int8_t ecn;
+
+	bzero(gp, sizeof (*gp));
+	if (eh == NULL || (m->m_pkthdr.csum_flags & CSUM_VLAN_TAG_VALID))
+		return (FALSE);
+
+	switch (ntohs(eh->ether_type)) {
+#if INET
+	case ETHERTYPE_IP: {
+		struct ip *ip = mtod(m, struct ip *);
+
+		/* No options, and no link-layer padding past ip_len */
+		if (ipforwarding || m->m_len < (int)sizeof (*ip) ||
+		    !IP_HDR_ALIGNED_P(ip) || ip->ip_v != IPVERSION ||
+		    ip->ip_hl != (sizeof (*ip) >> 2) ||
+		    ntohs(ip->ip_len) != m_pktlen(m) ||
+		    ntohs(ip->ip_len) <= (int)sizeof (*ip))
+			return (FALSE);
+
+		gp->gp_af = AF_INET;
+		gp->gp_l3 = (caddr_t)ip;
+		gp->gp_hlen = sizeof (*ip);
+		tlen = ntohs(ip->ip_len) - sizeof (*ip);
+		ecn = ip->ip_tos & IPTOS_ECN_MASK;
+
+		if (ip->ip_off & htons(IP_MF | IP_OFFMASK)) {
+			if (ip->ip_p != IPPROTO_UDP)
+				return (FALSE);
+			gp->gp_hash = ip->ip_src.s_addr ^ ip->ip_dst.s_addr ^
+			    ip->ip_id;
+			gp->gp_plen = tlen;
+			/* All but the last one carry multiples of 8 bytes */
+			if ((ip->ip_off & htons(IP_MF)) && (tlen & 0x7) != 0)
+				return (TRUE);
+			if (!dlil_gro_ip_cksum_ok(m, ip)) {
+				gs->ifi_gro_bad_cksum++;
+				return (TRUE);
+			}
+			gp->gp_ok = 1;
+			return (TRUE);
+		}
+		if (ip->ip_p != IPPROTO_TCP)
+			return (FALSE);
+		gp->gp_hash = ip->ip_src.s_addr ^ ip->ip_dst.s_addr;
+		break;
+	}
+#endif /* INET */
+#if INET6
+	case ETHERTYPE_IPV6: {
+		struct ip6_hdr *ip6 = mtod(m, struct ip6_hdr *);
+		int i;
+
+		/* No extension headers, and no link-layer padding */
+		if (ip6_forwarding || m->m_len < (int)sizeof (*ip6) ||
+		    !IP6_HDR_ALIGNED_P(ip6) ||
+		    (ip6->ip6_vfc & IPV6_VERSION_MASK) != IPV6_VERSION ||
+		    ip6->ip6_nxt != IPPROTO_TCP ||
+		    ntohs(ip6->ip6_plen) + (int)sizeof (*ip6) != m_pktlen(m))
+			return (FALSE);
+
+		gp->gp_af = AF_INET6;
+		gp->gp_l3 = (caddr_t)ip6;
+		gp->gp_hlen = sizeof (*ip6);
+		tlen = ntohs(ip6->ip6_plen);
+		ecn = (ntohl(ip6->ip6_flow) >> 20) & IPTOS_ECN_MASK;
+		for (i = 0; i < 4; i++) {
+			gp->gp_hash ^= ip6->ip6_src.s6_addr32[i] ^
+			    ip6->ip6_dst.s6_addr32[i];
+		}
+		break;
+	}
+#endif /* INET6 */
+	default:
+		return (FALSE);
+	}
+
+	/* The whole TCP header must be in the first mbuf */
+	if (m->m_len < gp->gp_hlen + (int)sizeof (*th))
+		return (FALSE);
+	th = (struct tcphdr *)(void *)(gp->gp_l3 + gp->gp_hlen);
+	gp->gp_thlen = th->th_off << 2;
+	if (gp->gp_thlen < (int)sizeof (*th) || gp->gp_thlen > tlen ||
+	    m->m_len < gp->gp_hlen + gp->gp_thlen)
+		return (FALSE);
+	gp->gp_th = th;
+	gp->gp_plen = tlen - gp->gp_thlen;
+	gp->gp_hash ^= (th->th_sport << 16) | th->th_dport;
+
+	/* Plain data segments only; ECN marks need prompt delivery */
+	if ((th->th_flags & ~(TH_ACK | TH_PUSH)) != 0 ||
+	    !(th->th_flags & TH_ACK) || gp->gp_plen == 0 ||
+	    ecn == IPTOS_ECN_CE)
+		return (TRUE);
+
+	if (
+#if INET
+	    (gp->gp_af == AF_INET &&
+	    !dlil_gro_ip_cksum_ok(m, (struct ip *)(void *)gp->gp_l3)) ||
+#endif /* INET */
+	    !dlil_gro_tcp_cksum_ok(m, gp)) {
+		gs->ifi_gro_bad_cksum++;
+		return (TRUE);
+	}
+	/* Spare tcp_input the trouble */
+	m->m_pkthdr.pkt_flags |= PKTF_SW_LRO_DID_CSUM;
+	gp->gp_ok = 1;
+	return (TRUE);
+}
+
+static boolean_t
+dlil_gro_match(struct dlil_gro_flow *gf, struct dlil_gro_pkt *gp)
+{
+	if (gf->gf_hash != gp->gp_hash || gf->gf_af != gp->gp_af ||
+	    (gf->gf_th == NULL) != (gp->gp_th == NULL))
+		return (FALSE);
+
+	switch (gp->gp_af) {
+#if INET
+	case AF_INET: {
+		struct ip *ip = (struct ip *)(void *)gp->gp_l3;
+		struct ip *fip = (struct ip *)(void *)gf->gf_l3;
+
+		if (ip->ip_src.s_addr != fip->ip_src.s_addr ||
+		    ip->ip_dst.s_addr != fip->ip_dst.s_addr)
+			return (FALSE);
+		if (gp->gp_th == NULL)
+			return (ip->ip_id == fip->ip_id);
+		break;
+	}
+#endif /* INET */
+#if INET6
+	case AF_INET6: {
+		struct ip6_hdr *ip6 = (struct ip6_hdr *)(void *)gp->gp_l3;
+		struct ip6_hdr *fip6 = (struct ip6_hdr *)(void *)gf->gf_l3;
+
+		if (!IN6_ARE_ADDR_EQUAL(&ip6->ip6_src, &fip6->ip6_src) ||
+		    !IN6_ARE_ADDR_EQUAL(&ip6->ip6_dst, &fip6->ip6_dst))
+			return (FALSE);
+		break;
+	}
+#endif /* INET6 */
+	}
+
+	return (gp->gp_th->th_sport == gf->gf_th->th_sport &&
+	    gp->gp_th->th_dport == gf->gf_th->th_dport);
+}
+
+/*
+ * TCP segments may only be merged if their IP headers agree on
+ * everything but the length (and the IPv4 id and checksum.)
+ */
+static boolean_t
+dlil_gro_l3_match(struct dlil_gro_flow *gf, struct dlil_gro_pkt *gp)
+{
+	switch (gp->gp_af) {
+#if INET
+	case AF_INET: {
+		struct ip *ip = (struct ip *)(void *)gp->gp_l3;
+		struct ip *fip = (struct ip *)(void *)gf->gf_l3;
+
+		return (ip->ip_tos == fip->ip_tos &&
+		    ip->ip_ttl == fip->ip_ttl && ip->ip_off == fip->ip_off);
+	}
+#endif /* INET */
+#if INET6
+	case AF_INET6: {
+		struct ip6_hdr *ip6 = (struct ip6_hdr *)(void *)gp->gp_l3;
+		struct ip6_hdr *fip6 = (struct ip6_hdr *)(void *)gf->gf_l3;
+
+		return (ip6->ip6_flow == fip6->ip6_flow &&
+		    ip6->ip6_hlim == fip6->ip6_hlim);
+	}
+#endif /* INET6 */
+	default:
+		return (FALSE);
+	}
+}
+
+static void
+dlil_gro_start(struct dlil_gro_flow *gf, struct mbuf *m,
+    struct dlil_gro_pkt *gp)
+{
+	bzero(gf, sizeof (*gf));
+	gf->gf_head = m;
+	for (gf->gf_tail = m; gf->gf_tail->m_next != NULL; )
+		gf->gf_tail = gf->gf_tail->m_next;
+	gf->gf_l3 = gp->gp_l3;
+	gf->gf_th = gp->gp_th;
+	gf->gf_hash = gp->gp_hash;
+	gf->gf_af = gp->gp_af;
+	gf->gf_len = gp->gp_thlen + gp->gp_plen;
+	gf->gf_npkts = 1;
+
+	if (gp->gp_th != NULL) {
+		gf->gf_next = ntohl(gp->gp_th->th_seq) + gp->gp_plen;
+		gf->gf_mss = gp->gp_plen;
+		gf->gf_maxseg = gp->gp_thlen + gp->gp_plen;
+	} else {
+		struct ip *ip = (struct ip *)(void *)gp->gp_l3;
+
+		gf->gf_next = ((ntohs(ip->ip_off) & IP_OFFMASK) << 3) +
+		    gp->gp_plen;
+	}
+}
+
+/*
+ * Finish the packet built for a flow and free the slot.
+ */
+static void
+dlil_gro_close(struct dlil_gro_flow *gf, struct if_gro_stats *gs)
+{
+	struct mbuf *m = gf->gf_head;
+
+	if (m == NULL)
+		return;
+	gf->gf_head = NULL;
+	if (gf->gf_npkts < 2)
+		return;
+
+	switch (gf->gf_af) {
+#if INET
+	case AF_INET: {
+		struct ip *ip = (struct ip *)(void *)gf->gf_l3;
+
+		ip->ip_len = htons(gf->gf_len + sizeof (*ip));
+		ip->ip_sum = 0;
+		ip->ip_sum = in_cksum_hdr(ip);
+		break;
+	}
+#endif /* INET */
+#if INET6
+	case AF_INET6:
+		((struct ip6_hdr *)(void *)gf->gf_l3)->ip6_plen =
+		    htons(gf->gf_len);
+		break;
+#endif /* INET6 */
+	}
+
+	if (gf->gf_th == NULL) {
+		/* Any partial sums were for the first fragment alone */
+		m->m_pkthdr.csum_flags &=
+		    ~(CSUM_DATA_VALID | CSUM_PARTIAL | CSUM_PSEUDO_HDR);
+		m->m_pkthdr.csum_data = 0;
+		return;
+	}
+
+	m->m_pkthdr.csum_flags &= ~CSUM_PARTIAL;
+	m->m_pkthdr.csum_flags |= (CSUM_DATA_VALID | CSUM_PSEUDO_HDR);
+	m->m_pkthdr.csum_rx_val = 0xffff;
+	m->m_pkthdr.csum_rx_start = 0;
+	m->m_pkthdr.pkt_flags |= (PKTF_SW_LRO_PKT | PKTF_SW_LRO_DID_CSUM);
+	m->m_pkthdr.lro_npkts = gf->gf_npkts;
+	m->m_pkthdr.lro_pktlen = gf->gf_maxseg;
+	m->m_pkthdr.lro_elapsed = 0;
+	gs->ifi_gro_coalesced++;
+}
+
+/*
+ * Append the payload of m to the packet built for its flow.  Returns
+ * FALSE if it doesn't continue that packet.  The flow is closed then,
+ * or when m ends the merge.
+ */
+static boolean_t
+dlil_gro_merge(struct dlil_gro_flow *gf, struct mbuf *m,
+    struct dlil_gro_pkt *gp, u_int32_t max, struct if_gro_stats *gs)
+{
+	struct tcphdr *th = gp->gp_th, *fth = gf->gf_th;
+	boolean_t more = TRUE;
+	u_int32_t limit;
+
+	/* Keep ip_len (or ip6_plen) within 16 bits */
+	limit = IP_MAXPACKET - gp->gp_hlen;
+
+	if (!gp->gp_ok) {
+		gs->ifi_gro_flush_other++;
+		goto close;
+	}
+
+	if (th == NULL) {
+		struct ip *ip = (struct ip *)(void *)gp->gp_l3;
+
+		if (((ntohs(ip->ip_off) & IP_OFFMASK) << 3) != gf->gf_next) {
+			gs->ifi_gro_flush_ooo++;
+			goto close;
+		}
+		if (gf->gf_len + gp->gp_plen > limit) {
+			gs->ifi_gro_flush_limit++;
+			goto close;
+		}
+		if (!(ip->ip_off & htons(IP_MF))) {
+			/* That was the last one; we have the datagram */
+			((struct ip *)(void *)gf->gf_l3)->ip_off &=
+			    ~htons(IP_MF);
+			more = FALSE;
+		}
+		gs->ifi_gro_frag_merged++;
+	} else {
+		if (ntohl(th->th_seq) != gf->gf_next) {
+			gs->ifi_gro_flush_ooo++;
+			goto close;
+		}
+		if (gp->gp_thlen != (fth->th_off << 2) ||
+		    bcmp(th + 1, fth + 1, gp->gp_thlen - sizeof (*th)) != 0) {
+			gs->ifi_gro_flush_opts++;
+			goto close;
+		}
+		if (th->th_ack != fth->th_ack || !dlil_gro_l3_match(gf, gp)) {
+			gs->ifi_gro_flush_other++;
+			goto close;
+		}
+		if (gp->gp_plen > gf->gf_mss || gf->gf_npkts >= max ||
+		    gf->gf_len + gp->gp_plen > limit) {
+			gs->ifi_gro_flush_limit++;
+			goto close;
+		}
+		fth->th_win = th->th_win;
+		if (th->th_flags & TH_PUSH) {
+			fth->th_flags |= TH_PUSH;
+			gs->ifi_gro_flush_psh++;
+			more = FALSE;
+		} else if (gp->gp_plen < gf->gf_mss) {
+			/* A short segment ends the burst */
+			more = FALSE;
+		}
+		gf->gf_maxseg = MAX(gf->gf_maxseg, gp->gp_thlen + gp->gp_plen);
+		gs->ifi_gro_merged++;
+	}
+
+	/* Only the payload goes on; same as tcp_lro_coalesce() */
+	m_adj(m, gp->gp_hlen + gp->gp_thlen);
+	gf->gf_head->m_pkthdr.len += m_pktlen(m);
+	gf->gf_tail->m_next = m;
+	for (gf->gf_tail = m; gf->gf_tail->m_next != NULL; )
+		gf->gf_tail = gf->gf_tail->m_next;
+	gf->gf_len += gp->gp_plen;
+	gf->gf_next += gp->gp_plen;
+	gf->gf_npkts++;
+
+	if (!more)
+		dlil_gro_close(gf, gs);
+	return (TRUE);
+
+close:
+	dlil_gro_close(gf, gs);
+	return (FALSE);
+}
+
+/*
+ * Run a batch of packets from one input queue through receive offload.
+ * Returns what's left of it, with m_cnt updated.
+ */
+static struct mbuf *
+dlil_gro_input(struct dlil_threading_info *inp, struct mbuf *m_head,
+    u_int32_t *m_cnt)
+{
+	struct dlil_gro_flow flows[DLIL_GRO_FLOWS], *gf;
+	struct dlil_gro_pkt gp;
+	struct if_gro_stats gs, *igs;
+	struct mbuf *m, *n, *head = NULL, **tailp = &head;
+	u_int32_t i, cnt = 0, evict = 0, max;
+
+	bzero(flows, sizeof (flows));
+	bzero(&gs, sizeof (gs));
+	max = MIN(if_gro_max, UINT8_MAX);	/* for lro_npkts */
+
+	for (m = m_head; m != NULL; m = n) {
+		n = mbuf_nextpkt(m);
+		mbuf_setnextpkt(m, NULL);
+
+		/* These are ours to set; see dlil_input_packet_list_common */
+		m->m_pkthdr.pkt_flags &=
+		    ~(PKTF_SW_LRO_PKT | PKTF_SW_LRO_DID_CSUM);
+
+		if (!dlil_gro_parse(m, &gp, &gs))
+			goto deliver;
+
+		for (gf = NULL, i = 0; i < DLIL_GRO_FLOWS; i++) {
+			if (flows[i].gf_head != NULL &&
+			    dlil_gro_match(&flows[i], &gp)) {
+				gf = &flows[i];
+				break;
+			}
+		}
+		if (gf != NULL && dlil_gro_merge(gf, m, &gp, max, &gs))
+			continue;
+
+		/*
+		 * Start a new merge with this one, if it may lead to one;
+		 * a PSH segment ends a burst, so nothing may follow it.
+		 */
+		if (!gp.gp_ok || (gp.gp_th == NULL &&
+		    !(((struct ip *)(void *)gp.gp_l3)->ip_off & htons(IP_MF))))
+			goto deliver;
+		if (gp.gp_th != NULL && (gp.gp_th->th_flags & TH_PUSH))
+			goto deliver;
+		for (gf = NULL, i = 0; i < DLIL_GRO_FLOWS; i++) {
+			if (flows[i].gf_head == NULL) {
+				gf = &flows[i];
+				break;
+			}
+		}
+		if (gf == NULL) {
+			gf = &flows[evict];
+			evict = (evict + 1) % DLIL_GRO_FLOWS;
+			dlil_gro_close(gf, &gs);
+			gs.ifi_gro_flush_limit++;
+		}
+		dlil_gro_start(gf, m, &gp);
+deliver:
+		*tailp = m;
+		tailp = &m->m_nextpkt;
+		cnt++;
+	}
+
+	for (i = 0; i < DLIL_GRO_FLOWS; i++)
+		dlil_gro_close(&flows[i], &gs);
+
+	lck_mtx_lock_spin(&inp->input_lck);
+	igs = &inp->gro_stats;
+	igs->ifi_gro_merged += gs.ifi_gro_merged;
+	igs->ifi_gro_coalesced += gs.ifi_gro_coalesced;
+	igs->ifi_gro_frag_merged += gs.ifi_gro_frag_merged;
+	igs->ifi_gro_flush_psh += gs.ifi_gro_flush_psh;
+	igs->ifi_gro_flush_opts += gs.ifi_gro_flush_opts;
+	igs->ifi_gro_flush_ooo += gs.ifi_gro_flush_ooo;
+	igs->ifi_gro_flush_limit += gs.ifi_gro_flush_limit;
+	igs->ifi_gro_flush_other += gs.ifi_gro_flush_other;
+	igs->ifi_gro_bad_cksum += gs.ifi_gro_bad_cksum;
+	lck_mtx_unlock(&inp->input_lck);
+
+	*m_cnt = cnt;
+	return (head);
 }
 
 static void
 dlil_input_packet_list_common(struct ifnet *ifp_param, struct mbuf *m,
-    u_int32_t cnt, ifnet_model_t mode, boolean_t ext)
+    u_int32_t cnt, ifnet_model_t mode, boolean_t ext, boolean_t gro)
 {
 	int				error = 0;
 	protocol_family_t		protocol_family;
@@ -3293,7 +4156,12 @@ dlil_input_packet_list_common(struct ifnet *ifp_param, struct mbuf *m,
 				goto next;
 			}
 			iorefcnt = 1;
-			pktf_mask = 0;
+			/*
+			 * Keep what dlil_gro_input() found out about the
+			 * packet; it clears these flags on everything else.
+			 */
+			pktf_mask = gro ?
+			    (PKTF_SW_LRO_PKT | PKTF_SW_LRO_DID_CSUM) : 0;
 		} else {
 			/*
 			 * If this arrived on lo0, preserve interface addr
@@ -3761,6 +4629,23 @@ preout_again:
 #endif
 
 	do {
+		/*
+		 * Cut a TSO super-segment into MSS sized segments if the
+		 * interface can't; the rest of them go to the front of
+		 * the list and share this one's link-layer destination.
+		 */
+		if (raw == 0 && (GSO_IPV4_OK(ifp, m) || GSO_IPV6_OK(ifp, m))) {
+			struct mbuf *last;
+
+			if ((m = dlil_gso_segment(ifp, m, &retval)) == NULL)
+				goto next;
+			for (last = m; last->m_nextpkt != NULL; )
+				last = last->m_nextpkt;
+			last->m_nextpkt = packetlist;
+			packetlist = m->m_nextpkt;
+			m->m_nextpkt = NULL;
+		}
+
 #if CONFIG_DTRACE
 		if (!raw && proto_family == PF_INET) {
 			struct ip *ip = mtod(m, struct ip*);
@@ -5027,6 +5912,7 @@ ifnet_attach(ifnet_t ifp, const struct sockaddr_dl *ll_addr)
 			    "err=%d", __func__, ifp, err);
 			/* NOTREACHED */
 		}
+		dlil_rxq_attach(ifp, dl_if);
 	}
 
 	/*
@@ -5645,6 +6531,9 @@ ifnet_detach_final(struct ifnet *ifp)
 	if ((inp = ifp->if_inp) != NULL) {
 		VERIFY(inp != dlil_main_input_thread);
 
+		/* Secondary input queues go first; nothing steers to them */
+		dlil_rxq_detach(ifp);
+
 		if (inp->net_affinity) {
 			struct thread *tp, *wtp, *ptp;
 
@@ -6436,6 +7325,26 @@ sysctl_rcvq_maxlen SYSCTL_HANDLER_ARGS
 	return (err);
 }
 
+static int
+sysctl_rxq_count SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2)
+	u_int32_t i;
+	int err;
+
+	i = if_rxq_count;
+
+	err = sysctl_handle_int(oidp, &i, 0, req);
+	if (err != 0 || req->newptr == USER_ADDR_NULL)
+		return (err);
+
+	if (i > IF_RXQ_MAX)
+		return (EINVAL);
+
+	if_rxq_count = i;
+	return (err);
+}
+
 void
 dlil_node_present(struct ifnet *ifp, struct sockaddr *sa,
     int32_t rssi, int lqm, int npm, u_int8_t srvinfo[48])
@@ -7020,6 +7929,146 @@ try_again:
 	return (flowhash);
 }
 
+/*
+ * Software TCP segmentation.  The super-segment has been through IP,
+ * pf and classification once; here every segment gets a copy of its
+ * headers (read once into a template) followed by a reference to its
+ * slice of the payload, so no data is copied.  Only what differs per
+ * segment is then fixed up: sequence number, lengths, IP ID, FIN/PSH
+ * on all but the last and CWR on all but the first, as TSO hardware
+ * does.  Checksums the interface can compute are left to it, the rest
+ * are computed here over each segment.
+ *
+ * Returns the segments linked through m_nextpkt, or NULL (with the
+ * super-segment freed and *error set) on failure.
+ */
+static struct mbuf *
+dlil_gso_segment(struct ifnet *ifp, struct mbuf *m0, int *error)
+{
+	u_int8_t hdr[(15 << 2) * 2] __attribute__((aligned(8)));
+	struct mbuf *head = NULL, **tail = &head, *m;
+	struct ip *ip = NULL;
+	struct ip6_hdr *ip6 = NULL;
+	struct tcphdr *th;
+	u_int32_t hlen, thlen, hdrlen, len, off, seg, mss, sw_csum, hwcap;
+	u_int32_t csum_flags, nsegs = 0;
+	tcp_seq seq;
+
+	len = m0->m_pkthdr.len;
+	mss = m0->m_pkthdr.tso_segsz;
+	m_copydata(m0, 0, MIN(len, sizeof (hdr)), (caddr_t)hdr);
+
+	if (m0->m_pkthdr.csum_flags & CSUM_TSO_IPV6) {
+		ip6 = (struct ip6_hdr *)(void *)hdr;
+		hlen = sizeof (*ip6);
+		if (len < hlen + sizeof (*th) || ip6->ip6_nxt != IPPROTO_TCP)
+			goto bad;
+		csum_flags = CSUM_TCPIPV6;
+	} else {
+		ip = (struct ip *)(void *)hdr;
+		if (len < sizeof (*ip))
+			goto bad;
+		hlen = IP_VHL_HL(ip->ip_vhl) << 2;
+		if (hlen < sizeof (*ip) || len < hlen + sizeof (*th) ||
+		    ip->ip_p != IPPROTO_TCP)
+			goto bad;
+		csum_flags = CSUM_IP | CSUM_TCP;
+	}
+	th = (struct tcphdr *)(void *)(hdr + hlen);
+	thlen = th->th_off << 2;
+	hdrlen = hlen + thlen;
+	if (thlen < sizeof (*th) || len < hdrlen || mss == 0)
+		goto bad;
+
+	/* What the interface won't do has to be done here */
+	hwcap = hwcksum_tx ? IF_HWASSIST_CSUM_FLAGS(ifp->if_hwassist) : 0;
+	sw_csum = csum_flags & ~hwcap;
+	csum_flags &= hwcap;
+	/* Keep the non-checksum bits, e.g. the VLAN tag */
+	csum_flags |= (m0->m_pkthdr.csum_flags &
+	    ~(IF_HWASSIST_CSUM_MASK | CSUM_TSO_IPV4 | CSUM_TSO_IPV6));
+
+	seq = ntohl(th->th_seq);
+	for (off = hdrlen; off < len; off += seg) {
+		struct tcphdr *nth;
+
+		seg = MIN(mss, len - off);
+
+		if ((m = m_gethdr(M_DONTWAIT, MT_DATA)) == NULL)
+			goto nobufs;
+		*tail = m;
+		tail = &m->m_nextpkt;
+		if (m_dup_pkthdr(m, m0, M_DONTWAIT) == 0)
+			goto nobufs;
+		if (MHLEN < hdrlen + max_linkhdr) {
+			MCLGET(m, M_DONTWAIT);
+			if (!(m->m_flags & M_EXT))
+				goto nobufs;
+		}
+		/* Leave room for the link-layer header */
+		m->m_data += max_linkhdr;
+		bcopy(hdr, mtod(m, caddr_t), hdrlen);
+		m->m_len = hdrlen;
+		if ((m->m_next = m_copym(m0, off, seg, M_DONTWAIT)) == NULL)
+			goto nobufs;
+		m->m_pkthdr.len = hdrlen + seg;
+		m->m_pkthdr.csum_flags = csum_flags;
+		m->m_pkthdr.csum_data = offsetof(struct tcphdr, th_sum);
+		m->m_pkthdr.tso_segsz = 0;
+
+		nth = (struct tcphdr *)(void *)(mtod(m, caddr_t) + hlen);
+		nth->th_seq = htonl(seq + (off - hdrlen));
+		if (off + seg < len)
+			nth->th_flags &= ~(TH_FIN | TH_PUSH);
+		if (off != hdrlen)
+			nth->th_flags &= ~TH_CWR;
+
+		if (ip6 != NULL) {
+			struct ip6_hdr *nip6 = mtod(m, struct ip6_hdr *);
+
+			nip6->ip6_plen = htons(thlen + seg);
+			nth->th_sum = in6_pseudo(&nip6->ip6_src,
+			    &nip6->ip6_dst, htonl(thlen + seg + IPPROTO_TCP));
+			if (sw_csum & CSUM_TCPIPV6) {
+				m->m_pkthdr.csum_flags |= CSUM_TCPIPV6;
+				in6_delayed_cksum(m);
+				m->m_pkthdr.csum_flags &= ~CSUM_TCPIPV6;
+			}
+		} else {
+			struct ip *nip = mtod(m, struct ip *);
+
+			nip->ip_len = htons(hdrlen + seg);
+			if (off != hdrlen)
+				nip->ip_id = ip_randomid();
+			nip->ip_sum = 0;
+			nth->th_sum = in_pseudo(nip->ip_src.s_addr,
+			    nip->ip_dst.s_addr, htons(thlen + seg + IPPROTO_TCP));
+			if (sw_csum != 0) {
+				m->m_pkthdr.csum_flags |= sw_csum;
+				(void) in_finalize_cksum(m, 0, sw_csum);
+				m->m_pkthdr.csum_flags &= ~sw_csum;
+			}
+		}
+		nsegs++;
+	}
+
+	m_freem(m0);
+	gso_packets++;
+	gso_segments += nsegs;
+	return (head);
+
+bad:
+	*error = EINVAL;
+	goto drop;
+nobufs:
+	*error = ENOBUFS;
+drop:
+	if (head != NULL)
+		m_freem_list(head);
+	m_freem(m0);
+	return (NULL);
+}
+
 static void
 dlil_output_cksum_dbg(struct ifnet *ifp, struct mbuf *m, uint32_t hoff,
     protocol_family_t pf)
@@ -7308,8 +8357,8 @@ static struct {
 static void
 dlil_verify_sum16(void)
 {
-	struct mbuf *m;
-	uint8_t *buf;
+	struct mbuf *m, *mc;
+	uint8_t *buf, *cbuf;
 	int n;
 
 	/* Make sure test data plus extra room for alignment fits in cluster */
@@ -7319,6 +8368,10 @@ dlil_verify_sum16(void)
 	MH_ALIGN(m, sizeof (uint32_t));		/* 32-bit starting alignment */
 	buf = mtod(m, uint8_t *);		/* base address */
 
+	/* Destination for the copy-and-sum tests */
+	mc = m_getcl(M_WAITOK, MT_DATA, M_PKTHDR);
+	cbuf = mtod(mc, uint8_t *);
+
 	for (n = 0; n < SUMTBL_MAX; n++) {
 		uint16_t len = sumtbl[n].len;
 		int i;
@@ -7369,10 +8422,37 @@ dlil_verify_sum16(void)
 				    len, i, sum, sumtbl[n].sum);
 				/* NOTREACHED */
 			}
+
+			/* Copy-and-sum, source misaligned by i */
+			bzero(cbuf, len + 1);
+			sum = b_sum16_copy(c, cbuf + 1, len);
+
+			/* Something is horribly broken; stop now */
+			if (sum != sumtbl[n].sum ||
+			    bcmp(cbuf + 1, sumdata, len) != 0) {
+				panic("%s: broken b_sum16_copy for len=%d "
+				    "align=%d sum=0x%04x [expected=0x%04x]\n",
+				    __func__, len, i, sum, sumtbl[n].sum);
+				/* NOTREACHED */
+			}
+
+			/* Copy-and-sum from a chain, by offset */
+			bzero(cbuf, len);
+			sum = m_copydata_sum16(m, i, len, cbuf);
+
+			/* Something is horribly broken; stop now */
+			if (sum != sumtbl[n].sum ||
+			    bcmp(cbuf, sumdata, len) != 0) {
+				panic("%s: broken m_copydata_sum16 for len=%d "
+				    "offset=%d sum=0x%04x [expected=0x%04x]\n",
+				    __func__, len, i, sum, sumtbl[n].sum);
+				/* NOTREACHED */
+			}
 #endif /* INET */
 		}
 	}
 	m_freem(m);
+	m_freem(mc);
 
 	printf("DLIL: SUM16 self-tests PASSED\n");
 }
@@ -172,6 +172,13 @@ struct dlil_threading_info {
 	struct timespec	sample_holdtime; /* sampling holdtime in nsec */
 	struct timespec	sample_lasttime; /* last sampling time in nsec */
 	struct timespec	dbg_lasttime;	/* last debug message time in nsec */
+	/*
+	 * Receive steering (input queues of the same interface).
+	 */
+	u_int32_t	rxq_index;	/* 0 for the primary input thread */
+	struct pktcntr	rxq_stats;	/* packets and bytes queued */
+	u_int64_t	rxq_wakeups;	/* # of times the thread was woken */
+	struct if_gro_stats gro_stats;	/* receive offload statistics */
 #if IFNET_INPUT_SANITY_CHK
 	/*
 	 * For debugging.
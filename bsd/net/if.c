@@ -3706,6 +3706,67 @@ if_copy_rxpoll_stats(struct ifnet *ifp, struct if_rxpoll_stats *if_rs)
 	ifnet_decr_iorefcnt(ifp);
 }
 
+void
+if_copy_rxq_stats(struct ifnet *ifp, struct if_rxq_stats *if_rq)
+{
+	struct dlil_threading_info *inp;
+	u_int32_t i;
+
+	bzero(if_rq, sizeof (*if_rq));
+	if (!ifnet_is_attached(ifp, 1))
+		return;
+
+	/* Queue 0 is the dedicated input thread, if there is one */
+	for (i = 0; i < MAX(ifp->if_rxq_cnt, 1); i++) {
+		inp = (i == 0) ? ifp->if_inp : &ifp->if_rxq[i - 1];
+		if (inp == NULL)
+			break;
+		lck_mtx_lock_spin(&inp->input_lck);
+		if_rq->ifi_rxq[i].ifi_rxq_packets = inp->rxq_stats.packets;
+		if_rq->ifi_rxq[i].ifi_rxq_bytes = inp->rxq_stats.bytes;
+		if_rq->ifi_rxq[i].ifi_rxq_wakeups = inp->rxq_wakeups;
+		lck_mtx_unlock(&inp->input_lck);
+		if_rq->ifi_rxq_count = i + 1;
+	}
+
+	/* Release the IO refcnt */
+	ifnet_decr_iorefcnt(ifp);
+}
+
+void
+if_copy_gro_stats(struct ifnet *ifp, struct if_gro_stats *if_gs)
+{
+	struct dlil_threading_info *inp;
+	struct if_gro_stats *gs;
+	u_int32_t i;
+
+	bzero(if_gs, sizeof (*if_gs));
+	if (!ifnet_is_attached(ifp, 1))
+		return;
+
+	/* Summed over all input queues of the interface */
+	for (i = 0; i < MAX(ifp->if_rxq_cnt, 1); i++) {
+		inp = (i == 0) ? ifp->if_inp : &ifp->if_rxq[i - 1];
+		if (inp == NULL)
+			break;
+		lck_mtx_lock_spin(&inp->input_lck);
+		gs = &inp->gro_stats;
+		if_gs->ifi_gro_merged += gs->ifi_gro_merged;
+		if_gs->ifi_gro_coalesced += gs->ifi_gro_coalesced;
+		if_gs->ifi_gro_frag_merged += gs->ifi_gro_frag_merged;
+		if_gs->ifi_gro_flush_psh += gs->ifi_gro_flush_psh;
+		if_gs->ifi_gro_flush_opts += gs->ifi_gro_flush_opts;
+		if_gs->ifi_gro_flush_ooo += gs->ifi_gro_flush_ooo;
+		if_gs->ifi_gro_flush_limit += gs->ifi_gro_flush_limit;
+		if_gs->ifi_gro_flush_other += gs->ifi_gro_flush_other;
+		if_gs->ifi_gro_bad_cksum += gs->ifi_gro_bad_cksum;
+		lck_mtx_unlock(&inp->input_lck);
+	}
+
+	/* Release the IO refcnt */
+	ifnet_decr_iorefcnt(ifp);
+}
+
 struct ifaddr *
 ifa_remref(struct ifaddr *ifa, int locked)
 {
@@ -77,6 +77,8 @@ struct ifmibdata_supplemental {
 	struct if_data_extended	ifmd_data_extended;
 	struct if_packet_stats	ifmd_packet_stats;
 	struct if_rxpoll_stats	ifmd_rxpoll_stats;
+	struct if_rxq_stats	ifmd_rxq_stats;
+	struct if_gro_stats	ifmd_gro_stats;
 };
 #endif /* PRIVATE */
 
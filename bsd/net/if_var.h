@@ -326,6 +326,30 @@ struct if_rxpoll_stats {
 	u_int32_t	ifi_poll_packets_limit;	/* max packets per poll call */
 	u_int64_t	ifi_poll_interval_time;	/* poll interval (nsec) */
 };
+
+#define	IF_RXQ_MAX	16	/* max input queues per interface */
+
+struct if_rxq_stats {
+	u_int32_t	ifi_rxq_count;		/* # of input queues in use */
+	u_int32_t	ifi_rxq_pad;
+	struct {
+		u_int64_t	ifi_rxq_packets; /* packets queued */
+		u_int64_t	ifi_rxq_bytes;	/* bytes queued */
+		u_int64_t	ifi_rxq_wakeups; /* input thread wakeups */
+	} ifi_rxq[IF_RXQ_MAX];
+};
+
+struct if_gro_stats {
+	u_int64_t	ifi_gro_merged;		/* TCP segments merged */
+	u_int64_t	ifi_gro_coalesced;	/* coalesced TCP segments built */
+	u_int64_t	ifi_gro_frag_merged;	/* IPv4 fragments merged */
+	u_int64_t	ifi_gro_flush_psh;	/* merges ended by PSH */
+	u_int64_t	ifi_gro_flush_opts;	/* ... by TCP option change */
+	u_int64_t	ifi_gro_flush_ooo;	/* ... by out-of-order segment */
+	u_int64_t	ifi_gro_flush_limit;	/* ... by size or flow limit */
+	u_int64_t	ifi_gro_flush_other;	/* ... by unmergeable segment */
+	u_int64_t	ifi_gro_bad_cksum;	/* segments with bad checksum */
+};
 #endif /* PRIVATE */
 
 #pragma pack()
@@ -621,6 +645,8 @@ struct ifnet {
 	struct thread		*if_poll_thread;
 
 	struct dlil_threading_info *if_inp;
+	struct dlil_threading_info *if_rxq;	/* input queues 1..n-1 */
+	u_int32_t		if_rxq_cnt;	/* # of input queues, or 0 */
 
 	struct	ifprefixhead	if_prefixhead;	/* list of prefixes per if */
 	struct {
@@ -989,10 +1015,30 @@ struct ifmultiaddr {
 	((_ifp)->if_subfamily == IFNET_SUBFAMILY_WIFI ||		\
 	(_ifp)->if_delegated.subfamily == IFNET_SUBFAMILY_WIFI)
 
+/*
+ * Software TCP segmentation (GSO).  With if_gso set, TCP builds TSO
+ * super-segments for interfaces without hardware TSO as well, and
+ * dlil_output() cuts them into MSS sized segments just before the
+ * driver.  Loopback gains nothing from it and is left out.
+ */
+#define	IFNET_GSO_CAPABLE(_ifp)						\
+	(if_gso != 0 && !((_ifp)->if_flags & IFF_LOOPBACK))
+
+#define	GSO_IPV4_OK(_ifp, _m)						\
+	(!((_ifp)->if_hwassist & IFNET_TSO_IPV4) &&			\
+	IFNET_GSO_CAPABLE(_ifp) &&					\
+	((_m)->m_pkthdr.csum_flags & CSUM_TSO_IPV4))
+
+#define	GSO_IPV6_OK(_ifp, _m)						\
+	(!((_ifp)->if_hwassist & IFNET_TSO_IPV6) &&			\
+	IFNET_GSO_CAPABLE(_ifp) &&					\
+	((_m)->m_pkthdr.csum_flags & CSUM_TSO_IPV6))
+
 extern struct ifnethead ifnet_head;
 extern struct ifnet **ifindex2ifnet;
 extern u_int32_t if_sndq_maxlen;
 extern u_int32_t if_rcvq_maxlen;
+extern u_int32_t if_gso;
 extern int if_index;
 extern struct ifaddr **ifnet_addrs;
 extern lck_attr_t *ifa_mtx_attr;
@@ -1131,6 +1177,10 @@ __private_extern__ void if_copy_packet_stats(struct ifnet *ifp,
     struct if_packet_stats *if_ps);
 __private_extern__ void if_copy_rxpoll_stats(struct ifnet *ifp,
     struct if_rxpoll_stats *if_rs);
+__private_extern__ void if_copy_rxq_stats(struct ifnet *ifp,
+    struct if_rxq_stats *if_rq);
+__private_extern__ void if_copy_gro_stats(struct ifnet *ifp,
+    struct if_gro_stats *if_gs);
 
 __private_extern__ struct rtentry *ifnet_cached_rtlookup_inet(struct ifnet *,
     struct in_addr);
@@ -7788,7 +7788,7 @@ pf_route(struct mbuf **m, struct pf_rule *r, int dir, struct ifnet *oifp,
 	    &sw_csum);
 
 	if (ntohs(ip->ip_len) <= ifp->if_mtu || TSO_IPV4_OK(ifp, m0) ||
-	    (!(ip->ip_off & htons(IP_DF)) &&
+	    GSO_IPV4_OK(ifp, m0) || (!(ip->ip_off & htons(IP_DF)) &&
 	    (ifp->if_hwassist & CSUM_FRAGMENT))) {
 		ip->ip_sum = 0;
 		if (sw_csum & CSUM_DELAY_IP) {
@@ -63,6 +63,9 @@
 #include <kern/debug.h>
 #include <netinet/in.h>
 #include <libkern/libkern.h>
+#if defined(__x86_64__)
+#include <machine/machine_routines.h>
+#endif /* __x86_64__ */
 
 int cpu_in_cksum(struct mbuf *, int, int, uint32_t);
 
@@ -86,6 +89,11 @@ int cpu_in_cksum(struct mbuf *, int, int, uint32_t);
  * Both versions are unrolled to handle 32 Byte / 64 Byte fragments as core
  * of the inner loop. After each iteration of the inner loop, a partial
  * reduction is done to avoid carry in long packets.
+ *
+ * On x86_64, long spans are handed to the vector kernels behind
+ * ml_cksum_simd(), which produce the same 32-bit word sum the inner
+ * loop would.  The 64-bit version begins one vector section for the
+ * whole request, so a long chain pays for entering it once.
  */
 
 #if ULONG_MAX == 0xffffffffUL
@@ -244,6 +252,9 @@ cpu_in_cksum(struct mbuf *m, int len, int off, uint32_t initial_sum)
 	unsigned int final_acc;
 	uint8_t *data;
 	boolean_t needs_swap, started_on_odd;
+#if defined(__x86_64__)
+	ml_cksum_simd_t cs;
+#endif /* __x86_64__ */
 
 	VERIFY(len >= 0);
 	VERIFY(off >= 0);
@@ -251,6 +262,10 @@ cpu_in_cksum(struct mbuf *m, int len, int off, uint32_t initial_sum)
 	needs_swap = FALSE;
 	started_on_odd = FALSE;
 	sum = initial_sum;
+#if defined(__x86_64__)
+	/* Nothing is entered until a span is long enough */
+	(void) ml_cksum_simd_begin(&cs, len);
+#endif /* __x86_64__ */
 
 	for (;;) {
 		if (PREDICT_FALSE(m == NULL)) {
@@ -271,6 +286,9 @@ cpu_in_cksum(struct mbuf *m, int len, int off, uint32_t initial_sum)
 
 	for (; len > 0; m = m->m_next) {
 		if (PREDICT_FALSE(m == NULL)) {
+#if defined(__x86_64__)
+			ml_cksum_simd_end(&cs);
+#endif /* __x86_64__ */
 			printf("%s: out of data\n", __func__);
 			return (-1);
 		}
@@ -303,6 +321,23 @@ post_initial_offset:
 			data += 2;
 			mlen -= 2;
 		}
+#if defined(__x86_64__)
+		if (mlen >= ML_CKSUM_SIMD_SPAN_MIN) {
+			size_t done;
+
+			partial += ml_cksum_simd(&cs, data, mlen, &done);
+			data += done;
+			mlen -= (int)done;
+			if (PREDICT_FALSE(partial & (3ULL << 62))) {
+				if (needs_swap)
+					partial = (partial << 8) +
+					    (partial >> 56);
+				sum += (partial >> 32);
+				sum += (partial & 0xffffffff);
+				partial = 0;
+			}
+		}
+#endif /* __x86_64__ */
 		while (mlen >= 64) {
 			__builtin_prefetch(data + 32);
 			__builtin_prefetch(data + 64);
@@ -387,6 +422,9 @@ trailing_bytes:
 		 */
 		sum = (sum >> 32) + (sum & 0xffffffff);
 	}
+#if defined(__x86_64__)
+	ml_cksum_simd_end(&cs);
+#endif /* __x86_64__ */
 	final_acc = (sum >> 48) + ((sum >> 32) & 0xffff) +
 	    ((sum >> 16) & 0xffff) + (sum & 0xffff);
 	final_acc = (final_acc >> 16) + (final_acc & 0xffff);
@@ -69,6 +69,9 @@
 #define	_IP_VHL
 #include <netinet/ip.h>
 #include <netinet/ip_var.h>
+#if defined(__x86_64__)
+#include <machine/machine_routines.h>
+#endif /* __x86_64__ */
 
 /*
  * Checksum routine for Internet Protocol family headers (Portable Version).
@@ -258,6 +261,26 @@ in_cksumdata(const void *buf, int mlen)
 		data += 2;
 		mlen -= 2;
 	}
+#if defined(__x86_64__)
+	if (mlen >= ML_CKSUM_SIMD_MIN) {
+		ml_cksum_simd_t cs;
+		size_t done;
+
+		(void) ml_cksum_simd_begin(&cs, mlen);
+		partial += ml_cksum_simd(&cs, data, mlen, &done);
+		ml_cksum_simd_end(&cs);
+		data += done;
+		mlen -= (int)done;
+		if (PREDICT_FALSE(partial & (3ULL << 62))) {
+			if (needs_swap)
+				partial = (partial << 8) +
+				    (partial >> 56);
+			sum += (partial >> 32);
+			sum += (partial & 0xffffffff);
+			partial = 0;
+		}
+	}
+#endif /* __x86_64__ */
 	while (mlen >= 64) {
 		__builtin_prefetch(data + 32);
 		__builtin_prefetch(data + 64);
@@ -356,6 +379,125 @@ b_sum16(const void *buf, int len)
 	return (in_cksumdata(buf, len));
 }
 
+/*
+ * Copy a contiguous span and return its 16-bit 1's complement sum.
+ * csp is the vector section of the request the span belongs to, or
+ * NULL where there are no vector kernels.
+ */
+static uint16_t
+b_sum16_copy_span(const void *src, void *dst, int len, void *csp)
+{
+	uint64_t sum = 0;
+	size_t done = 0;
+
+#if defined(__x86_64__)
+	sum = ml_cksum_copy_simd(csp, src, dst, len, &done);
+#else
+#pragma unused(csp)
+#endif /* __x86_64__ */
+	if ((size_t)len > done) {
+		/* done is a multiple of 64; the remainder starts even */
+		bcopy((const uint8_t *)src + done, (uint8_t *)dst + done,
+		    len - done);
+		sum += in_cksumdata((uint8_t *)dst + done, (int)(len - done));
+	}
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+
+	return (sum);
+}
+
+/*
+ * Copy a contiguous span and return the 16-bit 1's complement sum of
+ * it, as b_sum16() would on the destination.  Where the vector kernels
+ * are available the bulk of the data is summed on its way through the
+ * registers, rather than being brought back in from the cache.
+ */
+uint16_t
+b_sum16_copy(const void *src, void *dst, int len)
+{
+	void *csp = NULL;
+	uint16_t sum;
+#if defined(__x86_64__)
+	ml_cksum_simd_t cs;
+#endif /* __x86_64__ */
+
+	VERIFY(len >= 0);
+
+#if defined(__x86_64__)
+	(void) ml_cksum_simd_begin(&cs, len);
+	csp = &cs;
+#endif /* __x86_64__ */
+	sum = b_sum16_copy_span(src, dst, len, csp);
+#if defined(__x86_64__)
+	ml_cksum_simd_end(&cs);
+#endif /* __x86_64__ */
+
+	return (sum);
+}
+
+/*
+ * Copy len bytes at offset off in an mbuf chain into a contiguous
+ * buffer, like m_copydata(), returning the 16-bit 1's complement sum
+ * of the data copied, like m_sum16() would over the same span.  The
+ * vector section, if any, is entered once for the whole chain.
+ */
+uint16_t
+m_copydata_sum16(struct mbuf *m, int off, int len, void *vp)
+{
+	uint8_t *cp = vp;
+	uint32_t sum = 0, s;
+	boolean_t odd = FALSE;
+	void *csp = NULL;
+	int count;
+#if defined(__x86_64__)
+	ml_cksum_simd_t cs;
+#endif /* __x86_64__ */
+
+	if (off < 0 || len < 0)
+		panic("%s: invalid offset %d or len %d", __func__, off, len);
+
+#if defined(__x86_64__)
+	(void) ml_cksum_simd_begin(&cs, len);
+	csp = &cs;
+#endif /* __x86_64__ */
+
+	while (off > 0) {
+		if (m == NULL)
+			panic("%s: invalid mbuf chain", __func__);
+		if (off < m->m_len)
+			break;
+		off -= m->m_len;
+		m = m->m_next;
+	}
+	while (len > 0) {
+		if (m == NULL)
+			panic("%s: invalid mbuf chain", __func__);
+		count = MIN(m->m_len - off, len);
+		s = b_sum16_copy_span(mtod(m, uint8_t *) + off, cp, count,
+		    csp);
+		/* a span starting at an odd offset has its bytes swapped */
+		if (odd)
+			s = ((s & 0xff) << 8) | (s >> 8);
+		sum += s;
+		if (count & 1)
+			odd = !odd;
+		len -= count;
+		cp += count;
+		off = 0;
+		m = m->m_next;
+	}
+#if defined(__x86_64__)
+	ml_cksum_simd_end(&cs);
+#endif /* __x86_64__ */
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+
+	return (sum);
+}
+
 uint16_t inet_cksum_simple(struct mbuf *, int);
 /*
  * For the exported _in_cksum symbol in BSDKernel symbol set.
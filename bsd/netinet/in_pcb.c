@@ -229,9 +229,14 @@ struct inp_flowhash_key {
 };
 
 static u_int32_t inp_hash_seed = 0;
+static u_int32_t inp_lbgroup_seed = 0;
 
 static int infc_cmp(const struct inpcb *, const struct inpcb *);
 
+static boolean_t in_pcblbgroup_eligible(struct inpcb *);
+static void in_pcblbgroup_insert(struct inpcb *);
+static void in_pcblbgroup_remove(struct inpcb *);
+
 /* Flags used by inp_fc_getinp */
 #define	INPFC_SOLOCKED	0x1
 #define	INPFC_REMOVE	0x2
@@ -452,6 +457,21 @@ void
 in_pcbinfo_attach(struct inpcbinfo *ipi)
 {
 	struct inpcbinfo *ipi0;
+	int i;
+
+	_CASSERT(INPCB_HASHLOCKS <= 32 &&
+	    (INPCB_HASHLOCKS & (INPCB_HASHLOCKS - 1)) == 0);
+	/*
+	 * A group and its port's wildcard bucket must share a hash lock;
+	 * every port on a group chain has to land on the same lock.
+	 */
+	VERIFY(ipi->ipi_lbgrouphashbase == NULL ||
+	    ((ipi->ipi_hashmask & (INPCB_HASHLOCKS - 1)) &
+	    ~ipi->ipi_lbgrouphashmask) == 0);
+	for (i = 0; i < INPCB_HASHLOCKS; i++) {
+		lck_rw_init(&ipi->ipi_hashlocks[i].ihl_lock,
+		    ipi->ipi_lock_grp, ipi->ipi_lock_attr);
+	}
 
 	lck_mtx_lock(&inpcb_lock);
 	TAILQ_FOREACH(ipi0, &inpcb_head, ipi_entry) {
@@ -1225,13 +1245,13 @@ in_pcbconnect(struct inpcb *inp, struct sockaddr *nam, struct proc *p,
 			if (error)
 				return (error);
 		}
-		if (!lck_rw_try_lock_exclusive(inp->inp_pcbinfo->ipi_lock)) {
+		if (!lck_rw_try_lock_shared(inp->inp_pcbinfo->ipi_lock)) {
 			/*
 			 * Lock inversion issue, mostly with udp
 			 * multicast packets.
 			 */
 			socket_unlock(inp->inp_socket, 0);
-			lck_rw_lock_exclusive(inp->inp_pcbinfo->ipi_lock);
+			lck_rw_lock_shared(inp->inp_pcbinfo->ipi_lock);
 			socket_lock(inp->inp_socket, 0);
 		}
 		inp->inp_laddr = laddr;
@@ -1239,13 +1259,13 @@ in_pcbconnect(struct inpcb *inp, struct sockaddr *nam, struct proc *p,
 		inp->inp_last_outifp = (outif != NULL) ? *outif : NULL;
 		inp->inp_flags |= INP_INADDR_ANY;
 	} else {
-		if (!lck_rw_try_lock_exclusive(inp->inp_pcbinfo->ipi_lock)) {
+		if (!lck_rw_try_lock_shared(inp->inp_pcbinfo->ipi_lock)) {
 			/*
 			 * Lock inversion issue, mostly with udp
 			 * multicast packets.
 			 */
 			socket_unlock(inp->inp_socket, 0);
-			lck_rw_lock_exclusive(inp->inp_pcbinfo->ipi_lock);
+			lck_rw_lock_shared(inp->inp_pcbinfo->ipi_lock);
 			socket_lock(inp->inp_socket, 0);
 		}
 	}
@@ -1264,10 +1284,10 @@ in_pcbdisconnect(struct inpcb *inp)
 	inp->inp_faddr.s_addr = INADDR_ANY;
 	inp->inp_fport = 0;
 
-	if (!lck_rw_try_lock_exclusive(inp->inp_pcbinfo->ipi_lock)) {
+	if (!lck_rw_try_lock_shared(inp->inp_pcbinfo->ipi_lock)) {
 		/* lock inversion issue, mostly with udp multicast packets */
 		socket_unlock(so, 0);
-		lck_rw_lock_exclusive(inp->inp_pcbinfo->ipi_lock);
+		lck_rw_lock_shared(inp->inp_pcbinfo->ipi_lock);
 		socket_lock(so, 0);
 	}
 
@@ -1718,6 +1738,8 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 {
 	struct inpcbhead *head;
 	struct inpcb *inp;
+	lck_rw_t *lck;
+	u_int32_t idx;
 	u_short fport = fport_arg, lport = lport_arg;
 	int found = 0;
 	struct inpcb *local_wild = NULL;
@@ -1732,13 +1754,12 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	 * We may have found the pcb in the last lookup - check this first.
 	 */
 
-	lck_rw_lock_shared(pcbinfo->ipi_lock);
-
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr.s_addr, lport, fport,
-	    pcbinfo->ipi_hashmask)];
+	idx = INP_PCBHASH(faddr.s_addr, lport, fport, pcbinfo->ipi_hashmask);
+	lck = in_pcbhash_lock_shared(pcbinfo, idx, NULL);
+	head = &pcbinfo->ipi_hashbase[idx];
 	LIST_FOREACH(inp, head, inp_hash) {
 #if INET6
 		if (!(inp->inp_vflag & INP_IPV4))
@@ -1764,7 +1785,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 				*gid = kauth_cred_getgid(
 				    inp->inp_socket->so_cred);
 			}
-			lck_rw_done(pcbinfo->ipi_lock);
+			lck_rw_done(lck);
 			return (found);
 		}
 	}
@@ -1773,12 +1794,17 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 		/*
 		 * Not found.
 		 */
-		lck_rw_done(pcbinfo->ipi_lock);
+		lck_rw_done(lck);
 		return (0);
 	}
 
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-	    pcbinfo->ipi_hashmask)];
+	/*
+	 * The wildcard bucket (and the port's group) may be under
+	 * another hash lock.
+	 */
+	idx = INP_PCBHASH(INADDR_ANY, lport, 0, pcbinfo->ipi_hashmask);
+	lck = in_pcbhash_lock_shared(pcbinfo, idx, lck);
+	head = &pcbinfo->ipi_hashbase[idx];
 	LIST_FOREACH(inp, head, inp_hash) {
 #if INET6
 		if (!(inp->inp_vflag & INP_IPV4))
@@ -1800,7 +1826,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 					*gid = kauth_cred_getgid(
 					    inp->inp_socket->so_cred);
 				}
-				lck_rw_done(pcbinfo->ipi_lock);
+				lck_rw_done(lck);
 				return (found);
 			} else if (inp->inp_laddr.s_addr == INADDR_ANY) {
 #if INET6
@@ -1822,11 +1848,11 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 				*gid = kauth_cred_getgid(
 				    local_wild_mapped->inp_socket->so_cred);
 			}
-			lck_rw_done(pcbinfo->ipi_lock);
+			lck_rw_done(lck);
 			return (found);
 		}
 #endif /* INET6 */
-		lck_rw_done(pcbinfo->ipi_lock);
+		lck_rw_done(lck);
 		return (0);
 	}
 	if ((found = (local_wild->inp_socket != NULL))) {
@@ -1835,7 +1861,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 		*gid = kauth_cred_getgid(
 		    local_wild->inp_socket->so_cred);
 	}
-	lck_rw_done(pcbinfo->ipi_lock);
+	lck_rw_done(lck);
 	return (found);
 }
 
@@ -1849,6 +1875,8 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 {
 	struct inpcbhead *head;
 	struct inpcb *inp;
+	lck_rw_t *lck;
+	u_int32_t idx;
 	u_short fport = fport_arg, lport = lport_arg;
 	struct inpcb *local_wild = NULL;
 #if INET6
@@ -1859,13 +1887,12 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	 * We may have found the pcb in the last lookup - check this first.
 	 */
 
-	lck_rw_lock_shared(pcbinfo->ipi_lock);
-
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr.s_addr, lport, fport,
-	    pcbinfo->ipi_hashmask)];
+	idx = INP_PCBHASH(faddr.s_addr, lport, fport, pcbinfo->ipi_hashmask);
+	lck = in_pcbhash_lock_shared(pcbinfo, idx, NULL);
+	head = &pcbinfo->ipi_hashbase[idx];
 	LIST_FOREACH(inp, head, inp_hash) {
 #if INET6
 		if (!(inp->inp_vflag & INP_IPV4))
@@ -1887,11 +1914,11 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 			 */
 			if (in_pcb_checkstate(inp, WNT_ACQUIRE, 0) !=
 			    WNT_STOPUSING) {
-				lck_rw_done(pcbinfo->ipi_lock);
+				lck_rw_done(lck);
 				return (inp);
 			} else {
 				/* it's there but dead, say it isn't found */
-				lck_rw_done(pcbinfo->ipi_lock);
+				lck_rw_done(lck);
 				return (NULL);
 			}
 		}
@@ -1901,12 +1928,38 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 		/*
 		 * Not found.
 		 */
-		lck_rw_done(pcbinfo->ipi_lock);
+		lck_rw_done(lck);
 		return (NULL);
 	}
 
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-	    pcbinfo->ipi_hashmask)];
+	/*
+	 * The wildcard bucket (and the port's group) may be under
+	 * another hash lock.
+	 */
+	idx = INP_PCBHASH(INADDR_ANY, lport, 0, pcbinfo->ipi_hashmask);
+	lck = in_pcbhash_lock_shared(pcbinfo, idx, lck);
+
+	/*
+	 * Then for a load balancing group.
+	 */
+	if (pcbinfo->ipi_lbgrouphashbase != NULL) {
+		struct in_addr_4in6 laddr46, faddr46;
+
+		bzero(&laddr46, sizeof (laddr46));
+		bzero(&faddr46, sizeof (faddr46));
+		laddr46.ia46_addr4 = laddr;
+		faddr46.ia46_addr4 = faddr;
+		inp = in_pcblbgroup_lookup(pcbinfo, INP_IPV4,
+		    (struct in6_addr *)&laddr46, lport,
+		    (struct in6_addr *)&faddr46, fport, ifp);
+		if (inp != NULL &&
+		    in_pcb_checkstate(inp, WNT_ACQUIRE, 0) != WNT_STOPUSING) {
+			lck_rw_done(lck);
+			return (inp);
+		}
+	}
+
+	head = &pcbinfo->ipi_hashbase[idx];
 	LIST_FOREACH(inp, head, inp_hash) {
 #if INET6
 		if (!(inp->inp_vflag & INP_IPV4))
@@ -1924,11 +1977,11 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 			if (inp->inp_laddr.s_addr == laddr.s_addr) {
 				if (in_pcb_checkstate(inp, WNT_ACQUIRE, 0) !=
 				    WNT_STOPUSING) {
-					lck_rw_done(pcbinfo->ipi_lock);
+					lck_rw_done(lck);
 					return (inp);
 				} else {
 					/* it's dead; say it isn't found */
-					lck_rw_done(pcbinfo->ipi_lock);
+					lck_rw_done(lck);
 					return (NULL);
 				}
 			} else if (inp->inp_laddr.s_addr == INADDR_ANY) {
@@ -1946,31 +1999,333 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 		if (local_wild_mapped != NULL) {
 			if (in_pcb_checkstate(local_wild_mapped,
 			    WNT_ACQUIRE, 0) != WNT_STOPUSING) {
-				lck_rw_done(pcbinfo->ipi_lock);
+				lck_rw_done(lck);
 				return (local_wild_mapped);
 			} else {
 				/* it's dead; say it isn't found */
-				lck_rw_done(pcbinfo->ipi_lock);
+				lck_rw_done(lck);
 				return (NULL);
 			}
 		}
 #endif /* INET6 */
-		lck_rw_done(pcbinfo->ipi_lock);
+		lck_rw_done(lck);
 		return (NULL);
 	}
 	if (in_pcb_checkstate(local_wild, WNT_ACQUIRE, 0) != WNT_STOPUSING) {
-		lck_rw_done(pcbinfo->ipi_lock);
+		lck_rw_done(lck);
 		return (local_wild);
 	}
 	/*
 	 * It's either not found or is already dead.
 	 */
-	lck_rw_done(pcbinfo->ipi_lock);
+	lck_rw_done(lck);
 	return (NULL);
 }
 
+/*
+ * Hash a flow onto a member of an SO_REUSEPORT_LB group.  The seed is
+ * separate from inp_hash_seed, which is regenerated on collisions and
+ * would move established flows between members.
+ */
+static u_int32_t
+in_pcblbgroup_hash(const struct in6_addr *laddr, u_short lport,
+    const struct in6_addr *faddr, u_short fport)
+{
+	struct inp_flowhash_key fh __attribute__((aligned(8)));
+
+	if (inp_lbgroup_seed == 0)
+		inp_lbgroup_seed = RandomULong();
+
+	bzero(&fh, sizeof (fh));
+	bcopy(laddr, &fh.infh_laddr, sizeof (fh.infh_laddr));
+	bcopy(faddr, &fh.infh_faddr, sizeof (fh.infh_faddr));
+	fh.infh_lport = lport;
+	fh.infh_fport = fport;
+
+	return (net_flowhash(&fh, sizeof (fh), inp_lbgroup_seed));
+}
+
+/*
+ * Find the SO_REUSEPORT_LB group for a wildcard lookup and pick the
+ * member for this flow.  Addresses are in in_addr_4in6 form for IPv4
+ * lookups (vflag INP_IPV4); as in in_pcblookup_hash() only the last
+ * word is compared then.  Returns NULL if there is no group, or if the
+ * chosen member can't take the flow, in which case the caller falls
+ * back to its ordinary wildcard match.
+ *
+ * Must be called with the hash lock of the port's wildcard bucket held,
+ * shared or exclusive, or with the pcbinfo lock exclusive; the caller
+ * takes its own reference on the returned PCB.
+ */
+struct inpcb *
+in_pcblbgroup_lookup(struct inpcbinfo *pcbinfo, u_char vflag,
+    const struct in6_addr *laddr, u_short lport,
+    const struct in6_addr *faddr, u_short fport, struct ifnet *ifp)
+{
+	struct inpcblbgrouphead *head;
+	struct inpcblbgroup *grp, *local_wild = NULL;
+	struct inpcb *inp;
+	u_int32_t idx;
+
+	if (pcbinfo->ipi_lbgrouphashbase == NULL)
+		return (NULL);
+
+	head = &pcbinfo->ipi_lbgrouphashbase[INP_PCBPORTHASH(lport,
+	    pcbinfo->ipi_lbgrouphashmask)];
+	LIST_FOREACH(grp, head, il_list) {
+		if (grp->il_lport != lport || !(grp->il_vflag & vflag))
+			continue;
+		if (vflag == INP_IPV4) {
+			if (grp->il_laddr.s_addr == laddr->s6_addr32[3])
+				break;
+			if (grp->il_laddr.s_addr != INADDR_ANY)
+				continue;
+		} else {
+			if (IN6_ARE_ADDR_EQUAL(&grp->il6_laddr, laddr))
+				break;
+			if (!IN6_IS_ADDR_UNSPECIFIED(&grp->il6_laddr))
+				continue;
+		}
+		/* prefer a group of the lookup's own family */
+		if (local_wild == NULL || grp->il_vflag == vflag)
+			local_wild = grp;
+	}
+	if (grp == NULL && (grp = local_wild) == NULL)
+		return (NULL);
+
+	VERIFY(grp->il_inpcnt != 0);
+	idx = in_pcblbgroup_hash(laddr, lport, faddr, fport) % grp->il_inpcnt;
+	inp = grp->il_inp[idx];
+
+	if (inp_restricted(inp, ifp))
+		return (NULL);
+	if (ifp != NULL && IFNET_IS_CELLULAR(ifp) &&
+	    (inp->inp_flags & INP_NO_IFT_CELLULAR))
+		return (NULL);
+	/* A member bound but not yet listening can't take a SYN */
+	if (inp->inp_socket->so_type == SOCK_STREAM &&
+	    !(inp->inp_socket->so_options & SO_ACCEPTCONN))
+		return (NULL);
+
+	return (inp);
+}
+
+static boolean_t
+in_pcblbgroup_eligible(struct inpcb *inp)
+{
+	return (inp->inp_pcbinfo->ipi_lbgrouphashbase != NULL &&
+	    (inp->inp_socket->so_flags & SOF_REUSEPORT_LB) &&
+	    inp->inp_lport != 0 &&
+	    IN6_IS_ADDR_UNSPECIFIED(&inp->in6p_faddr));
+}
+
+/*
+ * Add a PCB to the group for its local address and port, creating or
+ * growing the group as needed.  A PCB whose owner differs from the
+ * group's is left out, so another user can't siphon off a share of
+ * the flows; it still gets traffic the group can't take.
+ *
+ * Must be called with the pcbinfo lock held, shared or exclusive, and
+ * the hash lock of the port's wildcard bucket held exclusive.
+ */
+static void
+in_pcblbgroup_insert(struct inpcb *inp)
+{
+	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
+	struct inpcblbgrouphead *head;
+	struct inpcblbgroup *grp, *ngrp;
+	uid_t uid;
+
+	if ((inp->inp_flags2 & INP2_IN_LBGROUP) || !in_pcblbgroup_eligible(inp))
+		return;
+
+	uid = kauth_cred_getuid(inp->inp_socket->so_cred);
+	head = &pcbinfo->ipi_lbgrouphashbase[INP_PCBPORTHASH(inp->inp_lport,
+	    pcbinfo->ipi_lbgrouphashmask)];
+	LIST_FOREACH(grp, head, il_list) {
+		if (grp->il_lport == inp->inp_lport &&
+		    grp->il_vflag == inp->inp_vflag &&
+		    IN6_ARE_ADDR_EQUAL(&grp->il6_laddr, &inp->in6p_laddr))
+			break;
+	}
+
+	if (grp != NULL && grp->il_uid != uid)
+		return;
+
+	if (grp == NULL || grp->il_inpcnt == grp->il_inpsiz) {
+		u_int32_t siz = (grp == NULL) ? INPCBLBGROUP_SIZMIN :
+		    grp->il_inpsiz * 2;
+
+		MALLOC(ngrp, struct inpcblbgroup *, sizeof (*ngrp) +
+		    siz * sizeof (struct inpcb *), M_PCB, M_WAITOK | M_ZERO);
+		if (ngrp == NULL)
+			return;
+		ngrp->il_inpsiz = siz;
+		if (grp != NULL) {
+			ngrp->il_lport = grp->il_lport;
+			ngrp->il_vflag = grp->il_vflag;
+			ngrp->il_uid = grp->il_uid;
+			ngrp->il_dependladdr = grp->il_dependladdr;
+			ngrp->il_inpcnt = grp->il_inpcnt;
+			bcopy(grp->il_inp, ngrp->il_inp,
+			    grp->il_inpcnt * sizeof (struct inpcb *));
+			LIST_REMOVE(grp, il_list);
+			FREE(grp, M_PCB);
+		} else {
+			ngrp->il_lport = inp->inp_lport;
+			ngrp->il_vflag = inp->inp_vflag;
+			ngrp->il_uid = uid;
+			ngrp->il6_laddr = inp->in6p_laddr;
+		}
+		LIST_INSERT_HEAD(head, ngrp, il_list);
+		grp = ngrp;
+	}
+
+	grp->il_inp[grp->il_inpcnt++] = inp;
+	inp->inp_flags2 |= INP2_IN_LBGROUP;
+}
+
+/*
+ * Take a PCB out of its group, freeing the group when it empties.  The
+ * group is found by port alone since the PCB's local address may have
+ * been set by a connect since it joined.  The last member takes the
+ * vacated slot, so only its flows and those of the departing member
+ * move.
+ *
+ * Must be called with the pcbinfo lock held, shared or exclusive, and
+ * the hash lock of the port's wildcard bucket held exclusive.
+ */
+static void
+in_pcblbgroup_remove(struct inpcb *inp)
+{
+	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
+	struct inpcblbgrouphead *head;
+	struct inpcblbgroup *grp;
+	u_int32_t i;
+
+	if (!(inp->inp_flags2 & INP2_IN_LBGROUP))
+		return;
+
+	head = &pcbinfo->ipi_lbgrouphashbase[INP_PCBPORTHASH(inp->inp_lport,
+	    pcbinfo->ipi_lbgrouphashmask)];
+	LIST_FOREACH(grp, head, il_list) {
+		if (grp->il_lport != inp->inp_lport)
+			continue;
+		for (i = 0; i < grp->il_inpcnt; i++) {
+			if (grp->il_inp[i] != inp)
+				continue;
+			grp->il_inp[i] = grp->il_inp[--grp->il_inpcnt];
+			grp->il_inp[grp->il_inpcnt] = NULL;
+			if (grp->il_inpcnt == 0) {
+				LIST_REMOVE(grp, il_list);
+				FREE(grp, M_PCB);
+			}
+			inp->inp_flags2 &= ~INP2_IN_LBGROUP;
+			return;
+		}
+	}
+	panic("%s: inp %p not found in any group\n", __func__, inp);
+	/* NOTREACHED */
+}
+
+/*
+ * Take the hash lock covering bucket idx shared, for a lookup.  The
+ * lock held so far, if any, is dropped unless it is the same one.
+ */
+lck_rw_t *
+in_pcbhash_lock_shared(struct inpcbinfo *pcbinfo, u_int32_t idx,
+    lck_rw_t *held)
+{
+	lck_rw_t *lck = INP_HASHLOCK(pcbinfo, idx);
+
+	if (lck != held) {
+		if (held != NULL)
+			lck_rw_done(held);
+		lck_rw_lock_shared(lck);
+	}
+	return (lck);
+}
+
+/*
+ * The hash locks a change to inp's hash chain (and to its port's
+ * group, if the protocol has groups) needs, as a bitmap.  Bucket
+ * nidx, if different, is the one inp moves to.  If porthash is set,
+ * the lock of inp's port hash bucket is included as well.
+ */
+static u_int32_t
+in_pcbhash_lockset(struct inpcb *inp, u_int32_t nidx, int porthash)
+{
+	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
+	u_int32_t set;
+
+	set = 1U << (inp->inp_hash_element & (INPCB_HASHLOCKS - 1));
+	set |= 1U << (nidx & (INPCB_HASHLOCKS - 1));
+	if (pcbinfo->ipi_lbgrouphashbase != NULL) {
+		set |= 1U << (INP_PCBHASH(INADDR_ANY, inp->inp_lport, 0,
+		    pcbinfo->ipi_hashmask) & (INPCB_HASHLOCKS - 1));
+	}
+	if (porthash) {
+		set |= 1U << (INP_PCBPORTHASH(inp->inp_lport,
+		    pcbinfo->ipi_porthashmask) & (INPCB_HASHLOCKS - 1));
+	}
+	return (set);
+}
+
+/*
+ * Writers hold ipi_lock at least shared, so they can compete with
+ * each other as well as with lookups for the hash locks; taking them
+ * in index order keeps this deadlock free, since lookups hold only
+ * one at a time.
+ */
+static void
+in_pcbhash_lock_exclusive(struct inpcbinfo *pcbinfo, u_int32_t set)
+{
+	int i;
+
+	lck_rw_assert(pcbinfo->ipi_lock, LCK_RW_ASSERT_HELD);
+	for (i = 0; i < INPCB_HASHLOCKS; i++) {
+		if (set & (1U << i))
+			lck_rw_lock_exclusive(&pcbinfo->ipi_hashlocks[i].ihl_lock);
+	}
+}
+
+static void
+in_pcbhash_unlock_exclusive(struct inpcbinfo *pcbinfo, u_int32_t set)
+{
+	int i;
+
+	for (i = 0; i < INPCB_HASHLOCKS; i++) {
+		if (set & (1U << i))
+			lck_rw_done(&pcbinfo->ipi_hashlocks[i].ihl_lock);
+	}
+}
+
+/*
+ * Look up the port hash head for lport; the hash lock of its port
+ * hash bucket must be held.
+ */
+static struct inpcbport *
+in_pcbport_lookup(struct inpcbporthead *pcbporthash, u_short lport)
+{
+	struct inpcbport *phd;
+
+	LIST_FOREACH(phd, pcbporthash, phd_hash) {
+		if (phd->phd_port == lport)
+			break;
+	}
+	return (phd);
+}
+
 /*
  * Insert PCB onto various hash lists.
+ *
+ * Callers that have done bind's conflict checks hold ipi_lock
+ * exclusive (locked is set), so nothing can take the port between
+ * the check and the insert.  Otherwise, as for a connection accepted
+ * on a listener's port, ipi_lock is taken shared here, and inserts
+ * into unrelated buckets proceed in parallel: the hash chain, the
+ * port's group and the port hash bucket are each covered by their
+ * hash lock, taken exclusive.
  */
 int
 in_pcbinshash(struct inpcb *inp, int locked)
@@ -1978,17 +2333,17 @@ in_pcbinshash(struct inpcb *inp, int locked)
 	struct inpcbhead *pcbhash;
 	struct inpcbporthead *pcbporthash;
 	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
-	struct inpcbport *phd;
-	u_int32_t hashkey_faddr;
+	struct inpcbport *phd, *nphd;
+	u_int32_t hashkey_faddr, lockset;
 
 	if (!locked) {
-		if (!lck_rw_try_lock_exclusive(pcbinfo->ipi_lock)) {
+		if (!lck_rw_try_lock_shared(pcbinfo->ipi_lock)) {
 			/*
 			 * Lock inversion issue, mostly with udp
 			 * multicast packets
 			 */
 			socket_unlock(inp->inp_socket, 0);
-			lck_rw_lock_exclusive(pcbinfo->ipi_lock);
+			lck_rw_lock_shared(pcbinfo->ipi_lock);
 			socket_lock(inp->inp_socket, 0);
 			if (inp->inp_state == INPCB_STATE_DEAD) {
 				/*
@@ -2016,34 +2371,45 @@ in_pcbinshash(struct inpcb *inp, int locked)
 	pcbporthash = &pcbinfo->ipi_porthashbase[INP_PCBPORTHASH(inp->inp_lport,
 	    pcbinfo->ipi_porthashmask)];
 
+	VERIFY(inp->inp_state != INPCB_STATE_DEAD);
+
 	/*
 	 * Go through port list and look for a head for this lport.
 	 */
-	LIST_FOREACH(phd, pcbporthash, phd_hash) {
-		if (phd->phd_port == inp->inp_lport)
-			break;
-	}
-
-	VERIFY(inp->inp_state != INPCB_STATE_DEAD);
+	lockset = in_pcbhash_lockset(inp, inp->inp_hash_element, 1);
+	in_pcbhash_lock_exclusive(pcbinfo, lockset);
+	phd = in_pcbport_lookup(pcbporthash, inp->inp_lport);
 
 	/*
-	 * If none exists, malloc one and tack it on.
+	 * If none exists, malloc one and tack it on.  The hash locks
+	 * are dropped around the allocation, so another insert may
+	 * have added one by the time they are retaken.
 	 */
 	if (phd == NULL) {
-		MALLOC(phd, struct inpcbport *, sizeof (struct inpcbport),
+		in_pcbhash_unlock_exclusive(pcbinfo, lockset);
+		MALLOC(nphd, struct inpcbport *, sizeof (struct inpcbport),
 		    M_PCB, M_WAITOK);
-		if (phd == NULL) {
+		if (nphd == NULL) {
 			if (!locked)
 				lck_rw_done(pcbinfo->ipi_lock);
 			return (ENOBUFS); /* XXX */
 		}
-		phd->phd_port = inp->inp_lport;
-		LIST_INIT(&phd->phd_pcblist);
-		LIST_INSERT_HEAD(pcbporthash, phd, phd_hash);
+		in_pcbhash_lock_exclusive(pcbinfo, lockset);
+		phd = in_pcbport_lookup(pcbporthash, inp->inp_lport);
+		if (phd == NULL) {
+			phd = nphd;
+			phd->phd_port = inp->inp_lport;
+			LIST_INIT(&phd->phd_pcblist);
+			LIST_INSERT_HEAD(pcbporthash, phd, phd_hash);
+		} else {
+			FREE(nphd, M_PCB);
+		}
 	}
 	inp->inp_phd = phd;
 	LIST_INSERT_HEAD(&phd->phd_pcblist, inp, inp_portlist);
 	LIST_INSERT_HEAD(pcbhash, inp, inp_hash);
+	in_pcblbgroup_insert(inp);
+	in_pcbhash_unlock_exclusive(pcbinfo, lockset);
 	if (!locked)
 		lck_rw_done(pcbinfo->ipi_lock);
 	return (0);
@@ -2054,12 +2420,15 @@ in_pcbinshash(struct inpcb *inp, int locked)
  * changed. NOTE: This does not handle the case of the lport changing (the
  * hashed port list would have to be updated as well), so the lport must
  * not change after in_pcbinshash() has been called.
+ *
+ * Must be called with the pcbinfo lock held, shared or exclusive.
  */
 void
 in_pcbrehash(struct inpcb *inp)
 {
+	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
 	struct inpcbhead *head;
-	u_int32_t hashkey_faddr;
+	u_int32_t hashkey_faddr, nidx, lockset;
 
 #if INET6
 	if (inp->inp_vflag & INP_IPV6)
@@ -2068,17 +2437,30 @@ in_pcbrehash(struct inpcb *inp)
 #endif /* INET6 */
 		hashkey_faddr = inp->inp_faddr.s_addr;
 
-	inp->inp_hash_element = INP_PCBHASH(hashkey_faddr, inp->inp_lport,
-	    inp->inp_fport, inp->inp_pcbinfo->ipi_hashmask);
-	head = &inp->inp_pcbinfo->ipi_hashbase[inp->inp_hash_element];
+	nidx = INP_PCBHASH(hashkey_faddr, inp->inp_lport, inp->inp_fport,
+	    pcbinfo->ipi_hashmask);
+	head = &pcbinfo->ipi_hashbase[nidx];
 
+	lockset = in_pcbhash_lockset(inp, nidx, 0);
+	in_pcbhash_lock_exclusive(pcbinfo, lockset);
+	inp->inp_hash_element = nidx;
 	LIST_REMOVE(inp, inp_hash);
 	LIST_INSERT_HEAD(head, inp, inp_hash);
+
+	/* Connected PCBs leave their group, disconnected ones rejoin */
+	if (!in_pcblbgroup_eligible(inp))
+		in_pcblbgroup_remove(inp);
+	else
+		in_pcblbgroup_insert(inp);
+	in_pcbhash_unlock_exclusive(pcbinfo, lockset);
 }
 
 /*
  * Remove PCB from various lists.
- * Must be called pcbinfo lock is held in exclusive mode.
+ * Must be called pcbinfo lock is held in exclusive mode, which covers
+ * ipi_listhead, ipi_count and the time-wait queue; the hash and port
+ * hash chains are also covered by their hash locks, taken on top of
+ * it for the benefit of lookups and of inserts holding it shared.
  */
 void
 in_pcbremlists(struct inpcb *inp)
@@ -2087,13 +2469,20 @@ in_pcbremlists(struct inpcb *inp)
 
 	if (inp->inp_lport) {
 		struct inpcbport *phd = inp->inp_phd;
+		u_int32_t lockset;
 
+		lockset = in_pcbhash_lockset(inp, inp->inp_hash_element, 1);
+		in_pcbhash_lock_exclusive(inp->inp_pcbinfo, lockset);
+		in_pcblbgroup_remove(inp);
 		LIST_REMOVE(inp, inp_hash);
 		LIST_REMOVE(inp, inp_portlist);
-		if (phd != NULL && (LIST_FIRST(&phd->phd_pcblist) == NULL)) {
+		if (phd != NULL && (LIST_FIRST(&phd->phd_pcblist) == NULL))
 			LIST_REMOVE(phd, phd_hash);
+		else
+			phd = NULL;
+		in_pcbhash_unlock_exclusive(inp->inp_pcbinfo, lockset);
+		if (phd != NULL)
 			FREE(phd, M_PCB);
-		}
 	}
 
 	if (inp->inp_flags2 & INP2_TIMEWAIT) {
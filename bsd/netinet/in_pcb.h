@@ -480,6 +480,34 @@ struct inpcbport {
 	u_short phd_port;
 };
 
+/*
+ * Load balancing group: the unconnected PCBs sharing a local address
+ * and port that have SO_REUSEPORT_LB set and the same owner.  Wildcard
+ * lookups that land on a group pick a member by flow hash, so each
+ * member socket gets a stable share of the flows instead of the most
+ * recently bound one getting all of them.  Protected by ipi_lock and
+ * the hash lock of the port's wildcard bucket, like the hash chains.
+ */
+struct inpcblbgroup {
+	LIST_ENTRY(inpcblbgroup) il_list;
+	u_short	il_lport;		/* local port */
+	u_char	il_vflag;		/* inp_vflag of the members */
+	uid_t	il_uid;			/* owner of the members */
+	union {
+		struct in_addr_4in6 il46_local;
+		struct in6_addr il6_local;
+	} il_dependladdr;
+	u_int32_t il_inpsiz;		/* slots in il_inp[] */
+	u_int32_t il_inpcnt;		/* members in il_inp[] */
+	struct inpcb *il_inp[0];	/* members */
+};
+LIST_HEAD(inpcblbgrouphead, inpcblbgroup);
+
+#define	il_laddr	il_dependladdr.il46_local.ia46_addr4
+#define	il6_laddr	il_dependladdr.il6_local
+
+#define	INPCBLBGROUP_SIZMIN	8
+
 struct intimercount {
 	u_int32_t intimer_lazy;	/* lazy requests for timer scheduling */
 	u_int32_t intimer_fast; /* fast requests, can be coalesced */
@@ -488,10 +516,31 @@ struct intimercount {
 
 typedef void (*inpcb_timer_func_t)(struct inpcbinfo *);
 
+/*
+ * Locks for the PCB hash and port hash chains; bucket i of either is
+ * covered by hash lock i % INPCB_HASHLOCKS.  Each sits on its own
+ * cache line so lookups of unrelated flows don't bounce a shared one.
+ *
+ * Inserting an accepted connection and rehashing on connect or
+ * disconnect hold ipi_lock shared, plus the hash locks of the buckets
+ * they change, exclusive; they serialize only on shared buckets.
+ * Bind, whose port conflict checks must not race an insert, and
+ * removal, which also updates ipi_listhead and ipi_count, hold
+ * ipi_lock exclusive.
+ */
+#define	INPCB_HASHLOCKS		32	/* power of 2, at most 32 */
+
+struct inpcbhashlock {
+	decl_lck_rw_data(, ihl_lock);
+} __attribute__((aligned(64)));
+
 /*
  * Global data structure for each high-level protocol (UDP, TCP, ...) in both
  * IPv4 and IPv6.  Holds inpcb lists and information for managing them.  Each
- * pcbinfo is protected by a RW lock: ipi_lock.
+ * pcbinfo is protected by a RW lock: ipi_lock.  Hash lookups don't take it;
+ * they hold just the hash lock of the bucket they walk (ipi_hashlocks), and
+ * whoever changes a hash or port hash chain holds ipi_lock, shared or
+ * exclusive, plus the hash locks of the buckets involved, exclusive.
  *
  * All INPCB pcbinfo entries are linked together via ipi_entry.
  */
@@ -554,6 +603,19 @@ struct inpcbinfo {
 	struct inpcbporthead	*ipi_porthashbase;
 	u_long			ipi_porthashmask;
 
+	/*
+	 * Per-protocol hash of SO_REUSEPORT_LB groups, hashed by local
+	 * port number; NULL if the protocol doesn't balance.
+	 */
+	struct inpcblbgrouphead	*ipi_lbgrouphashbase;
+	u_long			ipi_lbgrouphashmask;
+
+	/*
+	 * Locks for ipi_hashbase, ipi_porthashbase and
+	 * ipi_lbgrouphashbase; see above.
+	 */
+	struct inpcbhashlock	ipi_hashlocks[INPCB_HASHLOCKS];
+
 	/*
 	 * Misc.
 	 */
@@ -566,6 +628,8 @@ struct inpcbinfo {
 	(((faddr) ^ ((faddr) >> 16) ^ ntohs((lport) ^ (fport))) & (mask))
 #define	INP_PCBPORTHASH(lport, mask) \
 	(ntohs((lport)) & (mask))
+#define	INP_HASHLOCK(ipi, idx) \
+	(&(ipi)->ipi_hashlocks[(idx) & (INPCB_HASHLOCKS - 1)].ihl_lock)
 
 #define	INP_IS_FLOW_CONTROLLED(_inp_) \
 	((_inp_)->inp_flags & INP_FLOW_CONTROLLED)
@@ -647,6 +711,7 @@ struct inpcbinfo {
 #define	INP2_TIMEWAIT		0x00000001 /* in TIMEWAIT */
 #define	INP2_IN_FCTREE		0x00000002 /* in inp_fc_tree */
 #define	INP2_WANT_FLOW_DIVERT	0x00000004 /* flow divert is desired */
+#define	INP2_IN_LBGROUP		0x00000008 /* in an SO_REUSEPORT_LB group */
 
 /*
  * Flags passed to in_pcblookup*() functions.
@@ -715,6 +780,11 @@ extern int in_pcblookup_hash_exists(struct inpcbinfo *, struct in_addr,
 extern void in_pcbnotifyall(struct inpcbinfo *, struct in_addr, int,
     void (*)(struct inpcb *, int));
 extern void in_pcbrehash(struct inpcb *);
+extern lck_rw_t *in_pcbhash_lock_shared(struct inpcbinfo *, u_int32_t,
+    lck_rw_t *);
+extern struct inpcb *in_pcblbgroup_lookup(struct inpcbinfo *, u_char,
+    const struct in6_addr *, u_short, const struct in6_addr *, u_short,
+    struct ifnet *);
 extern int in_getpeeraddr(struct socket *, struct sockaddr **);
 extern int in_getpeeraddr_s(struct socket *, struct sockaddr_storage *);
 extern int in_getsockaddr(struct socket *, struct sockaddr **);
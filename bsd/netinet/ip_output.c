@@ -1710,6 +1710,7 @@ pass:
 	 * care of the fragmentation for us, can just send directly.
 	 */
 	if ((u_short)ip->ip_len <= ifp->if_mtu || TSO_IPV4_OK(ifp, m) ||
+	    GSO_IPV4_OK(ifp, m) ||
 	    (!(ip->ip_off & IP_DF) && (ifp->if_hwassist & CSUM_FRAGMENT))) {
 #if BYTE_ORDER != BIG_ENDIAN
 		HTONS(ip->ip_len);
@@ -3366,6 +3367,7 @@ ip_output_checksum(struct ifnet *ifp, struct mbuf *m, int hlen, int ip_len,
     uint32_t *sw_csum)
 {
 	int tso = TSO_IPV4_OK(ifp, m);
+	int gso = GSO_IPV4_OK(ifp, m);
 	uint32_t hwcap = ifp->if_hwassist;
 
 	m->m_pkthdr.csum_flags |= CSUM_IP;
@@ -3405,6 +3407,10 @@ ip_output_checksum(struct ifnet *ifp, struct mbuf *m, int hlen, int ip_len,
 		}
 	}
 
+	/* Software segmentation checksums each segment on its own */
+	if (gso)
+		*sw_csum &= ~CSUM_DELAY_DATA;
+
 	if (*sw_csum & CSUM_DELAY_DATA) {
 		in_delayed_cksum(m);
 		*sw_csum &= ~CSUM_DELAY_DATA;
@@ -626,9 +626,13 @@ mptcp_input_csum(struct tcpcb *tp, struct mbuf *m, int off)
 	return (~sum & 0xffff);
 }
 
+/*
+ * datasum, if not NULL, is the 16-bit sum of the len bytes of data,
+ * already computed while they were copied into m.
+ */
 void
 mptcp_output_csum(struct tcpcb *tp, struct mbuf *m, int32_t len,
-    unsigned hdrlen, u_int64_t dss_val, u_int32_t *sseqp)
+    unsigned hdrlen, u_int64_t dss_val, u_int32_t *sseqp, u_int16_t *datasum)
 {
 	struct mptcb *mp_tp = tptomptp(tp);
 	u_int32_t sum = 0;
@@ -646,7 +650,9 @@ mptcp_output_csum(struct tcpcb *tp, struct mbuf *m, int32_t len,
 	if (sseqp == NULL)
 		return;
 
-	if (len)
+	if (datasum != NULL)
+		sum = *datasum;
+	else if (len)
 		sum = m_sum16(m, hdrlen, len);
 
 	dss_val = mptcp_hton64(dss_val);
@@ -303,6 +303,7 @@ tcp_output(struct tcpcb *tp)
 	u_int8_t *finp = NULL;
 	u_int32_t *sseqp = NULL;
 	u_int64_t dss_val = 0;
+	u_int16_t dss_sum = 0, *dss_sump = NULL;
 	int mptcp_acknow = 0;
 #endif /* MPTCP */
 	boolean_t cell = FALSE;
@@ -1422,6 +1423,9 @@ send:
 	}
 
 	VERIFY(inp->inp_flowhash != 0);
+#if MPTCP
+	dss_sump = NULL;
+#endif /* MPTCP */
 	/*
 	 * Grab a header mbuf, attaching a copy of data to
 	 * be transmitted, and initialize the header from
@@ -1504,6 +1508,17 @@ send:
 				error = 0; /* should we return an error? */
 				goto out;
 			}
+#if MPTCP
+			/*
+			 * The DSS checksum covers the data being copied;
+			 * sum it on the way rather than reading it back.
+			 */
+			if (sseqp != NULL) {
+				dss_sum = m_copydata_sum16(so->so_snd.sb_mb,
+				    off, (int) len, mtod(m, caddr_t) + hdrlen);
+				dss_sump = &dss_sum;
+			} else
+#endif /* MPTCP */
 			m_copydata(so->so_snd.sb_mb, off, (int) len,
 			    mtod(m, caddr_t) + hdrlen);
 			m->m_len += len;
@@ -1617,7 +1632,7 @@ send:
 	m->m_pkthdr.rcvif = 0;
 #if MPTCP
 	/* Before opt is copied to the mbuf, set the csum field */
-	mptcp_output_csum(tp, m, len, hdrlen, dss_val, sseqp);
+	mptcp_output_csum(tp, m, len, hdrlen, dss_val, sseqp, dss_sump);
 #endif /* MPTCP */
 #if CONFIG_MACF_NET
 	mac_mbuf_label_associate_inpcb(inp, m);
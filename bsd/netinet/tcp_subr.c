@@ -391,6 +391,8 @@ tcp_init(struct protosw *pp, struct domain *dp)
 	tcbinfo.ipi_hashbase = hashinit(tcp_tcbhashsize, M_PCB, &tcbinfo.ipi_hashmask);
 	tcbinfo.ipi_porthashbase = hashinit(tcp_tcbhashsize, M_PCB,
 					&tcbinfo.ipi_porthashmask);
+	tcbinfo.ipi_lbgrouphashbase = hashinit(tcp_tcbhashsize, M_PCB,
+					&tcbinfo.ipi_lbgrouphashmask);
 	str_size = P2ROUNDUP(sizeof(struct inp_tp), sizeof(u_int64_t));
 	tcbinfo.ipi_zone = zinit(str_size, 120000*str_size, 8192, "tcpcb");
 	zone_change(tcbinfo.ipi_zone, Z_CALLERACCT, FALSE);
@@ -2618,6 +2620,10 @@ tcp_set_tso(struct tcpcb *tp, struct ifnet *ifp)
 				tp->tso_max_segment_size = ifp->if_tso_v6_mtu;
 			else
 				tp->tso_max_segment_size = TCP_MAXWIN;
+		} else if (ifp && IFNET_GSO_CAPABLE(ifp)) {
+			/* DLIL will segment it in software */
+			tp->t_flags |= TF_TSO;
+			tp->tso_max_segment_size = TCP_MAXWIN;
 		} else
 				tp->t_flags &= ~TF_TSO;
 
@@ -2631,6 +2637,10 @@ tcp_set_tso(struct tcpcb *tp, struct ifnet *ifp)
 				tp->tso_max_segment_size = ifp->if_tso_v4_mtu;
 			else
 				tp->tso_max_segment_size = TCP_MAXWIN;
+		} else if (ifp && IFNET_GSO_CAPABLE(ifp)) {
+			/* DLIL will segment it in software */
+			tp->t_flags |= TF_TSO;
+			tp->tso_max_segment_size = TCP_MAXWIN;
 		} else
 				tp->t_flags &= ~TF_TSO;
 	}
@@ -1242,7 +1242,7 @@ extern void tcp_getconninfo(struct socket *, struct conninfo_tcp *);
 #if MPTCP
 extern uint16_t mptcp_input_csum(struct tcpcb *, struct mbuf *, int);
 extern void mptcp_output_csum(struct tcpcb *, struct mbuf *, int32_t, unsigned, 
-    u_int64_t, u_int32_t *);
+    u_int64_t, u_int32_t *, u_int16_t *);
 extern int mptcp_adj_mss(struct tcpcb *, boolean_t);
 #endif
 #endif /* BSD_KERNEL_RPIVATE */
@@ -182,6 +182,16 @@ SYSCTL_INT(_net_inet_udp, OID_AUTO, randomize_ports,
     CTLFLAG_RW | CTLFLAG_LOCKED, &udp_use_randomport, 0,
     "Randomize UDP port numbers");
 
+static int udp_packet_chaining = 50;
+SYSCTL_INT(_net_inet_udp, OID_AUTO, packetchain,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &udp_packet_chaining, 0,
+    "Max number of datagrams sent down to IP in one chain");
+
+#if IPFIREWALL
+extern int fw_enable;		/* firewall check for packet chaining */
+extern int fw_bypass;		/* firewall check: disable chaining w/ rules */
+#endif /* IPFIREWALL */
+
 #if INET6
 struct udp_in6 {
 	struct sockaddr_in6	uin6_sin;
@@ -213,6 +223,9 @@ static void udp_append(struct inpcb *, struct ip *, struct mbuf *, int,
 static int udp_input_checksum(struct mbuf *, struct udphdr *, int, int);
 static int udp_output(struct inpcb *, struct mbuf *, struct sockaddr *,
     struct mbuf *, struct proc *);
+static int udp_ip_output_list(struct mbuf *, struct mbuf *, struct route *,
+    int, struct ip_moptions *, struct ip_out_args *);
+static int udp_send_list(struct socket *, int, struct mbuf *, struct proc *);
 static void ip_2_ip6_hdr(struct ip6_hdr *ip6, struct ip *ip);
 static void udp_gc(struct inpcbinfo *);
 
@@ -228,10 +241,13 @@ struct pr_usrreqs udp_usrreqs = {
 	.pru_disconnectx =	udp_disconnectx,
 	.pru_peeraddr =		in_getpeeraddr,
 	.pru_send =		udp_send,
+	.pru_send_list =	udp_send_list,
 	.pru_shutdown =		udp_shutdown,
 	.pru_sockaddr =		in_getsockaddr,
 	.pru_sosend =		sosend,
+	.pru_sosend_list =	sosend_list,
 	.pru_soreceive =	soreceive,
+	.pru_soreceive_list =	soreceive_list,
 };
 
 void
@@ -254,6 +270,8 @@ udp_init(struct protosw *pp, struct domain *dp)
 	    &udbinfo.ipi_hashmask);
 	udbinfo.ipi_porthashbase = hashinit(UDBHASHSIZE, M_PCB,
 	    &udbinfo.ipi_porthashmask);
+	udbinfo.ipi_lbgrouphashbase = hashinit(UDBHASHSIZE, M_PCB,
+	    &udbinfo.ipi_lbgrouphashmask);
 	str_size = (vm_size_t) sizeof (struct inpcb);
 	udbinfo.ipi_zone = zinit(str_size, 80000*str_size, 8192, "udpcb");
 
@@ -1293,12 +1311,18 @@ udp_check_pktinfo(struct mbuf *control, struct ifnet **outif,
 	return (0);
 }
 
+/*
+ * Output one datagram, or, for a connected socket with no address or
+ * control data given, a list of datagrams linked by m_nextpkt; the
+ * whole list is sent to the same destination and handed to IP at once.
+ */
 static int
 udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
     struct mbuf *control, struct proc *p)
 {
 	struct udpiphdr *ui;
-	int len = m->m_pkthdr.len;
+	struct mbuf *n, **np;
+	int len = m->m_pkthdr.len, totlen = 0, pktcnt = 0;
 	struct sockaddr_in *sin;
 	struct in_addr origladdr, laddr, faddr, pi_laddr;
 	u_short lport, fport;
@@ -1323,6 +1347,7 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 	KERNEL_DEBUG(DBG_FNC_UDP_OUTPUT | DBG_FUNC_START, 0,0,0,0,0);
 
 	lck_mtx_assert(&inp->inpcb_mtx, LCK_MTX_ASSERT_OWNED);
+	VERIFY(m->m_nextpkt == NULL || (addr == NULL && control == NULL));
 	if (control != NULL) {
 		msc = mbuf_service_class_from_control(control);
 		VERIFY(outif == NULL);
@@ -1340,9 +1365,13 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 	    inp->inp_laddr.s_addr, inp->inp_faddr.s_addr,
 	    (htons((u_short)len + sizeof (struct udphdr))));
 
-	if (len + sizeof (struct udpiphdr) > IP_MAXPACKET) {
-		error = EMSGSIZE;
-		goto release;
+	for (n = m; n != NULL; n = n->m_nextpkt) {
+		if (n->m_pkthdr.len + sizeof (struct udpiphdr) > IP_MAXPACKET) {
+			error = EMSGSIZE;
+			goto release;
+		}
+		totlen += n->m_pkthdr.len;
+		pktcnt++;
 	}
 
 	if (flowadv && INP_WAIT_FOR_IF_FEEDBACK(inp)) {
@@ -1505,62 +1534,81 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		}
 	}
 
-#if CONFIG_MACF_NET
-	mac_mbuf_label_associate_inpcb(inp, m);
-#endif /* CONFIG_MACF_NET */
-
 	if (inp->inp_flowhash == 0)
 		inp->inp_flowhash = inp_calc_flowhash(inp);
 
-	/*
-	 * Calculate data length and get a mbuf
-	 * for UDP and IP headers.
-	 */
-	M_PREPEND(m, sizeof (struct udpiphdr), M_DONTWAIT);
-	if (m == 0) {
-		error = ENOBUFS;
-		goto abort;
-	}
+	for (np = &m; *np != NULL; np = &(*np)->m_nextpkt) {
+		struct mbuf *nextpkt = (*np)->m_nextpkt;
 
-	/*
-	 * Fill in mbuf with extended UDP header
-	 * and addresses and length put into network format.
-	 */
-	ui = mtod(m, struct udpiphdr *);
-	bzero(ui->ui_x1, sizeof (ui->ui_x1));	/* XXX still needed? */
-	ui->ui_pr = IPPROTO_UDP;
-	ui->ui_src = laddr;
-	ui->ui_dst = faddr;
-	ui->ui_sport = lport;
-	ui->ui_dport = fport;
-	ui->ui_ulen = htons((u_short)len + sizeof (struct udphdr));
+#if CONFIG_MACF_NET
+		mac_mbuf_label_associate_inpcb(inp, *np);
+#endif /* CONFIG_MACF_NET */
 
-	/*
-	 * Set up checksum and output datagram.
-	 */
-	if (udpcksum && !(inp->inp_flags & INP_UDP_NOCKSUM)) {
-		ui->ui_sum = in_pseudo(ui->ui_src.s_addr, ui->ui_dst.s_addr,
-		    htons((u_short)len + sizeof (struct udphdr) + IPPROTO_UDP));
-		m->m_pkthdr.csum_flags = CSUM_UDP;
-		m->m_pkthdr.csum_data = offsetof(struct udphdr, uh_sum);
-	} else {
-		ui->ui_sum = 0;
-	}
-	((struct ip *)ui)->ip_len = sizeof (struct udpiphdr) + len;
-	((struct ip *)ui)->ip_ttl = inp->inp_ip_ttl;	/* XXX */
-	((struct ip *)ui)->ip_tos = inp->inp_ip_tos;	/* XXX */
-	udpstat.udps_opackets++;
+		/*
+		 * Calculate data length and get a mbuf
+		 * for UDP and IP headers.
+		 */
+		len = (*np)->m_pkthdr.len;
+		(*np)->m_nextpkt = NULL;
+		M_PREPEND(*np, sizeof (struct udpiphdr), M_DONTWAIT);
+		if (*np == NULL) {
+			*np = nextpkt;		/* freed on release */
+			error = ENOBUFS;
+			goto abort;
+		}
+		n = *np;
+		n->m_nextpkt = nextpkt;
+
+		/*
+		 * Fill in mbuf with extended UDP header
+		 * and addresses and length put into network format.
+		 */
+		ui = mtod(n, struct udpiphdr *);
+		bzero(ui->ui_x1, sizeof (ui->ui_x1));	/* XXX still needed? */
+		ui->ui_pr = IPPROTO_UDP;
+		ui->ui_src = laddr;
+		ui->ui_dst = faddr;
+		ui->ui_sport = lport;
+		ui->ui_dport = fport;
+		ui->ui_ulen = htons((u_short)len + sizeof (struct udphdr));
 
-	KERNEL_DEBUG(DBG_LAYER_OUT_END, ui->ui_dport, ui->ui_sport,
-		     ui->ui_src.s_addr, ui->ui_dst.s_addr, ui->ui_ulen);
+		/*
+		 * Set up checksum and output datagram.
+		 */
+		if (udpcksum && !(inp->inp_flags & INP_UDP_NOCKSUM)) {
+			ui->ui_sum = in_pseudo(ui->ui_src.s_addr,
+			    ui->ui_dst.s_addr, htons((u_short)len +
+			    sizeof (struct udphdr) + IPPROTO_UDP));
+			n->m_pkthdr.csum_flags = CSUM_UDP;
+			n->m_pkthdr.csum_data = offsetof(struct udphdr, uh_sum);
+		} else {
+			ui->ui_sum = 0;
+		}
+		((struct ip *)ui)->ip_len = sizeof (struct udpiphdr) + len;
+		((struct ip *)ui)->ip_ttl = inp->inp_ip_ttl;	/* XXX */
+		((struct ip *)ui)->ip_tos = inp->inp_ip_tos;	/* XXX */
+		udpstat.udps_opackets++;
+
+		KERNEL_DEBUG(DBG_LAYER_OUT_END, ui->ui_dport, ui->ui_sport,
+		    ui->ui_src.s_addr, ui->ui_dst.s_addr, ui->ui_ulen);
 
 #if IPSEC
-	if (ipsec_bypass == 0 && ipsec_setsocket(m, inp->inp_socket) != 0) {
-		error = ENOBUFS;
-		goto abort;
-	}
+		if (ipsec_bypass == 0 &&
+		    ipsec_setsocket(n, inp->inp_socket) != 0) {
+			error = ENOBUFS;
+			goto abort;
+		}
 #endif /* IPSEC */
 
+		set_packet_service_class(n, so, msc, 0);
+		n->m_pkthdr.pkt_flowsrc = FLOWSRC_INPCB;
+		n->m_pkthdr.pkt_flowid = inp->inp_flowhash;
+		n->m_pkthdr.pkt_proto = IPPROTO_UDP;
+		n->m_pkthdr.pkt_flags |= (PKTF_FLOW_ID | PKTF_FLOW_LOCALSRC);
+		if (flowadv)
+			n->m_pkthdr.pkt_flags |= PKTF_FLOW_ADV;
+	}
+
 	inpopts = inp->inp_options;
 	soopts |= (inp->inp_socket->so_options & (SO_DONTROUTE | SO_BROADCAST));
 	mopts = inp->inp_moptions;
@@ -1578,14 +1626,6 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 	/* Copy the cached route and take an extra reference */
 	inp_route_copyout(inp, &ro);
 
-	set_packet_service_class(m, so, msc, 0);
-	m->m_pkthdr.pkt_flowsrc = FLOWSRC_INPCB;
-	m->m_pkthdr.pkt_flowid = inp->inp_flowhash;
-	m->m_pkthdr.pkt_proto = IPPROTO_UDP;
-	m->m_pkthdr.pkt_flags |= (PKTF_FLOW_ID | PKTF_FLOW_LOCALSRC);
-	if (flowadv)
-		m->m_pkthdr.pkt_flags |= PKTF_FLOW_ADV;
-
 	if (ipoa.ipoa_boundif != IFSCOPE_NONE)
 		ipoa.ipoa_flags |= IPOAF_BOUND_IF;
 
@@ -1595,7 +1635,11 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 	inp->inp_sndinprog_cnt++;
 
 	socket_unlock(so, 0);
-	error = ip_output(m, inpopts, &ro, soopts, mopts, &ipoa);
+	if (pktcnt == 1)
+		error = ip_output(m, inpopts, &ro, soopts, mopts, &ipoa);
+	else
+		error = udp_ip_output_list(m, inpopts, &ro, soopts, mopts,
+		    &ipoa);
 	m = NULL;
 	socket_lock(so, 0);
 	if (mopts != NULL)
@@ -1610,8 +1654,8 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		} else {
 			cell = wifi = FALSE;
 		}
-		INP_ADD_STAT(inp, cell, wifi, txpackets, 1);
-		INP_ADD_STAT(inp, cell, wifi, txbytes, len);
+		INP_ADD_STAT(inp, cell, wifi, txpackets, pktcnt);
+		INP_ADD_STAT(inp, cell, wifi, txbytes, totlen);
 	}
 
 	if (flowadv && (adv->code == FADV_FLOW_CONTROLLED ||
@@ -1672,7 +1716,7 @@ release:
 	KERNEL_DEBUG(DBG_FNC_UDP_OUTPUT | DBG_FUNC_END, error, 0, 0, 0, 0);
 
 	if (m != NULL)
-		m_freem(m);
+		m_freem_list(m);
 
 	if (outif != NULL)
 		ifnet_release(outif);
@@ -1680,6 +1724,63 @@ release:
 	return (error);
 }
 
+/*
+ * Hand a list of datagrams for one destination to IP.  Runs of packets
+ * that fit the interface MTU of the cached route go down as a single
+ * chain, sharing the route lookup and the trip through DLIL.  IP can't
+ * fragment in the middle of a chain, so oversized datagrams go out on
+ * their own, as does everything when there is no usable cached route
+ * yet, when IP options are set, or when IPsec or firewall rules are in
+ * place (see the matching test in tcp_ip_output()).  Stops at the
+ * first error; the rest of the list is freed.
+ */
+static int
+udp_ip_output_list(struct mbuf *m, struct mbuf *opt, struct route *ro,
+    int flags, struct ip_moptions *imo, struct ip_out_args *ipoa)
+{
+	struct mbuf *head, *n;
+	u_int32_t mtu;
+	int cnt, error = 0;
+	boolean_t chain;
+
+	chain = udp_packet_chaining > 1 && opt == NULL
+#if IPSEC
+		&& ipsec_bypass
+#endif
+#if IPFIREWALL
+		&& (fw_enable == 0 || fw_bypass)
+#endif
+		;
+
+	while (m != NULL && error == 0) {
+		/* ip_output() below may have just filled in the route */
+		mtu = 0;
+		if (chain && ro->ro_rt != NULL && !ROUTE_UNUSABLE(ro) &&
+		    ro->ro_rt->rt_ifp != NULL)
+			mtu = ro->ro_rt->rt_ifp->if_mtu;
+
+		head = n = m;
+		cnt = 1;
+		if ((u_int32_t)n->m_pkthdr.len <= mtu) {
+			while (n->m_nextpkt != NULL &&
+			    (u_int32_t)n->m_nextpkt->m_pkthdr.len <= mtu &&
+			    cnt < udp_packet_chaining) {
+				n = n->m_nextpkt;
+				cnt++;
+			}
+		}
+		m = n->m_nextpkt;
+		n->m_nextpkt = NULL;
+
+		error = ip_output_list(head, (cnt > 1) ? cnt : 0, opt, ro,
+		    flags, imo, ipoa);
+	}
+	if (m != NULL)
+		m_freem_list(m);
+
+	return (error);
+}
+
 u_int32_t	udp_sendspace = 9216;		/* really max datagram size */
 /* 187 1K datagrams (approx 192 KB) */
 u_int32_t	udp_recvspace = 187 * (1024 +
@@ -1942,6 +2043,25 @@ udp_send(struct socket *so, int flags, struct mbuf *m,
 	return (udp_output(inp, m, addr, control, p));
 }
 
+/*
+ * Send a list of datagrams, linked by m_nextpkt, on a connected socket;
+ * see sosend_list().
+ */
+static int
+udp_send_list(struct socket *so, int flags, struct mbuf *m, struct proc *p)
+{
+#pragma unused(flags)
+	struct inpcb *inp;
+
+	inp = sotoinpcb(so);
+	if (inp == NULL || (inp->inp_flags2 & INP2_WANT_FLOW_DIVERT)) {
+		m_freem_list(m);
+		return (inp == NULL ? EINVAL : EPROTOTYPE);
+	}
+
+	return (udp_output(inp, m, NULL, NULL, p));
+}
+
 int
 udp_shutdown(struct socket *so)
 {
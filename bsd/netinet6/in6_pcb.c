@@ -531,10 +531,10 @@ in6_pcbconnect(struct inpcb *inp, struct sockaddr *nam, struct proc *p)
 		inp->in6p_last_outifp = outif;	/* no reference needed */
 		inp->in6p_flags |= INP_IN6ADDR_ANY;
 	}
-	if (!lck_rw_try_lock_exclusive(inp->inp_pcbinfo->ipi_lock)) {
+	if (!lck_rw_try_lock_shared(inp->inp_pcbinfo->ipi_lock)) {
 		/* lock inversion issue, mostly with udp multicast packets */
 		socket_unlock(inp->inp_socket, 0);
-		lck_rw_lock_exclusive(inp->inp_pcbinfo->ipi_lock);
+		lck_rw_lock_shared(inp->inp_pcbinfo->ipi_lock);
 		socket_lock(inp->inp_socket, 0);
 	}
 	inp->in6p_faddr = sin6->sin6_addr;
@@ -555,10 +555,10 @@ in6_pcbdisconnect(struct inpcb *inp)
 {
 	struct socket *so = inp->inp_socket;
 
-	if (!lck_rw_try_lock_exclusive(inp->inp_pcbinfo->ipi_lock)) {
+	if (!lck_rw_try_lock_shared(inp->inp_pcbinfo->ipi_lock)) {
 		/* lock inversion issue, mostly with udp multicast packets */
 		socket_unlock(so, 0);
-		lck_rw_lock_exclusive(inp->inp_pcbinfo->ipi_lock);
+		lck_rw_lock_shared(inp->inp_pcbinfo->ipi_lock);
 		socket_lock(so, 0);
 	}
 	bzero((caddr_t)&inp->in6p_faddr, sizeof (inp->in6p_faddr));
@@ -1064,19 +1064,21 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 {
 	struct inpcbhead *head;
 	struct inpcb *inp;
+	lck_rw_t *lck;
+	u_int32_t idx;
 	u_short fport = fport_arg, lport = lport_arg;
 	int found;
 
 	*uid = UID_MAX;
 	*gid = GID_MAX;
 
-	lck_rw_lock_shared(pcbinfo->ipi_lock);
-
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr->s6_addr32[3] /* XXX */,
-	    lport, fport, pcbinfo->ipi_hashmask)];
+	idx = INP_PCBHASH(faddr->s6_addr32[3] /* XXX */, lport, fport,
+	    pcbinfo->ipi_hashmask);
+	lck = in_pcbhash_lock_shared(pcbinfo, idx, NULL);
+	head = &pcbinfo->ipi_hashbase[idx];
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV6))
 			continue;
@@ -1101,15 +1103,20 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 				*gid = kauth_cred_getgid(
 				    inp->inp_socket->so_cred);
 			}
-			lck_rw_done(pcbinfo->ipi_lock);
+			lck_rw_done(lck);
 			return (found);
 		}
 	}
 	if (wildcard) {
 		struct inpcb *local_wild = NULL;
 
-		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-		    pcbinfo->ipi_hashmask)];
+		/*
+		 * The wildcard bucket (and the port's group) may be
+		 * under another hash lock.
+		 */
+		idx = INP_PCBHASH(INADDR_ANY, lport, 0, pcbinfo->ipi_hashmask);
+		lck = in_pcbhash_lock_shared(pcbinfo, idx, lck);
+		head = &pcbinfo->ipi_hashbase[idx];
 		LIST_FOREACH(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6))
 				continue;
@@ -1132,7 +1139,7 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 						*gid = kauth_cred_getgid(
 						    inp->inp_socket->so_cred);
 					}
-					lck_rw_done(pcbinfo->ipi_lock);
+					lck_rw_done(lck);
 					return (found);
 				} else if (IN6_IS_ADDR_UNSPECIFIED(
 				    &inp->in6p_laddr)) {
@@ -1147,7 +1154,7 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 				*gid = kauth_cred_getgid(
 				    local_wild->inp_socket->so_cred);
 			}
-			lck_rw_done(pcbinfo->ipi_lock);
+			lck_rw_done(lck);
 			return (found);
 		}
 	}
@@ -1155,7 +1162,7 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	/*
 	 * Not found.
 	 */
-	lck_rw_done(pcbinfo->ipi_lock);
+	lck_rw_done(lck);
 	return (0);
 }
 
@@ -1169,15 +1176,17 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 {
 	struct inpcbhead *head;
 	struct inpcb *inp;
+	lck_rw_t *lck;
+	u_int32_t idx;
 	u_short fport = fport_arg, lport = lport_arg;
 
-	lck_rw_lock_shared(pcbinfo->ipi_lock);
-
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr->s6_addr32[3] /* XXX */,
-	    lport, fport, pcbinfo->ipi_hashmask)];
+	idx = INP_PCBHASH(faddr->s6_addr32[3] /* XXX */, lport, fport,
+	    pcbinfo->ipi_hashmask);
+	lck = in_pcbhash_lock_shared(pcbinfo, idx, NULL);
+	head = &pcbinfo->ipi_hashbase[idx];
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV6))
 			continue;
@@ -1198,11 +1207,11 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 			 */
 			if (in_pcb_checkstate(inp, WNT_ACQUIRE, 0) !=
 			    WNT_STOPUSING) {
-				lck_rw_done(pcbinfo->ipi_lock);
+				lck_rw_done(lck);
 				return (inp);
 			} else {
 				/* it's there but dead, say it isn't found */
-				lck_rw_done(pcbinfo->ipi_lock);
+				lck_rw_done(lck);
 				return (NULL);
 			}
 		}
@@ -1210,8 +1219,22 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	if (wildcard) {
 		struct inpcb *local_wild = NULL;
 
-		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-		    pcbinfo->ipi_hashmask)];
+		/*
+		 * The wildcard bucket (and the port's group) may be
+		 * under another hash lock.
+		 */
+		idx = INP_PCBHASH(INADDR_ANY, lport, 0, pcbinfo->ipi_hashmask);
+		lck = in_pcbhash_lock_shared(pcbinfo, idx, lck);
+
+		inp = in_pcblbgroup_lookup(pcbinfo, INP_IPV6, laddr, lport,
+		    faddr, fport, ifp);
+		if (inp != NULL &&
+		    in_pcb_checkstate(inp, WNT_ACQUIRE, 0) != WNT_STOPUSING) {
+			lck_rw_done(lck);
+			return (inp);
+		}
+
+		head = &pcbinfo->ipi_hashbase[idx];
 		LIST_FOREACH(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6))
 				continue;
@@ -1229,11 +1252,11 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 				    laddr)) {
 					if (in_pcb_checkstate(inp, WNT_ACQUIRE,
 					    0) != WNT_STOPUSING) {
-						lck_rw_done(pcbinfo->ipi_lock);
+						lck_rw_done(lck);
 						return (inp);
 					} else {
 						/* dead; say it isn't found */
-						lck_rw_done(pcbinfo->ipi_lock);
+						lck_rw_done(lck);
 						return (NULL);
 					}
 				} else if (IN6_IS_ADDR_UNSPECIFIED(
@@ -1244,10 +1267,10 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 		}
 		if (local_wild && in_pcb_checkstate(local_wild,
 		    WNT_ACQUIRE, 0) != WNT_STOPUSING) {
-			lck_rw_done(pcbinfo->ipi_lock);
+			lck_rw_done(lck);
 			return (local_wild);
 		} else {
-			lck_rw_done(pcbinfo->ipi_lock);
+			lck_rw_done(lck);
 			return (NULL);
 		}
 	}
@@ -1255,7 +1278,7 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	/*
 	 * Not found.
 	 */
-	lck_rw_done(pcbinfo->ipi_lock);
+	lck_rw_done(lck);
 	return (NULL);
 }
 
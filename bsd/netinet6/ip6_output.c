@@ -1420,7 +1420,7 @@ check_with_pf:
 	 * transmit packet without fragmentation
 	 */
 	if (ip6obf.dontfrag || (!alwaysfrag &&		/* case 1-a and 2-a */
-	    (tlen <= mtu || TSO_IPV6_OK(ifp, m) ||
+	    (tlen <= mtu || TSO_IPV6_OK(ifp, m) || GSO_IPV6_OK(ifp, m) ||
 	    (ifp->if_hwassist & CSUM_FRAGMENT_IPV6)))) {
 #ifdef IPSEC
 		/* clean ipsec history once it goes out of the node */
@@ -3807,6 +3807,7 @@ ip6_output_checksum(struct ifnet *ifp, uint32_t mtu, struct mbuf *m,
 {
 	uint32_t sw_csum, hwcap = ifp->if_hwassist;
 	int tso = TSO_IPV6_OK(ifp, m);
+	int gso = GSO_IPV6_OK(ifp, m);
 
 	if (!hwcksum_tx) {
 		/* do all in software; checksum offload is disabled */
@@ -3845,6 +3846,10 @@ ip6_output_checksum(struct ifnet *ifp, uint32_t mtu, struct mbuf *m,
 		}
 	}
 
+	/* Software segmentation checksums each segment on its own */
+	if (gso)
+		sw_csum &= ~CSUM_DELAY_IPV6_DATA;
+
 	if (sw_csum & CSUM_DELAY_IPV6_DATA) {
 		in6_delayed_cksum_offset(m, 0, optlen, nxt0);
 		sw_csum &= ~CSUM_DELAY_IPV6_DATA;
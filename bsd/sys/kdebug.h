@@ -241,6 +241,7 @@ extern void kernel_debug_enter(
 #define PMAP__QUERY_RESIDENT	0xc
 #define PMAP__FLUSH_KERN_TLBS	0xd
 #define PMAP__FLUSH_DELAYED_TLBS	0xe
+#define PMAP__PROMOTE		0xf
 
 /* Codes for Stackshot/Microstackshot (DBG_MACH_STACKSHOT) */
 #define MICROSTACKSHOT_RECORD	0x0
@@ -1,4 +1,6 @@
 #ifndef _KERN_TESTS_H
 #define _KERN_TESTS_H
 
+extern int mcs_lock_stress_test(void);
+
 #endif /* !defined(_KERN_TESTS_H) */
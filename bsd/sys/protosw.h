@@ -384,6 +384,9 @@ struct ifnet;
 struct stat;
 struct ucred;
 struct uio;
+#ifdef XNU_KERNEL_PRIVATE
+struct recv_msg_elem;
+#endif /* XNU_KERNEL_PRIVATE */
 
 #ifdef XNU_KERNEL_PRIVATE
 /*
@@ -466,14 +469,20 @@ struct pr_usrreqs {
 #define	PRUS_OOB	0x1
 #define	PRUS_EOF	0x2
 #define	PRUS_MORETOCOME	0x4
+	int	(*pru_send_list)(struct socket *, int, struct mbuf *,
+		    struct proc *);
 	int	(*pru_sense)(struct socket *, void *, int);
 	int	(*pru_shutdown)(struct socket *);
 	int	(*pru_sockaddr)(struct socket *, struct sockaddr **);
 	int	(*pru_sopoll)(struct socket *, int, struct ucred *, void *);
 	int	(*pru_soreceive)(struct socket *, struct sockaddr **,
 		    struct uio *, struct mbuf **, struct mbuf **, int *);
+	int	(*pru_soreceive_list)(struct socket *,
+		    struct recv_msg_elem *, u_int, int, u_int *);
 	int	(*pru_sosend)(struct socket *, struct sockaddr *,
 		    struct uio *, struct mbuf *, struct mbuf *, int);
+	int	(*pru_sosend_list)(struct socket *, struct uio **, u_int,
+		    int, u_int *);
 	int	(*pru_socheckopt)(struct socket *, struct sockopt *);
 };
 
@@ -498,6 +507,12 @@ extern int pru_connectx_notsupp(struct socket *, struct sockaddr_list **,
 extern int pru_disconnectx_notsupp(struct socket *, associd_t, connid_t);
 extern int pru_socheckopt_null(struct socket *, struct sockopt *);
 extern int pru_peeloff_notsupp(struct socket *, associd_t, struct socket **);
+extern int pru_send_list_notsupp(struct socket *, int, struct mbuf *,
+    struct proc *);
+extern int pru_soreceive_list_notsupp(struct socket *,
+    struct recv_msg_elem *, u_int, int, u_int *);
+extern int pru_sosend_list_notsupp(struct socket *, struct uio **, u_int,
+    int, u_int *);
 #endif /* XNU_KERNEL_PRIVATE */
 extern int pru_control_notsupp(struct socket *so, u_long cmd, caddr_t data,
     struct ifnet *ifp, struct proc *p);
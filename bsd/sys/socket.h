@@ -320,6 +320,8 @@ struct so_tcdbg {
 #define	SO_DELEGATED		0x1107	/* set socket as delegate (pid_t) */
 #define	SO_DELEGATED_UUID	0x1108	/* set socket as delegate (uuid_t) */
 
+#define	SO_REUSEPORT_LB	0x1109	/* spread flows over SO_REUSEPORT group (int) */
+
 #endif /* PRIVATE */
 #endif	/* (!_POSIX_C_SOURCE || _DARWIN_C_SOURCE) */
 
@@ -1059,6 +1061,32 @@ struct kev_netpolicy_ifdenied {
 	struct netpolicy_event_data	ev_data;
 };
 
+/*
+ * Message vector element for sendmmsg() and recvmmsg(): a message header
+ * plus the number of bytes sent or received for that message.
+ */
+struct mmsghdr {
+	struct msghdr	msg_hdr;	/* message header */
+	unsigned int	msg_len;	/* bytes transferred */
+};
+
+#ifdef BSD_KERNEL_PRIVATE
+struct user_mmsghdr {
+	struct user_msghdr	msg_hdr;
+	unsigned int		msg_len;
+};
+
+struct user64_mmsghdr {
+	struct user64_msghdr	msg_hdr;
+	unsigned int		msg_len;
+};
+
+struct user32_mmsghdr {
+	struct user32_msghdr	msg_hdr;
+	unsigned int		msg_len;
+};
+#endif /* BSD_KERNEL_PRIVATE */
+
 #ifndef	KERNEL
 __BEGIN_DECLS
 extern int connectx(int s, struct sockaddr *, socklen_t, struct sockaddr *,
@@ -1066,6 +1094,8 @@ extern int connectx(int s, struct sockaddr *, socklen_t, struct sockaddr *,
 extern int disconnectx(int s, associd_t, connid_t);
 extern int peeloff(int s, associd_t);
 extern int socket_delegate(int, int, int, pid_t);
+extern int sendmmsg(int, struct mmsghdr *, unsigned int, int);
+extern int recvmmsg(int, struct mmsghdr *, unsigned int, int);
 __END_DECLS
 #endif /* !KERNEL */
 #endif	/* (!_POSIX_C_SOURCE || _DARWIN_C_SOURCE) */
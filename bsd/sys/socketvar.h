@@ -273,6 +273,7 @@ struct socket {
 #define SOF_MP_SEC_SUBFLOW      0x8000000 /* Set up secondary flow */
 #define SOF_MP_TRYFAILOVER	0x10000000 /* Failing subflow */
 #define	SOF_DELEGATED		0x20000000 /* on behalf of another process */
+#define	SOF_REUSEPORT_LB	0x40000000 /* balance flows across reuseport group */
 	uint32_t	so_upcallusecount; /* number of upcalls in progress */
 	int		so_usecount;	/* refcounting of socket use */;
 	int		so_retaincnt;
@@ -616,6 +617,18 @@ struct so_procinfo {
 	pid_t		spi_epid;
 };
 
+/*
+ * Per-datagram state for soreceive_list()
+ */
+struct recv_msg_elem {
+	struct uio		*uio;		/* in: buffer for the data */
+	struct sockaddr		*psa;		/* out: source, if requested */
+	int			which;		/* in/out: see below */
+};
+
+#define	RECV_MSG_WANTADDR	0x1	/* in: return the source address */
+#define	RECV_MSG_TRUNC		0x2	/* out: datagram was truncated */
+
 extern int maxsockets;
 extern u_int32_t sb_max;
 extern so_gen_t so_gencnt;
@@ -792,6 +805,9 @@ extern int sowriteable(struct socket *so);
 extern void sowwakeup(struct socket *so);
 extern int sosendcheck(struct socket *, struct sockaddr *, user_ssize_t,
     int32_t, int32_t, int, int *, struct mbuf *);
+extern int sosend_list(struct socket *, struct uio **, u_int, int, u_int *);
+extern int soreceive_list(struct socket *, struct recv_msg_elem *, u_int,
+    int, u_int *);
 
 extern int soo_ioctl(struct fileproc *, u_long, caddr_t, vfs_context_t);
 extern int soo_stat(struct socket *, void *, int);
@@ -170,6 +170,7 @@ __private_extern__ uint32_t cluster_throttle_io_limit(vnode_t, uint32_t *);
 #define UBC_FOR_PAGEOUT         0x0002
 
 memory_object_control_t ubc_getobject(vnode_t, int);
+kern_return_t	ubc_create_iopl(vnode_t, off_t, int, upl_t *, upl_page_info_t **);
 boolean_t	ubc_strict_uncached_IO(vnode_t);
 
 int	ubc_info_init(vnode_t);
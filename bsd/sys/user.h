@@ -144,6 +144,9 @@ struct uthread {
 			size_t eventsize;	/* kevent or kevent64_s */
 			int eventcount;	 	/* user-level event count */
 			int eventout;		 /* number of events output */
+			char *eventbuf;		 /* events staged for copyout */
+			int eventbufsize;	 /* size of eventbuf */
+			int eventbuflen;	 /* bytes staged in eventbuf */
 		} ss_kevent;			 /* saved state for kevent() */
 
 		struct _kauth {
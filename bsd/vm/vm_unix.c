@@ -1529,6 +1529,39 @@ SYSCTL_UINT(_vm, OID_AUTO, pageout_cleaned_commit_reactivated, CTLFLAG_RD | CTLF
 SYSCTL_UINT(_vm, OID_AUTO, pageout_cleaned_busy, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_cleaned_busy, 0, "Cleaned pages busy (deactivated)");
 SYSCTL_UINT(_vm, OID_AUTO, pageout_cleaned_nolock, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_cleaned_nolock, 0, "Cleaned pages no-lock (deactivated)");
 
+extern unsigned int vm_page_local_q_drained;
+SYSCTL_UINT(_vm, OID_AUTO, page_local_q_drained, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_page_local_q_drained, 0, "Pages moved from per-cpu local queues by vm_pageout_scan");
+
+/* per-cpu free page cache */
+extern unsigned int vm_page_cpu_cache_limit, vm_page_cpu_cache_released, vm_page_cpu_cache_drained;
+SYSCTL_UINT(_vm, OID_AUTO, page_cpu_cache_limit, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_page_cpu_cache_limit, 0, "Pages a processor may cache on release (0 disables)");
+SYSCTL_UINT(_vm, OID_AUTO, page_cpu_cache_released, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_page_cpu_cache_released, 0, "Pages released to a per-cpu cache");
+SYSCTL_UINT(_vm, OID_AUTO, page_cpu_cache_drained, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_page_cpu_cache_drained, 0, "Pages drained from per-cpu caches to the global free queues");
+extern unsigned int vm_page_cpu_free_count;
+SYSCTL_UINT(_vm, OID_AUTO, page_cpu_free_count, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_page_cpu_free_count, 0, "Free pages held on per-cpu free lists");
+
+/* fault-around */
+extern int vm_fault_around_pages;
+extern unsigned int vm_fault_around_mapped;
+SYSCTL_INT(_vm, OID_AUTO, fault_around_pages, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_fault_around_pages, 0, "Resident neighbors considered for mapping on a soft fault (0 disables)");
+SYSCTL_UINT(_vm, OID_AUTO, fault_around_mapped, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_fault_around_mapped, 0, "Pages mapped by fault-around");
+
+/* transparent superpages */
+extern int vm_transparent_superpages;
+extern unsigned int vm_superpage_hints, vm_superpage_hints_dropped, vm_superpage_collapses, vm_superpage_collapse_copied, vm_superpage_collapse_failures, vm_superpage_collapse_nomem;
+SYSCTL_INT(_vm, OID_AUTO, transparent_superpages, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_transparent_superpages, 0, "Collapse fully populated anonymous 2MB blocks into superpages");
+SYSCTL_UINT(_vm, OID_AUTO, superpage_hints, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_superpage_hints, 0, "Superpage collapse hints queued");
+SYSCTL_UINT(_vm, OID_AUTO, superpage_hints_dropped, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_superpage_hints_dropped, 0, "Superpage collapse hints dropped (duplicate or queue full)");
+SYSCTL_UINT(_vm, OID_AUTO, superpage_collapses, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_superpage_collapses, 0, "Blocks promoted to superpages");
+SYSCTL_UINT(_vm, OID_AUTO, superpage_collapse_copied, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_superpage_collapse_copied, 0, "Blocks migrated to contiguous memory before promotion");
+SYSCTL_UINT(_vm, OID_AUTO, superpage_collapse_failures, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_superpage_collapse_failures, 0, "Blocks found ineligible for promotion");
+SYSCTL_UINT(_vm, OID_AUTO, superpage_collapse_nomem, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_superpage_collapse_nomem, 0, "Promotions abandoned for lack of contiguous memory");
+#if defined(__x86_64__)
+extern long long pmap_superpage_promotions, pmap_superpage_demotions;
+SYSCTL_QUAD(_vm, OID_AUTO, pmap_superpage_promotions, CTLFLAG_RD | CTLFLAG_LOCKED, &pmap_superpage_promotions, "");
+SYSCTL_QUAD(_vm, OID_AUTO, pmap_superpage_demotions, CTLFLAG_RD | CTLFLAG_LOCKED, &pmap_superpage_demotions, "");
+#endif /* __x86_64__ */
+
 #include <kern/thread.h>
 #include <sys/user.h>
 
@@ -168,6 +168,7 @@ main(
 	DECLARE("GRP_MTX_STAT_DIRECT_WAIT",	offsetof(lck_grp_t *, lck_grp_stat.lck_grp_mtx_stat.lck_grp_mtx_held_cnt));
 
 	DECLARE("GRP_MTX_STAT_HELD_MAX",	offsetof(lck_grp_t *, lck_grp_stat.lck_grp_mtx_stat.lck_grp_mtx_held_max));
+	DECLARE("GRP_MTX_STAT_HELD_CUM",	offsetof(lck_grp_t *, lck_grp_stat.lck_grp_mtx_stat.lck_grp_mtx_held_cum));
 	/* Reader writer lock types */
 	DECLARE("RW_SHARED",    LCK_RW_TYPE_SHARED);
 	DECLARE("RW_EXCL",      LCK_RW_TYPE_EXCLUSIVE);
@@ -1039,7 +1039,45 @@ Entry(lck_rw_held_read_or_upgrade)
 
 #define LMTX_EXIT_EXTENDED
 
-#define	LMTX_CHK_EXTENDED_EXIT
+/*
+ * Hold time statistics for indirect mutexes: the TSC is sampled into
+ * the extended mutex on every successful acquire and the difference
+ * charged to the group (GRP_MTX_STAT_HELD_CUM/MAX) on unlock.
+ * Clobbers %rax and LMTX_SSTATE_REG; LMTX_REG (%rdx) is preserved.
+ */
+#define LMTX_STAMP_ACQUIRE					\
+	mov	LMTX_REG, LMTX_SSTATE_REG		;	\
+	rdtsc						;	\
+	shl	$32, %rdx				;	\
+	or	%rdx, %rax				;	\
+	mov	LMTX_SSTATE_REG, LMTX_REG		;	\
+	mov	%rax, MTX_ACQ_TSC(LMTX_REG)
+
+#define	LMTX_CHK_EXTENDED_EXIT					\
+	LMTX_CHK_EXTENDED				;	\
+	je	13f					;	\
+	LMTX_STAMP_ACQUIRE				;	\
+13:
+
+/*
+ * Clobbers %rax, LMTX_LGROUP_REG and LMTX_SSTATE_REG.
+ * The max update is racy across mutexes of the same group; it is a
+ * statistic and the race only loses a concurrent maximum.
+ */
+#define LMTX_UPDATE_HELD					\
+	mov	LMTX_REG, LMTX_SSTATE_REG		;	\
+	rdtsc						;	\
+	shl	$32, %rdx				;	\
+	or	%rdx, %rax				;	\
+	mov	LMTX_SSTATE_REG, LMTX_REG		;	\
+	sub	MTX_ACQ_TSC(LMTX_REG), %rax		;	\
+	mov	MUTEX_GRP(LMTX_REG), LMTX_LGROUP_REG	;	\
+	LOCK_IF_ATOMIC_STAT_UPDATES			;	\
+	add	%rax, GRP_MTX_STAT_HELD_CUM(LMTX_LGROUP_REG)	;	\
+	cmp	GRP_MTX_STAT_HELD_MAX(LMTX_LGROUP_REG), %rax	;	\
+	jbe	13f					;	\
+	mov	%rax, GRP_MTX_STAT_HELD_MAX(LMTX_LGROUP_REG)	;	\
+13:
 
 
 #if	LOG_FIRST_MISS_ALONE
@@ -1317,6 +1355,7 @@ Llml_finish:
 #endif
 	ret
 2:	
+	LMTX_STAMP_ACQUIRE
 	LMTX_EXIT_EXTENDED
 	leave
 #if	CONFIG_DTRACE
@@ -1692,6 +1731,7 @@ Llmu_ext:
 	mov	M_OWNER(LMTX_REG), LMTX_A_REG
 	mov	%gs:CPU_ACTIVE_THREAD, LMTX_C_REG
 	CHECK_UNLOCK(LMTX_C_REG, LMTX_A_REG)
+	LMTX_UPDATE_HELD
 	mov	M_STATE(LMTX_REG), LMTX_C_REG32
 	jmp 	Llmu_chktype
 
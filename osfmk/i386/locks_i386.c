@@ -79,6 +79,7 @@
 #include <i386/machine_routines.h> /* machine_timeout_suspended() */
 #include <machine/machine_cpu.h>
 #include <i386/mp.h>
+#include <i386/proc_reg.h>		/* rdtsc64() */
 
 #include <sys/kdebug.h>
 #include <mach/branch_predicates.h>
@@ -1971,6 +1972,31 @@ lck_mtx_lock_acquire_x86(
 
 
 
+/*
+ * Upper bound, in pause instructions, on the exponential backoff
+ * between attempts to grab a contended mutex.
+ */
+#define LCK_MTX_SPIN_BACKOFF_MAX	32
+
+/*
+ * Charge an adaptive spin to the lock group of an indirect mutex.
+ * On x86 the group's mutex wait_cum/wait_max hold spin time in TSC
+ * ticks (see lck_grp_mtx_stat_t).
+ */
+static void
+lck_mtx_update_spin_stat(
+	lck_mtx_t	*mutex,
+	uint64_t	spin)
+{
+	lck_grp_mtx_stat_t	*stat;
+
+	stat = &((lck_mtx_ext_t *)mutex)->lck_mtx_grp->lck_grp_stat.lck_grp_mtx_stat;
+
+	(void)__sync_fetch_and_add(&stat->lck_grp_mtx_wait_cum, spin);
+	if (spin > stat->lck_grp_mtx_wait_max)
+		stat->lck_grp_mtx_wait_max = spin;
+}
+
 /*
  * Routine: 	lck_mtx_lock_spinwait_x86
  *
@@ -1987,8 +2013,10 @@ int
 lck_mtx_lock_spinwait_x86(
 	lck_mtx_t	*mutex)
 {
-	thread_t	holder;
+	thread_t	holder, prev_holder = THREAD_NULL;
 	uint64_t	deadline;
+	uint64_t	tsc_start;
+	unsigned int	backoff = 1, i;
 	int		retval = 1;
 	int		loopcount = 0;
 
@@ -1996,6 +2024,7 @@ lck_mtx_lock_spinwait_x86(
 	KERNEL_DEBUG(MACHDBG_CODE(DBG_MACH_LOCKS, LCK_MTX_LCK_SPIN_CODE) | DBG_FUNC_START,
 		     mutex, mutex->lck_mtx_owner, mutex->lck_mtx_waiters, 0, 0);
 
+	tsc_start = rdtsc64();
 	deadline = mach_absolute_time() + MutexSpin;
 
 	/*
@@ -2005,6 +2034,13 @@ lck_mtx_lock_spinwait_x86(
 	 *   - owner is running on another processor, and
 	 *   - owner (processor) is not idling, and
 	 *   - we haven't spun for long enough.
+	 *
+	 * The owner is re-checked on every probe, so we stop spinning
+	 * (and go block) as soon as it is switched out rather than
+	 * burning the rest of the window.  Between probes we back off
+	 * exponentially so that several spinners don't keep pulling the
+	 * lock's cache line away from the owner; the backoff restarts
+	 * whenever the mutex changes hands.
 	 */
 	do {
 		if (__probable(lck_mtx_lock_grab_mutex(mutex))) {
@@ -2019,13 +2055,22 @@ lck_mtx_lock_spinwait_x86(
 					retval = 2;
 				break;
 			}
+			if (holder != prev_holder) {
+				prev_holder = holder;
+				backoff = 1;
+			}
 		}
-		cpu_pause();
+		for (i = 0; i < backoff; i++)
+			cpu_pause();
+		if (backoff < LCK_MTX_SPIN_BACKOFF_MAX)
+			backoff <<= 1;
 
 		loopcount++;
 
 	} while (mach_absolute_time() < deadline);
 
+	if (mutex->lck_mtx_is_ext && retval != 2)
+		lck_mtx_update_spin_stat(mutex, rdtsc64() - tsc_start);
 
 #if	CONFIG_DTRACE
 	/*
@@ -120,6 +120,13 @@ ml_static_ptovirt(
 #endif
 } 
 
+vm_offset_t
+ml_physmap_ptovirt(
+	addr64_t paddr)
+{
+	return (vm_offset_t)PHYSMAP_PTOV(paddr);
+}
+
 
 /*
  *	Routine:        ml_static_mfree
@@ -594,6 +601,18 @@ ml_get_max_cpus(void)
         return(machine_info.max_cpus);
 }
 
+/*
+ *	Routine:        ml_early_cpu_count
+ *	Function:	Logical processors in the boot package, clipped to
+ *			max_ncpus.  Unlike ml_get_max_cpus() this never blocks,
+ *			so it can be used to size tables early in bootstrap.
+ */
+int
+ml_early_cpu_count(void)
+{
+	return (int) MIN(cpuid_info()->thread_count, max_ncpus);
+}
+
 /*
  *	Routine:        ml_init_lock_timeout
  *	Function:
@@ -795,3 +814,145 @@ boolean_t
 ml_timer_forced_evaluation(void) {
 	return ml_timer_evaluation_in_progress;
 }
+
+/*
+ * Vector checksum kernels, in x86_64/in_cksum_simd.s.  They save and
+ * restore the registers they use, but the live register file may hold
+ * another thread's state (CR0.TS set) or our own, so TS must be clear
+ * and nothing else may use the FPU - an interrupt handler, or a thread
+ * we'd be preempted by - while one runs.  Interrupts are therefore off
+ * from the first span of a request that is vectorized until the end of
+ * the request, or until CKSUM_SIMD_BATCH bytes have gone through the
+ * kernels, whichever comes first; the batch bounds interrupt latency
+ * to well under a microsecond at the kernels' rates.
+ *
+ * The boot-arg cksum_simd=<n> limits the kernels used: 0 for none (the
+ * scalar loops in bsd/netinet), 1 for SSE2 only.  AVX2 is used where
+ * present otherwise.
+ */
+#define	CKSUM_SIMD_BATCH	16384
+
+extern uint64_t	in_cksum_sse2(const void *, size_t);
+extern uint64_t	in_cksum_avx2(const void *, size_t);
+extern uint64_t	in_cksum_copy_sse2(const void *, void *, size_t);
+extern uint64_t	in_cksum_copy_avx2(const void *, void *, size_t);
+
+typedef enum {
+	CKSUM_SIMD_UNKNOWN = 0,
+	CKSUM_SIMD_NONE,
+	CKSUM_SIMD_SSE2,
+	CKSUM_SIMD_AVX2
+} cksum_simd_t;
+
+static cksum_simd_t	cksum_simd = CKSUM_SIMD_UNKNOWN;
+
+static cksum_simd_t
+ml_cksum_simd_select(void)
+{
+	uint32_t	limit = CKSUM_SIMD_AVX2;
+	cksum_simd_t	kind = CKSUM_SIMD_SSE2;
+
+	if (PE_parse_boot_argn("cksum_simd", &limit, sizeof (limit)))
+		limit++;	/* 0 == none, 1 == SSE2, ... */
+
+	if ((get_cr4() & CR4_OSXSAVE) &&
+	    (cpuid_leaf7_features() & CPUID_LEAF7_FEATURE_AVX2))
+		kind = CKSUM_SIMD_AVX2;
+	if (kind > limit)
+		kind = (cksum_simd_t)limit;
+	cksum_simd = kind;
+	return (kind);
+}
+
+static inline void
+ml_cksum_simd_enter(ml_cksum_simd_t *cs)
+{
+	cs->cs_istate = ml_set_interrupts_enabled(FALSE);
+	cs->cs_ts = get_cr0() & CR0_TS;
+	if (cs->cs_ts)
+		clear_ts();
+	cs->cs_budget = CKSUM_SIMD_BATCH;
+	cs->cs_entered = TRUE;
+}
+
+static inline void
+ml_cksum_simd_leave(ml_cksum_simd_t *cs)
+{
+	if (cs->cs_ts)
+		set_ts();
+	ml_set_interrupts_enabled(cs->cs_istate);
+	cs->cs_entered = FALSE;
+}
+
+boolean_t
+ml_cksum_simd_begin(ml_cksum_simd_t *cs, size_t len)
+{
+	cksum_simd_t	kind = cksum_simd;
+
+	if (__improbable(kind == CKSUM_SIMD_UNKNOWN))
+		kind = ml_cksum_simd_select();
+
+	if (len < ML_CKSUM_SIMD_MIN)
+		kind = CKSUM_SIMD_NONE;
+
+	cs->cs_kind = kind;
+	cs->cs_entered = FALSE;
+	return (kind != CKSUM_SIMD_NONE);
+}
+
+void
+ml_cksum_simd_end(ml_cksum_simd_t *cs)
+{
+	if (cs->cs_entered)
+		ml_cksum_simd_leave(cs);
+}
+
+static uint64_t
+ml_cksum_simd_common(ml_cksum_simd_t *cs, const void *src, void *dst,
+    size_t len, size_t *done)
+{
+	uint64_t	sum = 0;
+	size_t		off, n;
+
+	*done = 0;
+	if (cs->cs_kind == CKSUM_SIMD_NONE || len < ML_CKSUM_SIMD_SPAN_MIN)
+		return (0);
+
+	len &= ~(size_t)63;
+	for (off = 0; off < len; off += n) {
+		if (!cs->cs_entered)
+			ml_cksum_simd_enter(cs);
+
+		n = MIN(len - off, cs->cs_budget);
+		if (dst == NULL)
+			sum += (cs->cs_kind == CKSUM_SIMD_AVX2) ?
+			    in_cksum_avx2((const char *)src + off, n) :
+			    in_cksum_sse2((const char *)src + off, n);
+		else
+			sum += (cs->cs_kind == CKSUM_SIMD_AVX2) ?
+			    in_cksum_copy_avx2((const char *)src + off,
+			    (char *)dst + off, n) :
+			    in_cksum_copy_sse2((const char *)src + off,
+			    (char *)dst + off, n);
+
+		/* Both are multiples of 64 */
+		cs->cs_budget -= n;
+		if (cs->cs_budget == 0)
+			ml_cksum_simd_leave(cs);
+	}
+	*done = len;
+	return (sum);
+}
+
+uint64_t
+ml_cksum_simd(ml_cksum_simd_t *cs, const void *buf, size_t len, size_t *done)
+{
+	return (ml_cksum_simd_common(cs, buf, NULL, len, done));
+}
+
+uint64_t
+ml_cksum_copy_simd(ml_cksum_simd_t *cs, const void *src, void *dst,
+    size_t len, size_t *done)
+{
+	return (ml_cksum_simd_common(cs, src, dst, len, done));
+}
@@ -88,6 +88,11 @@ vm_offset_t
 ml_static_ptovirt(
 	vm_offset_t);
 
+/* kernel virtual address of any physical page, through the physical map */
+vm_offset_t
+ml_physmap_ptovirt(
+	addr64_t);
+
 void ml_static_mfree(
 	vm_offset_t,
 	vm_size_t);
@@ -167,6 +172,52 @@ boolean_t machine_timeout_suspended(void);
 /* Warm up a CPU to receive an interrupt */
 kern_return_t ml_interrupt_prewarm(uint64_t deadline);
 
+/*
+ * Vector one's complement checksum of (and, for the copy variant, copy
+ * of) the largest multiple of 64 bytes at the front of a buffer.  The
+ * result is the unfolded sum of its little-endian 32-bit words; the
+ * number of bytes covered, possibly 0, is returned through done.
+ *
+ * The kernels run with interrupts off and CR0.TS clear, which costs a
+ * serializing CR0 write each way; a request (one buffer, or the spans
+ * of an mbuf chain) is bracketed by ml_cksum_simd_begin() and
+ * ml_cksum_simd_end() so that this is paid once per request rather
+ * than per span.  Requests shorter than ML_CKSUM_SIMD_MIN in total,
+ * and spans shorter than ML_CKSUM_SIMD_SPAN_MIN, are left to the
+ * scalar loops.
+ */
+#define	ML_CKSUM_SIMD_MIN	2048
+#define	ML_CKSUM_SIMD_SPAN_MIN	256
+
+/* Opaque to callers */
+typedef struct {
+	uint32_t	cs_kind;
+	uint32_t	cs_budget;
+	boolean_t	cs_entered;
+	boolean_t	cs_istate;
+	uintptr_t	cs_ts;
+} ml_cksum_simd_t;
+
+boolean_t ml_cksum_simd_begin(
+	ml_cksum_simd_t	*cs,
+	size_t		len);
+
+void ml_cksum_simd_end(
+	ml_cksum_simd_t	*cs);
+
+uint64_t ml_cksum_simd(
+	ml_cksum_simd_t	*cs,
+	const void	*buf,
+	size_t		len,
+	size_t		*done);
+
+uint64_t ml_cksum_copy_simd(
+	ml_cksum_simd_t	*cs,
+	const void	*src,
+	void		*dst,
+	size_t		len,
+	size_t		*done);
+
 #endif /* XNU_KERNEL_PRIVATE */
 
 #ifdef KERNEL_PRIVATE
@@ -294,6 +345,10 @@ void ml_thread_policy(
 int ml_get_max_cpus(
 	void);
 
+/* Estimate of the logical CPU count, usable before ml_init_max_cpus() */
+int ml_early_cpu_count(
+	void);
+
 /*
  * The following are in pmCPU.c not machine_routines.c.
  */
@@ -300,6 +300,7 @@ pmap_store_pte(pt_entry_t *entryp, pt_entry_t value)
 #define INTEL_PTE_GLOBAL	0x00000100ULL
 #define INTEL_PTE_WIRED		0x00000200ULL
 #define INTEL_PDPTE_NESTED	0x00000400ULL
+#define INTEL_PDE_PROMOTED	0x00000800ULL	/* 2MB pde promoted from a page table */
 #define INTEL_PTE_PFN		PG_FRAME
 
 #define INTEL_PTE_NX		(1ULL << 63)
@@ -339,6 +340,7 @@ extern pt_entry_t	*PTmap;
 extern pdpt_entry_t	*IdlePDPT;
 extern pml4_entry_t	*IdlePML4;
 extern boolean_t	no_shared_cr3;
+extern boolean_t	pmap_kernel_global_pages;
 extern addr64_t		kernel64_cr3;
 extern pd_entry_t	*IdlePTD;	/* physical addr of "Idle" state PTD */
 
@@ -414,6 +416,8 @@ struct pmap {
 	int		ref_count;	/* reference count */
         int		nx_enabled;
 	ledger_t	ledger;		/* ledger tracking phys mappings */
+	int		pm_superpage_promotions; /* transparent 2MB promotions */
+	int		pm_superpage_demotions;	/* ... and demotions */
 };
 
 
@@ -710,6 +714,15 @@ extern boolean_t pmap_is_empty(pmap_t		pmap,
 
 #define MACHINE_BOOTSTRAPPTD	1	/* Static bootstrap page-tables */
 
+#if defined(__x86_64__)
+#define MACHINE_PMAP_PROMOTE_SUPERPAGE	1
+extern boolean_t pmap_promote_superpage(pmap_t		pmap,
+				       vm_map_offset_t	vaddr);
+extern void pmap_superpage_counts(pmap_t	pmap,
+				  integer_t	*promotions,
+				  integer_t	*demotions);
+#endif
+
 kern_return_t
 pmap_permissions_verify(pmap_t, vm_map_t, vm_offset_t, vm_offset_t);
 
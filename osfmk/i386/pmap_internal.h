@@ -1044,6 +1044,24 @@ pmap_pde(pmap_t m, vm_map_offset_t v)
 }
 
 
+/*
+ * Transparent superpages: a fully populated, physically contiguous page
+ * table can be replaced by a 2MB pde marked INTEL_PDE_PROMOTED.  The page
+ * table page and the base pages' pv entries are kept while promoted, so
+ * demotion only has to reinstall the page table.
+ */
+extern void	pmap_superpage_init(void);
+extern void	pmap_superpage_purge(pmap_t pmap);
+extern void	pmap_demote_superpage(pmap_t pmap, vm_map_offset_t vaddr, pd_entry_t *pdep);
+
+static inline void
+pmap_pde_demote(pmap_t pmap, vm_map_offset_t vaddr, pd_entry_t *pdep)
+{
+	if (__improbable((*pdep & (INTEL_PTE_PS | INTEL_PDE_PROMOTED)) ==
+			 (INTEL_PTE_PS | INTEL_PDE_PROMOTED)))
+		pmap_demote_superpage(pmap, vaddr, pdep);
+}
+
 /*
  * return address of mapped pte for vaddr va in pmap pmap.
  *
@@ -1060,8 +1078,15 @@ pmap_pte(pmap_t pmap, vm_map_offset_t vaddr)
 	pde = pmap64_pde(pmap, vaddr);
 
 	if (pde && ((*pde & INTEL_PTE_VALID))) {
-		if (*pde & INTEL_PTE_PS) 
-			return pde;
+		if (*pde & INTEL_PTE_PS) {
+			if (__probable(!(*pde & INTEL_PDE_PROMOTED)))
+				return pde;
+			/*
+			 * A transparently promoted superpage still has
+			 * its page table: hand the caller a base pte.
+			 */
+			pmap_demote_superpage(pmap, vaddr, pde);
+		}
 		newpf = *pde & PG_FRAME;
 		return &((pt_entry_t *)PHYSMAP_PTOV(newpf))
 			[i386_btop(vaddr) & (ppnum_t)(NPTEPG-1)];
@@ -43,6 +43,18 @@ void		pmap_remove_range_options(
 			pt_entry_t	*epte,
 			int		options);
 
+static int	pmap_remove_range_invalidate(
+			pmap_t		pmap,
+			pt_entry_t	*spte,
+			pt_entry_t	*epte,
+			int		options);
+
+static void	pmap_remove_range_finish(
+			pmap_t		pmap,
+			vm_map_offset_t	va,
+			pt_entry_t	*spte,
+			pt_entry_t	*epte);
+
 void		pmap_reusable_range(
 			pmap_t		pmap,
 			vm_map_offset_t	va,
@@ -592,6 +604,8 @@ Retry:
 		}
 		if (pmap != kernel_pmap)
 			template |= INTEL_PTE_USER;
+		else if (pmap_kernel_global_pages)
+			template |= INTEL_PTE_GLOBAL;
 		if (prot & VM_PROT_WRITE) {
 			template |= INTEL_PTE_WRITE;
 		}
@@ -861,6 +875,8 @@ Retry:
 	}
 	if (pmap != kernel_pmap)
 		template |= INTEL_PTE_USER;
+	else if (pmap_kernel_global_pages)
+		template |= INTEL_PTE_GLOBAL;
 	if (prot & VM_PROT_WRITE)
 		template |= INTEL_PTE_WRITE;
 	if (set_NX)
@@ -943,32 +959,45 @@ pmap_remove_range_options(
 	pt_entry_t		*spte,
 	pt_entry_t		*epte,
 	int			options)
+{
+	if (pmap_remove_range_invalidate(pmap, spte, epte, options) == 0) {
+		/* nothing was changed: we're done */
+		return;
+	}
+
+	/* propagate the invalidates to other CPUs */
+
+	PMAP_UPDATE_TLBS(pmap, start_vaddr, start_vaddr + PAGE_SIZE_64 * (epte - spte));
+
+	pmap_remove_range_finish(pmap, start_vaddr, spte, epte);
+}
+
+/*
+ *	First half of pmap_remove_range_options(): clear the valid bit
+ *	in every PTE of the range to "freeze" it, and drop device and
+ *	compressed-marker entries outright.  Returns the number of
+ *	mappings found; if non-zero, the caller must flush the TLBs
+ *	and then call pmap_remove_range_finish() before dropping the
+ *	pmap lock.
+ */
+static int
+pmap_remove_range_invalidate(
+	pmap_t			pmap,
+	pt_entry_t		*spte,
+	pt_entry_t		*epte,
+	int			options)
 {
 	pt_entry_t		*cpte;
-	pv_hashed_entry_t       pvh_et = PV_HASHED_ENTRY_NULL;
-	pv_hashed_entry_t       pvh_eh = PV_HASHED_ENTRY_NULL;
-	pv_hashed_entry_t       pvh_e;
-	int			pvh_cnt = 0;
-	int			num_removed, num_unwired, num_found, num_invalid;
-	int			num_device, num_external, num_internal, num_reusable;
+	int			num_unwired, num_found;
 	uint64_t		num_compressed;
 	ppnum_t			pai;
 	pmap_paddr_t		pa;
-	vm_map_offset_t		vaddr;
 
-	num_removed = 0;
 	num_unwired = 0;
 	num_found   = 0;
-	num_invalid = 0;
-	num_device  = 0;
-	num_external = 0;
-	num_internal = 0;
-	num_reusable = 0;
 	num_compressed = 0;
 	/* invalidate the PTEs first to "freeze" them */
-	for (cpte = spte, vaddr = start_vaddr;
-	     cpte < epte;
-	     cpte++, vaddr += PAGE_SIZE_64) {
+	for (cpte = spte; cpte < epte; cpte++) {
 		pt_entry_t p = *cpte;
 
 		pa = pte_to_pa(p);
@@ -997,25 +1026,61 @@ pmap_remove_range_options(
 			 *	Just remove the mappings.
 			 */
 			pmap_store_pte(cpte, 0);
-			num_device++;
 			continue;
 		}
 
-		if ((p & INTEL_PTE_VALID) == 0)
-			num_invalid++;
-
 		/* invalidate the PTE */
 		pmap_update_pte(cpte, INTEL_PTE_VALID, 0);
 	}
 
-	if (num_found == 0) {
-		/* nothing was changed: we're done */
-	        goto update_counts;
+	/*
+	 *	Update the counts
+	 */
+	if (pmap != kernel_pmap) {
+		assert(pmap->stats.compressed >= num_compressed);
+		if (num_compressed)
+			OSAddAtomic64(-num_compressed, &pmap->stats.compressed);
 	}
 
-	/* propagate the invalidates to other CPUs */
+#if TESTING
+	if (pmap->stats.wired_count < num_unwired)
+	        panic("pmap_remove_range: wired_count");
+#endif
+	assert(pmap->stats.wired_count >= num_unwired);
+	OSAddAtomic(-num_unwired,  &pmap->stats.wired_count);
+	pmap_ledger_debit(pmap, task_ledgers.wired_mem, machine_ptob(num_unwired));
+
+	return (num_found);
+}
 
-	PMAP_UPDATE_TLBS(pmap, start_vaddr, vaddr);
+/*
+ *	Second half of pmap_remove_range_options(), run once the
+ *	invalidations are visible on every processor: harvest the
+ *	final reference and modify bits, unlink the pv entries and
+ *	clear the PTEs.
+ */
+static void
+pmap_remove_range_finish(
+	pmap_t			pmap,
+	vm_map_offset_t		start_vaddr,
+	pt_entry_t		*spte,
+	pt_entry_t		*epte)
+{
+	pt_entry_t		*cpte;
+	pv_hashed_entry_t       pvh_et = PV_HASHED_ENTRY_NULL;
+	pv_hashed_entry_t       pvh_eh = PV_HASHED_ENTRY_NULL;
+	pv_hashed_entry_t       pvh_e;
+	int			pvh_cnt = 0;
+	int			num_removed;
+	int			num_external, num_internal, num_reusable;
+	ppnum_t			pai;
+	pmap_paddr_t		pa;
+	vm_map_offset_t		vaddr;
+
+	num_removed = 0;
+	num_external = 0;
+	num_internal = 0;
+	num_reusable = 0;
 
 	for (cpte = spte, vaddr = start_vaddr;
 	     cpte < epte;
@@ -1075,7 +1140,7 @@ pmap_remove_range_options(
 	if (pvh_eh != PV_HASHED_ENTRY_NULL) {
 		PV_HASHED_FREE_LIST(pvh_eh, pvh_et, pvh_cnt);
 	}
-update_counts:
+
 	/*
 	 *	Update the counts
 	 */
@@ -1089,11 +1154,6 @@ update_counts:
 	OSAddAtomic(-num_removed,  &pmap->stats.resident_count);
 
 	if (pmap != kernel_pmap) {
-#if 00
-		assert(pmap->stats.device >= num_device);
-		if (num_device)
-			OSAddAtomic(-num_device, &pmap->stats.device);
-#endif /* 00 */
 		assert(pmap->stats.external >= num_external);
 		if (num_external)
 			OSAddAtomic(-num_external, &pmap->stats.external);
@@ -1103,22 +1163,45 @@ update_counts:
 		assert(pmap->stats.reusable >= num_reusable);
 		if (num_reusable)
 			OSAddAtomic(-num_reusable, &pmap->stats.reusable);
-		assert(pmap->stats.compressed >= num_compressed);
-		if (num_compressed)
-			OSAddAtomic64(-num_compressed, &pmap->stats.compressed);
 	}
+}
 
-#if TESTING
-	if (pmap->stats.wired_count < num_unwired)
-	        panic("pmap_remove_range: wired_count");
-#endif
-	assert(pmap->stats.wired_count >= num_unwired);
-	OSAddAtomic(-num_unwired,  &pmap->stats.wired_count);
-	pmap_ledger_debit(pmap, task_ledgers.wired_mem, machine_ptob(num_unwired));
+/*
+ *	pmap_remove_options() invalidates up to this many pte-page
+ *	ranges before issuing a single TLB shootdown for all of them.
+ */
+#define PMAP_REMOVE_BATCH	16
+
+struct pmap_remove_batch {
+	int			count;
+	struct pmap_remove_range {
+		vm_map_offset_t	va;
+		pt_entry_t	*spte, *epte;
+	}			range[PMAP_REMOVE_BATCH];
+};
+
+static void
+pmap_remove_batch_flush(
+	pmap_t			map,
+	struct pmap_remove_batch *batch)
+{
+	struct pmap_remove_range *last;
+	int	i;
 
-	return;
-}
+	if (batch->count == 0)
+		return;
 
+	/* One shootdown covers every range: x86 flushes whole TLBs */
+	last = &batch->range[batch->count - 1];
+	PMAP_UPDATE_TLBS(map, batch->range[0].va,
+	    last->va + PAGE_SIZE_64 * (last->epte - last->spte));
+
+	for (i = 0; i < batch->count; i++)
+		pmap_remove_range_finish(map, batch->range[i].va,
+		    batch->range[i].spte, batch->range[i].epte);
+
+	batch->count = 0;
+}
 
 /*
  *	Remove the given range of addresses
@@ -1147,12 +1230,15 @@ pmap_remove_options(
 	pt_entry_t     *spte, *epte;
 	addr64_t        l64;
 	uint64_t        deadline;
+	struct pmap_remove_batch batch;
 
 	pmap_intr_assert();
 
 	if (map == PMAP_NULL || s64 == e64)
 		return;
 
+	batch.count = 0;
+
 	PMAP_TRACE(PMAP_CODE(PMAP__REMOVE) | DBG_FUNC_START,
 		   map,
 		   (uint32_t) (s64 >> 32), s64,
@@ -1202,6 +1288,7 @@ pmap_remove_options(
 		pde = pmap_pde(map, s64);
 
 		if (pde && (*pde & INTEL_PTE_VALID)) {
+			pmap_pde_demote(map, s64, pde);
 			if (*pde & INTEL_PTE_PS) {
 				/*
 				 * If we're removing a superpage, pmap_remove_range()
@@ -1216,18 +1303,27 @@ pmap_remove_options(
 				spte = &spte[ptenum(s64)];
 				epte = &spte[intel_btop(l64 - s64)];
 			}
-			pmap_remove_range_options(map, s64, spte, epte,
-						  options);
+			if (pmap_remove_range_invalidate(map, spte, epte, options) != 0) {
+				batch.range[batch.count].va = s64;
+				batch.range[batch.count].spte = spte;
+				batch.range[batch.count].epte = epte;
+				if (++batch.count == PMAP_REMOVE_BATCH)
+					pmap_remove_batch_flush(map, &batch);
+			}
 		}
 		s64 = l64;
 
 		if (s64 < e64 && rdtsc64() >= deadline) {
+			/* Frozen PTEs must be finished before unlocking */
+			pmap_remove_batch_flush(map, &batch);
 			PMAP_UNLOCK(map)
 			PMAP_LOCK(map)
 			deadline = rdtsc64() + max_preemption_latency_tsc;
 		}
 	}
 
+	pmap_remove_batch_flush(map, &batch);
+
 	PMAP_UNLOCK(map);
 
 	PMAP_TRACE(PMAP_CODE(PMAP__REMOVE) | DBG_FUNC_END,
@@ -1720,6 +1816,9 @@ pmap_map_bd(
 	if (prot & VM_PROT_WRITE)
 		template |= INTEL_PTE_WRITE;
 
+	if (pmap_kernel_global_pages)
+		template |= INTEL_PTE_GLOBAL;
+
 	while (start_addr < end_addr) {
 	        spl = splhigh();
 		pte = pmap_pte(kernel_pmap, (vm_map_offset_t)virt);
@@ -1770,6 +1869,7 @@ pmap_reusable(
 		pde = pmap_pde(pmap, s64);
 
 		if (pde && (*pde & INTEL_PTE_VALID)) {
+			pmap_pde_demote(pmap, s64, pde);
 			if (*pde & INTEL_PTE_PS) {
 				/* superpage: not supported */
 			} else {
@@ -1928,7 +2028,10 @@ pmap_query_resident(
 		pde = pmap_pde(pmap, s64);
 
 		if (pde && (*pde & INTEL_PTE_VALID)) {
-			if (*pde & INTEL_PTE_PS) {
+			if (*pde & INTEL_PDE_PROMOTED) {
+				/* promoted superpage: every base page is resident */
+				result += (unsigned int) intel_btop(l64 - s64);
+			} else if (*pde & INTEL_PTE_PS) {
 				/* superpage: not supported */
 			} else {
 				spte = pmap_pte(pmap,
@@ -1960,3 +2063,270 @@ pmap_query_resident(
 
 	return result;
 }
+
+/*
+ * Transparent superpages.
+ *
+ * pmap_promote_superpage() replaces a page table whose 512 ptes map a
+ * naturally aligned, physically contiguous 2MB run with identical
+ * attributes by a single 2MB pde tagged INTEL_PDE_PROMOTED.  The page
+ * table page is not freed and the pv entries of the base pages are left
+ * alone, so everything that finds a base page through its pv list keeps
+ * working: pmap_pte() notices the promoted pde and calls
+ * pmap_demote_superpage(), which folds the pde's ref/mod bits back into
+ * the saved ptes and reinstalls the page table.
+ *
+ * The saved page table pages are remembered in a small hash keyed by
+ * (pmap, va), protected by pmap_superpage_lock.  That lock is a leaf: it
+ * is taken with the pmap lock and/or pv locks held.
+ */
+#define PMAP_SUPERPAGE_HASH_SIZE	1024	/* must be a power of 2 */
+#define PMAP_SUPERPAGE_HASH(pmap, va)					\
+	((((uintptr_t)(pmap) >> 6) ^ ((va) >> PDSHIFT)) & (PMAP_SUPERPAGE_HASH_SIZE - 1))
+
+#define PMAP_SUPERPAGE_ATTR_MASK					\
+	(INTEL_PTE_WRITE | INTEL_PTE_USER | INTEL_PTE_WTHRU |		\
+	 INTEL_PTE_NCACHE | INTEL_PTE_PTA | INTEL_PTE_GLOBAL |		\
+	 INTEL_PTE_WIRED | INTEL_PTE_NX)
+
+typedef struct pmap_superpage {
+	struct pmap_superpage	*next;
+	pmap_t			pmap;
+	vm_map_offset_t		va;	/* SUPERPAGE_SIZE aligned */
+	pmap_paddr_t		ptp;	/* page table kept while promoted */
+} *pmap_superpage_t;
+
+static pmap_superpage_t	pmap_superpage_hash[PMAP_SUPERPAGE_HASH_SIZE];
+static pmap_superpage_t	pmap_superpage_free_list;
+static zone_t		pmap_superpage_zone;
+decl_simple_lock_data(static, pmap_superpage_lock)
+
+long long	pmap_superpage_promotions __attribute__((aligned(8))) = 0;
+long long	pmap_superpage_demotions __attribute__((aligned(8))) = 0;
+
+void
+pmap_superpage_init(void)
+{
+	vm_size_t	s = (vm_size_t) sizeof (struct pmap_superpage);
+
+	simple_lock_init(&pmap_superpage_lock, 0);
+	pmap_superpage_zone = zinit(s, 10000 * s, PAGE_SIZE, "pmap superpages");
+	zone_change(pmap_superpage_zone, Z_NOENCRYPT, TRUE);
+}
+
+boolean_t
+pmap_promote_superpage(
+	pmap_t		pmap,
+	vm_map_offset_t	vaddr)
+{
+	pd_entry_t		*pdep;
+	pt_entry_t		*ptep;
+	pt_entry_t		first, pte;
+	pmap_paddr_t		pa;
+	ppnum_t			pai;
+	pmap_superpage_t	psp;
+	unsigned int		i, nlocked;
+	boolean_t		promoted = FALSE;
+
+	if (pmap == PMAP_NULL || pmap == kernel_pmap)
+		return FALSE;
+
+	vaddr &= ~((vm_map_offset_t) SUPERPAGE_SIZE - 1);
+
+	simple_lock(&pmap_superpage_lock);
+	if ((psp = pmap_superpage_free_list) != NULL)
+		pmap_superpage_free_list = psp->next;
+	simple_unlock(&pmap_superpage_lock);
+
+	if (psp == NULL)
+		psp = (pmap_superpage_t) zalloc(pmap_superpage_zone);
+
+	PMAP_TRACE(PMAP_CODE(PMAP__PROMOTE) | DBG_FUNC_START,
+		   pmap, (uint32_t) (vaddr >> 32), (uint32_t) vaddr, 0, 0);
+
+	nlocked = 0;
+
+	PMAP_LOCK(pmap);
+
+	pdep = pmap_pde(pmap, vaddr);
+	if (pdep == PD_ENTRY_NULL ||
+	    (*pdep & (INTEL_PTE_VALID | INTEL_PTE_PS)) != INTEL_PTE_VALID)
+		goto out;
+
+	ptep = (pt_entry_t *) PHYSMAP_PTOV(*pdep & PG_FRAME);
+	first = ptep[0];
+	pa = pte_to_pa(first);
+	pai = pa_index(pa);
+
+	/*
+	 * The PAT bit of a 4K pte is the PS bit of a pde, so only
+	 * mappings that don't use it can be promoted.
+	 */
+	if (!(first & INTEL_PTE_VALID) ||
+	    (pa & (SUPERPAGE_SIZE - 1)) ||
+	    (first & (INTEL_PTE_PTA | INTEL_PTE_WIRED)))
+		goto out;
+
+	/*
+	 * Take every base page's pv lock, in ascending order, so that
+	 * no pv-driven operation (pmap_page_protect, attribute clears,
+	 * ...) can change one of the ptes while we collapse them.
+	 */
+	for (i = 0; i < SUPERPAGE_NBASEPAGES; i++) {
+		if (!IS_MANAGED_PAGE(pai + i))
+			goto out;
+		LOCK_PVH(pai + i);
+		nlocked++;
+
+		pte = ptep[i];
+		if (!(pte & INTEL_PTE_VALID) ||
+		    pte_to_pa(pte) != pa + i386_ptob(i) ||
+		    (pte & PMAP_SUPERPAGE_ATTR_MASK) != (first & PMAP_SUPERPAGE_ATTR_MASK))
+			goto out;
+	}
+
+	psp->pmap = pmap;
+	psp->va = vaddr;
+	psp->ptp = pte_to_pa(*pdep);
+
+	simple_lock(&pmap_superpage_lock);
+	psp->next = pmap_superpage_hash[PMAP_SUPERPAGE_HASH(pmap, vaddr)];
+	pmap_superpage_hash[PMAP_SUPERPAGE_HASH(pmap, vaddr)] = psp;
+	simple_unlock(&pmap_superpage_lock);
+	psp = NULL;
+
+	pmap_store_pte(pdep, pa_to_pte(pa) |
+		       (first & PMAP_SUPERPAGE_ATTR_MASK) |
+		       INTEL_PTE_VALID | INTEL_PTE_PS | INTEL_PDE_PROMOTED);
+	/*
+	 * Flush the 4K translations so that no cpu holds both
+	 * sizes for the same range.
+	 */
+	PMAP_UPDATE_TLBS(pmap, vaddr, vaddr + SUPERPAGE_SIZE);
+
+	OSAddAtomic(1, &pmap->pm_superpage_promotions);
+	OSAddAtomic64(1, &pmap_superpage_promotions);
+	promoted = TRUE;
+out:
+	while (nlocked > 0) {
+		nlocked--;
+		UNLOCK_PVH(pai + nlocked);
+	}
+	PMAP_UNLOCK(pmap);
+
+	if (psp != NULL) {
+		simple_lock(&pmap_superpage_lock);
+		psp->next = pmap_superpage_free_list;
+		pmap_superpage_free_list = psp;
+		simple_unlock(&pmap_superpage_lock);
+	}
+
+	PMAP_TRACE(PMAP_CODE(PMAP__PROMOTE) | DBG_FUNC_END,
+		   pmap, promoted, 0, 0, 0);
+
+	return promoted;
+}
+
+/*
+ * Called with the pmap lock or a pv lock of one of the base pages held,
+ * either of which keeps the range from being promoted again under us.
+ */
+void
+pmap_demote_superpage(
+	pmap_t		pmap,
+	vm_map_offset_t	vaddr,
+	pd_entry_t	*pdep)
+{
+	pmap_superpage_t	psp, *pspp;
+	pt_entry_t		*ptep;
+	pd_entry_t		opde;
+	uint64_t		refmod;
+	unsigned int		i;
+
+	vaddr &= ~((vm_map_offset_t) SUPERPAGE_SIZE - 1);
+
+	simple_lock(&pmap_superpage_lock);
+
+	for (pspp = &pmap_superpage_hash[PMAP_SUPERPAGE_HASH(pmap, vaddr)];
+	     (psp = *pspp) != NULL;
+	     pspp = &psp->next) {
+		if (psp->pmap == pmap && psp->va == vaddr)
+			break;
+	}
+	if (psp == NULL) {
+		/*
+		 * Somebody else demoted this range first; the pde
+		 * already points at the page table again.
+		 */
+		simple_unlock(&pmap_superpage_lock);
+		return;
+	}
+	ptep = (pt_entry_t *) PHYSMAP_PTOV(psp->ptp);
+
+	/*
+	 * The hardware only maintained ref/mod in the pde while the
+	 * range was promoted: push them down into every base pte
+	 * before switching back, and retry if they changed meanwhile.
+	 */
+	do {
+		opde = *pdep;
+		refmod = opde & (INTEL_PTE_REF | INTEL_PTE_MOD);
+		if (refmod) {
+			for (i = 0; i < SUPERPAGE_NBASEPAGES; i++)
+				pmap_update_pte(&ptep[i], 0, refmod);
+		}
+	} while (!pmap_cmpx_pte(pdep, opde, pa_to_pte(psp->ptp) |
+				INTEL_PTE_VALID | INTEL_PTE_USER | INTEL_PTE_WRITE));
+
+	*pspp = psp->next;
+	psp->next = pmap_superpage_free_list;
+	pmap_superpage_free_list = psp;
+
+	simple_unlock(&pmap_superpage_lock);
+
+	OSAddAtomic(1, &pmap->pm_superpage_demotions);
+	OSAddAtomic64(1, &pmap_superpage_demotions);
+
+	PMAP_UPDATE_TLBS(pmap, vaddr, vaddr + SUPERPAGE_SIZE);
+}
+
+/*
+ * Lifetime promotion and demotion counts for a pmap, for task_info().
+ */
+void
+pmap_superpage_counts(
+	pmap_t		pmap,
+	integer_t	*promotions,
+	integer_t	*demotions)
+{
+	*promotions = pmap->pm_superpage_promotions;
+	*demotions = pmap->pm_superpage_demotions;
+}
+
+/*
+ * Forget any promotion records left for a pmap being destroyed.
+ */
+void
+pmap_superpage_purge(
+	pmap_t		pmap)
+{
+	pmap_superpage_t	psp, *pspp;
+	unsigned int		i;
+
+	simple_lock(&pmap_superpage_lock);
+
+	for (i = 0; i < PMAP_SUPERPAGE_HASH_SIZE; i++) {
+		pspp = &pmap_superpage_hash[i];
+
+		while ((psp = *pspp) != NULL) {
+			if (psp->pmap != pmap) {
+				pspp = &psp->next;
+				continue;
+			}
+			*pspp = psp->next;
+			psp->next = pmap_superpage_free_list;
+			pmap_superpage_free_list = psp;
+		}
+	}
+	simple_unlock(&pmap_superpage_lock);
+}
@@ -102,7 +102,7 @@ ipc_entry_lookup(
 			
 	index = MACH_PORT_INDEX(name);
 	if (index <  space->is_table_size) {
-                entry = &space->is_table[index];
+                entry = is_table_entry(space, index);
 		if (IE_BITS_GEN(entry->ie_bits) != MACH_PORT_GEN(name) ||
 		    IE_BITS_TYPE(entry->ie_bits) == MACH_PORT_TYPE_NONE)
 			entry = IE_NULL;		
@@ -147,7 +147,7 @@ ipc_entry_get(
 			return KERN_NO_SPACE;
 
 		assert(first_free < space->is_table_size);
-		free_entry = &table[first_free];
+		free_entry = is_table_entry(space, first_free);
 		table->ie_next = free_entry->ie_next;
 	}
 
@@ -269,9 +269,7 @@ ipc_entry_alloc_name(
 		 *	cases 1) and 3), because ports cannot be renamed.
 		 */
 		if (index < space->is_table_size) {
-			ipc_entry_t table = space->is_table;
-
-			entry = &table[index];
+			entry = is_table_entry(space, index);
 
 			if (index == 0) {
 				/* case #1 - the entry is reserved */
@@ -292,6 +290,7 @@ ipc_entry_alloc_name(
 				}
 			} else {
 				mach_port_index_t free_index, next_index;
+				ipc_entry_t free_entry;
 
 				/*
 				 *      case #4 -- the entry is free
@@ -299,19 +298,19 @@ ipc_entry_alloc_name(
 				 */
 
 				for (free_index = 0;
-				     (next_index = table[free_index].ie_next)
+				     (next_index = is_table_entry(space, free_index)->ie_next)
 							!= index;
 				     free_index = next_index)
 					continue;
 
-				table[free_index].ie_next =
-					table[next_index].ie_next;
+				free_entry = is_table_entry(space, free_index);
+				free_entry->ie_next = entry->ie_next;
 				
 				/* mark the previous entry modified - reconstructing the name */
 				ipc_entry_modified(space, 
 						   MACH_PORT_MAKE(free_index, 
-						   	IE_BITS_GEN(table[free_index].ie_bits)),
-						   &table[free_index]);
+						   	IE_BITS_GEN(free_entry->ie_bits)),
+						   free_entry);
 
 				entry->ie_bits = gen;
 				entry->ie_request = IE_REQ_NONE;
@@ -371,7 +370,7 @@ ipc_entry_dealloc(
 	table = space->is_table;
 	size = space->is_table_size;
 
-	if ((index < size) && (entry == &table[index])) {
+	if ((index < size) && (entry == is_table_entry(space, index))) {
 		assert(IE_BITS_GEN(entry->ie_bits) == MACH_PORT_GEN(name));
 		entry->ie_bits &= IE_BITS_GEN_MASK;
 		entry->ie_next = table->ie_next;
@@ -382,7 +381,7 @@ ipc_entry_dealloc(
 		 * so there is nothing to deallocate.
 		 */
                 assert(index < size);
-		assert(entry == &table[index]);
+		assert(entry == is_table_entry(space, index));
 		assert(IE_BITS_GEN(entry->ie_bits) == MACH_PORT_GEN(name));
 	}
 	ipc_entry_modified(space, name, entry);
@@ -392,6 +391,9 @@ ipc_entry_dealloc(
  *	Routine:	ipc_entry_modified
  *	Purpose:
  *		Note that an entry was modified in a space.
+ *		Growing a table no longer copies entries with
+ *		the space unlocked, so there is nothing to track;
+ *		this only checks the entry belongs to the space.
  *	Conditions:
  *		Assumes exclusive write access to the space,
  *		either through a write lock or being the cleaner
@@ -400,45 +402,158 @@ ipc_entry_dealloc(
 
 void
 ipc_entry_modified(
-	ipc_space_t		space,
-	mach_port_name_t	name,
-	__assert_only ipc_entry_t entry)
+	__assert_only ipc_space_t	space,
+	mach_port_name_t		name,
+	__assert_only ipc_entry_t	entry)
 {
-	ipc_entry_t table;
-	ipc_entry_num_t size;
-	mach_port_index_t index;
+	__assert_only mach_port_index_t index;
 
 	index = MACH_PORT_INDEX(name);
-	table = space->is_table;
-	size = space->is_table_size;
-
-	assert(index < size);
-	assert(entry == &table[index]);
 
-	assert(space->is_low_mod <= size);
-	assert(space->is_high_mod < size);
-
-	if (index < space->is_low_mod)
-		space->is_low_mod = index;
-	if (index > space->is_high_mod)
-		space->is_high_mod = index;
+	assert(index < space->is_table_size);
+	assert(entry == is_table_entry(space, index));
 }
 
 #define IPC_ENTRY_GROW_STATS 1
 #if IPC_ENTRY_GROW_STATS
 static uint64_t ipc_entry_grow_count = 0;
-static uint64_t ipc_entry_grow_rescan = 0;
-static uint64_t ipc_entry_grow_rescan_max = 0;
-static uint64_t ipc_entry_grow_rescan_entries = 0;
-static uint64_t ipc_entry_grow_rescan_entries_max = 0;
-static uint64_t	ipc_entry_grow_freelist_entries = 0;
-static uint64_t	ipc_entry_grow_freelist_entries_max = 0;
+static uint64_t ipc_entry_grow_leaves = 0;
+static uint64_t ipc_entry_grow_dir = 0;
 #endif
 
+/*
+ *	Routine:	ipc_entry_leaf_init
+ *	Purpose:
+ *		Initialize entries [first, first + count) of a new
+ *		leaf as free, chained in order onto the free list
+ *		whose old head is "next".
+ */
+
+static void
+ipc_entry_leaf_init(
+	ipc_entry_t		leaf,
+	mach_port_index_t	first,
+	ipc_entry_num_t		count,
+	mach_port_index_t	next)
+{
+	mach_port_index_t i;
+
+	for (i = 0; i < count; i++) {
+		leaf[i].ie_object = IO_NULL;
+		leaf[i].ie_bits = IE_BITS_GEN_MASK;
+		leaf[i].ie_index = 0;
+		leaf[i].ie_link = 0;
+		leaf[i].ie_next = first + i + 1;
+	}
+	leaf[count - 1].ie_next = next;
+}
+
+/*
+ *	Routine:	ipc_entry_grow_first_leaf
+ *	Purpose:
+ *		Grows a table smaller than IE_LEAF_ENTRIES to the
+ *		next size on the ipc_table_entries ladder (at least
+ *		target_size if given), but no larger than one leaf.
+ *		The entries are copied with the space locked; there
+ *		are few enough of them that this is cheap.
+ *	Conditions:
+ *		As ipc_entry_grow_table.  The space is not growing.
+ */
+
+static kern_return_t
+ipc_entry_grow_first_leaf(
+	ipc_space_t		space,
+	ipc_table_elems_t	target_size)
+{
+	ipc_entry_num_t osize, size;
+	ipc_entry_t otable, table;
+	ipc_table_size_t its;
+
+	osize = space->is_table_size;
+	assert(osize < IE_LEAF_ENTRIES);
+
+	its = space->is_table_next;
+	if (target_size != ITS_SIZE_NONE) {
+		while ((its->its_size < target_size) &&
+		       (its->its_size < IE_LEAF_ENTRIES) &&
+		       (its[1].its_size != its->its_size))
+			its++;
+	}
+	size = its->its_size;
+	if (size > IE_LEAF_ENTRIES)
+		size = IE_LEAF_ENTRIES;
+
+	if (size <= osize) {
+		is_write_unlock(space);
+		return KERN_NO_SPACE;
+	}
+
+	is_start_growing(space);
+#if IPC_ENTRY_GROW_STATS
+	ipc_entry_grow_count++;
+#endif
+	is_write_unlock(space);
+
+	table = (ipc_entry_t)ipc_table_alloc(size * sizeof(struct ipc_entry));
+	if (table == IE_NULL) {
+		is_write_lock(space);
+		is_done_growing(space);
+		is_write_unlock(space);
+		thread_wakeup((event_t) space);
+		return KERN_RESOURCE_SHORTAGE;
+	}
+
+	is_write_lock(space);
+
+	if (!is_active(space)) {
+		/*
+		 *	The space died while it was unlocked.
+		 */
+
+		is_done_growing(space);
+		is_write_unlock(space);
+		thread_wakeup((event_t) space);
+		ipc_table_free(size * sizeof(struct ipc_entry), table);
+		is_write_lock(space);
+		return KERN_SUCCESS;
+	}
+
+	/*
+	 *	Copy the old entries, reverse hash and all (it is
+	 *	indexed by name), and put the new ones at the head
+	 *	of the free list.
+	 */
+	otable = space->is_table;
+	assert(space->is_table_size == osize);
+	assert(space->is_table_dir == &space->is_table);
+
+	memcpy((void *)table, (void *)otable, osize * sizeof(struct ipc_entry));
+	ipc_entry_leaf_init(&table[osize], osize, size - osize, table[0].ie_next);
+	table[0].ie_next = osize;
+
+	space->is_table = table;
+	space->is_table_size = size;
+	space->is_table_next = its + 1;
+
+	is_done_growing(space);
+	is_write_unlock(space);
+
+	thread_wakeup((event_t) space);
+
+	ipc_table_free(osize * sizeof(struct ipc_entry), otable);
+	is_write_lock(space);
+
+	return KERN_SUCCESS;
+}
+
 /*
  *	Routine:	ipc_entry_grow_table
  *	Purpose:
  *		Grows the table in a space.
+ *
+ *		Past IE_LEAF_ENTRIES, a table grows by whole leaves
+ *		which are linked into the directory with the space
+ *		locked; existing entries are never copied or moved.
  *	Conditions:
  *		The space must be write-locked and active before.
  *		If successful, the space is also returned locked.
@@ -457,16 +572,12 @@ ipc_entry_grow_table(
 	ipc_space_t		space,
 	ipc_table_elems_t	target_size)
 {
-	ipc_entry_num_t osize, size, nsize, psize;
+	ipc_entry_num_t osize, size, max_size;
+	ipc_entry_num_t dir_size;
+	ipc_entry_t *dir, *odir;
+	ipc_entry_t leaf;
+	kern_return_t kr;
 
-	ipc_entry_t otable, table;
-	ipc_table_size_t oits, its, nits;
-	mach_port_index_t i, free_index;
-	mach_port_index_t low_mod, hi_mod;
-	ipc_table_index_t sanity;
-#if IPC_ENTRY_GROW_STATS
-	uint64_t rescan_count = 0;
-#endif
 	assert(is_active(space));
 
 	if (is_growing(space)) {
@@ -479,147 +590,120 @@ ipc_entry_grow_table(
 		return KERN_SUCCESS;
 	}
 
-	otable = space->is_table;
-		
-	its = space->is_table_next;
-	size = its->its_size;
-		
-	/*
-	 * Since is_table_next points to the next natural size
-	 * we can identify the current size entry.
-	 */
-	oits = its - 1;
-	osize = oits->its_size;
-		
+	osize = space->is_table_size;
+
+	if (target_size != ITS_SIZE_NONE && target_size <= osize) {
+		/* the space is locked */
+		return KERN_SUCCESS;
+	}
+
+	if (osize < IE_LEAF_ENTRIES) {
+		kr = ipc_entry_grow_first_leaf(space, target_size);
+		if (kr != KERN_SUCCESS || target_size == ITS_SIZE_NONE ||
+		    target_size <= space->is_table_size || !is_active(space))
+			return kr;
+
+		/* the space is locked; go on adding leaves */
+		osize = space->is_table_size;
+		assert(osize == IE_LEAF_ENTRIES);
+	}
+
+	assert((osize & IE_LEAF_MASK) == 0);
+
 	/*
-	 * If there is no target size, then the new size is simply
-	 * specified by is_table_next.  If there is a target
-	 * size, then search for the next entry.
+	 *	The largest table is the last size on the
+	 *	ipc_table_entries ladder, in whole leaves.
 	 */
-	if (target_size != ITS_SIZE_NONE) {
-		if (target_size <= osize) {
-			/* the space is locked */			
-			return KERN_SUCCESS;
-		}
+	max_size = ipc_table_entries[ipc_table_entries_size - 1].its_size &
+		~IE_LEAF_MASK;
 
-		psize = osize;
-		while ((psize != size) && (target_size > size)) {
-			psize = size;
-			its++;
-			size = its->its_size;
-		}
-		if (psize == size) {
-			is_write_unlock(space);
-			return KERN_NO_SPACE;
-		}
-	}
+	if (target_size == ITS_SIZE_NONE)
+		size = osize + IE_LEAF_ENTRIES;
+	else
+		size = (target_size + IE_LEAF_MASK) & ~IE_LEAF_MASK;
 
-	if (osize == size) {
+	if (size > max_size) {
 		is_write_unlock(space);
 		return KERN_NO_SPACE;
 	}
- 
-	nits = its + 1;
-	nsize = nits->its_size;
-	assert((osize < size) && (size <= nsize));
 
-	/*
-	 * We'll attempt to grow the table.
-	 *
-	 * Because we will be copying without the space lock, reset
-	 * the lowest_mod index to just beyond the end of the current
-	 * table.  Modification of entries (other than hashes) will
-	 * bump this downward, and we only have to reprocess entries
-	 * above that mark.  Eventually, we'll get done.
-	 */
 	is_start_growing(space);
-	space->is_low_mod = osize;
-	space->is_high_mod = 0;
 #if IPC_ENTRY_GROW_STATS
 	ipc_entry_grow_count++;
 #endif
 	is_write_unlock(space);
 
-	table = it_entries_alloc(its);
-	if (table == IE_NULL) {
-		is_write_lock(space);
-		is_done_growing(space);
-		is_write_unlock(space);
-		thread_wakeup((event_t) space);
-		return KERN_RESOURCE_SHORTAGE;
-	}
-
-	/* initialize new entries (free chain in backwards order) */
-	for (i = osize; i < size; i++) {
-		table[i].ie_object = IO_NULL;
-		table[i].ie_bits = IE_BITS_GEN_MASK;
-		table[i].ie_index = 0;
-		table[i].ie_next = i + 1;
-	}
-	table[size-1].ie_next = 0;
-
-	/* clear out old entries in new table */
-	memset((void *)table, 0, osize * sizeof(*table));
-
-	low_mod = 0;
-	hi_mod = osize - 1;
- rescan:	
 	/*
-	 * Within the range of the table that changed, determine what we
-	 * have to take action on. For each entry, take a snapshot of the
-	 * corresponding entry in the old table (so it won't change
-	 * during this iteration). The snapshot may not be self-consistent
-	 * (if we caught it in the middle of being changed), so be very
-	 * cautious with the values.
+	 *	Only the grower changes the directory and the
+	 *	table size, so we can look at them unlocked.
 	 */
-	for (i = low_mod; i <= hi_mod; i++) {
-		ipc_entry_t entry = &table[i];
-		struct ipc_entry osnap = otable[i]; 
+	kr = KERN_SUCCESS;
+	while (osize < size) {
+		leaf = (ipc_entry_t)ipc_table_alloc(IE_LEAF_ENTRIES *
+						     sizeof(struct ipc_entry));
+		if (leaf == IE_NULL) {
+			kr = KERN_RESOURCE_SHORTAGE;
+			break;
+		}
 
-		if (entry->ie_object != osnap.ie_object ||
-		    IE_BITS_TYPE(entry->ie_bits) != IE_BITS_TYPE(osnap.ie_bits)) {
-			
-			if (entry->ie_object != IO_NULL &&
-			    IE_BITS_TYPE(entry->ie_bits) == MACH_PORT_TYPE_SEND)
-				ipc_hash_table_delete(table, size, entry->ie_object, i, entry);
-
-			entry->ie_object = osnap.ie_object;
-			entry->ie_bits = osnap.ie_bits;
-			entry->ie_request = osnap.ie_request; /* or ie_next */
-
-			if (entry->ie_object != IO_NULL &&
-			    IE_BITS_TYPE(entry->ie_bits) == MACH_PORT_TYPE_SEND)
-				ipc_hash_table_insert(table, size, entry->ie_object, i, entry);
-		} else {
-			assert(entry->ie_object == osnap.ie_object);
-			entry->ie_bits = osnap.ie_bits;
-			entry->ie_request = osnap.ie_request; /* or ie_next */
+		dir = NULL;
+		dir_size = space->is_table_dir_size;
+		if ((osize >> IE_LEAF_SHIFT) == dir_size) {
+			dir_size *= 2;
+			dir = (ipc_entry_t *)ipc_table_alloc(dir_size *
+							     sizeof(ipc_entry_t));
+			if (dir == NULL) {
+				ipc_table_free(IE_LEAF_ENTRIES *
+					       sizeof(struct ipc_entry), leaf);
+				kr = KERN_RESOURCE_SHORTAGE;
+				break;
+			}
 		}
 
-	}
-	table[0].ie_next = otable[0].ie_next;  /* always rebase the freelist */
+		is_write_lock(space);
 
-	/*
-	 * find the end of the freelist (should be short). But be careful,
-	 * the list items can change so only follow through truly free entries
-	 * (no problem stopping short in those cases, because we'll rescan).
-	 */
-	free_index = 0;
-	for (sanity = 0; sanity < osize; sanity++) {
-		if (table[free_index].ie_object != IPC_OBJECT_NULL)
-			break;
-		i = table[free_index].ie_next;
-		if (i == 0 || i >= osize)
+		if (!is_active(space)) {
+			/*
+			 *	The space died while it was unlocked.
+			 */
+			is_write_unlock(space);
+			ipc_table_free(IE_LEAF_ENTRIES *
+				       sizeof(struct ipc_entry), leaf);
+			if (dir != NULL)
+				ipc_table_free(dir_size *
+					       sizeof(ipc_entry_t), dir);
 			break;
-		free_index = i;
-	}
+		}
+
+		odir = NULL;
+		if (dir != NULL) {
+			memcpy((void *)dir, (void *)space->is_table_dir,
+			       space->is_table_dir_size * sizeof(ipc_entry_t));
+			if (space->is_table_dir != &space->is_table)
+				odir = space->is_table_dir;
+			space->is_table_dir = dir;
+			space->is_table_dir_size = dir_size;
 #if IPC_ENTRY_GROW_STATS
-	ipc_entry_grow_freelist_entries += sanity;
-	if (sanity > ipc_entry_grow_freelist_entries_max)
-		ipc_entry_grow_freelist_entries_max = sanity;
+			ipc_entry_grow_dir++;
 #endif
-		
-	is_write_lock(space);
+		}
+
+		/* link the new leaf in and put its entries on the free list */
+		ipc_entry_leaf_init(leaf, osize, IE_LEAF_ENTRIES,
+				    space->is_table->ie_next);
+		space->is_table_dir[osize >> IE_LEAF_SHIFT] = leaf;
+		space->is_table->ie_next = osize;
+		osize += IE_LEAF_ENTRIES;
+		space->is_table_size = osize;
+#if IPC_ENTRY_GROW_STATS
+		ipc_entry_grow_leaves++;
+#endif
+
+		is_write_unlock(space);
+
+		if (odir != NULL)
+			ipc_table_free((dir_size / 2) * sizeof(ipc_entry_t), odir);
+	}
 
 	/*
 	 *	We need to do a wakeup on the space,
@@ -627,65 +711,51 @@ ipc_entry_grow_table(
 	 *	this until the space is unlocked,
 	 *	because we don't want them to spin.
 	 */
+	is_write_lock(space);
+	is_done_growing(space);
+	is_write_unlock(space);
 
-	if (!is_active(space)) {
-		/*
-		 *	The space died while it was unlocked.
-		 */
+	thread_wakeup((event_t) space);
 
-		is_done_growing(space);
-		is_write_unlock(space);
-		thread_wakeup((event_t) space);
-		it_entries_free(its, table);
-		is_write_lock(space);
-		return KERN_SUCCESS;
-	}
+	if (kr != KERN_SUCCESS)
+		return kr;
 
-	/* If the space changed while unlocked, go back and process the changes */
-	if (space->is_low_mod < osize) {
-		assert(space->is_high_mod > 0);
-		low_mod = space->is_low_mod;
-		space->is_low_mod = osize;
-		hi_mod = space->is_high_mod;
-		space->is_high_mod = 0;
-		is_write_unlock(space);
-#if IPC_ENTRY_GROW_STATS
-		rescan_count++;
-		if (rescan_count > ipc_entry_grow_rescan_max)
-			ipc_entry_grow_rescan_max = rescan_count;
-
-		ipc_entry_grow_rescan++;
-		ipc_entry_grow_rescan_entries += hi_mod - low_mod + 1;
-		if (hi_mod - low_mod + 1 > ipc_entry_grow_rescan_entries_max)
-			ipc_entry_grow_rescan_entries_max = hi_mod - low_mod + 1;
-#endif
-		goto rescan;
-	}
-
-	/* link new free entries onto the rest of the freelist */
-	assert(table[free_index].ie_next == 0 &&
-	       table[free_index].ie_object == IO_NULL);
-	table[free_index].ie_next = osize;
+	is_write_lock(space);
+	return KERN_SUCCESS;
+}
 
-	assert(space->is_table == otable);
-	assert((space->is_table_next == its) ||
-	    (target_size != ITS_SIZE_NONE));
-	assert(space->is_table_size == osize);
+/*
+ *	Routine:	ipc_entry_table_free
+ *	Purpose:
+ *		Free the entry table of a dead space.
+ *	Conditions:
+ *		The space is inactive and not growing.
+ */
 
-	space->is_table = table;
-	space->is_table_size = size;
-	space->is_table_next = nits;
+void
+ipc_entry_table_free(
+	ipc_space_t		space)
+{
+	ipc_entry_num_t size = space->is_table_size;
+	mach_port_index_t leaf;
 
-	is_done_growing(space);
-	is_write_unlock(space);
+	assert(!is_active(space));
+	assert(!is_growing(space));
 
-	thread_wakeup((event_t) space);
+	if (size < IE_LEAF_ENTRIES) {
+		ipc_table_free(size * sizeof(struct ipc_entry), space->is_table);
+	} else {
+		for (leaf = 0; leaf < (size >> IE_LEAF_SHIFT); leaf++)
+			ipc_table_free(IE_LEAF_ENTRIES * sizeof(struct ipc_entry),
+				       space->is_table_dir[leaf]);
+	}
 
-	/*
-	 *	Now we need to free the old table.
-	 */
-	it_entries_free(oits, otable);
-	is_write_lock(space);
+	if (space->is_table_dir != &space->is_table)
+		ipc_table_free(space->is_table_dir_size * sizeof(ipc_entry_t),
+			       space->is_table_dir);
 
-	return KERN_SUCCESS;
+	space->is_table = IE_NULL;
+	space->is_table_dir = NULL;
+	space->is_table_dir_size = 0;
+	space->is_table_size = 0;
 }
@@ -81,8 +81,13 @@
  *	Each ipc_entry_t records a capability.  Most capabilities have
  *	small names, and the entries are elements of a table.
  *
- *	The ie_index field of entries in the table implements
- *	a ordered hash table with open addressing and linear probing.
+ *	Small tables are a single array.  Once a table reaches
+ *	IE_LEAF_ENTRIES it is kept as a directory of leaves of that
+ *	size, and grows by adding leaves, so entries never move.
+ *
+ *	The ie_index and ie_link fields of entries in the table implement
+ *	a chained hash table: ie_index of the entry at index i is the head
+ *	of bucket i, and ie_link chains the entries in a bucket.
  *	This hash table converts (space, object) -> name.
  *	It is used independently of the other fields.
  *
@@ -102,6 +107,7 @@ struct ipc_entry {
 		mach_port_index_t next;		/* next in freelist, or...  */
 		ipc_table_index_t request;	/* dead name request notify */
 	} index;
+	mach_port_index_t ie_link;	/* next in reverse hash bucket */
 };
 
 #define	ie_request	index.request
@@ -109,6 +115,10 @@ struct ipc_entry {
 
 #define IE_REQ_NONE		0		/* no request */
 
+#define	IE_LEAF_SHIFT		9
+#define	IE_LEAF_ENTRIES		(1 << IE_LEAF_SHIFT)	/* entries per leaf */
+#define	IE_LEAF_MASK		(IE_LEAF_ENTRIES - 1)
+
 #define	IE_BITS_UREFS_MASK	0x0000ffff	/* 16 bits of user-reference */
 #define	IE_BITS_UREFS(bits)	((bits) & IE_BITS_UREFS_MASK)
 
@@ -174,4 +184,8 @@ extern kern_return_t ipc_entry_grow_table(
 	ipc_space_t		space,
 	ipc_table_elems_t	target_size);
 
+/* Free the table of a dead space */
+extern void ipc_entry_table_free(
+	ipc_space_t		space);
+
 #endif	/* _IPC_IPC_ENTRY_H_ */
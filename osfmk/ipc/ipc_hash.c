@@ -84,285 +84,194 @@
 #endif	/* MACH_IPC_DEBUG */
 
 /*
- * Forward declarations 
+ *	Each space has a local reverse hash table, which holds
+ *	entries from the space's table.  In fact, the hash table
+ *	just uses fields (ie_index, ie_link) in the table itself:
+ *	ie_index of the entry at index b is the head of bucket b,
+ *	and ie_link chains the entries in a bucket.  Index 0 is
+ *	never hashed, so it terminates a chain.
+ *
+ *	The number of buckets grows by linear hashing: whenever the
+ *	average chain gets longer than IH_LOAD_FACTOR, one bucket is
+ *	split in two, with the next table slot as the new bucket head.
+ *	So growing the hash never needs a rehash of the whole table,
+ *	and the table itself can grow without touching the hash.
+ *	The number of buckets never exceeds the size of the table.
+ *
+ *	Entries are only entered into the reverse table if they
+ *	are pure send rights (not receive, send-once, port-set,
+ *	or dead-name rights), and free entries of course aren't entered.
  */
 
-/* Delete an entry from the local reverse hash table */
-void ipc_hash_local_delete(
-	ipc_space_t		space,
-	ipc_object_t		obj,
-	mach_port_index_t	index,
-	ipc_entry_t		entry);
+#define	IH_LOAD_FACTOR		2
 
-/*
- *	Routine:	ipc_hash_lookup
- *	Purpose:
- *		Converts (space, obj) -> (name, entry).
- *		Returns TRUE if an entry was found.
- *	Conditions:
- *		The space must be locked (read or write) throughout.
- */
+#define	IH_HASH(obj)						\
+		((mach_port_index_t)((((uintptr_t) (obj)) >> 6) ^	\
+				     (((uintptr_t) (obj)) >> 18)))
 
-boolean_t
-ipc_hash_lookup(
+static inline mach_port_index_t
+ipc_hash_bucket(
 	ipc_space_t		space,
-	ipc_object_t		obj,
-	mach_port_name_t	*namep,
-	ipc_entry_t		*entryp)
+	mach_port_index_t	hash)
 {
-	return ipc_hash_table_lookup(space->is_table, space->is_table_size, obj, namep, entryp);
-}
+	mach_port_index_t bucket;
 
-/*
- *	Routine:	ipc_hash_insert
- *	Purpose:
- *		Inserts an entry into the appropriate reverse hash table,
- *		so that ipc_hash_lookup will find it.
- *	Conditions:
- *		The space must be write-locked.
- */
-
-void
-ipc_hash_insert(
-	ipc_space_t		space,
-	ipc_object_t		obj,
-	mach_port_name_t	name,
-	ipc_entry_t		entry)
-{
-	mach_port_index_t index;
-
-	index = MACH_PORT_INDEX(name);
-	ipc_hash_table_insert(space->is_table, space->is_table_size, obj, index, entry);
+	bucket = hash & space->is_hash_mask;
+	if (bucket < space->is_hash_split)
+		bucket = hash & ((space->is_hash_mask << 1) | 1);
+	return bucket;
 }
 
 /*
- *	Routine:	ipc_hash_delete
+ *	Routine:	ipc_hash_split
  *	Purpose:
- *		Deletes an entry from the appropriate reverse hash table.
+ *		Split the next bucket, moving the entries that
+ *		now hash to the new bucket over to it.
  *	Conditions:
  *		The space must be write-locked.
  */
 
-void
-ipc_hash_delete(
-	ipc_space_t		space,
-	ipc_object_t		obj,
-	mach_port_name_t	name,
-	ipc_entry_t		entry)
+static void
+ipc_hash_split(
+	ipc_space_t		space)
 {
-	mach_port_index_t index;
+	mach_port_index_t mask = (space->is_hash_mask << 1) | 1;
+	mach_port_index_t obucket = space->is_hash_split;
+	mach_port_index_t nbucket = obucket + space->is_hash_mask + 1;
+	mach_port_index_t *prevp, index;
+	ipc_entry_t entry;
+
+	assert(nbucket < space->is_table_size);
+	assert(is_table_entry(space, nbucket)->ie_index == 0);
+
+	prevp = &is_table_entry(space, obucket)->ie_index;
+	while ((index = *prevp) != 0) {
+		entry = is_table_entry(space, index);
+		if ((IH_HASH(entry->ie_object) & mask) == nbucket) {
+			*prevp = entry->ie_link;
+			entry->ie_link = is_table_entry(space, nbucket)->ie_index;
+			is_table_entry(space, nbucket)->ie_index = index;
+		} else {
+			prevp = &entry->ie_link;
+		}
+	}
 
-	index = MACH_PORT_INDEX(name);
-	ipc_hash_table_delete(space->is_table, space->is_table_size, obj, index, entry);
+	if (++space->is_hash_split > space->is_hash_mask) {
+		space->is_hash_mask = mask;
+		space->is_hash_split = 0;
+	}
 }
 
 /*
- *	Each space has a local reverse hash table, which holds
- *	entries from the space's table.  In fact, the hash table
- *	just uses a field (ie_index) in the table itself.
- *
- *	The local hash table is an open-addressing hash table,
- *	which means that when a collision occurs, instead of
- *	throwing the entry into a bucket, the entry is rehashed
- *	to another position in the table.  In this case the rehash
- *	is very simple: linear probing (ie, just increment the position).
- *	This simple rehash makes deletions tractable (they're still a pain),
- *	but it means that collisions tend to build up into clumps.
- *
- *	Because at least one entry in the table (index 0) is always unused,
- *	there will always be room in the reverse hash table.  If a table
- *	with n slots gets completely full, the reverse hash table will
- *	have one giant clump of n-1 slots and one free slot somewhere.
- *	Because entries are only entered into the reverse table if they
- *	are pure send rights (not receive, send-once, port-set,
- *	or dead-name rights), and free entries of course aren't entered,
- *	I expect the reverse hash table won't get unreasonably full.
- *
- *	Ordered hash tables (Amble & Knuth, Computer Journal, v. 17, no. 2,
- *	pp. 135-142.) may be desirable here.  They can dramatically help
- *	unsuccessful lookups.  But unsuccessful lookups are almost always
- *	followed by insertions, and those slow down somewhat.  They
- *	also can help deletions somewhat.  Successful lookups aren't affected.
- *	So possibly a small win; probably nothing significant.
- */
-
-#define	IH_TABLE_HASH(obj, size)				\
-		((mach_port_index_t)((((uintptr_t) (obj)) >> 6) % (size)))
-
-/*
- *	Routine:	ipc_hash_table_lookup
+ *	Routine:	ipc_hash_lookup
  *	Purpose:
- *		Converts (table, obj) -> (name, entry).
+ *		Converts (space, obj) -> (name, entry).
+ *		Returns TRUE if an entry was found.
  *	Conditions:
- *		Must have read consistency on the table.
+ *		The space must be locked (read or write) throughout.
  */
 
 boolean_t
-ipc_hash_table_lookup(
-	ipc_entry_t		table,
-	ipc_entry_num_t		size,
+ipc_hash_lookup(
+	ipc_space_t		space,
 	ipc_object_t		obj,
 	mach_port_name_t	*namep,
 	ipc_entry_t		*entryp)
 {
-	mach_port_index_t hindex, index;
+	mach_port_index_t bucket, index;
+	ipc_entry_t entry;
 
-	if (obj == IO_NULL) {
+	if (obj == IO_NULL)
 		return FALSE;
-	}
-
-	hindex = IH_TABLE_HASH(obj, size);
 
-	/*
-	 *	Ideally, table[hindex].ie_index is the name we want.
-	 *	However, must check ie_object to verify this,
-	 *	because collisions can happen.  In case of a collision,
-	 *	search farther along in the clump.
-	 */
+	bucket = ipc_hash_bucket(space, IH_HASH(obj));
 
-	while ((index = table[hindex].ie_index) != 0) {
-		ipc_entry_t entry;
-
-		assert(index < size);
-		entry = &table[index];
+	for (index = is_table_entry(space, bucket)->ie_index;
+	     index != 0;
+	     index = entry->ie_link) {
+		assert(index < space->is_table_size);
+		entry = is_table_entry(space, index);
 		if (entry->ie_object == obj) {
 			*entryp = entry;
 			*namep = MACH_PORT_MAKE(index,
 						IE_BITS_GEN(entry->ie_bits));
 			return TRUE;
 		}
-
-		if (++hindex == size)
-			hindex = 0;
 	}
 
 	return FALSE;
 }
 
 /*
- *	Routine:	ipc_hash_table_insert
+ *	Routine:	ipc_hash_insert
  *	Purpose:
- *		Inserts an entry into the space's reverse hash table.
+ *		Inserts an entry into the space's reverse hash table,
+ *		so that ipc_hash_lookup will find it.
  *	Conditions:
  *		The space must be write-locked.
  */
 
 void
-ipc_hash_table_insert(
-	ipc_entry_t			table,
-	ipc_entry_num_t			size,
+ipc_hash_insert(
+	ipc_space_t			space,
 	ipc_object_t			obj,
-	mach_port_index_t		index,
-	__assert_only ipc_entry_t	entry)
+	mach_port_name_t		name,
+	ipc_entry_t			entry)
 {
-	mach_port_index_t hindex;
+	mach_port_index_t index, bucket;
+	ipc_entry_t head;
+
+	index = MACH_PORT_INDEX(name);
 
 	assert(index != 0);
 	assert(obj != IO_NULL);
-
-	hindex = IH_TABLE_HASH(obj, size);
-
-	assert(entry == &table[index]);
+	assert(entry == is_table_entry(space, index));
 	assert(entry->ie_object == obj);
 
-	/*
-	 *	We want to insert at hindex, but there may be collisions.
-	 *	If a collision occurs, search for the end of the clump
-	 *	and insert there.
-	 */
+	bucket = ipc_hash_bucket(space, IH_HASH(obj));
+	head = is_table_entry(space, bucket);
 
-	while (table[hindex].ie_index != 0) {
-		if (++hindex == size)
-			hindex = 0;
-	}
+	entry->ie_link = head->ie_index;
+	head->ie_index = index;
+	space->is_hash_count++;
 
-	table[hindex].ie_index = index;
+	if (space->is_hash_count >
+	    IH_LOAD_FACTOR * (space->is_hash_mask + 1 + space->is_hash_split) &&
+	    space->is_hash_mask + 1 + space->is_hash_split < space->is_table_size)
+		ipc_hash_split(space);
 }
 
 /*
- *	Routine:	ipc_hash_table_delete
+ *	Routine:	ipc_hash_delete
  *	Purpose:
- *		Deletes an entry from the table's reverse hash.
+ *		Deletes an entry from the space's reverse hash table.
  *	Conditions:
- *		Exclusive access to the table.
+ *		Exclusive access to the space.
  */
 
 void
-ipc_hash_table_delete(
-	ipc_entry_t			table,
-	ipc_entry_num_t			size,
+ipc_hash_delete(
+	ipc_space_t			space,
 	ipc_object_t			obj,
-	mach_port_index_t		index,
+	mach_port_name_t		name,
 	__assert_only ipc_entry_t	entry)
 {
-	mach_port_index_t hindex, dindex;
+	mach_port_index_t index, *prevp;
 
-	assert(index != MACH_PORT_NULL);
-	assert(obj != IO_NULL);
-
-	hindex = IH_TABLE_HASH(obj, size);
+	index = MACH_PORT_INDEX(name);
 
-	assert(entry == &table[index]);
+	assert(index != 0);
+	assert(obj != IO_NULL);
+	assert(entry == is_table_entry(space, index));
 	assert(entry->ie_object == obj);
 
-	/*
-	 *	First check we have the right hindex for this index.
-	 *	In case of collision, we have to search farther
-	 *	along in this clump.
-	 */
-
-	while (table[hindex].ie_index != index) {
-		if (++hindex == size)
-			hindex = 0;
+	prevp = &is_table_entry(space, ipc_hash_bucket(space, IH_HASH(obj)))->ie_index;
+	while (*prevp != index) {
+		assert(*prevp != 0);
+		prevp = &is_table_entry(space, *prevp)->ie_link;
 	}
+	*prevp = is_table_entry(space, index)->ie_link;
 
-	/*
-	 *	Now we want to set table[hindex].ie_index = 0.
-	 *	But if we aren't the last index in a clump,
-	 *	this might cause problems for lookups of objects
-	 *	farther along in the clump that are displaced
-	 *	due to collisions.  Searches for them would fail
-	 *	at hindex instead of succeeding.
-	 *
-	 *	So we must check the clump after hindex for objects
-	 *	that are so displaced, and move one up to the new hole.
-	 *
-	 *		hindex - index of new hole in the clump
-	 *		dindex - index we are checking for a displaced object
-	 *
-	 *	When we move a displaced object up into the hole,
-	 *	it creates a new hole, and we have to repeat the process
-	 *	until we get to the end of the clump.
-	 */
-
-	for (dindex = hindex; index != 0; hindex = dindex) {
-		for (;;) {
-			mach_port_index_t tindex;
-			ipc_object_t tobj;
-
-			if (++dindex == size)
-				dindex = 0;
-			assert(dindex != hindex);
-
-			/* are we at the end of the clump? */
-
-			index = table[dindex].ie_index;
-			if (index == 0)
-				break;
-
-			/* is this a displaced object? */
-
-			tobj = table[index].ie_object;
-			assert(tobj != IO_NULL);
-			tindex = IH_TABLE_HASH(tobj, size);
-
-			if ((dindex < hindex) ?
-			    ((dindex < tindex) && (tindex <= hindex)) :
-			    ((dindex < tindex) || (tindex <= hindex)))
-				break;
-		}
-
-		table[hindex].ie_index = index;
-	}
+	assert(space->is_hash_count > 0);
+	space->is_hash_count--;
 }
-
@@ -75,56 +75,27 @@
  * Exported interfaces
  */
 
-/* Lookup (space, obj) in the appropriate reverse hash table */
+/* Lookup (space, obj) in the space's reverse hash table */
 extern boolean_t ipc_hash_lookup(
 	ipc_space_t		space,
 	ipc_object_t		obj,
 	mach_port_name_t	*namep,
 	ipc_entry_t		*entryp);
 
-/* Insert an entry into the appropriate reverse hash table */
+/* Insert an entry into the space's reverse hash table */
 extern void ipc_hash_insert(
 	ipc_space_t		space,
 	ipc_object_t		obj,
 	mach_port_name_t	name,
 	ipc_entry_t		entry);
 
-/* Delete an entry from the appropriate reverse hash table */
+/* Delete an entry from the space's reverse hash table */
 extern void ipc_hash_delete(
 	ipc_space_t		space,
 	ipc_object_t		obj,
 	mach_port_name_t	name,
 	ipc_entry_t		entry);
 
-/*
- *	For use by functions that know what they're doing:
- *	local primitives are for table entries.
- */
-
-/* Lookup (space, obj) in local hash table */
-extern boolean_t ipc_hash_table_lookup(
-	ipc_entry_t		table,
-	ipc_entry_num_t		size,
-	ipc_object_t		obj,
-	mach_port_name_t	*namep,
-	ipc_entry_t		*entryp);
-
-/* Inserts an entry into the local reverse hash table */
-extern void ipc_hash_table_insert(
-	ipc_entry_t		table,
-	ipc_entry_num_t		size,
-	ipc_object_t		obj,
-	mach_port_index_t	index,
-	ipc_entry_t		entry);
-
-/* Delete an entry from the appropriate reverse hash table */
-extern void ipc_hash_table_delete(
-	ipc_entry_t		table,
-	ipc_entry_num_t		size,
-	ipc_object_t		obj,
-	mach_port_name_t	name,
-	ipc_entry_t		entry);
-
 #include <mach_ipc_debug.h>
 
 #if	MACH_IPC_DEBUG
@@ -564,7 +564,97 @@ mach_msg_return_t ipc_kmsg_copyin_body(
  *	The per-processor cache seems to miss less than a per-thread cache,
  *	and it also uses less memory.  Access to the cache doesn't
  *	require locking.
+ *
+ *	There is one cache per size class, so that inline messages up to
+ *	64KB don't pay for a kalloc and kfree on every send; above 8KB
+ *	those are a kmem_alloc and kmem_free, with their VM map and pmap
+ *	work.  The small classes hold fewer buffers as they grow, bounding
+ *	each one to roughly IKM_CACHE_CLASS_BYTES per processor.  The
+ *	classes above that hold at most IKM_CACHE_LARGE_STASH buffers each
+ *	and IKM_CACHE_LARGE_BYTES between them per processor.
+ *	ipc_kmsg_cache_drain() empties a processor's caches under memory
+ *	pressure.
+ */
+
+#define	IKM_CACHE_CLASS_BYTES	(4 * 1024)
+#define	IKM_CACHE_LARGE_STASH	4
+#define	IKM_CACHE_LARGE_BYTES	(128 * 1024)
+
+const mach_msg_size_t ikm_cache_kmsg_size[IKM_CACHE_CLASSES] = {
+	IKM_SAVED_KMSG_SIZE, 384, 512, 768, 1024, 1536, 2048, 3072,
+	4096, 6144, 8192, 12288, 16384, 24576, 32768, 49152,
+	IKM_CACHE_KMSG_SIZE_MAX
+};
+
+static inline unsigned int
+ikm_cache_class_limit(
+	unsigned int	class)
+{
+	unsigned int limit = IKM_CACHE_CLASS_BYTES / IKM_CACHE_KMSG_SIZE(class);
+
+	if (limit == 0)
+		return IKM_CACHE_LARGE_STASH;
+	if (limit > IKM_STASH)
+		return IKM_STASH;
+	return limit;
+}
+
+/*
+ *	Charge a buffer of the given class being cached on the current
+ *	processor against its large-class budget, if the class is a large
+ *	one.  Returns FALSE if the budget is spent.  Preemption disabled.
  */
+static inline boolean_t
+ikm_cache_large_charge(
+	unsigned int	class)
+{
+	mach_msg_size_t	size = IKM_CACHE_KMSG_SIZE(class);
+	vm_size_t	*bytes;
+
+	if (size <= IKM_CACHE_CLASS_BYTES)
+		return TRUE;
+
+	bytes = &PROCESSOR_DATA(current_processor(), ikm_cache_large_bytes);
+	if (*bytes + size > IKM_CACHE_LARGE_BYTES)
+		return FALSE;
+	*bytes += size;
+	return TRUE;
+}
+
+/*
+ *	Undo the above for a buffer leaving the current processor's cache.
+ *	Preemption disabled.
+ */
+static inline void
+ikm_cache_large_credit(
+	unsigned int	class)
+{
+	mach_msg_size_t	size = IKM_CACHE_KMSG_SIZE(class);
+
+	if (size > IKM_CACHE_CLASS_BYTES)
+		PROCESSOR_DATA(current_processor(), ikm_cache_large_bytes) -= size;
+}
+
+/*
+ *	Return the cache class for a kmsg of the given size (overhead
+ *	excluded), or IKM_CACHE_CLASSES if it is not cacheable.  Only
+ *	sizes that are exactly a class size are cacheable.
+ */
+static inline unsigned int
+ikm_cache_class(
+	mach_msg_size_t	size)
+{
+	mach_msg_size_t	kmsg_size = ikm_plus_overhead(size);
+	unsigned int	class;
+
+	for (class = 0; class < IKM_CACHE_CLASSES; class++) {
+		if (kmsg_size == IKM_CACHE_KMSG_SIZE(class))
+			return class;
+		if (kmsg_size < IKM_CACHE_KMSG_SIZE(class))
+			break;
+	}
+	return IKM_CACHE_CLASSES;
+}
 
 /*
  *	Routine:	ipc_kmsg_alloc
@@ -613,26 +703,33 @@ ipc_kmsg_alloc(
 	} else
 		max_expanded_size = msg_and_trailer_size;
 
-	if (max_expanded_size < IKM_SAVED_MSG_SIZE)
-		max_expanded_size = IKM_SAVED_MSG_SIZE; 	/* round up for ikm_cache */
-
-	if (max_expanded_size == IKM_SAVED_MSG_SIZE) {
+	if (max_expanded_size <= ikm_less_overhead(IKM_CACHE_KMSG_SIZE_MAX)) {
 		struct ikm_cache	*cache;
-		unsigned int		i;
+		unsigned int		class, i;
+
+		/* round up to a size class for ikm_cache */
+		for (class = 0; class < IKM_CACHE_CLASSES - 1; class++)
+			if (max_expanded_size <= ikm_less_overhead(IKM_CACHE_KMSG_SIZE(class)))
+				break;
+		max_expanded_size = ikm_less_overhead(IKM_CACHE_KMSG_SIZE(class));
 
 		disable_preemption();
-		cache = &PROCESSOR_DATA(current_processor(), ikm_cache);
+		cache = &PROCESSOR_DATA(current_processor(), ikm_cache[class]);
 		if ((i = cache->avail) > 0) {
 			assert(i <= IKM_STASH);
 			kmsg = cache->entries[--i];
 			cache->avail = i;
+			ikm_cache_large_credit(class);
 			enable_preemption();
 			ikm_check_init(kmsg, max_expanded_size);
 			ikm_set_header(kmsg, msg_and_trailer_size);
 			return (kmsg);
 		}
 		enable_preemption();
-		kmsg = (ipc_kmsg_t)zalloc(ipc_kmsg_zone);
+		if (class == 0)
+			kmsg = (ipc_kmsg_t)zalloc(ipc_kmsg_zone);
+		else
+			kmsg = (ipc_kmsg_t)kalloc(IKM_CACHE_KMSG_SIZE(class));
 	} else {
 		kmsg = (ipc_kmsg_t)kalloc(ikm_plus_overhead(max_expanded_size));
 	}
@@ -662,6 +759,7 @@ ipc_kmsg_free(
 	ipc_kmsg_t	kmsg)
 {
 	mach_msg_size_t size = kmsg->ikm_size;
+	unsigned int class;
 	ipc_port_t port;
 
 #if CONFIG_MACF_MACH
@@ -693,25 +791,64 @@ ipc_kmsg_free(
 	/*
 	 * Peek and see if it has to go back in the cache.
 	 */
-	if (kmsg->ikm_size == IKM_SAVED_MSG_SIZE) {
+	class = ikm_cache_class(size);
+	if (class < IKM_CACHE_CLASSES) {
 		struct ikm_cache	*cache;
 		unsigned int		i;
 
 		disable_preemption();
-		cache = &PROCESSOR_DATA(current_processor(), ikm_cache);
-		if ((i = cache->avail) < IKM_STASH) {
+		cache = &PROCESSOR_DATA(current_processor(), ikm_cache[class]);
+		if ((i = cache->avail) < ikm_cache_class_limit(class) &&
+		    ikm_cache_large_charge(class)) {
 			cache->entries[i] = kmsg;
 			cache->avail = i + 1;
 			enable_preemption();
 			return;
 		}
 		enable_preemption();
-		zfree(ipc_kmsg_zone, kmsg);
-		return;
+		if (class == 0) {
+			zfree(ipc_kmsg_zone, kmsg);
+			return;
+		}
 	}
 	kfree(kmsg, ikm_plus_overhead(size));
 }
 
+/*
+ *	Routine:	ipc_kmsg_cache_drain
+ *	Purpose:
+ *		Free every buffer in the current processor's kmsg caches.
+ *		Run on each processor in turn when memory is short.
+ *	Conditions:
+ *		Nothing locked.
+ */
+void
+ipc_kmsg_cache_drain(void)
+{
+	struct ikm_cache	*cache;
+	ipc_kmsg_t		kmsg;
+	unsigned int		class;
+
+	for (class = 0; class < IKM_CACHE_CLASSES; class++) {
+		for (;;) {
+			disable_preemption();
+			cache = &PROCESSOR_DATA(current_processor(), ikm_cache[class]);
+			if (cache->avail == 0) {
+				enable_preemption();
+				break;
+			}
+			kmsg = cache->entries[--cache->avail];
+			ikm_cache_large_credit(class);
+			enable_preemption();
+
+			if (class == 0)
+				zfree(ipc_kmsg_zone, kmsg);
+			else
+				kfree(kmsg, IKM_CACHE_KMSG_SIZE(class));
+		}
+	}
+}
+
 
 /*
  *	Routine:	ipc_kmsg_enqueue
@@ -128,6 +128,18 @@ extern zone_t ipc_kmsg_zone;
 #define	IKM_SAVED_KMSG_SIZE	256
 #define	IKM_SAVED_MSG_SIZE	ikm_less_overhead(IKM_SAVED_KMSG_SIZE)
 
+/*
+ *	Buffers up to IKM_CACHE_KMSG_SIZE_MAX (overhead included) are rounded
+ *	up to the next size class so they can be recycled through the
+ *	per-processor caches as well.  Class 0 is IKM_SAVED_KMSG_SIZE and
+ *	comes from ipc_kmsg_zone; the others come from kalloc.  Up to 8KB
+ *	the classes are the kalloc zone sizes; beyond that kalloc goes to
+ *	the VM, and the classes are page multiples in steps of 1.5x.
+ */
+extern const mach_msg_size_t ikm_cache_kmsg_size[];
+#define	IKM_CACHE_KMSG_SIZE(class)	(ikm_cache_kmsg_size[(class)])
+#define	IKM_CACHE_KMSG_SIZE_MAX		(64 * 1024)
+
 #define	ikm_prealloc_inuse_port(kmsg)					\
 	((kmsg)->ikm_prealloc)
 
@@ -256,6 +268,9 @@ extern ipc_kmsg_t ipc_kmsg_alloc(
 extern void ipc_kmsg_free(
 	ipc_kmsg_t	kmsg);
 
+/* Empty the current processor's kernel message buffer caches */
+extern void ipc_kmsg_cache_drain(void);
+
 /* Destroy kernel message */
 extern void ipc_kmsg_destroy(
 	ipc_kmsg_t	kmsg);
@@ -511,12 +511,11 @@ ipc_mqueue_post(
 		thread_t receiver;
 		mach_msg_size_t msize;
 
-		receiver = wait_queue_wakeup64_identity_locked(
+		receiver = wait_queue_select64_identity_locked(
 							waitq,
 							IPC_MQUEUE_RECEIVE,
-							THREAD_AWAKENED,
 							FALSE);
-		/* waitq still locked, thread locked */
+		/* waitq still locked, thread locked, not yet awakened */
 
 		if (receiver == THREAD_NULL) {
 			/* 
@@ -534,6 +533,7 @@ ipc_mqueue_post(
 		 * go look for another thread that can.
 		 */
 		if (receiver->ith_state != MACH_RCV_IN_PROGRESS) {
+				  (void) thread_go(receiver, THREAD_AWAKENED);
 				  thread_unlock(receiver);
 				  continue;
 		}
@@ -563,6 +563,12 @@ ipc_mqueue_post(
 
 			receiver->ith_kmsg = kmsg;
 			receiver->ith_seqno = mqueue->imq_seqno++;
+
+			/*
+			 * If we are about to block for the reply, this
+			 * may leave the receiver for us to switch to directly.
+			 */
+			(void) thread_go_handoff(receiver, THREAD_AWAKENED);
 			thread_unlock(receiver);
 
 			/* we didn't need our reserved spot in the queue */
@@ -578,6 +584,7 @@ ipc_mqueue_post(
 		receiver->ith_receiver_name = mqueue->imq_receiver_name;
 		receiver->ith_kmsg = IKM_NULL;
 		receiver->ith_seqno = 0;
+		(void) thread_go(receiver, THREAD_AWAKENED);
 		thread_unlock(receiver);
 	}
 
@@ -703,10 +710,10 @@ ipc_mqueue_receive(
 			c_ipc_mqueue_receive_block_kernel++);
 
 		if (self->ith_continuation)
-			thread_block(ipc_mqueue_receive_continue);
+			thread_handoff_block(ipc_mqueue_receive_continue, NULL);
 			/* NOTREACHED */
 
-		wresult = thread_block(THREAD_CONTINUE_NULL);
+		wresult = thread_handoff_block(THREAD_CONTINUE_NULL, NULL);
 	}
 	ipc_mqueue_receive_results(wresult);
 }
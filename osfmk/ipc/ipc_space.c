@@ -138,6 +138,8 @@ ipc_space_create(
 	if (space == IS_NULL)
 		return KERN_RESOURCE_SHORTAGE;
 
+	assert(initial->its_size <= IE_LEAF_ENTRIES);
+
 	table = it_entries_alloc(initial);
 	if (table == IE_NULL) {
 		is_free(space);
@@ -165,10 +167,13 @@ ipc_space_create(
 	space->is_bits = 2; /* 2 refs, active, not growing */
 	space->is_table_size = new_size;
 	space->is_table = table;
+	space->is_table_dir = &space->is_table;
+	space->is_table_dir_size = 1;
 	space->is_table_next = initial+1;
 	space->is_task = NULL;
-	space->is_low_mod = new_size;
-	space->is_high_mod = 0;
+	space->is_hash_mask = 0;
+	space->is_hash_split = 0;
+	space->is_hash_count = 0;
 
 	*spacep = space;
 	return KERN_SUCCESS;
@@ -203,10 +208,13 @@ ipc_space_create_special(
 
 	space->is_bits       = IS_INACTIVE | 1; /* 1 ref, not active, not growing */
 	space->is_table      = IE_NULL;
+	space->is_table_dir  = NULL;
+	space->is_table_dir_size = 0;
 	space->is_task       = TASK_NULL;
 	space->is_table_next = 0;
-	space->is_low_mod    = 0;
-	space->is_high_mod   = 0;
+	space->is_hash_mask  = 0;
+	space->is_hash_split = 0;
+	space->is_hash_count = 0;
 
 	*spacep = space;
 	return KERN_SUCCESS;
@@ -223,7 +231,6 @@ void
 ipc_space_clean(
 	ipc_space_t space)
 {
-	ipc_entry_t table;
 	ipc_entry_num_t size;
 	mach_port_index_t index;
 
@@ -246,11 +253,10 @@ ipc_space_clean(
 	 *	Now we can futz with it	since we have the write lock.
 	 */
 
-	table = space->is_table;
 	size = space->is_table_size;
 
 	for (index = 0; index < size; index++) {
-		ipc_entry_t entry = &table[index];
+		ipc_entry_t entry = is_table_entry(space, index);
 		mach_port_type_t type;
 
 		type = IE_BITS_TYPE(entry->ie_bits);
@@ -285,7 +291,6 @@ void
 ipc_space_terminate(
 	ipc_space_t	space)
 {
-	ipc_entry_t table;
 	ipc_entry_num_t size;
 	mach_port_index_t index;
 
@@ -313,11 +318,10 @@ ipc_space_terminate(
 	 *	Now we can futz with it	unlocked.
 	 */
 
-	table = space->is_table;
 	size = space->is_table_size;
 
 	for (index = 0; index < size; index++) {
-		ipc_entry_t entry = &table[index];
+		ipc_entry_t entry = is_table_entry(space, index);
 		mach_port_type_t type;
 
 		type = IE_BITS_TYPE(entry->ie_bits);
@@ -330,8 +334,7 @@ ipc_space_terminate(
 		}
 	}
 
-	it_entries_free(space->is_table_next-1, table);
-	space->is_table_size = 0;
+	ipc_entry_table_free(space);
 
 	/*
 	 *	Because the space is now dead,
@@ -97,12 +97,17 @@
  *	IPC operations like send and receive use this space.
  *	IPC kernel calls manipulate the space of the target task.
  *
- *	Every space has a non-NULL is_table with is_table_size entries.
+ *	Every space has a non-NULL is_table with is_table_size entries,
+ *	reached through is_table_dir (see is_table_entry).  While the
+ *	table is smaller than IE_LEAF_ENTRIES, is_table is the whole
+ *	table and is_table_dir points at it; after that, is_table is
+ *	the first of is_table_size / IE_LEAF_ENTRIES leaves.
  *
  *	Only one thread can be growing the space at a time.  Others
- *	that need it grown wait for the first.  We do almost all the
- *	work with the space unlocked, so lookups proceed pretty much
- *	unaffected while the grow operation is underway.
+ *	that need it grown wait for the first.  Memory is allocated
+ *	with the space unlocked; the lock is only held to link in a
+ *	new leaf (or to copy a small first leaf), so lookups and other
+ *	operations proceed while the grow operation is underway.
  */
 
 typedef natural_t ipc_space_refs_t;
@@ -114,13 +119,23 @@ struct ipc_space {
 	lck_spin_t	is_lock_data;
 	ipc_space_refs_t is_bits;	/* holds refs, active, growing */
 	ipc_entry_num_t is_table_size;	/* current size of table */
-	ipc_entry_t is_table;		/* an array of entries */
+	ipc_entry_t is_table;		/* first (or only) leaf of entries */
+	ipc_entry_t *is_table_dir;	/* directory of leaves */
+	ipc_entry_num_t is_table_dir_size; /* slots in is_table_dir */
 	task_t is_task;                 /* associated task */
-	struct ipc_table_size *is_table_next; /* info for larger table */
-	ipc_entry_num_t is_low_mod;	/* lowest modified entry during growth */
-	ipc_entry_num_t is_high_mod;	/* highest modified entry during growth */
+	struct ipc_table_size *is_table_next; /* info for larger first leaf */
+	ipc_entry_num_t is_hash_mask;	/* reverse hash: base bucket mask */
+	ipc_entry_num_t is_hash_split;	/* reverse hash: next bucket to split */
+	ipc_entry_num_t is_hash_count;	/* reverse hash: entries hashed */
 };
 
+/*
+ *	The entry at a table index.  The index must be less
+ *	than is_table_size, and the space locked or inactive.
+ */
+#define	is_table_entry(is, index)					\
+	(&(is)->is_table_dir[(index) >> IE_LEAF_SHIFT][(index) & IE_LEAF_MASK])
+
 #define	IS_NULL			((ipc_space_t) 0)
 
 #define is_active(is) 		(((is)->is_bits & IS_INACTIVE) != IS_INACTIVE)
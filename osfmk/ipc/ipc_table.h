@@ -106,6 +106,7 @@ struct ipc_table_size {
 };
 
 extern ipc_table_size_t ipc_table_entries;
+extern unsigned int ipc_table_entries_size;
 extern ipc_table_size_t ipc_table_requests;
 
 /* Initialize IPC capabilities table storage */
@@ -176,7 +176,6 @@ mach_port_space_info(
 	ipc_info_name_t *table_info;
 	vm_offset_t table_addr;
 	vm_size_t table_size, table_size_needed;
-	ipc_entry_t table;
 	ipc_entry_num_t tsize;
 	mach_port_index_t index;
 	kern_return_t kr;
@@ -226,15 +225,17 @@ mach_port_space_info(
 	/* get the overall space info */
 	infop->iis_genno_mask = MACH_PORT_NGEN(MACH_PORT_DEAD);
 	infop->iis_table_size = space->is_table_size;
-	infop->iis_table_next = space->is_table_next->its_size;
+	if (space->is_table_size < IE_LEAF_ENTRIES)
+		infop->iis_table_next = space->is_table_next->its_size;
+	else
+		infop->iis_table_next = space->is_table_size + IE_LEAF_ENTRIES;
 
 	/* walk the table for this space */
-	table = space->is_table;
 	tsize = space->is_table_size;
 	table_info = (ipc_info_name_array_t)table_addr;
 	for (index = 0; index < tsize; index++) {
 		ipc_info_name_t *iin = &table_info[index];
-		ipc_entry_t entry = &table[index];
+		ipc_entry_t entry = is_table_entry(space, index);
 		ipc_entry_bits_t bits;
 
 		bits = entry->ie_bits;
@@ -510,9 +510,20 @@ mach_msg_overwrite_trap(
 			return mr;
 		}
 
+		/*
+		 * If we are going to wait for a reply, a receiver
+		 * woken by this send can be switched to directly
+		 * once we block, rather than being dispatched now.
+		 */
+		if (option & MACH_RCV_MSG)
+			current_thread()->options |= TH_OPT_HANDOFF;
+
 		mr = ipc_kmsg_send(kmsg, option, msg_timeout);
 
+		current_thread()->options &= ~TH_OPT_HANDOFF;
+
 		if (mr != MACH_MSG_SUCCESS) {
+			thread_handoff_cancel(current_thread());
 			mr |= ipc_kmsg_copyout_pseudo(kmsg, space, map, MACH_MSG_BODY_NULL);
 			(void) ipc_kmsg_put(msg_addr, kmsg, kmsg->ikm_header->msgh_size);
 			return mr;
@@ -528,6 +539,7 @@ mach_msg_overwrite_trap(
 
 		mr = ipc_mqueue_copyin(space, rcv_name, &mqueue, &object);
 		if (mr != MACH_MSG_SUCCESS) {
+			thread_handoff_cancel(self);
 			return mr;
 		}
 		/* hold ref for object */
@@ -552,6 +564,8 @@ mach_msg_overwrite_trap(
 		self->ith_continuation = thread_syscall_return;
 
 		ipc_mqueue_receive(mqueue, option, rcv_size, msg_timeout, THREAD_ABORTSAFE);
+		/* didn't block: the handoff, if any, wasn't taken */
+		thread_handoff_cancel(self);
 		if ((option & MACH_RCV_TIMEOUT) && msg_timeout == 0)
 			thread_poll_yield(self);
 		return mach_msg_receive_results();
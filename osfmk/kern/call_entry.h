@@ -151,6 +151,167 @@ call_entry_enqueue_deadline(
 
 	return (old_queue);
 }
+
+/*
+ * Indexed deadline queues.
+ *
+ * call_entry_enqueue_deadline() walks the queue to find the
+ * insertion point, which gets expensive once a queue holds
+ * thousands of entries.  A queue_wheel_t is a hierarchical timing
+ * wheel laid over such a queue: at each level, one slot per
+ * 2^CALL_ENTRY_WHEEL_SHIFT(level) units of deadline, wrapping every
+ * QUEUE_WHEEL_SLOTS slots, pointing at an entry queued in that
+ * bucket (preferably the latest one).  The queue itself stays the
+ * sorted list, so its consumers are unchanged; the wheel only
+ * supplies an entry no later than the new deadline to start the
+ * walk from.  An aliased slot merely costs a longer walk, and
+ * slots are repointed or cleared as their entries leave the queue,
+ * so they never refer to an entry that isn't on it.
+ *
+ * With mach_absolute_time() in nanoseconds, level 0 buckets are
+ * ~1ms wide, level 1 ~67ms and level 2 ~4.3s.
+ */
+#define CALL_ENTRY_WHEEL_SHIFT(level)		(20 + 6 * (level))
+#define CALL_ENTRY_WHEEL_BUCKET(d, level)	((d) >> CALL_ENTRY_WHEEL_SHIFT(level))
+#define CALL_ENTRY_WHEEL_SLOT(d, level)		\
+	(CALL_ENTRY_WHEEL_BUCKET(d, level) & (QUEUE_WHEEL_SLOTS - 1))
+
+static __inline__ void
+call_entry_wheel_init(
+	queue_wheel_t			*wheel)
+{
+	int		level, slot;
+
+	for (level = 0; level < QUEUE_WHEEL_LEVELS; level++)
+		for (slot = 0; slot < QUEUE_WHEEL_SLOTS; slot++)
+			wheel->slot[level][slot] = NULL;
+	wheel->hits = wheel->misses = 0;
+}
+
+/*
+ * Drop any slot referring to an entry about to leave the queue,
+ * handing it to a neighbor in the same bucket if there is one.
+ */
+static __inline__ void
+call_entry_wheel_remove(
+	call_entry_t			entry,
+	queue_head_t			*queue,
+	queue_wheel_t			*wheel)
+{
+	queue_entry_t	neighbor;
+	uint64_t	bucket;
+	int		level, slot;
+
+	for (level = 0; level < QUEUE_WHEEL_LEVELS; level++) {
+		slot = CALL_ENTRY_WHEEL_SLOT(entry->deadline, level);
+
+		if (wheel->slot[level][slot] != qe(entry))
+			continue;
+
+		bucket = CALL_ENTRY_WHEEL_BUCKET(entry->deadline, level);
+
+		neighbor = queue_prev(qe(entry));
+		if (queue_end(queue, neighbor) ||
+		    CALL_ENTRY_WHEEL_BUCKET(CE(neighbor)->deadline, level) != bucket) {
+			neighbor = queue_next(qe(entry));
+			if (queue_end(queue, neighbor) ||
+			    CALL_ENTRY_WHEEL_BUCKET(CE(neighbor)->deadline, level) != bucket)
+				neighbor = NULL;
+		}
+		wheel->slot[level][slot] = neighbor;
+	}
+}
+
+/*
+ * Same contract as call_entry_enqueue_deadline(), except that if
+ * the entry is currently on a different indexed queue, the caller
+ * must already have removed it from that queue's wheel.
+ */
+static __inline__ queue_head_t *
+call_entry_enqueue_deadline_indexed(
+	call_entry_t			entry,
+	queue_head_t			*queue,
+	queue_wheel_t			*wheel,
+	uint64_t			deadline)
+{
+	queue_t		old_queue = entry->queue;
+	queue_entry_t	start = NULL;
+	queue_entry_t	candidate, next;
+	uint64_t	bucket;
+	int		level, slot, k;
+
+	if (old_queue != NULL) {
+		if (old_queue == queue)
+			call_entry_wheel_remove(entry, queue, wheel);
+		(void)remque(qe(entry));
+	}
+
+	/*
+	 * Find the latest indexed entry not after the new deadline,
+	 * looking at this bucket and the previous one, finest level first.
+	 */
+	for (level = 0; level < QUEUE_WHEEL_LEVELS && start == NULL; level++) {
+		bucket = CALL_ENTRY_WHEEL_BUCKET(deadline, level);
+
+		for (k = 0; k < 2 && bucket >= (uint64_t)k; k++) {
+			candidate = wheel->slot[level][(bucket - k) & (QUEUE_WHEEL_SLOTS - 1)];
+
+			if (candidate != NULL &&
+			    CALL_ENTRY_WHEEL_BUCKET(CE(candidate)->deadline, level) == bucket - k &&
+			    CE(candidate)->deadline <= deadline &&
+			    (start == NULL || CE(candidate)->deadline > CE(start)->deadline))
+				start = candidate;
+		}
+	}
+	if (start != NULL) {
+		wheel->hits++;
+	} else {
+		/*
+		 * Nothing indexed nearby: the new entry either goes
+		 * last, or we fall back to walking from the front.
+		 */
+		start = queue_last(queue);
+		if (queue_end(queue, start) || CE(start)->deadline > deadline) {
+			start = (queue_entry_t) queue;
+			wheel->misses++;
+		}
+	}
+
+	/* after existing entries with an earlier (or identical) deadline */
+	for (next = queue_next(start);
+	     !queue_end(queue, next) && CE(next)->deadline <= deadline;
+	     next = queue_next(next))
+		start = next;
+
+	insque(qe(entry), start);
+
+	entry->queue = queue;
+	entry->deadline = deadline;
+
+	for (level = 0; level < QUEUE_WHEEL_LEVELS; level++) {
+		slot = CALL_ENTRY_WHEEL_SLOT(deadline, level);
+		candidate = wheel->slot[level][slot];
+
+		if (candidate == NULL ||
+		    CALL_ENTRY_WHEEL_BUCKET(CE(candidate)->deadline, level) !=
+		    CALL_ENTRY_WHEEL_BUCKET(deadline, level) ||
+		    CE(candidate)->deadline <= deadline)
+			wheel->slot[level][slot] = qe(entry);
+	}
+
+	return (old_queue);
+}
+
+static __inline__ queue_head_t *
+call_entry_dequeue_indexed(
+	call_entry_t			entry,
+	queue_wheel_t			*wheel)
+{
+	if (entry->queue != NULL)
+		call_entry_wheel_remove(entry, entry->queue, wheel);
+
+	return (call_entry_dequeue(entry));
+}
 #endif /* MACH_KERNEL_PRIVATE */
 
 #endif /* XNU_KERNEL_PRIVATE */
@@ -345,7 +345,7 @@ host_statistics(
 
 		stat32 = (vm_statistics_t) info;
 
-		stat32->free_count = VM_STATISTICS_TRUNCATE_TO_32_BIT(vm_page_free_count + vm_page_speculative_count);
+		stat32->free_count = VM_STATISTICS_TRUNCATE_TO_32_BIT(vm_page_free_count + vm_page_cpu_free_count + vm_page_speculative_count);
 		stat32->active_count = VM_STATISTICS_TRUNCATE_TO_32_BIT(vm_page_active_count);
 		
 		if (vm_page_local_q) {
@@ -545,7 +545,7 @@ host_statistics64(
 
 			stat = (vm_statistics64_t) info;
 
-			stat->free_count = vm_page_free_count + vm_page_speculative_count;
+			stat->free_count = vm_page_free_count + vm_page_cpu_free_count + vm_page_speculative_count;
 			stat->active_count = vm_page_active_count;
 
 			local_q_internal_count = 0;
@@ -77,7 +77,12 @@ typedef struct {
 	uint64_t			lck_grp_mtx_held_cnt;
 	uint64_t			lck_grp_mtx_miss_cnt;
 	uint64_t			lck_grp_mtx_wait_cnt;
-	/* Rest currently unused */
+	/*
+	 * On x86, held_max/held_cum are the longest and total hold
+	 * times of indirect mutexes, and wait_max/wait_cum the longest
+	 * and total adaptive spin before acquiring or blocking; all in
+	 * TSC ticks.  Unused elsewhere.
+	 */
 	uint64_t			lck_grp_mtx_held_max;
 	uint64_t			lck_grp_mtx_held_cum;
 	uint64_t			lck_grp_mtx_wait_max;
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+/*
+ *	File:	kern/mcs_lock.c
+ *
+ *	Queued spin locks; see kern/mcs_lock.h.
+ */
+
+#include <mach/mach_types.h>
+
+#include <kern/mcs_lock.h>
+#include <kern/processor.h>
+#include <kern/cpu_data.h>
+#include <kern/cpu_number.h>
+#include <kern/misc_protos.h>
+#include <kern/simple_lock.h>
+#include <kern/debug.h>
+
+#include <machine/machine_cpu.h>
+#include <machine/machine_routines.h>
+
+#if	CONFIG_IN_KERNEL_TESTS
+#include <kern/thread.h>
+#include <kern/sched_prim.h>
+#include <kern/clock.h>
+#endif
+
+/* Check for a stuck lock every this many spins */
+#define	MCS_SPIN_CHECK		1024
+
+/*
+ *	Routine:	mcs_node_alloc
+ *	Purpose:
+ *		Claim a free queue node from the current processor's
+ *		set.  An interrupt may nest another acquisition between
+ *		our load and store of the busy map, hence the atomic.
+ *	Conditions:
+ *		Preemption disabled.
+ */
+static mcs_node_t
+mcs_node_alloc(void)
+{
+	struct mcs_node_set	*set;
+	uint32_t		busy, index;
+
+	set = &PROCESSOR_DATA(current_processor(), mcs_nodes);
+	do {
+		busy = set->busy;
+		if (busy == (1U << MCS_LOCK_NODES) - 1)
+			panic("mcs_lock: more than %d queued locks held on cpu %d",
+			      MCS_LOCK_NODES, cpu_number());
+		index = ffs(~busy) - 1;
+	} while (!hw_compare_and_store(busy, busy | (1U << index), &set->busy));
+
+	set->nodes[index].mcs_index = index;
+	return (&set->nodes[index]);
+}
+
+static void
+mcs_node_free(
+	mcs_node_t		node)
+{
+	struct mcs_node_set	*set;
+
+	set = &PROCESSOR_DATA(current_processor(), mcs_nodes);
+	assert(&set->nodes[node->mcs_index] == node);
+	hw_atomic_and_noret(&set->busy, ~(1U << node->mcs_index));
+}
+
+/*
+ *	Spin until our predecessor hands the lock over, panicking
+ *	(outside of debugger/timeout-suspended windows) if that takes
+ *	longer than the machine lock timeout, as hw_lock_to() would.
+ */
+static void
+mcs_lock_wait(
+	mcs_lock_t		lock,
+	mcs_node_t		node)
+{
+	uint64_t	deadline = 0;
+	unsigned int	spins = 0;
+
+	while (node->mcs_wait) {
+		cpu_pause();
+		if (++spins < MCS_SPIN_CHECK)
+			continue;
+		spins = 0;
+		if (deadline == 0)
+			deadline = mach_absolute_time() + LockTimeOut;
+		else if (mach_absolute_time() > deadline &&
+			 !machine_timeout_suspended())
+			panic("mcs_lock: timeout waiting for lock %p, owner node %p, cpu %d",
+			      lock, lock->mcs_owner, cpu_number());
+	}
+	/* Don't let accesses to the protected data start early */
+	__sync_synchronize();
+}
+
+void
+mcs_lock_init(
+	mcs_lock_t		lock)
+{
+	lock->mcs_tail = NULL;
+	lock->mcs_owner = NULL;
+}
+
+/*
+ *	Routine:	mcs_lock
+ *	Purpose:
+ *		Append our node to the lock's queue and, if there was a
+ *		predecessor, link behind it and spin on our own node
+ *		until it hands the lock to us.
+ *	Conditions:
+ *		Returns with preemption disabled.
+ */
+void
+mcs_lock(
+	mcs_lock_t		lock)
+{
+	mcs_node_t		node, pred;
+
+	disable_preemption();
+
+	node = mcs_node_alloc();
+	node->mcs_next = NULL;
+	node->mcs_wait = 1;
+
+	pred = __sync_lock_test_and_set(&lock->mcs_tail, node);
+	if (pred != NULL) {
+		pred->mcs_next = node;
+		mcs_lock_wait(lock, node);
+	}
+	lock->mcs_owner = node;
+}
+
+boolean_t
+mcs_lock_try(
+	mcs_lock_t		lock)
+{
+	mcs_node_t		node;
+
+	disable_preemption();
+
+	if (lock->mcs_tail == NULL) {
+		node = mcs_node_alloc();
+		node->mcs_next = NULL;
+		node->mcs_wait = 0;
+
+		if (__sync_bool_compare_and_swap(&lock->mcs_tail, NULL, node)) {
+			lock->mcs_owner = node;
+			return (TRUE);
+		}
+		mcs_node_free(node);
+	}
+
+	enable_preemption();
+	return (FALSE);
+}
+
+/*
+ *	Routine:	mcs_unlock
+ *	Purpose:
+ *		Hand the lock to our successor, if any.  A successor
+ *		may have swapped itself into the tail but not yet
+ *		linked behind us; wait for the link in that case.
+ */
+void
+mcs_unlock(
+	mcs_lock_t		lock)
+{
+	mcs_node_t		node, next;
+
+	node = lock->mcs_owner;
+	assert(node != NULL && mcs_lock_held(lock));
+
+	next = node->mcs_next;
+	if (next == NULL) {
+		if (__sync_bool_compare_and_swap(&lock->mcs_tail, node, NULL))
+			goto done;
+		while ((next = node->mcs_next) == NULL)
+			cpu_pause();
+	}
+	__sync_lock_release(&next->mcs_wait);
+
+done:
+	mcs_node_free(node);
+	enable_preemption();
+}
+
+#if	CONFIG_IN_KERNEL_TESTS
+
+/*
+ * Stress test: one kernel thread per available processor hammers a
+ * single lock for a fixed interval, first as an MCS lock and then as
+ * a simple lock for comparison.  Each run checks mutual exclusion and
+ * reports fairness (fewest and most acquisitions by any thread) and
+ * handoff latency, the time from a release to the acquire by a thread
+ * that was already waiting.  The MCS run also fails if any thread
+ * was starved outright.
+ */
+#define	MCS_TEST_THREADS_MAX	64
+#define	MCS_TEST_DURATION_MS	250
+
+static struct mcs_test {
+	boolean_t		use_mcs;
+	decl_mcs_lock_data(,	mcs)
+	decl_simple_lock_data(,	simple)
+	uint64_t		deadline;
+	volatile uint32_t	running;
+	boolean_t		failed;
+
+	/* protected by the lock under test */
+	thread_t		owner;
+	uint64_t		count;
+	uint64_t		last_release;
+	uint64_t		handoff_sum;
+	uint64_t		handoff_count;
+	uint64_t		handoff_max;
+
+	uint64_t		acquired[MCS_TEST_THREADS_MAX];
+} mcs_test;
+
+static void
+mcs_test_thread(
+	void			*arg,
+	__unused wait_result_t	wr)
+{
+	struct mcs_test	*t = &mcs_test;
+	unsigned int	index = (unsigned int)(uintptr_t)arg;
+	uint64_t	requested, now, handoff, count = 0;
+
+	while ((requested = mach_absolute_time()) < t->deadline) {
+		if (t->use_mcs)
+			mcs_lock(&t->mcs);
+		else
+			simple_lock(&t->simple);
+
+		now = mach_absolute_time();
+		if (t->owner != THREAD_NULL)
+			t->failed = TRUE;
+		t->owner = current_thread();
+		t->count++;
+		if (t->last_release > requested) {
+			handoff = now - t->last_release;
+			t->handoff_sum += handoff;
+			t->handoff_count++;
+			if (handoff > t->handoff_max)
+				t->handoff_max = handoff;
+		}
+		t->owner = THREAD_NULL;
+		t->last_release = mach_absolute_time();
+
+		if (t->use_mcs)
+			mcs_unlock(&t->mcs);
+		else
+			simple_unlock(&t->simple);
+		count++;
+	}
+
+	t->acquired[index] = count;
+	if (hw_atomic_sub(&t->running, 1) == 0)
+		thread_wakeup((event_t)&t->running);
+}
+
+static int
+mcs_test_run(
+	boolean_t		use_mcs,
+	unsigned int		nthreads)
+{
+	struct mcs_test	*t = &mcs_test;
+	uint64_t	interval, sum, min, max, avg_ns, max_ns;
+	thread_t	thread;
+	unsigned int	i;
+
+	bzero(t, sizeof (*t));
+	t->use_mcs = use_mcs;
+	mcs_lock_init(&t->mcs);
+	simple_lock_init(&t->simple, 0);
+	t->running = nthreads;
+
+	nanoseconds_to_absolutetime(MCS_TEST_DURATION_MS * NSEC_PER_MSEC, &interval);
+	t->deadline = mach_absolute_time() + interval;
+
+	for (i = 0; i < nthreads; i++) {
+		if (kernel_thread_start_priority(mcs_test_thread, (void *)(uintptr_t)i,
+						 BASEPRI_KERNEL, &thread) != KERN_SUCCESS)
+			panic("mcs_lock_stress_test: can't start thread %d", i);
+		thread_deallocate(thread);
+	}
+
+	while (t->running != 0) {
+		assert_wait((event_t)&t->running, THREAD_UNINT);
+		if (t->running != 0)
+			thread_block(THREAD_CONTINUE_NULL);
+		else
+			clear_wait(current_thread(), THREAD_AWAKENED);
+	}
+
+	sum = 0;
+	min = UINT64_MAX;
+	max = 0;
+	for (i = 0; i < nthreads; i++) {
+		sum += t->acquired[i];
+		min = MIN(min, t->acquired[i]);
+		max = MAX(max, t->acquired[i]);
+	}
+
+	avg_ns = max_ns = 0;
+	if (t->handoff_count != 0)
+		absolutetime_to_nanoseconds(t->handoff_sum / t->handoff_count, &avg_ns);
+	absolutetime_to_nanoseconds(t->handoff_max, &max_ns);
+
+	kprintf("mcs_lock_stress_test: %s lock, %d threads: %llu acquisitions, "
+		"per thread min %llu max %llu, handoff avg %llu ns max %llu ns\n",
+		use_mcs ? "mcs" : "simple", nthreads, sum, min, max, avg_ns, max_ns);
+
+	if (t->failed || sum != t->count) {
+		kprintf("mcs_lock_stress_test: %s lock failed mutual exclusion\n",
+			use_mcs ? "mcs" : "simple");
+		return (1);
+	}
+	if (use_mcs && min == 0) {
+		kprintf("mcs_lock_stress_test: a thread was starved\n");
+		return (1);
+	}
+	return (0);
+}
+
+int
+mcs_lock_stress_test(void)
+{
+	unsigned int	nthreads;
+	int		result;
+
+	nthreads = MIN(MAX(processor_avail_count, 2), MCS_TEST_THREADS_MAX);
+
+	result = mcs_test_run(TRUE, nthreads);
+	if (result == 0)
+		result = mcs_test_run(FALSE, nthreads);
+	return (result);
+}
+
+#endif	/* CONFIG_IN_KERNEL_TESTS */
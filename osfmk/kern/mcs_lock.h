@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+/*
+ *	File:	kern/mcs_lock.h
+ *
+ *	Queued (Mellor-Crummey/Scott) spin locks.
+ *
+ *	A test-and-set lock has every waiter spinning on the lock word,
+ *	so each release is followed by a burst of coherence traffic and
+ *	the next owner is whichever processor wins the race - usually
+ *	the one closest to the last owner.  An MCS lock queues waiters
+ *	on per-processor nodes; each waiter spins only on its own node
+ *	and the owner hands the lock directly to its successor, in
+ *	arrival order.
+ *
+ *	These are a drop-in for simple locks that are heavily contended
+ *	across packages.  Like simple locks they disable preemption while
+ *	held and must not be held across a block.  A processor can hold
+ *	(or wait for) at most MCS_LOCK_NODES of them at once, counting
+ *	locks taken from interrupt context.
+ */
+
+#ifndef	_KERN_MCS_LOCK_H_
+#define	_KERN_MCS_LOCK_H_
+
+#include <mach/boolean.h>
+#include <kern/kern_types.h>
+
+#ifdef	MACH_KERNEL_PRIVATE
+
+typedef struct mcs_node {
+	struct mcs_node * volatile	mcs_next;	/* successor waiting on us */
+	volatile uint32_t		mcs_wait;	/* spin here until cleared */
+	uint32_t			mcs_index;	/* slot in the node set */
+} __attribute__((aligned(64))) *mcs_node_t;
+
+#define	MCS_LOCK_NODES		4
+
+/* Per-processor node set, see processor_data */
+struct mcs_node_set {
+	struct mcs_node		nodes[MCS_LOCK_NODES];
+	volatile uint32_t	busy;			/* bitmap of nodes in use */
+};
+
+typedef struct mcs_lock {
+	mcs_node_t volatile	mcs_tail;		/* last waiter, or owner */
+	mcs_node_t		mcs_owner;		/* owner's node */
+} mcs_lock_data_t, *mcs_lock_t;
+
+#define	decl_mcs_lock_data(class,name)	class	mcs_lock_data_t	name;
+
+extern void		mcs_lock_init(
+				mcs_lock_t	lock);
+
+extern void		mcs_lock(
+				mcs_lock_t	lock);
+
+extern boolean_t	mcs_lock_try(
+				mcs_lock_t	lock);
+
+extern void		mcs_unlock(
+				mcs_lock_t	lock);
+
+#define	mcs_lock_held(lock)	((lock)->mcs_tail != NULL)
+
+#endif	/* MACH_KERNEL_PRIVATE */
+
+#endif	/* _KERN_MCS_LOCK_H_ */
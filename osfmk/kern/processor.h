@@ -92,7 +92,7 @@ struct processor_set {
 	int					cpu_set_low, cpu_set_hi;
 	int					cpu_set_count;
 
-	decl_simple_lock_data(,sched_lock)	/* lock for above */
+	decl_mcs_lock_data(,sched_lock)		/* lock for above */
 
 #if defined(CONFIG_SCHED_TRADITIONAL) || defined(CONFIG_SCHED_FIXEDPRIORITY)
 	struct run_queue	pset_runq;      /* runq for this processor set */
@@ -201,9 +201,9 @@ extern processor_t	cpu_to_processor(
 
 /* Lock macros */
 
-#define pset_lock(p)			simple_lock(&(p)->sched_lock)
-#define pset_unlock(p)			simple_unlock(&(p)->sched_lock)
-#define pset_lock_init(p)		simple_lock_init(&(p)->sched_lock, 0)
+#define pset_lock(p)			mcs_lock(&(p)->sched_lock)
+#define pset_unlock(p)			mcs_unlock(&(p)->sched_lock)
+#define pset_lock_init(p)		mcs_lock_init(&(p)->sched_lock)
 
 /* Update hints */
 
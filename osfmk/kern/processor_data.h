@@ -40,6 +40,7 @@
 
 #include <ipc/ipc_kmsg.h>
 #include <kern/timer.h>
+#include <kern/mcs_lock.h>
 
 struct processor_sched_statistics {
 	uint32_t		csw_count;
@@ -75,20 +76,26 @@ struct processor_data {
 	/* VM event counters */
 	vm_statistics64_data_t	vm_stat;
 
-	/* IPC free message cache */
+	/* IPC free message caches, one per buffer size class */
 	struct ikm_cache {
 #define IKM_STASH	16
 		ipc_kmsg_t				entries[IKM_STASH];
 		unsigned int			avail;
-	}						ikm_cache;
+#define IKM_CACHE_CLASSES	17
+	}						ikm_cache[IKM_CACHE_CLASSES];
+	vm_size_t				ikm_cache_large_bytes;	/* cached in classes over 4KB */
 	int						start_color;
 	unsigned long			page_grab_count;
 	void					*free_pages;
+	unsigned int			free_pages_count;
 	struct processor_sched_statistics sched_stats;
 	uint64_t	timer_call_ttd; /* current timer call time-to-deadline */
 	uint64_t	wakeups_issued_total; /* Count of thread wakeups issued
 					       * by this processor
 					       */
+
+	/* Queue nodes for MCS locks held or awaited by this processor */
+	struct mcs_node_set		mcs_nodes;
 };
 
 typedef struct processor_data	processor_data_t;
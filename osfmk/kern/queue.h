@@ -616,6 +616,20 @@ MACRO_END
 
 #include <kern/lock.h>
 
+/*----------------------------------------------------------------*/
+/*
+ *	Deadline index for queues sorted by deadline, maintained
+ *	by the call_entry_*_indexed() routines in kern/call_entry.h.
+ */
+#define QUEUE_WHEEL_LEVELS	3
+#define QUEUE_WHEEL_SLOTS	64
+
+typedef struct queue_wheel {
+	queue_entry_t		slot[QUEUE_WHEEL_LEVELS][QUEUE_WHEEL_SLOTS];
+	uint64_t		hits;		/* inserts started from a slot */
+	uint64_t		misses;		/* inserts that had to scan */
+} queue_wheel_t;
+
 /*----------------------------------------------------------------*/
 /*
  *	Define macros for queues with locks.
@@ -624,6 +638,7 @@ struct mpqueue_head {
 	struct queue_entry	head;		/* header for queue */
 	uint64_t		earliest_soft_deadline;
 	uint64_t		count;
+	queue_wheel_t		wheel;		/* deadline index */
 #if defined(__i386__) || defined(__x86_64__)
 	lck_mtx_t		lock_data;
 	lck_mtx_ext_t		lock_data_ext;
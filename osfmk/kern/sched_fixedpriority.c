@@ -472,13 +472,13 @@ sched_fixedpriority_processor_queue_remove(
 								processor_t			processor,
 								thread_t		thread)
 {
-	void *			rqlock;
+	mcs_lock_t			rqlock;
 	run_queue_t		rq;
 
 	rqlock = &processor->processor_set->sched_lock;
 	rq = runq_for_processor(processor);
 
-	simple_lock(rqlock);
+	mcs_lock(rqlock);
 	if (processor == thread->runq) {
 		/*
 		 *	Thread is on a run queue and we have a lock on
@@ -496,7 +496,7 @@ sched_fixedpriority_processor_queue_remove(
 		processor = PROCESSOR_NULL;
 	}
 	
-	simple_unlock(rqlock);
+	mcs_unlock(rqlock);
 	
 	return (processor != PROCESSOR_NULL);
 }
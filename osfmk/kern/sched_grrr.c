@@ -393,10 +393,10 @@ sched_grrr_processor_queue_remove(
 								processor_t			processor,
 								thread_t		thread)
 {
-	void *			rqlock;
+	mcs_lock_t			rqlock;
 	
 	rqlock = &processor->processor_set->sched_lock;
-	simple_lock(rqlock);
+	mcs_lock(rqlock);
 	
 	if (processor == thread->runq) {
 		/*
@@ -415,7 +415,7 @@ sched_grrr_processor_queue_remove(
 		processor = PROCESSOR_NULL;		
 	}
 	
-	simple_unlock(rqlock);
+	mcs_unlock(rqlock);
 	
 	return (processor != PROCESSOR_NULL);	
 }
@@ -1012,6 +1012,135 @@ thread_go(
 	return (KERN_NOT_WAITING);
 }
 
+/*
+ *	Direct handoff.
+ *
+ *	A thread about to block waiting for the reply to a message it
+ *	just sent (TH_OPT_HANDOFF) can have the wakeup of the receiver
+ *	deferred: rather than going through thread_setrun() and likely
+ *	an IPI to another processor, the receiver is left runnable but
+ *	off the run queues in self->handoff_thread, and the sender then
+ *	switches straight to it with thread_run() when it blocks, handing
+ *	over the rest of its quantum.  A handoff that isn't consumed by
+ *	blocking must be released with thread_handoff_cancel().  If the
+ *	sender is preempted or blocks anywhere else first, the context
+ *	switch dispatches the receiver normally, so it can't be stranded
+ *	runnable but on no run queue.
+ */
+int			sched_handoff_enabled = 1;
+uint32_t	sched_handoff_count;
+
+static boolean_t
+thread_handoff_eligible(
+	thread_t		self,
+	thread_t		thread)
+{
+	processor_t		processor = current_processor();
+
+	if (!sched_handoff_enabled || !(self->options & TH_OPT_HANDOFF))
+		return (FALSE);
+
+	if (self->handoff_thread != THREAD_NULL)
+		return (FALSE);
+
+	if (processor->state != PROCESSOR_RUNNING)
+		return (FALSE);
+
+	if (thread->bound_processor != PROCESSOR_NULL &&
+	    thread->bound_processor != processor)
+		return (FALSE);
+
+	if (thread->affinity_set != AFFINITY_SET_NULL)
+		return (FALSE);
+
+	/*
+	 *	Priority isn't donated, so only hand off to a thread
+	 *	that would be entitled to this processor anyway.
+	 */
+	if (thread->sched_pri < self->sched_pri)
+		return (FALSE);
+
+	return (TRUE);
+}
+
+/*
+ *	Routine:	thread_go_handoff
+ *	Purpose:
+ *		As thread_go(), but if the current thread asked for a
+ *		handoff and the thread can run here, record it for
+ *		thread_handoff_block() instead of dispatching it.
+ *	Conditions:
+ *		thread lock held, IPC locks may be held.
+ *		thread must have been pulled from wait queue under same lock hold.
+ */
+kern_return_t
+thread_go_handoff(
+	thread_t		thread,
+	wait_result_t	wresult)
+{
+	thread_t		self = current_thread();
+
+	assert(thread->at_safe_point == FALSE);
+	assert(thread->wait_event == NO_EVENT64);
+	assert(thread->wait_queue == WAIT_QUEUE_NULL);
+
+	if ((thread->state & (TH_WAIT|TH_TERMINATE)) == TH_WAIT) {
+		if (!thread_unblock(thread, wresult)) {
+			if (thread_handoff_eligible(self, thread))
+				self->handoff_thread = thread;
+			else
+				thread_setrun(thread, SCHED_PREEMPT | SCHED_TAILQ);
+		}
+
+		return (KERN_SUCCESS);
+	}
+
+	return (KERN_NOT_WAITING);
+}
+
+/*
+ *	Routine:	thread_handoff_release
+ *	Purpose:
+ *		Dispatch a thread left by thread_go_handoff()
+ *		through the run queues after all.
+ *	Conditions:
+ *		At splsched, nothing locked.
+ */
+static void
+thread_handoff_release(
+	thread_t		self)
+{
+	thread_t		thread = self->handoff_thread;
+
+	if (thread == THREAD_NULL)
+		return;
+
+	self->handoff_thread = THREAD_NULL;
+
+	thread_lock(thread);
+	thread_setrun(thread, SCHED_PREEMPT | SCHED_TAILQ);
+	thread_unlock(thread);
+}
+
+/*
+ *	Routine:	thread_handoff_cancel
+ *	Purpose:
+ *		As thread_handoff_release(), for callers that
+ *		aren't going to block.
+ *	Conditions:
+ *		Nothing locked.
+ */
+void
+thread_handoff_cancel(
+	thread_t		self)
+{
+	spl_t			s;
+
+	s = splsched();
+	thread_handoff_release(self);
+	splx(s);
+}
+
 /*
  *	Routine:	thread_mark_wait_locked
  *	Purpose:
@@ -1130,7 +1259,7 @@ assert_wait(
 		VM_KERNEL_UNSLIDE(event), 0, 0, 0, 0);
 
 	index = wait_hash(event);
-	wq = &wait_queues[index];
+	wq = &wait_queues[index].wqb_queue;
 	return wait_queue_assert_wait(wq, event, interruptible, 0);
 }
 
@@ -1148,7 +1277,7 @@ assert_wait_timeout(
 	spl_t				s;
 
 	assert(event != NO_EVENT);
-	wqueue = &wait_queues[wait_hash(event)];
+	wqueue = wait_hash_queue(event);
 
 	s = splsched();
 	wait_queue_lock(wqueue);
@@ -1198,7 +1327,7 @@ assert_wait_timeout_with_leeway(
 	clock_interval_to_absolutetime_interval(leeway, scale_factor, &slop);
 
 	assert(event != NO_EVENT);
-	wqueue = &wait_queues[wait_hash(event)];
+	wqueue = wait_hash_queue(event);
 
 	s = splsched();
 	wait_queue_lock(wqueue);
@@ -1232,7 +1361,7 @@ assert_wait_deadline(
 	spl_t				s;
 
 	assert(event != NO_EVENT);
-	wqueue = &wait_queues[wait_hash(event)];
+	wqueue = wait_hash_queue(event);
 
 	s = splsched();
 	wait_queue_lock(wqueue);
@@ -1268,7 +1397,7 @@ assert_wait_deadline_with_leeway(
 	spl_t				s;
 
 	assert(event != NO_EVENT);
-	wqueue = &wait_queues[wait_hash(event)];
+	wqueue = wait_hash_queue(event);
 
 	s = splsched();
 	wait_queue_lock(wqueue);
@@ -1702,7 +1831,7 @@ thread_wakeup_prim_internal(
 	register int			index;
 
 	index = wait_hash(event);
-	wq = &wait_queues[index];
+	wq = &wait_queues[index].wqb_queue;
 	if (one_thread)
 		return (wait_queue_wakeup_one(wq, event, result, priority));
 	else
@@ -2737,6 +2866,9 @@ thread_block_reason(
 			reason, VM_KERNEL_UNSLIDE(continuation), 0, 0, 0);
 	}
 
+	/* Preempted or blocking elsewhere before a pending handoff */
+	thread_handoff_release(self);
+
 	do {
 		thread_lock(self);
 		new_thread = thread_select(self, processor);
@@ -2790,6 +2922,11 @@ thread_run(
 
 	funnel_release_check(self, 3);
 
+	/* Switching to some other thread than a pending handoff */
+	if (self->handoff_thread != new_thread)
+		thread_handoff_release(self);
+	self->handoff_thread = THREAD_NULL;
+
 	self->continuation = continuation;
 	self->parameter = parameter;
 
@@ -2807,6 +2944,57 @@ thread_run(
 	return (self->wait_result);
 }
 
+/*
+ *	thread_handoff_block:
+ *
+ *	Block as thread_block_parameter() would, but switch
+ *	directly to the thread left by thread_go_handoff(), if any.
+ */
+wait_result_t
+thread_handoff_block(
+	thread_continue_t	continuation,
+	void				*parameter)
+{
+	thread_t		self = current_thread();
+	thread_t		thread;
+	wait_result_t	wresult;
+	spl_t			s;
+
+	/*
+	 *	Sample the handoff at splsched: a preemption before
+	 *	this point will already have dispatched it.
+	 */
+	s = splsched();
+
+	thread = self->handoff_thread;
+	if (thread == THREAD_NULL) {
+		splx(s);
+		return (thread_block_parameter(continuation, parameter));
+	}
+
+	/*
+	 *	We may have been moved since the wakeup;
+	 *	the handoff thread may not run here.
+	 */
+	if (thread->bound_processor != PROCESSOR_NULL &&
+	    thread->bound_processor != current_processor()) {
+		thread_handoff_release(self);
+		splx(s);
+		return (thread_block_parameter(continuation, parameter));
+	}
+
+	self->handoff_thread = THREAD_NULL;
+
+	ast_off(AST_SCHEDULING);
+	(void)hw_atomic_add(&sched_handoff_count, 1);
+
+	wresult = thread_run(self, continuation, parameter, thread);
+
+	splx(s);
+
+	return (wresult);
+}
+
 /*
  *	thread_continue:
  *
@@ -4124,13 +4312,13 @@ processor_queue_remove(
 					   processor_t			processor,
 					   thread_t		thread)
 {
-	void *			rqlock;
+	mcs_lock_t			rqlock;
 	run_queue_t		rq;
 	
 	rqlock = &processor->processor_set->sched_lock;
 	rq = runq_for_processor(processor);
 
-	simple_lock(rqlock);
+	mcs_lock(rqlock);
 	if (processor == thread->runq) {
 		/*
 		 *	Thread is on a run queue and we have a lock on
@@ -4148,7 +4336,7 @@ processor_queue_remove(
 		processor = PROCESSOR_NULL;
 	}
 	
-	simple_unlock(rqlock);
+	mcs_unlock(rqlock);
 
 	return (processor != PROCESSOR_NULL);
 }
@@ -107,6 +107,23 @@ extern kern_return_t	thread_go(
 						 	thread_t		thread,
 							wait_result_t	wresult);
 
+/* Unblock thread, possibly deferring dispatch to a handoff */
+extern kern_return_t	thread_go_handoff(
+							thread_t		thread,
+							wait_result_t	wresult);
+
+/* Block, switching directly to a pending handoff thread */
+extern wait_result_t	thread_handoff_block(
+							thread_continue_t	continuation,
+							void				*parameter);
+
+/* Dispatch a pending handoff thread normally */
+extern void			thread_handoff_cancel(
+						thread_t		self);
+
+extern int			sched_handoff_enabled;
+extern uint32_t		sched_handoff_count;
+
 /* Handle threads at context switch */
 extern void			thread_dispatch(
 						thread_t		old_thread,
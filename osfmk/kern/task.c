@@ -2657,7 +2657,7 @@ task_info(
 		task_vm_info_t		vm_info;
 		vm_map_t		map;
 
-		if (*task_info_count < TASK_VM_INFO_COUNT) {
+		if (*task_info_count < TASK_VM_INFO_REV0_COUNT) {
 		    error = KERN_INVALID_ARGUMENT;
 		    break;
 		}
@@ -2741,7 +2741,19 @@ task_info(
 			vm_map_unlock_read(map);
 		}
 
-		*task_info_count = TASK_VM_INFO_COUNT;
+		if (*task_info_count >= TASK_VM_INFO_COUNT) {
+#if MACHINE_PMAP_PROMOTE_SUPERPAGE
+			pmap_superpage_counts(map->pmap,
+					      &vm_info->superpage_promotions,
+					      &vm_info->superpage_demotions);
+#else
+			vm_info->superpage_promotions = 0;
+			vm_info->superpage_demotions = 0;
+#endif
+			*task_info_count = TASK_VM_INFO_COUNT;
+		} else {
+			*task_info_count = TASK_VM_INFO_REV0_COUNT;
+		}
 		break;
 	}
 
@@ -212,6 +212,7 @@ thread_bootstrap(void)
 	thread_template.wake_active = FALSE;
 	thread_template.continuation = THREAD_CONTINUE_NULL;
 	thread_template.parameter = NULL;
+	thread_template.handoff_thread = THREAD_NULL;
 
 	thread_template.importance = 0;
 	thread_template.sched_mode = TH_MODE_NONE;
@@ -153,12 +153,14 @@ struct thread {
 #define TH_OPT_PROC_CPULIMIT	0x0020		/* Thread has a task-wide CPU limit applied to it */
 #define TH_OPT_PRVT_CPULIMIT	0x0040		/* Thread has a thread-private CPU limit applied to it */
 #define TH_OPT_IDLE_THREAD		0x0080		/* Thread is a per-processor idle thread */
+#define TH_OPT_HANDOFF		0x0100		/* Wakeups may be deferred to a direct handoff */
 
 	boolean_t			wake_active;	/* wake event on stop */
 	int					at_safe_point;	/* thread_abort_safely allowed */
 	ast_t				reason;			/* why we blocked */
 	thread_continue_t	continuation;	/* continue here next dispatch */
 	void				*parameter;		/* continuation parameter */
+	struct thread		*handoff_thread;	/* woken, switch to it on block */
 	wait_result_t		wait_result;	/* outcome of wait -
 										 * may be examined by this thread
 										 * WITHOUT locking */
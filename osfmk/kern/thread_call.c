@@ -31,6 +31,8 @@
 
 #include <kern/kern_types.h>
 #include <kern/zalloc.h>
+#include <kern/kalloc.h>
+#include <kern/cpu_number.h>
 #include <kern/sched_prim.h>
 #include <kern/clock.h>
 #include <kern/task.h>
@@ -53,17 +55,58 @@
 #endif
 #include <machine/machine_routines.h>
 
+#if defined(__i386__) || defined(__x86_64__)
+typedef lck_mtx_t		thread_call_lock_data_t;
+#else
+typedef lck_spin_t		thread_call_lock_data_t;
+#endif
+
 static zone_t			thread_call_zone;
 static struct wait_queue	daemon_wqueue;
 
-struct thread_call_group {
+/*
+ * Each priority group is split into per-processor shards.  A call is
+ * homed on the shard of the processor it was set up on (tc_cpu, fixed
+ * for the life of the call), and the shard lock protects the shard's
+ * queues as well as the queue linkage, counts, flags and references of
+ * every call homed there.  Submitters on different processors thus
+ * take different locks.  A worker services the shard of the processor
+ * it is running on first and steals from the others when that one is
+ * empty, so work is never stranded on a shard.
+ *
+ * The delayed queue of each shard stays a deadline-sorted list indexed
+ * by a timing wheel (see call_entry.h): insertion is constant time for
+ * near deadlines and the head is always the next to fire, which is
+ * what the shard's timer needs.
+ */
+struct thread_call_shard {
+	thread_call_lock_data_t	lock;
+
 	queue_head_t		pending_queue;
 	uint32_t		pending_count;
 
 	queue_head_t		delayed_queue;
-	uint32_t		delayed_count;
+	queue_wheel_t		delayed_wheel;
 
 	timer_call_data_t	delayed_timer;
+
+	struct thread_call_group *group;
+} __attribute__((aligned(64)));
+
+typedef struct thread_call_shard	*thread_call_shard_t;
+
+/*
+ * The group lock protects only thread accounting and the idle wait
+ * queue.  pending_count is the sum of the shard counts; it is updated
+ * atomically under the shard lock so that submitters and workers can
+ * test for work without taking the group lock.
+ */
+struct thread_call_group {
+	thread_call_lock_data_t	lock;
+
+	volatile uint32_t	pending_count;
+	thread_call_shard_t	shards;
+
 	timer_call_data_t	dealloc_timer;
 
 	struct wait_queue	idle_wqueue;
@@ -75,7 +118,7 @@ struct thread_call_group {
 
 	uint32_t		flags;
 	sched_call_t		sched_call;
-};
+} __attribute__((aligned(64)));
 
 typedef struct thread_call_group	*thread_call_group_t;
 
@@ -88,31 +131,38 @@ typedef struct thread_call_group	*thread_call_group_t;
 #define THREAD_CALL_DEALLOC_INTERVAL_NS (5 * 1000 * 1000) /* 5 ms */
 #define THREAD_CALL_ADD_RATIO		4
 #define THREAD_CALL_MACH_FACTOR_CAP	3
+#define THREAD_CALL_SHARD_MAX		16
 
 static struct thread_call_group	thread_call_groups[THREAD_CALL_GROUP_COUNT];
+static uint32_t			thread_call_shard_mask;
 static boolean_t		thread_call_daemon_awake;
+static thread_call_lock_data_t	thread_call_daemon_lock;
 static thread_call_data_t	internal_call_storage[INTERNAL_CALL_COUNT];
+static thread_call_lock_data_t	thread_call_internal_lock;
 static queue_head_t		thread_call_internal_queue;
 int						thread_call_internal_queue_count = 0;
 static uint64_t 		thread_call_dealloc_interval_abs;
 
 static __inline__ thread_call_t	_internal_call_allocate(thread_call_func_t func, thread_call_param_t param0);
 static __inline__ void		_internal_call_release(thread_call_t call);
-static __inline__ boolean_t	_pending_call_enqueue(thread_call_t call, thread_call_group_t group);
-static __inline__ boolean_t 	_delayed_call_enqueue(thread_call_t call, thread_call_group_t group, uint64_t deadline);
-static __inline__ boolean_t 	_call_dequeue(thread_call_t call, thread_call_group_t group);
+static __inline__ boolean_t	_pending_call_enqueue(thread_call_t call, thread_call_shard_t shard);
+static __inline__ boolean_t 	_delayed_call_enqueue(thread_call_t call, thread_call_shard_t shard, uint64_t deadline);
+static __inline__ boolean_t 	_call_dequeue(thread_call_t call, thread_call_shard_t shard);
 static __inline__ void		thread_call_wake(thread_call_group_t group);
-static __inline__ void		_set_delayed_call_timer(thread_call_t call, thread_call_group_t	group);
-static boolean_t		_remove_from_pending_queue(thread_call_func_t func, thread_call_param_t	param0, boolean_t remove_all);
-static boolean_t 		_remove_from_delayed_queue(thread_call_func_t func, thread_call_param_t	param0, boolean_t remove_all);
+static void			thread_call_wake_locked(thread_call_group_t group);
+static void			thread_call_group_recheck(thread_call_group_t group);
+static void			thread_call_daemon_wake(void);
+static __inline__ void		_set_delayed_call_timer(thread_call_t call, thread_call_shard_t shard);
+static boolean_t		_remove_from_pending_queue(thread_call_shard_t shard, thread_call_func_t func, thread_call_param_t	param0, boolean_t remove_all);
+static boolean_t 		_remove_from_delayed_queue(thread_call_shard_t shard, thread_call_func_t func, thread_call_param_t	param0, boolean_t remove_all);
 static void			thread_call_daemon(void *arg);
 static void			thread_call_thread(thread_call_group_t group, wait_result_t wres);
 extern void			thread_call_delayed_timer(timer_call_param_t p0, timer_call_param_t p1);
 static void			thread_call_dealloc_timer(timer_call_param_t p0, timer_call_param_t p1);
-static void			thread_call_group_setup(thread_call_group_t group, thread_call_priority_t pri, uint32_t target_thread_count, boolean_t parallel);
+static void			thread_call_group_setup(thread_call_group_t group, thread_call_priority_t pri, uint32_t target_thread_count, boolean_t parallel, thread_call_shard_t shards);
 static void			sched_call_thread(int type, thread_t thread);
 static void			thread_call_start_deallocate_timer(thread_call_group_t group);
-static void			thread_call_wait_locked(thread_call_t call);
+static void			thread_call_wait_locked(thread_call_t call, thread_call_shard_t shard);
 static boolean_t		thread_call_enter_delayed_internal(thread_call_t call,
 						thread_call_func_t alt_func, thread_call_param_t alt_param0,
 						thread_call_param_t param1, uint64_t deadline,
@@ -127,39 +177,66 @@ lck_grp_t               thread_call_lck_grp;
 lck_attr_t              thread_call_lck_attr;
 lck_grp_attr_t          thread_call_lck_grp_attr;
 
-#if defined(__i386__) || defined(__x86_64__)
-lck_mtx_t		thread_call_lock_data;
-#else
-lck_spin_t		thread_call_lock_data;
-#endif
+/*
+ * Lock ordering: a shard lock may be held while taking its group's
+ * lock, and either may be held while taking thread_call_internal_lock
+ * or thread_call_daemon_lock.  Never the reverse, and never two shard
+ * or two group locks at once.  The macros take a group or a shard.
+ */
+#define thread_call_lock_spin(x)		\
+	lck_mtx_lock_spin_always(&(x)->lock)
 
+#define thread_call_unlock(x)		\
+	lck_mtx_unlock_always(&(x)->lock)
 
-#define thread_call_lock_spin()			\
-	lck_mtx_lock_spin_always(&thread_call_lock_data)
+extern boolean_t	mach_timer_coalescing_enabled;
 
-#define thread_call_unlock()			\
-	lck_mtx_unlock_always(&thread_call_lock_data)
+static inline spl_t
+disable_ints_and_lock(thread_call_group_t group)
+{
+	spl_t s;
 
-extern boolean_t	mach_timer_coalescing_enabled;
+	s = splsched();
+	thread_call_lock_spin(group);
+
+	return s;
+}
+
+static inline void 
+enable_ints_and_unlock(thread_call_group_t group)
+{
+	thread_call_unlock(group);
+	(void)spllo();
+}
 
 static inline spl_t
-disable_ints_and_lock(void)
+disable_ints_and_lock_shard(thread_call_shard_t shard)
 {
 	spl_t s;
 
 	s = splsched();
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
 	return s;
 }
 
 static inline void 
-enable_ints_and_unlock(void)
+enable_ints_and_unlock_shard(thread_call_shard_t shard)
 {
-	thread_call_unlock();
+	thread_call_unlock(shard);
 	(void)spllo();
 }
 
+static inline void
+thread_call_lock_init(thread_call_lock_data_t *lock)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	lck_mtx_init(lock, &thread_call_lck_grp, &thread_call_lck_attr);
+#else
+	lck_spin_init(lock, &thread_call_lck_grp, &thread_call_lck_attr);
+#endif
+}
+
 
 static inline boolean_t
 group_isparallel(thread_call_group_t group)
@@ -181,8 +258,13 @@ thread_call_group_should_add_thread(thread_call_group_t group)
 	}
 
 	if (group->pending_count > 0) {
+		/*
+		 * Submitters bump pending_count before they take the
+		 * group lock to wake an idle thread, so this is a
+		 * window to wait out rather than an inconsistency.
+		 */
 		if (group->idle_count > 0) {
-			panic("Pending work, but threads are idle?");
+			return FALSE;
 		}
 
 		thread_count = group->active_count;
@@ -225,7 +307,7 @@ thread_call_priority_to_sched_pri(thread_call_priority_t pri)
 	return 0;
 }
 
-/* Lock held */
+/* Stable for the life of the call; no lock needed */
 static inline thread_call_group_t
 thread_call_get_group(
 		thread_call_t call)
@@ -240,17 +322,59 @@ thread_call_get_group(
 	return &thread_call_groups[pri];
 }
 
+/* Stable for the life of the call; no lock needed */
+static inline thread_call_shard_t
+thread_call_get_shard(
+		thread_call_t call)
+{
+	return &thread_call_get_group(call)->shards[call->tc_cpu & thread_call_shard_mask];
+}
+
+/*
+ * Adjust a shard's pending count and its group's total.
+ * Called with the shard lock held.
+ */
+static __inline__ void
+thread_call_shard_pending_adjust(
+		thread_call_shard_t	shard,
+		int32_t			delta)
+{
+	shard->pending_count += delta;
+	OSAddAtomic(delta, &shard->group->pending_count);
+}
+
+static void
+thread_call_shard_setup(
+		thread_call_shard_t		shard,
+		thread_call_group_t		group)
+{
+	thread_call_lock_init(&shard->lock);
+
+	queue_init(&shard->pending_queue);
+	queue_init(&shard->delayed_queue);
+	call_entry_wheel_init(&shard->delayed_wheel);
+
+	timer_call_setup(&shard->delayed_timer, thread_call_delayed_timer, shard);
+
+	shard->group = group;
+}
+
 static void
 thread_call_group_setup(
 		thread_call_group_t 		group, 
 		thread_call_priority_t		pri,
 		uint32_t			target_thread_count,
-		boolean_t			parallel)
+		boolean_t			parallel,
+		thread_call_shard_t		shards)
 {
-	queue_init(&group->pending_queue);
-	queue_init(&group->delayed_queue);
+	uint32_t	i;
+
+	thread_call_lock_init(&group->lock);
+
+	group->shards = shards;
+	for (i = 0; i <= thread_call_shard_mask; i++)
+		thread_call_shard_setup(&shards[i], group);
 
-	timer_call_setup(&group->delayed_timer, thread_call_delayed_timer, group);
 	timer_call_setup(&group->dealloc_timer, thread_call_dealloc_timer, group);
 
 	wait_queue_init(&group->idle_wqueue, SYNC_POLICY_FIFO);
@@ -304,8 +428,10 @@ void
 thread_call_initialize(void)
 {
 	thread_call_t			call;
+	thread_call_shard_t		shards;
 	kern_return_t			result;
 	thread_t			thread;
+	uint32_t			nshards, ncpus;
 	int				i;
 
 	i = sizeof (thread_call_data_t);
@@ -318,21 +444,30 @@ thread_call_initialize(void)
 	lck_grp_init(&thread_call_queues_lck_grp, "thread_call_queues", &thread_call_lck_grp_attr);
 	lck_grp_init(&thread_call_lck_grp, "thread_call", &thread_call_lck_grp_attr);
 
-#if defined(__i386__) || defined(__x86_64__)
-        lck_mtx_init(&thread_call_lock_data, &thread_call_lck_grp, &thread_call_lck_attr);
-#else
-        lck_spin_init(&thread_call_lock_data, &thread_call_lck_grp, &thread_call_lck_attr);
-#endif
+	thread_call_lock_init(&thread_call_internal_lock);
+	thread_call_lock_init(&thread_call_daemon_lock);
 
 	nanotime_to_absolutetime(0, THREAD_CALL_DEALLOC_INTERVAL_NS, &thread_call_dealloc_interval_abs);
 	wait_queue_init(&daemon_wqueue, SYNC_POLICY_FIFO);
 
-	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_LOW], THREAD_CALL_PRIORITY_LOW, 0, TRUE);
-	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_USER], THREAD_CALL_PRIORITY_USER, 0, TRUE);
-	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_KERNEL], THREAD_CALL_PRIORITY_KERNEL, 1, TRUE);
-	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_HIGH], THREAD_CALL_PRIORITY_HIGH, THREAD_CALL_THREAD_MIN, FALSE);
-
-	disable_ints_and_lock();
+	/* One shard per processor, rounded up to a power of two */
+	ncpus = (uint32_t) ml_early_cpu_count();
+	for (nshards = 1; nshards < ncpus && nshards < THREAD_CALL_SHARD_MAX; nshards <<= 1)
+		;
+	thread_call_shard_mask = nshards - 1;
+
+	shards = (thread_call_shard_t)kalloc(THREAD_CALL_GROUP_COUNT * nshards * sizeof (struct thread_call_shard));
+	if (shards == NULL)
+		panic("thread_call_initialize: no memory for shards");
+
+	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_LOW], THREAD_CALL_PRIORITY_LOW, 0, TRUE,
+	    &shards[THREAD_CALL_PRIORITY_LOW * nshards]);
+	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_USER], THREAD_CALL_PRIORITY_USER, 0, TRUE,
+	    &shards[THREAD_CALL_PRIORITY_USER * nshards]);
+	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_KERNEL], THREAD_CALL_PRIORITY_KERNEL, 1, TRUE,
+	    &shards[THREAD_CALL_PRIORITY_KERNEL * nshards]);
+	thread_call_group_setup(&thread_call_groups[THREAD_CALL_PRIORITY_HIGH], THREAD_CALL_PRIORITY_HIGH, THREAD_CALL_THREAD_MIN, FALSE,
+	    &shards[THREAD_CALL_PRIORITY_HIGH * nshards]);
 
 	queue_init(&thread_call_internal_queue);
 	for (
@@ -346,8 +481,6 @@ thread_call_initialize(void)
 
 	thread_call_daemon_awake = TRUE;
 
-	enable_ints_and_unlock();
-
 	result = kernel_thread_start_priority((thread_continue_t)thread_call_daemon, NULL, BASEPRI_PREEMPT + 1, &thread);
 	if (result != KERN_SUCCESS)
 		panic("thread_call_initialize");
@@ -364,6 +497,7 @@ thread_call_setup(
 	bzero(call, sizeof(*call));
 	call_entry_setup((call_entry_t)call, func, param0);
 	call->tc_pri = THREAD_CALL_PRIORITY_HIGH; /* Default priority */
+	call->tc_cpu = cpu_number();
 }
 
 /*
@@ -371,19 +505,23 @@ thread_call_setup(
  *
  *	Allocate an internal callout entry.
  *
- *	Called with thread_call_lock held.
+ *	Called with interrupts disabled.
  */
 static __inline__ thread_call_t
 _internal_call_allocate(thread_call_func_t func, thread_call_param_t param0)
 {
     thread_call_t		call;
     
+    lck_mtx_lock_spin_always(&thread_call_internal_lock);
+
     if (queue_empty(&thread_call_internal_queue))
     	panic("_internal_call_allocate");
 	
     call = TC(dequeue_head(&thread_call_internal_queue));
     thread_call_internal_queue_count--;
 
+    lck_mtx_unlock_always(&thread_call_internal_lock);
+
     thread_call_setup(call, func, param0);
     call->tc_refs = 0;
     call->tc_flags = 0; /* THREAD_CALL_ALLOC not set, do not free back to zone */
@@ -399,7 +537,7 @@ _internal_call_allocate(thread_call_func_t func, thread_call_param_t param0)
  *	safe to call on a non-internal entry, in which
  *	case nothing happens.
  *
- * 	Called with thread_call_lock held.
+ * 	Called with the shard lock held.
  */
 static __inline__ void
 _internal_call_release(
@@ -408,8 +546,10 @@ _internal_call_release(
     if (    call >= internal_call_storage						&&
 	   	    call < &internal_call_storage[INTERNAL_CALL_COUNT]		) {
 		assert((call->tc_flags & THREAD_CALL_ALLOC) == 0);
+		lck_mtx_lock_spin_always(&thread_call_internal_lock);
 		enqueue_head(&thread_call_internal_queue, qe(call));
 		thread_call_internal_queue_count++;
+		lck_mtx_unlock_always(&thread_call_internal_lock);
 	}
 }
 
@@ -422,24 +562,27 @@ _internal_call_release(
  *	Returns TRUE if the entry was already
  *	on a queue.
  *
- *	Called with thread_call_lock held.
+ *	Called with the shard lock held.
  */
 static __inline__ boolean_t
 _pending_call_enqueue(
     thread_call_t		call,
-	thread_call_group_t	group)
+	thread_call_shard_t	shard)
 {
 	queue_head_t		*old_queue;
 
-	old_queue = call_entry_enqueue_tail(CE(call), &group->pending_queue);
+	if (CE(call)->queue == &shard->delayed_queue)
+		call_entry_wheel_remove(CE(call), &shard->delayed_queue, &shard->delayed_wheel);
+
+	old_queue = call_entry_enqueue_tail(CE(call), &shard->pending_queue);
 
 	if (old_queue == NULL) {
 		call->tc_submit_count++;
 	}
 
-	group->pending_count++;
+	thread_call_shard_pending_adjust(shard, 1);
 
-	thread_call_wake(group);
+	thread_call_wake(shard->group);
 
 	return (old_queue != NULL);
 }
@@ -454,20 +597,21 @@ _pending_call_enqueue(
  *	Returns TRUE if the entry was already
  *	on a queue.
  *
- *	Called with thread_call_lock held.
+ *	Called with the shard lock held.
  */
 static __inline__ boolean_t
 _delayed_call_enqueue(
     	thread_call_t		call,
-	thread_call_group_t	group,
+	thread_call_shard_t	shard,
 	uint64_t		deadline)
 {
 	queue_head_t		*old_queue;
 
-	old_queue = call_entry_enqueue_deadline(CE(call), &group->delayed_queue, deadline);
+	old_queue = call_entry_enqueue_deadline_indexed(CE(call), &shard->delayed_queue,
+							&shard->delayed_wheel, deadline);
 
-	if (old_queue == &group->pending_queue)
-		group->pending_count--;
+	if (old_queue == &shard->pending_queue)
+		thread_call_shard_pending_adjust(shard, -1);
 	else if (old_queue == NULL) 
 		call->tc_submit_count++;
 
@@ -481,21 +625,24 @@ _delayed_call_enqueue(
  *
  *	Returns TRUE if the entry was on a queue.
  *
- *	Called with thread_call_lock held.
+ *	Called with the shard lock held.
  */
 static __inline__ boolean_t
 _call_dequeue(
 	thread_call_t		call,
-	thread_call_group_t	group)
+	thread_call_shard_t	shard)
 {
 	queue_head_t		*old_queue;
 
-	old_queue = call_entry_dequeue(CE(call));
+	if (CE(call)->queue == &shard->delayed_queue)
+		old_queue = call_entry_dequeue_indexed(CE(call), &shard->delayed_wheel);
+	else
+		old_queue = call_entry_dequeue(CE(call));
 
 	if (old_queue != NULL) {
 		call->tc_finish_count++;
-		if (old_queue == &group->pending_queue)
-			group->pending_count--;
+		if (old_queue == &shard->pending_queue)
+			thread_call_shard_pending_adjust(shard, -1);
 	}
 
 	return (old_queue != NULL);
@@ -507,19 +654,19 @@ _call_dequeue(
  *	Reset the timer so that it
  *	next expires when the entry is due.
  *
- *	Called with thread_call_lock held.
+ *	Called with the shard lock held.
  */
 static __inline__ void
 _set_delayed_call_timer(
     thread_call_t		call,
-	thread_call_group_t	group)
+	thread_call_shard_t	shard)
 {
 	uint64_t leeway;
 
 	assert((call->tc_soft_deadline != 0) && ((call->tc_soft_deadline <= call->tc_call.deadline)));
 
 	leeway = call->tc_call.deadline - call->tc_soft_deadline;
-	timer_call_enter_with_leeway(&group->delayed_timer, NULL,
+	timer_call_enter_with_leeway(&shard->delayed_timer, NULL,
 	    call->tc_soft_deadline, leeway,
 	    TIMER_CALL_SYS_CRITICAL|TIMER_CALL_LEEWAY,
 	    ((call->tc_soft_deadline & 0x1) == 0x1));
@@ -529,31 +676,31 @@ _set_delayed_call_timer(
  *	_remove_from_pending_queue:
  *
  *	Remove the first (or all) matching
- *	entries	from the pending queue.
+ *	entries	from a shard's pending queue.
  *
  *	Returns	TRUE if any matching entries
  *	were found.
  *
- *	Called with thread_call_lock held.
+ *	Called with the shard lock held.
  */
 static boolean_t
 _remove_from_pending_queue(
+    thread_call_shard_t		shard,
     thread_call_func_t		func,
     thread_call_param_t		param0,
     boolean_t				remove_all)
 {
 	boolean_t				call_removed = FALSE;
 	thread_call_t			call;
-	thread_call_group_t		group = &thread_call_groups[THREAD_CALL_PRIORITY_HIGH];
 
-	call = TC(queue_first(&group->pending_queue));
+	call = TC(queue_first(&shard->pending_queue));
 
-	while (!queue_end(&group->pending_queue, qe(call))) {
+	while (!queue_end(&shard->pending_queue, qe(call))) {
 		if (call->tc_call.func == func &&
 				call->tc_call.param0 == param0) {
 			thread_call_t	next = TC(queue_next(qe(call)));
 
-			_call_dequeue(call, group);
+			_call_dequeue(call, shard);
 
 			_internal_call_release(call);
 
@@ -574,31 +721,31 @@ _remove_from_pending_queue(
  *	_remove_from_delayed_queue:
  *
  *	Remove the first (or all) matching
- *	entries	from the delayed queue.
+ *	entries	from a shard's delayed queue.
  *
  *	Returns	TRUE if any matching entries
  *	were found.
  *
- *	Called with thread_call_lock held.
+ *	Called with the shard lock held.
  */
 static boolean_t
 _remove_from_delayed_queue(
+    thread_call_shard_t		shard,
     thread_call_func_t		func,
     thread_call_param_t		param0,
     boolean_t				remove_all)
 {
 	boolean_t			call_removed = FALSE;
 	thread_call_t			call;
-	thread_call_group_t		group = &thread_call_groups[THREAD_CALL_PRIORITY_HIGH];
 
-	call = TC(queue_first(&group->delayed_queue));
+	call = TC(queue_first(&shard->delayed_queue));
 
-	while (!queue_end(&group->delayed_queue, qe(call))) {
+	while (!queue_end(&shard->delayed_queue, qe(call))) {
 		if (call->tc_call.func == func	&&
 				call->tc_call.param0 == param0) {
 			thread_call_t	next = TC(queue_next(qe(call)));
 
-			_call_dequeue(call, group);
+			_call_dequeue(call, shard);
 
 			_internal_call_release(call);
 
@@ -666,20 +813,28 @@ thread_call_func_cancel(
 		thread_call_param_t		param,
 		boolean_t			cancel_all)
 {
-	boolean_t	result;
-	spl_t		s;
+	boolean_t		result = FALSE;
+	thread_call_group_t	group = &thread_call_groups[THREAD_CALL_PRIORITY_HIGH];
+	thread_call_shard_t	shard;
+	uint32_t		i;
+	spl_t			s;
 
 	s = splsched();
-	thread_call_lock_spin();
 
-	if (cancel_all)
-		result = _remove_from_pending_queue(func, param, cancel_all) |
-			_remove_from_delayed_queue(func, param, cancel_all);
-	else
-		result = _remove_from_pending_queue(func, param, cancel_all) ||
-			_remove_from_delayed_queue(func, param, cancel_all);
+	for (i = 0; i <= thread_call_shard_mask && (cancel_all || !result); i++) {
+		shard = &group->shards[i];
+		thread_call_lock_spin(shard);
+		result |= _remove_from_pending_queue(shard, func, param, cancel_all);
+		thread_call_unlock(shard);
+	}
+
+	for (i = 0; i <= thread_call_shard_mask && (cancel_all || !result); i++) {
+		shard = &group->shards[i];
+		thread_call_lock_spin(shard);
+		result |= _remove_from_delayed_queue(shard, func, param, cancel_all);
+		thread_call_unlock(shard);
+	}
 
-	thread_call_unlock();
 	splx(s);
 
 	return (result);
@@ -739,14 +894,15 @@ boolean_t
 thread_call_free(
 		thread_call_t		call)
 {
-	spl_t	s;
-	int32_t refs;
+	thread_call_shard_t	shard = thread_call_get_shard(call);
+	spl_t			s;
+	int32_t			refs;
 
 	s = splsched();
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
 	if (call->tc_call.queue != NULL) {
-		thread_call_unlock();
+		thread_call_unlock(shard);
 		splx(s);
 
 		return (FALSE);
@@ -757,7 +913,7 @@ thread_call_free(
 		panic("Refcount negative: %d\n", refs);
 	}	
 
-	thread_call_unlock();
+	thread_call_unlock(shard);
 	splx(s);
 
 	if (refs == 0) {
@@ -780,21 +936,21 @@ thread_call_enter(
 		thread_call_t		call)
 {
 	boolean_t		result = TRUE;
-	thread_call_group_t	group;
+	thread_call_shard_t	shard;
 	spl_t			s;
 
-	group = thread_call_get_group(call);
+	shard = thread_call_get_shard(call);
 
 	s = splsched();
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
-	if (call->tc_call.queue != &group->pending_queue) {
-		result = _pending_call_enqueue(call, group);
+	if (call->tc_call.queue != &shard->pending_queue) {
+		result = _pending_call_enqueue(call, shard);
 	}
 
 	call->tc_call.param1 = 0;
 
-	thread_call_unlock();
+	thread_call_unlock(shard);
 	splx(s);
 
 	return (result);
@@ -806,21 +962,21 @@ thread_call_enter1(
 		thread_call_param_t		param1)
 {
 	boolean_t		result = TRUE;
-	thread_call_group_t	group;
+	thread_call_shard_t	shard;
 	spl_t			s;
 
-	group = thread_call_get_group(call);
+	shard = thread_call_get_shard(call);
 
 	s = splsched();
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
-	if (call->tc_call.queue != &group->pending_queue) {
-		result = _pending_call_enqueue(call, group);
+	if (call->tc_call.queue != &shard->pending_queue) {
+		result = _pending_call_enqueue(call, shard);
 	}
 
 	call->tc_call.param1 = param1;
 
-	thread_call_unlock();
+	thread_call_unlock(shard);
 	splx(s);
 
 	return (result);
@@ -891,7 +1047,7 @@ thread_call_enter_delayed_internal(
 		unsigned int 		flags)
 {
 	boolean_t		result = TRUE;
-	thread_call_group_t	group;
+	thread_call_shard_t	shard;
 	spl_t			s;
 	uint64_t		abstime, sdeadline, slop;
 	uint32_t		urgency;
@@ -900,14 +1056,15 @@ thread_call_enter_delayed_internal(
 	urgency = (flags & TIMEOUT_URGENCY_MASK);
 
 	s = splsched();
-	thread_call_lock_spin();
 
 	if (call == NULL) {
 		/* allocate a structure out of internal storage, as a convenience for BSD callers */
 		call = _internal_call_allocate(alt_func, alt_param0);
 	}
 
-	group = thread_call_get_group(call);
+	shard = thread_call_get_shard(call);
+	thread_call_lock_spin(shard);
+
 	abstime =  mach_absolute_time();
 	
 	call->tc_flags |= THREAD_CALL_DELAYED;
@@ -939,15 +1096,15 @@ thread_call_enter_delayed_internal(
 	call->tc_call.param1 = param1;
 	call->ttd = (sdeadline > abstime) ? (sdeadline - abstime) : 0;
 
-	result = _delayed_call_enqueue(call, group, deadline);
+	result = _delayed_call_enqueue(call, shard, deadline);
 
-	if (queue_first(&group->delayed_queue) == qe(call))
-		_set_delayed_call_timer(call, group);
+	if (queue_first(&shard->delayed_queue) == qe(call))
+		_set_delayed_call_timer(call, shard);
 
 #if CONFIG_DTRACE
 	DTRACE_TMR5(thread_callout__create, thread_call_func_t, call->tc_call.func, uint64_t, (deadline - sdeadline), uint64_t, (call->ttd >> 32), (unsigned) (call->ttd & 0xFFFFFFFF), call);
 #endif
-	thread_call_unlock();
+	thread_call_unlock(shard);
 	splx(s);
 
 	return (result);
@@ -966,30 +1123,30 @@ thread_call_cancel(
 		thread_call_t		call)
 {
 	boolean_t		result, do_cancel_callout = FALSE;
-	thread_call_group_t	group;
+	thread_call_shard_t	shard;
 	spl_t			s;
 
-	group = thread_call_get_group(call);
+	shard = thread_call_get_shard(call);
 
 	s = splsched();
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
 	if ((call->tc_call.deadline != 0) &&
-	    (queue_first(&group->delayed_queue) == qe(call))) {
-		assert (call->tc_call.queue == &group->delayed_queue);
+	    (queue_first(&shard->delayed_queue) == qe(call))) {
+		assert (call->tc_call.queue == &shard->delayed_queue);
 		do_cancel_callout = TRUE;
 	}
 
-	result = _call_dequeue(call, group);
+	result = _call_dequeue(call, shard);
 
 	if (do_cancel_callout) {
-		timer_call_cancel(&group->delayed_timer);
-		if (!queue_empty(&group->delayed_queue)) {
-			_set_delayed_call_timer(TC(queue_first(&group->delayed_queue)), group);
+		timer_call_cancel(&shard->delayed_timer);
+		if (!queue_empty(&shard->delayed_queue)) {
+			_set_delayed_call_timer(TC(queue_first(&shard->delayed_queue)), shard);
 		}
 	}
 
-	thread_call_unlock();
+	thread_call_unlock(shard);
 	splx(s);
 #if CONFIG_DTRACE
 	DTRACE_TMR4(thread_callout__cancel, thread_call_func_t, call->tc_call.func, 0, (call->ttd >> 32), (unsigned) (call->ttd & 0xFFFFFFFF));
@@ -1011,23 +1168,23 @@ thread_call_cancel_wait(
 		thread_call_t		call)
 {
 	boolean_t		result;
-	thread_call_group_t	group;
+	thread_call_shard_t	shard;
 
 	if ((call->tc_flags & THREAD_CALL_ALLOC) == 0) {
 		panic("%s: Can't wait on thread call whose storage I don't own.", __FUNCTION__);
 	}
 
-	group = thread_call_get_group(call);
+	shard = thread_call_get_shard(call);
 
 	(void) splsched();
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
-	result = _call_dequeue(call, group);
+	result = _call_dequeue(call, shard);
 	if (result == FALSE) {
-		thread_call_wait_locked(call);
+		thread_call_wait_locked(call, shard);
 	}
 
-	thread_call_unlock();
+	thread_call_unlock(shard);
 	(void) spllo();
 
 	return result;
@@ -1038,17 +1195,50 @@ thread_call_cancel_wait(
  *	thread_call_wake:
  *
  *	Wake a call thread to service
+ *	pending call entries, after the
+ *	group's pending_count has been
+ *	raised.
+ *
+ *	Called with a shard lock held.
+ *
+ *	The thread counts are sampled without the group lock: when
+ *	no thread could be woken or created there is nothing to do.
+ *	A worker that is about to go idle (or stop running) updates
+ *	its count under the group lock and then rechecks pending_count
+ *	(thread_call_group_recheck()); since pending_count was raised
+ *	atomically before the sample, one side always sees the other.
+ */
+static __inline__ void
+thread_call_wake(
+	thread_call_group_t		group)
+{
+	if (group_isparallel(group)) {
+		if (group->idle_count == 0 && !thread_call_group_should_add_thread(group))
+			return;
+	} else if (group->active_count != 0) {
+		return;
+	}
+
+	thread_call_lock_spin(group);
+	thread_call_wake_locked(group);
+	thread_call_unlock(group);
+}
+
+/*
+ *	thread_call_wake_locked:
+ *
+ *	Wake a call thread to service
  *	pending call entries.  May wake
  *	the daemon thread in order to
  *	create additional call threads.
  *
- *	Called with thread_call_lock held.
+ *	Called with the group lock held.
  *
  *	For high-priority group, only does wakeup/creation if there are no threads
  *	running.
  */
-static __inline__ void
-thread_call_wake(
+static void
+thread_call_wake_locked(
 	thread_call_group_t		group)
 {
 	/* 
@@ -1063,15 +1253,51 @@ thread_call_wake(
 				timer_call_cancel(&group->dealloc_timer);
 				group->flags &= TCG_DEALLOC_ACTIVE;
 			}
-		} else {
-			if (!thread_call_daemon_awake && thread_call_group_should_add_thread(group)) {
-				thread_call_daemon_awake = TRUE;
-				wait_queue_wakeup_one(&daemon_wqueue, NO_EVENT, THREAD_AWAKENED, -1);
-			}
+		} else if (thread_call_group_should_add_thread(group)) {
+			thread_call_daemon_wake();
 		}
 	}
 }
 
+/*
+ *	thread_call_group_recheck:
+ *
+ *	Called by a worker after it has stopped counting as
+ *	active, so that work submitted while it was doing so
+ *	is not left without a thread (see thread_call_wake()).
+ *
+ *	Called with the group lock held.
+ */
+static void
+thread_call_group_recheck(
+	thread_call_group_t		group)
+{
+	OSMemoryBarrier();
+
+	if (group->pending_count > 0)
+		thread_call_wake_locked(group);
+}
+
+/*
+ *	thread_call_daemon_wake:
+ *
+ *	Ask the daemon to rescan the groups.  thread_call_daemon_awake
+ *	is cleared by the daemon before each scan, so a request that
+ *	arrives mid-scan is seen when the scan finishes rather than lost.
+ *
+ *	Called with the group lock held.
+ */
+static void
+thread_call_daemon_wake(void)
+{
+	lck_mtx_lock_spin_always(&thread_call_daemon_lock);
+	if (!thread_call_daemon_awake) {
+		thread_call_daemon_awake = TRUE;
+		wait_queue_wakeup_one(&daemon_wqueue, NO_EVENT, THREAD_AWAKENED, -1);
+	}
+	lck_mtx_unlock_always(&thread_call_daemon_lock);
+}
+
 /*
  *	sched_call_thread:
  *
@@ -1087,14 +1313,13 @@ sched_call_thread(
 
 	group = &thread_call_groups[THREAD_CALL_PRIORITY_HIGH]; /* XXX */
 
-	thread_call_lock_spin();
+	thread_call_lock_spin(group);
 
 	switch (type) {
 
 		case SCHED_CALL_BLOCK:
 			--group->active_count;
-			if (group->pending_count > 0)
-				thread_call_wake(group);
+			thread_call_group_recheck(group);
 			break;
 
 		case SCHED_CALL_UNBLOCK:
@@ -1102,17 +1327,17 @@ sched_call_thread(
 			break;
 	}
 
-	thread_call_unlock();
+	thread_call_unlock(group);
 }
 
 /* 
- * Interrupts disabled, lock held; returns the same way. 
+ * Interrupts disabled, shard lock held; returns the same way. 
  * Only called on thread calls whose storage we own.  Wakes up
  * anyone who might be waiting on this work item and frees it
  * if the client has so requested.
  */
 static void
-thread_call_finish(thread_call_t call)
+thread_call_finish(thread_call_t call, thread_call_shard_t shard)
 {
 	boolean_t dowake = FALSE;
 
@@ -1125,12 +1350,12 @@ thread_call_finish(thread_call_t call)
 
 		/* 
 		 * Dropping lock here because the sched call for the 
-		 * high-pri group can take the big lock from under
+		 * high-pri group can take the group lock from under
 		 * a thread lock.
 		 */
-		thread_call_unlock();
+		thread_call_unlock(shard);
 		thread_wakeup((event_t)call);
-		thread_call_lock_spin();
+		thread_call_lock_spin(shard);
 	}
 
 	if (call->tc_refs == 0) {
@@ -1138,13 +1363,58 @@ thread_call_finish(thread_call_t call)
 			panic("Someone waiting on a thread call that is scheduled for free: %p\n", call->tc_call.func);
 		}
 
-		enable_ints_and_unlock();
+		enable_ints_and_unlock_shard(shard);
 
 		zfree(thread_call_zone, call);
 
-		(void)disable_ints_and_lock();
+		(void)disable_ints_and_lock_shard(shard);
+	}
+
+}
+
+/*
+ *	thread_call_steal:
+ *
+ *	Dequeue the next pending call of the group, looking
+ *	first at the shard of the current processor and then
+ *	at the others in turn.  Shards that look empty are
+ *	skipped without taking their lock.
+ *
+ *	Called with interrupts disabled.  Returns with the
+ *	lock of the call's shard held, or NULL if no call
+ *	was found.
+ */
+static thread_call_t
+thread_call_steal(
+		thread_call_group_t		group,
+		thread_call_shard_t		*shardp)
+{
+	thread_call_shard_t	shard;
+	thread_call_t		call;
+	uint32_t		i, first;
+
+	first = cpu_number();
+
+	for (i = 0; i <= thread_call_shard_mask; i++) {
+		shard = &group->shards[(first + i) & thread_call_shard_mask];
+
+		if (shard->pending_count == 0)
+			continue;
+
+		thread_call_lock_spin(shard);
+
+		if (shard->pending_count > 0) {
+			call = TC(dequeue_head(&shard->pending_queue));
+			thread_call_shard_pending_adjust(shard, -1);
+
+			*shardp = shard;
+			return (call);
+		}
+
+		thread_call_unlock(shard);
 	}
 
+	return (NULL);
 }
 
 /*
@@ -1155,8 +1425,10 @@ thread_call_thread(
 		thread_call_group_t		group,
 		wait_result_t			wres)
 {
-	thread_t	self = current_thread();
-	boolean_t	canwait;
+	thread_t		self = current_thread();
+	thread_call_shard_t	shard;
+	thread_call_t		call;
+	boolean_t		canwait;
 
 	if ((thread_get_tag_internal(self) & THREAD_TAG_CALLOUT) == 0)
 		(void)thread_set_tag_internal(self, THREAD_TAG_CALLOUT);
@@ -1172,18 +1444,16 @@ thread_call_thread(
 		panic("thread_terminate() returned?");
 	}
 
-	(void)disable_ints_and_lock();
+	(void)disable_ints_and_lock(group);
 
 	thread_sched_call(self, group->sched_call);
 
-	while (group->pending_count > 0) {
-		thread_call_t			call;
+	thread_call_unlock(group);
+
+	while ((call = thread_call_steal(group, &shard)) != NULL) {
 		thread_call_func_t		func;
 		thread_call_param_t		param0, param1;
 
-		call = TC(dequeue_head(&group->pending_queue));
-		group->pending_count--;
-
 		func = call->tc_call.func;
 		param0 = call->tc_call.param0;
 		param1 = call->tc_call.param1;
@@ -1202,7 +1472,7 @@ thread_call_thread(
 		} else
 			canwait = FALSE;
 
-		enable_ints_and_unlock();
+		enable_ints_and_unlock_shard(shard);
 
 		KERNEL_DEBUG_CONSTANT(
 				MACHDBG_CODE(DBG_MACH_SCHED,MACH_CALLOUT) | DBG_FUNC_NONE,
@@ -1226,14 +1496,18 @@ thread_call_thread(
 
 		(void)thread_funnel_set(self->funnel_lock, FALSE);		/* XXX */
 
-		(void) disable_ints_and_lock();
+		(void) disable_ints_and_lock_shard(shard);
 		
 		if (canwait) {
 			/* Frees if so desired */
-			thread_call_finish(call);
+			thread_call_finish(call, shard);
 		}
+
+		thread_call_unlock(shard);
 	}
 
+	thread_call_lock_spin(group);
+
 	thread_sched_call(self, NULL);
 	group->active_count--;
 	
@@ -1273,7 +1547,10 @@ thread_call_thread(
 			panic("kcall worker unable to assert wait?");
 		}   
 
-		enable_ints_and_unlock();
+		/* May wake this very thread, in which case the block returns at once */
+		thread_call_group_recheck(group);
+
+		enable_ints_and_unlock(group);
 
 		thread_block_parameter((thread_continue_t)thread_call_thread, group);
 	} else {
@@ -1282,14 +1559,18 @@ thread_call_thread(
 
 			wait_queue_assert_wait(&group->idle_wqueue, NO_EVENT, THREAD_UNINT, 0); /* Interrupted means to exit */
 
-			enable_ints_and_unlock();
+			thread_call_group_recheck(group);
+
+			enable_ints_and_unlock(group);
 
 			thread_block_parameter((thread_continue_t)thread_call_thread, group);
 			/* NOTREACHED */
 		}
 	}
 
-	enable_ints_and_unlock();
+	thread_call_group_recheck(group);
+
+	enable_ints_and_unlock(group);
 
 	thread_terminate(self);
 	/* NOTREACHED */
@@ -1304,18 +1585,25 @@ static void
 thread_call_daemon_continue(__unused void *arg)
 {
 	int		i;
-	kern_return_t	kr;
+	kern_return_t	kr = KERN_SUCCESS;
 	thread_call_group_t group;
 
-	(void)disable_ints_and_lock();
+	(void) splsched();
+
+rescan:
+	lck_mtx_lock_spin_always(&thread_call_daemon_lock);
+	thread_call_daemon_awake = FALSE;
+	lck_mtx_unlock_always(&thread_call_daemon_lock);
 
 	/* Starting at zero happens to be high-priority first. */
 	for (i = 0; i < THREAD_CALL_GROUP_COUNT; i++) {
 		group = &thread_call_groups[i];
+
+		thread_call_lock_spin(group);
 		while (thread_call_group_should_add_thread(group)) {
 			group->active_count++;
 
-			enable_ints_and_unlock();
+			enable_ints_and_unlock(group);
 
 			kr = thread_call_thread_create(group);
 			if (kr != KERN_SUCCESS) {
@@ -1324,19 +1612,27 @@ thread_call_daemon_continue(__unused void *arg)
 				 * We can try again later.
 				 */
 				delay(10000); /* 10 ms */
-				(void)disable_ints_and_lock();
+				(void)disable_ints_and_lock(group);
+				thread_call_unlock(group);
 				goto out;
 			}
 
-			(void)disable_ints_and_lock();
+			(void)disable_ints_and_lock(group);
 		}
+		thread_call_unlock(group);
 	}
 
 out:
+	lck_mtx_lock_spin_always(&thread_call_daemon_lock);
+	if (thread_call_daemon_awake && kr == KERN_SUCCESS) {
+		/* Woken during the scan */
+		lck_mtx_unlock_always(&thread_call_daemon_lock);
+		goto rescan;
+	}
 	thread_call_daemon_awake = FALSE;
 	wait_queue_assert_wait(&daemon_wqueue, NO_EVENT, THREAD_UNINT, 0);
-
-	enable_ints_and_unlock();
+	lck_mtx_unlock_always(&thread_call_daemon_lock);
+	(void) spllo();
 
 	thread_block_parameter((thread_continue_t)thread_call_daemon_continue, NULL);
 	/* NOTREACHED */
@@ -1385,16 +1681,16 @@ thread_call_delayed_timer(
 )
 {
 	thread_call_t			call;
-	thread_call_group_t		group = p0;
+	thread_call_shard_t		shard = p0;
 	uint64_t			timestamp;
 
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
 	timestamp = mach_absolute_time();
 
-	call = TC(queue_first(&group->delayed_queue));
+	call = TC(queue_first(&shard->delayed_queue));
 
-	while (!queue_end(&group->delayed_queue, qe(call))) {
+	while (!queue_end(&shard->delayed_queue, qe(call))) {
 		if (call->tc_soft_deadline <= timestamp) {
 			/* Bit 0 of the "soft" deadline indicates that
 			 * this particular callout is rate-limited
@@ -1407,40 +1703,40 @@ thread_call_delayed_timer(
 			    (ml_timer_forced_evaluation() == FALSE)) {
 				break;
 			}
-			_pending_call_enqueue(call, group);
+			_pending_call_enqueue(call, shard);
 		} /* TODO, identify differentially coalesced timers */
 		else
 			break;
 
-		call = TC(queue_first(&group->delayed_queue));
+		call = TC(queue_first(&shard->delayed_queue));
 	}
 
-	if (!queue_end(&group->delayed_queue, qe(call)))
-		_set_delayed_call_timer(call, group);
+	if (!queue_end(&shard->delayed_queue, qe(call)))
+		_set_delayed_call_timer(call, shard);
 
-	thread_call_unlock();
+	thread_call_unlock(shard);
 }
 
 static void
 thread_call_delayed_timer_rescan(timer_call_param_t		p0, __unused timer_call_param_t	p1)
 {
 	thread_call_t			call;
-	thread_call_group_t		group = p0;
+	thread_call_shard_t		shard = p0;
 	uint64_t				timestamp;
 	boolean_t		istate;
 
 	istate = ml_set_interrupts_enabled(FALSE);
-	thread_call_lock_spin();
+	thread_call_lock_spin(shard);
 
 	assert(ml_timer_forced_evaluation() == TRUE);
 	timestamp = mach_absolute_time();
 
-	call = TC(queue_first(&group->delayed_queue));
+	call = TC(queue_first(&shard->delayed_queue));
 
-	while (!queue_end(&group->delayed_queue, qe(call))) {
+	while (!queue_end(&shard->delayed_queue, qe(call))) {
 		if (call->tc_soft_deadline <= timestamp) {
-			_pending_call_enqueue(call, group);
-			call = TC(queue_first(&group->delayed_queue));
+			_pending_call_enqueue(call, shard);
+			call = TC(queue_first(&shard->delayed_queue));
 		}
 		else {
 			uint64_t skew = call->tc_call.deadline - call->tc_soft_deadline;
@@ -1450,25 +1746,28 @@ thread_call_delayed_timer_rescan(timer_call_param_t		p0, __unused timer_call_par
 			 * layer determines which timers require this.
 			 */
 			if (timer_resort_threshold(skew)) {
-				_call_dequeue(call, group);
-				_delayed_call_enqueue(call, group, call->tc_soft_deadline);
+				_call_dequeue(call, shard);
+				_delayed_call_enqueue(call, shard, call->tc_soft_deadline);
 			}
 			call = TC(queue_next(qe(call)));
 		}
 	}
 
-	if (!queue_empty(&group->delayed_queue))
- 		_set_delayed_call_timer(TC(queue_first(&group->delayed_queue)), group);
-	thread_call_unlock();
+	if (!queue_empty(&shard->delayed_queue))
+ 		_set_delayed_call_timer(TC(queue_first(&shard->delayed_queue)), shard);
+	thread_call_unlock(shard);
 	ml_set_interrupts_enabled(istate);
 }
 
 void
 thread_call_delayed_timer_rescan_all(void) {
-	thread_call_delayed_timer_rescan((timer_call_param_t)&thread_call_groups[THREAD_CALL_PRIORITY_LOW], NULL);
-	thread_call_delayed_timer_rescan((timer_call_param_t)&thread_call_groups[THREAD_CALL_PRIORITY_USER], NULL);
-	thread_call_delayed_timer_rescan((timer_call_param_t)&thread_call_groups[THREAD_CALL_PRIORITY_KERNEL], NULL);
-	thread_call_delayed_timer_rescan((timer_call_param_t)&thread_call_groups[THREAD_CALL_PRIORITY_HIGH], NULL);
+	int		i;
+	uint32_t	j;
+
+	for (i = 0; i < THREAD_CALL_GROUP_COUNT; i++) {
+		for (j = 0; j <= thread_call_shard_mask; j++)
+			thread_call_delayed_timer_rescan((timer_call_param_t)&thread_call_groups[i].shards[j], NULL);
+	}
 }
 
 /*
@@ -1486,7 +1785,7 @@ thread_call_dealloc_timer(
 	kern_return_t res;
 	boolean_t terminated = FALSE;
 	
-	thread_call_lock_spin();
+	thread_call_lock_spin(group);
 
 	now = mach_absolute_time();
 	if (group->idle_count > 0) {
@@ -1519,7 +1818,7 @@ thread_call_dealloc_timer(
 		group->flags &= ~TCG_DEALLOC_ACTIVE;
 	}
 
-	thread_call_unlock();
+	thread_call_unlock(group);
 }
 
 /*
@@ -1529,7 +1828,7 @@ thread_call_dealloc_timer(
  * at the beginning of our wait.
  */
 static void
-thread_call_wait_locked(thread_call_t call)
+thread_call_wait_locked(thread_call_t call, thread_call_shard_t shard)
 {
 	uint64_t submit_count;
 	wait_result_t res;
@@ -1546,7 +1845,7 @@ thread_call_wait_locked(thread_call_t call)
 			panic("Unable to assert wait?");
 		}
 
-		thread_call_unlock();
+		thread_call_unlock(shard);
 		(void) spllo();
 
 		res = thread_block(NULL);
@@ -1555,7 +1854,7 @@ thread_call_wait_locked(thread_call_t call)
 		}
 	
 		(void) splsched();
-		thread_call_lock_spin();
+		thread_call_lock_spin(shard);
 	}
 }
 
@@ -1566,11 +1865,12 @@ thread_call_wait_locked(thread_call_t call)
 boolean_t
 thread_call_isactive(thread_call_t call) 
 {
-	boolean_t active;
+	thread_call_shard_t	shard = thread_call_get_shard(call);
+	boolean_t		active;
 
-	disable_ints_and_lock();
+	disable_ints_and_lock_shard(shard);
 	active = (call->tc_submit_count > call->tc_finish_count);
-	enable_ints_and_unlock();
+	enable_ints_and_unlock_shard(shard);
 
 	return active;
 }
@@ -287,6 +287,7 @@ struct thread_call {
 	thread_call_priority_t		tc_pri;
 	uint32_t			tc_flags;
 	int32_t				tc_refs;
+	uint32_t			tc_cpu;		/* Processor set up on; selects the shard */
 }; 
 
 #define THREAD_CALL_ALLOC		0x01
@@ -183,6 +183,7 @@ timer_call_queue_init(mpqueue_head_t *queue)
 {
 	DBG("timer_call_queue_init(%p)\n", queue);
 	mpqueue_init(queue, &timer_call_lck_grp, &timer_call_lck_attr);
+	call_entry_wheel_init(&queue->wheel);
 }
 
 
@@ -230,9 +231,13 @@ timer_call_setup(
 /*
  * Inlines timer_call_entry_dequeue() and timer_call_entry_enqueue_deadline()
  * cast between pointer types (mpqueue_head_t *) and (queue_t) so that
- * we can use the call_entry_dequeue() and call_entry_enqueue_deadline()
- * methods to operate on timer_call structs as if they are call_entry structs.
+ * we can use the call_entry_dequeue_indexed() and
+ * call_entry_enqueue_deadline_indexed() methods to operate on timer_call
+ * structs as if they are call_entry structs.
  * These structures are identical except for their queue head pointer fields.
+ * The per-queue deadline wheel keeps insertion cheap on queues holding
+ * thousands of timers; entries leaving a queue by any path (including
+ * timer_call_entry_dequeue_async()) must be removed from its wheel.
  *
  * In the debug case, we assert that the timer call locking protocol 
  * is being obeyed.
@@ -256,7 +261,7 @@ timer_call_entry_dequeue(
 		panic("_call_entry_dequeue() "
 			"queue %p is not locked\n", old_queue);
 
-	call_entry_dequeue(CE(entry));
+	call_entry_dequeue_indexed(CE(entry), &old_queue->wheel);
 	old_queue->count--;
 
 	return (old_queue);
@@ -281,7 +286,7 @@ timer_call_entry_enqueue_deadline(
 		panic("_call_entry_enqueue_deadline() "
 			"old_queue %p != queue", old_queue);
 
-	call_entry_enqueue_deadline(CE(entry), QUEUE(queue), deadline);
+	call_entry_enqueue_deadline_indexed(CE(entry), QUEUE(queue), &queue->wheel, deadline);
 
 /* For efficiency, track the earliest soft deadline on the queue, so that
  * fuzzy decisions can be made without lock acquisitions.
@@ -303,7 +308,7 @@ timer_call_entry_dequeue(
 {
 	mpqueue_head_t	*old_queue = MPQUEUE(CE(entry)->queue);
 
-	call_entry_dequeue(CE(entry));
+	call_entry_dequeue_indexed(CE(entry), &old_queue->wheel);
 	old_queue->count--;
 
 	return old_queue;
@@ -317,7 +322,7 @@ timer_call_entry_enqueue_deadline(
 {
 	mpqueue_head_t	*old_queue = MPQUEUE(CE(entry)->queue);
 
-	call_entry_enqueue_deadline(CE(entry), QUEUE(queue), deadline);
+	call_entry_enqueue_deadline_indexed(CE(entry), QUEUE(queue), &queue->wheel, deadline);
 
 	/* For efficiency, track the earliest soft deadline on the queue,
 	 * so that fuzzy decisions can be made without lock acquisitions.
@@ -354,6 +359,7 @@ timer_call_entry_dequeue_async(
 	mpqueue_head_t	*old_queue = MPQUEUE(CE(entry)->queue);
 	if (old_queue) {
 		old_queue->count--;
+		call_entry_wheel_remove(CE(entry), QUEUE(old_queue), &old_queue->wheel);
 		(void) remque(qe(entry));
 		entry->async_dequeue = TRUE;
 	}
@@ -1305,6 +1311,8 @@ timer_longterm_init(void)
 		     "timer_longterm", &timer_longterm_lck_grp_attr);
 	mpqueue_init(&tlp->queue,
 		     &timer_longterm_lck_grp, &timer_longterm_lck_attr);
+	/* unsorted, but timer_call_entry_dequeue() consults the wheel */
+	call_entry_wheel_init(&tlp->queue.wheel);
 
 	timer_call_setup(&tlp->threshold.timer,
 			 timer_longterm_callout, (timer_call_param_t) tlp);
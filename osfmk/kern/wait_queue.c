@@ -125,23 +125,35 @@ volatile WaitQueueLink *unused_except_for_debugging;
  *	The wait event hash table declarations are as follows:
  */
 
-struct wait_queue boot_wait_queue[1];
-__private_extern__ struct wait_queue *wait_queues = &boot_wait_queue[0];
+struct wait_queue_bucket boot_wait_queue[1];
+__private_extern__ struct wait_queue_bucket *wait_queues = &boot_wait_queue[0];
 __private_extern__ uint32_t num_wait_queues = 1;
 
 #define	P2ROUNDUP(x, align) (-(-((uint32_t)(x)) & -(align)))
 #define ROUNDDOWN(x,y)	(((x)/(y))*(y))
 
+/*
+ * Minimum number of hash buckets per processor.  The thread_max based
+ * size keeps chains short; this keeps the number of distinct bucket
+ * locks (and so the chance of two processors colliding on one) growing
+ * with the machine even when thread_max is small.
+ */
+#define WAIT_QUEUES_PER_CPU	256
+
 static uint32_t
 compute_wait_hash_size(void)
 {
-	uint32_t hsize, queues;
+	uint32_t hsize, queues, ncpus;
 	
 	if (PE_parse_boot_argn("wqsize", &hsize, sizeof(hsize)))
 		return (hsize);
 
-	queues = thread_max / 11;
-	hsize = P2ROUNDUP(queues * sizeof(struct wait_queue), PAGE_SIZE);
+	ncpus = (uint32_t) ml_early_cpu_count();
+	if (ncpus == 0)
+		ncpus = 1;
+
+	queues = MAX(thread_max / 11, ncpus * WAIT_QUEUES_PER_CPU);
+	hsize = P2ROUNDUP(queues * sizeof(struct wait_queue_bucket), PAGE_SIZE);
 
 	return hsize;
 }
@@ -159,7 +171,7 @@ wait_queues_init(void)
 	whsize = compute_wait_hash_size();
 
 	/* Determine the number of waitqueues we can fit. */
-	qsz = sizeof (struct wait_queue);
+	qsz = sizeof (struct wait_queue_bucket);
 	whsize = ROUNDDOWN(whsize, qsz);
 	num_wait_queues = whsize / qsz;
 
@@ -185,7 +197,8 @@ wait_queues_init(void)
 		panic("kernel_memory_allocate() failed to allocate wait queues, error: %d, whsize: 0x%x", kret, whsize);
 
 	for (i = 0; i < num_wait_queues; i++) {
-		wait_queue_init(&wait_queues[i], SYNC_POLICY_FIFO);
+		wait_queue_init(&wait_queues[i].wqb_queue, SYNC_POLICY_FIFO);
+		wait_queues[i].wqb_contended = 0;
 	}
 }
 
@@ -483,12 +496,102 @@ static boolean_t
 wait_queue_global(
 	wait_queue_t wq)
 {
-	if ((wq >= wait_queues) && (wq <= (wait_queues + num_wait_queues))) {
+	if (((struct wait_queue_bucket *)wq >= wait_queues) &&
+	    ((struct wait_queue_bucket *)wq < (wait_queues + num_wait_queues))) {
 		return TRUE;
 	}
 	return FALSE;
 }
 
+/*
+ *	Routine:	wait_queue_lock_contended
+ *	Purpose:
+ *		Slow path of wait_queue_lock(): the interlock was busy.
+ *		Charge the miss to the bucket if this is one of the
+ *		global event hash queues, then spin with a timeout.
+ *
+ *		Double the standard lock timeout, because wait queues tend
+ *		to iterate over a number of threads - locking each.  If there
+ *		is a problem with a thread lock, it normally times out at the
+ *		wait queue level first, hiding the real problem.
+ */
+void
+wait_queue_lock_contended(
+	wait_queue_t wq)
+{
+	if (wait_queue_global(wq))
+		(void)hw_atomic_add(&((struct wait_queue_bucket *)wq)->wqb_contended, 1);
+
+	if (__improbable(hw_lock_to(&(wq)->wq_interlock, hwLockTimeOut * 2) == 0)) {
+		boolean_t wql_acquired = FALSE;
+
+		while (machine_timeout_suspended()) {
+#if	defined(__i386__) || defined(__x86_64__)
+/*
+ * i386/x86_64 return with preemption disabled on a timeout for
+ * diagnostic purposes.
+ */
+			mp_enable_preemption();
+#endif
+			if ((wql_acquired = hw_lock_to(&(wq)->wq_interlock, hwLockTimeOut * 2)))
+				break;
+		}
+		if (wql_acquired == FALSE)
+			panic("wait queue deadlock - wq=%p, cpu=%d\n", wq, cpu_number());
+	}
+}
+
+/*
+ *	Routine:	wait_queue_global_stats
+ *	Purpose:
+ *		Report the shape of the global event hash: number of
+ *		buckets, how many are in use, the longest chain, the
+ *		total number of queued waiters and the number of
+ *		contended bucket lock acquisitions since boot.
+ *	Conditions:
+ *		Nothing locked.  Each bucket is locked in turn, so the
+ *		result is not an atomic snapshot.
+ */
+void
+wait_queue_global_stats(
+	uint32_t *buckets,
+	uint32_t *used,
+	uint32_t *max_chain,
+	uint64_t *waiters,
+	uint64_t *contended)
+{
+	uint32_t i, chain;
+	wait_queue_element_t wq_element;
+	spl_t s;
+
+	*buckets = num_wait_queues;
+	*used = *max_chain = 0;
+	*waiters = *contended = 0;
+
+	for (i = 0; i < num_wait_queues; i++) {
+		wait_queue_t wq = &wait_queues[i].wqb_queue;
+
+		*contended += wait_queues[i].wqb_contended;
+		if (wait_queue_empty(wq))
+			continue;
+
+		chain = 0;
+		s = splsched();
+		wait_queue_lock(wq);
+		queue_iterate(&wq->wq_queue, wq_element, wait_queue_element_t, wqe_links)
+			chain++;
+		wait_queue_unlock(wq);
+		splx(s);
+
+		if (chain == 0)
+			continue;
+		(*used)++;
+		*waiters += chain;
+		if (chain > *max_chain)
+			*max_chain = chain;
+	}
+}
+
 
 /*
  *	Routine:	wait_queue_member_locked
@@ -1886,6 +1989,37 @@ wait_queue_wakeup64_identity_locked(
 	return thread;  /* still locked if not NULL */
 }
 
+/*
+ *	Routine:	wait_queue_select64_identity_locked
+ *	Purpose:
+ *		Select a single thread that is most-eligible to run and pull
+ *		it off the wait queue, but leave it to the caller to look it
+ *		over and set it running with thread_go() (or thread_go_handoff()).
+ *
+ * 	Conditions:
+ *		at splsched
+ *		wait queue locked
+ *		possibly recursive
+ * 	Returns:
+ *		a pointer to the locked thread that was selected
+ */
+__private_extern__ thread_t
+wait_queue_select64_identity_locked(
+	wait_queue_t wq,
+	event64_t event,
+	boolean_t unlock)
+{
+	thread_t thread;
+
+	assert(wait_queue_held(wq));
+
+	thread = _wait_queue_select64_one(wq, event);
+	if (unlock)
+		wait_queue_unlock(wq);
+
+	return thread;  /* still locked if not NULL */
+}
+
 
 /*
  *	Routine:	wait_queue_wakeup64_one_locked
@@ -172,31 +172,16 @@ typedef struct _wait_queue_link {
 #else
 #define	hwLockTimeOut LockTimeOut
 #endif
+
 /*
- * Double the standard lock timeout, because wait queues tend
- * to iterate over a number of threads - locking each.  If there is
- * a problem with a thread lock, it normally times out at the wait
- * queue level first, hiding the real problem.
+ * The uncontended case is a single try; everything else (contention
+ * accounting for the global event hash, timeouts) is out of line.
  */
+__private_extern__ void wait_queue_lock_contended(wait_queue_t wq);
 
 static inline void wait_queue_lock(wait_queue_t wq) {
-	if (__improbable(hw_lock_to(&(wq)->wq_interlock, hwLockTimeOut * 2) == 0)) {
-		boolean_t wql_acquired = FALSE;
-
-		while (machine_timeout_suspended()) {
-#if	defined(__i386__) || defined(__x86_64__)
-/*
- * i386/x86_64 return with preemption disabled on a timeout for
- * diagnostic purposes.
- */
-			mp_enable_preemption();
-#endif
-			if ((wql_acquired = hw_lock_to(&(wq)->wq_interlock, hwLockTimeOut * 2)))
-				break;
-		}
-		if (wql_acquired == FALSE)
-			panic("wait queue deadlock - wq=%p, cpu=%d\n", wq, cpu_number());
-	}
+	if (__improbable(!hw_lock_try(&(wq)->wq_interlock)))
+		wait_queue_lock_contended(wq);
 	assert(wait_queue_held(wq));
 }
 
@@ -258,6 +243,12 @@ __private_extern__ thread_t wait_queue_wakeup64_identity_locked(
 			wait_result_t result,
 			boolean_t unlock);
 
+/* return identity of a thread pulled off a <wait_queue,event>, not yet awakened */
+__private_extern__ thread_t wait_queue_select64_identity_locked(
+			wait_queue_t wait_queue,
+			event64_t wake_event,
+			boolean_t unlock);
+
 /* wakeup thread iff its still waiting for a particular event on locked queue */
 __private_extern__ kern_return_t wait_queue_wakeup64_thread_locked(
 			wait_queue_t wait_queue,
@@ -266,8 +257,21 @@ __private_extern__ kern_return_t wait_queue_wakeup64_thread_locked(
 			wait_result_t result,
 			boolean_t unlock);
 
+/*
+ *	Global event hash bucket.  Each bucket is padded out to its own
+ *	cache line so that unrelated events hashing to adjacent buckets
+ *	do not bounce the same line between processors.  The contention
+ *	count is only updated on the slow path of wait_queue_lock().
+ */
+#define WAIT_QUEUE_BUCKET_ALIGN	64
+
+struct wait_queue_bucket {
+	struct wait_queue	wqb_queue;		/* must be first */
+	uint32_t		wqb_contended;		/* contended lock attempts */
+} __attribute__((aligned(WAIT_QUEUE_BUCKET_ALIGN)));
+
 extern uint32_t num_wait_queues;
-extern struct wait_queue *wait_queues;
+extern struct wait_queue_bucket *wait_queues;
 /* The Jenkins "one at a time" hash.
  * TBD: There may be some value to unrolling here,
  * depending on the architecture.
@@ -292,6 +296,7 @@ static inline uint32_t wq_hash(char *key)
 }
 
 #define	wait_hash(event) wq_hash((char *)&event) 
+#define	wait_hash_queue(event) (&wait_queues[wait_hash(event)].wqb_queue)
 
 #endif	/* MACH_KERNEL_PRIVATE */
 
@@ -365,6 +370,14 @@ extern kern_return_t wait_queue_set_unlink_all_nofree(
 
 extern wait_queue_link_t wait_queue_link_allocate(void);
 
+/* global event hash statistics, for sysctl */
+extern void wait_queue_global_stats(
+			uint32_t *buckets,
+			uint32_t *used,
+			uint32_t *max_chain,
+			uint64_t *waiters,
+			uint64_t *contended);
+
 #endif /* XNU_KERNEL_PRIVATE */
 
 /* legacy API */
@@ -321,11 +321,17 @@ struct task_vm_info {
 	mach_vm_size_t	compressed;
 	mach_vm_size_t	compressed_peak;
 	mach_vm_size_t	compressed_lifetime;
+
+	/* added for rev1 */
+	integer_t	superpage_promotions; /* transparent 2MB promotions */
+	integer_t	superpage_demotions;  /* ... and demotions */
 };
 typedef struct task_vm_info	task_vm_info_data_t;
 typedef struct task_vm_info	*task_vm_info_t;
 #define TASK_VM_INFO_COUNT	((mach_msg_type_number_t) \
 		(sizeof (task_vm_info_data_t) / sizeof (natural_t)))
+#define TASK_VM_INFO_REV0_COUNT /* doesn't include superpage counts */ \
+		((mach_msg_type_number_t) (TASK_VM_INFO_COUNT - 2))
 
 
 typedef struct vm_purgeable_info	task_purgable_info_t;
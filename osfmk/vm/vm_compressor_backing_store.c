@@ -113,6 +113,8 @@ extern boolean_t		swap_crypt_ctx_initialized;
 extern void 			swap_crypt_ctx_initialize(void);
 extern const unsigned char	swap_crypt_null_iv[AES_BLOCK_SIZE];
 extern aes_ctx			swap_crypt_ctx;
+extern boolean_t		swap_crypt_xts;
+extern symmetric_xts		swap_crypt_xts_ctx;
 extern unsigned long 		vm_page_encrypt_counter;
 extern unsigned long 		vm_page_decrypt_counter;
 #endif /* CRYPTO */
@@ -350,6 +352,21 @@ done:
 }
 
 #if CRYPTO
+/*
+ * Build the XTS tweak for page "pageno" of a segment.  The segment's
+ * identity is the per-segment part of the IV and the page index makes
+ * every page of the segment a distinct XTS data unit, so each page can
+ * be encrypted or decrypted independently of its neighbours.
+ */
+static void
+vm_swap_crypt_xts_tweak(c_segment_t c_seg, uint64_t pageno, unsigned char tweak[AES_BLOCK_SIZE])
+{
+	uint64_t	seg_id = (uint64_t)(uintptr_t)c_seg;
+
+	memcpy(&tweak[0], &seg_id, sizeof (seg_id));
+	memcpy(&tweak[8], &pageno, sizeof (pageno));
+}
+
 void
 vm_swap_encrypt(c_segment_t c_seg)
 {
@@ -363,6 +380,28 @@ vm_swap_encrypt(c_segment_t c_seg)
 	
 	assert(swap_crypt_ctx_initialized);
 	
+	kernel_vaddr = (vm_offset_t) c_seg->c_store.c_buffer;
+	size = round_page_32(C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset));
+
+	if (swap_crypt_xts) {
+		uint64_t	pageno;
+
+		/*
+		 * Encrypt the c_segment one page (XTS data unit) at a time.
+		 */
+		for (pageno = 0; pageno < (size / PAGE_SIZE_64); pageno++) {
+			vm_swap_crypt_xts_tweak(c_seg, pageno, &encrypt_iv.aes_iv[0]);
+
+			xts_encrypt((const uint8_t *) (kernel_vaddr + (vm_offset_t)(pageno * PAGE_SIZE_64)),
+				    PAGE_SIZE,
+				    (uint8_t *) (kernel_vaddr + (vm_offset_t)(pageno * PAGE_SIZE_64)),
+				    &encrypt_iv.aes_iv[0],
+				    &swap_crypt_xts_ctx);
+		}
+		vm_page_encrypt_counter += (size/PAGE_SIZE_64);
+		return;
+	}
+
 	bzero(&encrypt_iv.aes_iv[0], sizeof (encrypt_iv.aes_iv));
 
 	encrypt_iv.c_seg = (void*)c_seg;
@@ -374,9 +413,6 @@ vm_swap_encrypt(c_segment_t c_seg)
 			&encrypt_iv.aes_iv[0],
 			&swap_crypt_ctx.encrypt);
 
-	kernel_vaddr = (vm_offset_t) c_seg->c_store.c_buffer;
-	size = round_page_32(C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset));
-
 	/*
 	 * Encrypt the c_segment.
 	 */
@@ -404,6 +440,29 @@ vm_swap_decrypt(c_segment_t c_seg)
 	
 	assert(swap_crypt_ctx_initialized);
 
+	kernel_vaddr = (vm_offset_t) c_seg->c_store.c_buffer;
+	size = round_page_32(C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset));
+
+	if (swap_crypt_xts) {
+		uint64_t	pageno;
+
+		/*
+		 * Decrypt the c_segment with the same per-page tweaks
+		 * that vm_swap_encrypt() used.
+		 */
+		for (pageno = 0; pageno < (size / PAGE_SIZE_64); pageno++) {
+			vm_swap_crypt_xts_tweak(c_seg, pageno, &decrypt_iv.aes_iv[0]);
+
+			xts_decrypt((const uint8_t *) (kernel_vaddr + (vm_offset_t)(pageno * PAGE_SIZE_64)),
+				    PAGE_SIZE,
+				    (uint8_t *) (kernel_vaddr + (vm_offset_t)(pageno * PAGE_SIZE_64)),
+				    &decrypt_iv.aes_iv[0],
+				    &swap_crypt_xts_ctx);
+		}
+		vm_page_decrypt_counter += (size/PAGE_SIZE_64);
+		return;
+	}
+
 	/*
 	 * Prepare an "initial vector" for the decryption.
 	 * It has to be the same as the "initial vector" we
@@ -420,9 +479,6 @@ vm_swap_decrypt(c_segment_t c_seg)
 			&decrypt_iv.aes_iv[0],
 			&swap_crypt_ctx.encrypt);
 	
-	kernel_vaddr = (vm_offset_t) c_seg->c_store.c_buffer;
-	size = round_page_32(C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset));
-
 	/*
 	 * Decrypt the c_segment.
 	 */
@@ -36,6 +36,7 @@
 #include <vm/vm_protos.h>
 #include <vm/vm_compressor.h>
 #include <libkern/crypto/aes.h>
+#include <libkern/crypto/aesxts.h>
 #include <kern/host_statistics.h>
 
 
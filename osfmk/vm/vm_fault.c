@@ -2716,7 +2716,11 @@ MACRO_END
 			if (vm_page_local_q &&
 			    !no_cache &&
 			    (*type_of_fault == DBG_COW_FAULT ||
-			     *type_of_fault == DBG_ZERO_FILL_FAULT) ) {
+			     *type_of_fault == DBG_ZERO_FILL_FAULT ||
+			     ((*type_of_fault == DBG_COMPRESSOR_FAULT ||
+			       *type_of_fault == DBG_COMPRESSOR_SWAPIN_FAULT) &&
+			      !m->speculative && !m->clean_queue &&
+			      !m->local && !m->pageout_queue)) ) {
 				struct vpl	*lq;
 				uint32_t	lid;
 
@@ -2725,7 +2729,12 @@ MACRO_END
 
 				/*
 				 * we got a local queue to stuff this
-				 * new page on...
+				 * new page on... freshly decompressed
+				 * pages qualify as well: they were just
+				 * inserted under the exclusive object lock
+				 * and haven't been put on any queue yet,
+				 * so their activation can be deferred and
+				 * batched like the zero-fill/COW pages...
 				 * its safe to manipulate local and
 				 * local_id at this point since we're
 				 * behind an exclusive object lock and
@@ -2991,6 +3000,119 @@ after_the_pmap_enter:
 }
 
 
+/*
+ * Fault-around: once a soft fault has been resolved, map up to
+ * vm_fault_around_pages of the already resident neighbors of the
+ * faulting page read-only, so that walking through a cached file
+ * mapping doesn't cost a trap per page.  The window follows the
+ * madvise() behavior of the map entry: none for RANDOM, ahead of the
+ * fault for SEQUENTIAL, behind it for RSEQNTL and an aligned window
+ * around it otherwise.
+ *
+ * Only pages that can be entered without any further work are
+ * considered: no busy, absent or otherwise unusual pages, nothing
+ * that needs code-signing validation or sliding, and nothing
+ * already mapped at that address.  We stop at the first mapping
+ * that would require the pmap to allocate.
+ *
+ * m->object must be locked (shared is fine) and must be the top
+ * object of the map entry; the map must be locked.
+ */
+int		vm_fault_around_pages = 16;
+unsigned int	vm_fault_around_mapped = 0;
+
+static void
+vm_fault_around(
+	vm_page_t			fault_page,
+	pmap_t				pmap,
+	vm_map_offset_t			vaddr,
+	vm_prot_t			prot,
+	vm_object_fault_info_t		fault_info)
+{
+	vm_object_t		object = fault_page->object;
+	vm_object_offset_t	fault_offset = fault_page->offset;
+	vm_object_offset_t	window, start, end, offset;
+	vm_map_offset_t		va;
+	vm_page_t		m;
+	boolean_t		need_retry;
+	int			type_of_fault;
+	unsigned int		mapped = 0;
+	kern_return_t		kr;
+
+	if (vm_fault_around_pages <= 1 ||
+	    pmap == kernel_pmap ||
+	    object == kernel_object)
+		return;
+
+	window = (vm_object_offset_t)vm_fault_around_pages * PAGE_SIZE_64;
+
+	switch (fault_info->behavior) {
+	case VM_BEHAVIOR_RANDOM:
+		return;
+	case VM_BEHAVIOR_SEQUENTIAL:
+		start = fault_offset;
+		end = fault_offset + window;
+		break;
+	case VM_BEHAVIOR_RSEQNTL:
+		start = (fault_offset >= window - PAGE_SIZE_64) ? fault_offset - (window - PAGE_SIZE_64) : 0;
+		end = fault_offset + PAGE_SIZE_64;
+		break;
+	case VM_BEHAVIOR_DEFAULT:
+	default:
+		start = fault_offset - (fault_offset % window);
+		end = start + window;
+		break;
+	}
+	/*
+	 * stay within the map entry
+	 */
+	if (start < fault_info->lo_offset)
+		start = fault_info->lo_offset;
+	if (end > fault_info->hi_offset)
+		end = fault_info->hi_offset;
+
+	prot &= ~VM_PROT_WRITE;
+	vaddr = vm_map_trunc_page(vaddr, PAGE_MASK);
+
+	for (offset = start; offset < end; offset += PAGE_SIZE_64) {
+
+		if (offset == fault_offset)
+			continue;
+
+		m = vm_page_lookup(object, offset);
+
+		if (m == VM_PAGE_NULL ||
+		    m->busy || m->absent || m->error || m->restart ||
+		    m->unusual || m->cleaning || m->laundry || m->pageout ||
+		    m->overwriting || m->encrypted || m->fictitious ||
+		    vm_page_is_slideable(m) ||
+		    VM_FAULT_NEED_CS_VALIDATION(pmap, m))
+			continue;
+
+		va = vaddr + (vm_map_offset_t)(offset - fault_offset);
+
+		if (pmap_find_phys(pmap, va) != 0)
+			continue;
+
+		need_retry = FALSE;
+		type_of_fault = DBG_CACHE_HIT_FAULT;
+
+		kr = vm_fault_enter(m, pmap, va, prot, VM_PROT_READ,
+				    FALSE, FALSE,
+				    fault_info->no_cache,
+				    fault_info->cs_bypass,
+				    &need_retry,
+				    &type_of_fault);
+
+		if (kr != KERN_SUCCESS || need_retry == TRUE)
+			break;
+		mapped++;
+	}
+	if (mapped)
+		vm_fault_around_mapped += mapped;
+}
+
+
 /*
  *	Routine:	vm_fault
  *	Purpose:
@@ -3588,6 +3710,19 @@ FastPmapEnter:
 							    &type_of_fault);
 				}
 
+				if (kr == KERN_SUCCESS &&
+				    need_retry == FALSE &&
+				    top_object == VM_OBJECT_NULL &&
+				    caller_pmap == PMAP_NULL &&
+				    !wired && !change_wiring) {
+					/*
+					 * the page came from the top object,
+					 * so its resident neighbors can be
+					 * mapped as well
+					 */
+					vm_fault_around(m, pmap, vaddr, prot, &fault_info);
+				}
+
 				if (top_object != VM_OBJECT_NULL) {
 					/*
 					 * It's safe to drop the top object
@@ -4489,6 +4624,21 @@ handle_copy_delay:
 done:
 	thread_interrupt_level(interruptible_state);
 
+#if MACHINE_PMAP_PROMOTE_SUPERPAGE
+	/*
+	 * A zero-fill fault on the last page of a 2MB block is a good
+	 * sign the block has just been fully populated: let the
+	 * superpage collapse thread have a look at it.
+	 */
+	if (vm_transparent_superpages &&
+	    kr == KERN_SUCCESS &&
+	    type_of_fault == DBG_ZERO_FILL_FAULT &&
+	    caller_pmap == PMAP_NULL &&
+	    original_map != kernel_map &&
+	    (vm_map_trunc_page(vaddr, PAGE_MASK) & ~SUPERPAGE_MASK) == SUPERPAGE_SIZE - PAGE_SIZE)
+		vm_superpage_fault_hint(original_map, vaddr);
+#endif /* MACHINE_PMAP_PROMOTE_SUPERPAGE */
+
 	/*
 	 * Only throttle on faults which cause a pagein.
 	 */
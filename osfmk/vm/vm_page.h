@@ -418,6 +418,8 @@ vm_offset_t	last_phys_addr;		/* physical address for last_page */
 extern
 unsigned int	vm_page_free_count;	/* How many pages are free? (sum of all colors) */
 extern
+unsigned int	vm_page_cpu_free_count;	/* How many more are on per-cpu free lists? */
+extern
 unsigned int	vm_page_fictitious_count;/* How many fictitious pages are free? */
 extern
 unsigned int	vm_page_active_count;	/* How many pages are active? */
@@ -541,6 +543,8 @@ extern vm_page_t	vm_page_grablo(void);
 extern void		vm_page_release(
 					vm_page_t	page);
 
+extern void		vm_page_cpu_cache_drain(void);
+
 extern boolean_t	vm_page_wait(
 					int		interruptible );
 
@@ -594,6 +598,8 @@ extern void		vm_page_reactivate_all_throttled(void);
 
 extern void		vm_page_reactivate_local(uint32_t lid, boolean_t force, boolean_t nolocks);
 
+extern uint32_t		vm_page_reactivate_all_local(void);
+
 extern void		vm_page_rename(
 					vm_page_t		page,
 					vm_object_t		new_object,
@@ -672,6 +678,7 @@ extern void memorystatus_pages_update(unsigned int pages_avail);
 	memorystatus_pages_update(		\
       		vm_page_external_count + \
 		vm_page_free_count +		\
+		vm_page_cpu_free_count +	\
       		(VM_DYNAMIC_PAGING_ENABLED(memory_manager_default) ? 0 : vm_page_purgeable_count) \
 		); \
 	} while(0)
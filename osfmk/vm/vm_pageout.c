@@ -86,6 +86,7 @@
 #include <kern/host_statistics.h>
 #include <kern/machine.h>
 #include <kern/misc_protos.h>
+#include <kern/processor.h>
 #include <kern/sched.h>
 #include <kern/thread.h>
 #include <kern/xpr.h>
@@ -111,6 +112,11 @@
  * ENCRYPTED SWAP:
  */
 #include <libkern/crypto/aes.h>
+#include <libkern/crypto/aesxts.h>
+#include <pexpert/pexpert.h>
+#if defined(__x86_64__)
+#include <i386/cpuid.h>		/* for CPUID_FEATURE_AES */
+#endif
 extern u_int32_t random(void);	/* from <libkern/libkern.h> */
 
 extern int cs_debug;
@@ -285,11 +291,16 @@ struct cq {
 void vm_pressure_thread(void);
 #endif
 static void vm_pageout_garbage_collect(int);
+static void vm_pageout_drain_cpu_caches(void);
 static void vm_pageout_iothread_continue(struct vm_pageout_queue *);
 static void vm_pageout_iothread_external(void);
 static void vm_pageout_iothread_internal(struct cq *cq);
 static void vm_pageout_adjust_io_throttles(struct vm_pageout_queue *, struct vm_pageout_queue *, boolean_t);
 
+/* why vm_pageout_garbage_collect() was woken */
+static volatile boolean_t vm_pageout_gc_wanted = FALSE;
+static volatile boolean_t vm_pageout_cpu_drain_wanted = FALSE;
+
 extern void vm_pageout_continue(void);
 extern void vm_pageout_scan(void);
 
@@ -1355,6 +1366,16 @@ Restart:
 			object = NULL;
 			vm_pageout_scan_wants_object = VM_OBJECT_NULL;
 		}
+		/*
+		 * pages recently faulted in sit on the per-cpu
+		 * local queues until the faulting cpu gets around
+		 * to pushing them... we already hold the page queues
+		 * lock, so pull them all onto the active queue in
+		 * one shot rather than let the fault paths each
+		 * take the lock to do it
+		 */
+		vm_page_reactivate_all_local();
+
 		/*
 		 * Don't sweep through active queue more than the throttle
 		 * which should be kept relatively low
@@ -1498,7 +1519,7 @@ Restart:
 
 done_moving_active_pages:
 
-		if (vm_page_free_count + local_freed >= vm_page_free_target) {
+		if (vm_page_free_count + vm_page_cpu_free_count + local_freed >= vm_page_free_target) {
 			if (object != NULL) {
 			        vm_object_unlock(object);
 				object = NULL;
@@ -1546,7 +1567,7 @@ done_moving_active_pages:
 			}
 		        lck_mtx_lock(&vm_page_queue_free_lock);
 
-			if ((vm_page_free_count >= vm_page_free_target) &&
+			if ((vm_page_free_count + vm_page_cpu_free_count >= vm_page_free_target) &&
 			    (vm_page_free_wanted == 0) && (vm_page_free_wanted_privileged == 0)) {
 				/*
 				 * done - we have met our target *and*
@@ -1793,6 +1814,7 @@ reset_deadlock_timer:
 				        vm_pageout_deadlock_target = vm_pageout_deadlock_relief + vm_page_free_wanted + vm_page_free_wanted_privileged;
 					vm_pageout_scan_deadlock_detected++;
 					flow_control.state = FCS_DEADLOCK_DETECTED;
+					vm_pageout_gc_wanted = TRUE;
 					thread_wakeup((event_t) &vm_pageout_garbage_collect);
 					goto consider_inactive;
 				}
@@ -1840,7 +1862,7 @@ vm_pageout_scan_delay:
 				}
 			}
 			
-			if (vm_page_free_count >= vm_page_free_target) {
+			if (vm_page_free_count + vm_page_cpu_free_count >= vm_page_free_target) {
 				/*
 				 * we're here because
 				 *  1) someone else freed up some pages while we had
@@ -1870,7 +1892,7 @@ vm_pageout_scan_delay:
 			}
 			lck_mtx_lock(&vm_page_queue_free_lock);
 
-			if (vm_page_free_count >= vm_page_free_target &&
+			if (vm_page_free_count + vm_page_cpu_free_count >= vm_page_free_target &&
 			    (vm_page_free_wanted == 0) && (vm_page_free_wanted_privileged == 0)) {
 				goto return_from_scan;
 			}
@@ -2790,6 +2812,12 @@ vm_pageout_continue(void)
 	DTRACE_VM2(pgrrun, int, 1, (uint64_t *), NULL);
 	vm_pageout_scan_event_counter++;
 
+	/*
+	 * free pages cached per-cpu should be found before anything is
+	 * paged out, and cached kmsg buffers given back
+	 */
+	vm_pageout_cpu_drain_request();
+
 	vm_pageout_scan();
 	/*
 	 * we hold both the vm_page_queue_free_lock
@@ -3685,19 +3713,79 @@ compute_pageout_gc_throttle()
 
 		vm_pageout_considered_page_last = vm_pageout_considered_page;
 
+		vm_pageout_gc_wanted = TRUE;
 		thread_wakeup((event_t) &vm_pageout_garbage_collect);
 	}
 }
 
 
+extern void ipc_kmsg_cache_drain(void);
+
+/*
+ * The per-cpu free page lists and kmsg caches may only be touched
+ * by their own processor, so draining them means visiting each one
+ * in turn.  Offline processors are skipped; their caches are drained
+ * once they are running again.
+ */
+static void
+vm_pageout_drain_cpu_caches(void)
+{
+	processor_t	processor, prev;
+
+	simple_lock(&processor_list_lock);
+	processor = processor_list;
+	simple_unlock(&processor_list_lock);
+
+	prev = thread_bind(PROCESSOR_NULL);
+
+	for (; processor != PROCESSOR_NULL; processor = processor->processor_list) {
+		if (processor->state == PROCESSOR_OFF_LINE ||
+		    processor->state == PROCESSOR_SHUTDOWN)
+			continue;
+
+		thread_bind(processor);
+		thread_block(THREAD_CONTINUE_NULL);
+
+		if (current_processor() == processor) {
+			vm_page_cpu_cache_drain();
+			ipc_kmsg_cache_drain();
+		}
+	}
+	thread_bind(prev);
+}
+
+/*
+ * Ask for the per-cpu free page lists to be drained back to the
+ * global free queues.  Called when the free count runs low.
+ */
+void
+vm_pageout_cpu_drain_request(void)
+{
+	if (vm_pageout_cpu_drain_wanted == FALSE) {
+		vm_pageout_cpu_drain_wanted = TRUE;
+		thread_wakeup((event_t) &vm_pageout_garbage_collect);
+	}
+}
+
 static void
 vm_pageout_garbage_collect(int collect)
 {
+	/*
+	 * collection is also the time to give back what the per-cpu
+	 * caches hold: free pages, and kmsg buffers' zone and kalloc
+	 * memory
+	 */
+	if (collect && (vm_pageout_cpu_drain_wanted || vm_pageout_gc_wanted)) {
+		vm_pageout_cpu_drain_wanted = FALSE;
+		vm_pageout_drain_cpu_caches();
+	}
 
-	if (collect) {
+	if (collect && vm_pageout_gc_wanted) {
 		boolean_t buf_large_zfree = FALSE;
 		boolean_t first_try = TRUE;
 
+		vm_pageout_gc_wanted = FALSE;
+
 		stack_collect();
 
 		consider_machine_collect();
@@ -3863,6 +3951,8 @@ vm_pageout(void)
 #endif
 
 	vm_object_reaper_init();
+
+	vm_superpage_init();
 	
 	if (COMPRESSED_PAGER_IS_ACTIVE || DEFAULT_FREEZER_COMPRESSED_PAGER_IS_ACTIVE)
 		vm_compressor_pager_init();
@@ -7725,6 +7815,18 @@ uint32_t 		swap_crypt_key[8]; /* big enough for a 256 key */
 aes_ctx			swap_crypt_ctx;
 const unsigned char	swap_crypt_null_iv[AES_BLOCK_SIZE] = {0xa, };
 
+/*
+ * The compressor's swap segments are encrypted with AES-XTS rather
+ * than CBC: each page of a segment is its own XTS data unit, so pages
+ * can be processed independently and the registered corecrypto XTS
+ * mode is free to use its AES-NI implementation.  "swap_crypt_xts=0"
+ * on the boot command line reverts to the legacy CBC path.
+ */
+#define SWAP_CRYPT_XTS_KEY_SIZE	16	/* bytes, for each of the 2 XTS keys */
+boolean_t		swap_crypt_xts = TRUE;
+boolean_t		swap_crypt_hw_aes = FALSE;
+symmetric_xts		swap_crypt_xts_ctx;
+
 #if DEBUG
 boolean_t		swap_crypt_ctx_tested = FALSE;
 unsigned char swap_crypt_test_page_ref[4096] __attribute__((aligned(4096)));
@@ -7760,6 +7862,26 @@ swap_crypt_ctx_initialize(void)
 		aes_decrypt_key((const unsigned char *) swap_crypt_key,
 				SWAP_CRYPT_AES_KEY_SIZE,
 				&swap_crypt_ctx.decrypt);
+
+		PE_parse_boot_argn("swap_crypt_xts", &swap_crypt_xts, sizeof (swap_crypt_xts));
+#if defined(__x86_64__)
+		if (cpuid_features() & CPUID_FEATURE_AES)
+			swap_crypt_hw_aes = TRUE;
+#endif
+		if (swap_crypt_xts) {
+			/*
+			 * swap_crypt_key holds 256 bits: the first half is
+			 * the data key, the second half the tweak key.
+			 */
+			xts_start(0, NULL,
+				  (const uint8_t *) &swap_crypt_key[0], SWAP_CRYPT_XTS_KEY_SIZE,
+				  (const uint8_t *) &swap_crypt_key[4], SWAP_CRYPT_XTS_KEY_SIZE,
+				  0, 0, &swap_crypt_xts_ctx);
+		}
+		printf("VM swap encryption: %s%s\n",
+		       swap_crypt_xts ? "AES-XTS" : "AES-CBC",
+		       swap_crypt_hw_aes ? " (AES-NI)" : "");
+
 		swap_crypt_ctx_initialized = TRUE;
 	}
 
@@ -7811,6 +7933,26 @@ swap_crypt_ctx_initialize(void)
 			}
 		}
 
+		if (swap_crypt_xts) {
+			unsigned char	tweak[AES_BLOCK_SIZE];
+
+			for (i = 0; i < AES_BLOCK_SIZE; i++)
+				tweak[i] = (unsigned char) (i * 7);
+
+			xts_encrypt(swap_crypt_test_page_ref, PAGE_SIZE,
+				    swap_crypt_test_page_encrypt, tweak,
+				    &swap_crypt_xts_ctx);
+			xts_decrypt(swap_crypt_test_page_encrypt, PAGE_SIZE,
+				    swap_crypt_test_page_decrypt, tweak,
+				    &swap_crypt_xts_ctx);
+			for (i = 0; i < 4096; i ++) {
+				if (swap_crypt_test_page_decrypt[i] !=
+				    swap_crypt_test_page_ref[i]) {
+					panic("xts encryption test failed");
+				}
+			}
+		}
+
 		swap_crypt_ctx_tested = TRUE;
 	}
 #endif /* DEBUG */
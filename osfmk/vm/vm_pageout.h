@@ -222,6 +222,8 @@ extern struct	vm_pageout_queue	vm_pageout_queue_external;
  */
 extern void		vm_pageout(void);
 
+extern void		vm_pageout_cpu_drain_request(void);
+
 extern kern_return_t	vm_pageout_internal_start(void);
 
 extern void		vm_pageout_object_terminate(
@@ -491,6 +491,12 @@ int vm_toggle_entry_reuse(int, int*);
 #define	SWAP_ASYNC		0x00000002	/* Start I/O, do not wait. */
 
 extern void vm_compressor_pager_init(void);
+
+extern int vm_transparent_superpages;
+extern void vm_superpage_init(void);
+extern void vm_superpage_fault_hint(
+	vm_map_t,
+	vm_map_offset_t);
 extern kern_return_t compressor_memory_object_create(
 	vm_size_t,
 	memory_object_t *);
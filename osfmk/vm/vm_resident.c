@@ -1889,7 +1889,9 @@ vm_page_grab( void )
 return_page_from_cpu_list:
 	        PROCESSOR_DATA(current_processor(), page_grab_count) += 1;
 	        PROCESSOR_DATA(current_processor(), free_pages) = mem->pageq.next;
+	        PROCESSOR_DATA(current_processor(), free_pages_count) -= 1;
 		mem->pageq.next = NULL;
+		OSAddAtomic(-1, &vm_page_cpu_free_count);
 
 	        enable_preemption();
 
@@ -1983,6 +1985,10 @@ return_page_from_cpu_list:
 		color = PROCESSOR_DATA(current_processor(), start_color);
 		head = tail = NULL;
 
+		/* one of them satisfies this request */
+		PROCESSOR_DATA(current_processor(), free_pages_count) = pages_to_steal - 1;
+		OSAddAtomic(pages_to_steal - 1, &vm_page_cpu_free_count);
+
 		while (pages_to_steal--) {
 		        if (--vm_page_free_count < vm_page_free_count_minimum)
 			        vm_page_free_count_minimum = vm_page_free_count;
@@ -2049,9 +2055,16 @@ return_page_from_cpu_list:
 	 *
 	 *	We don't have the counts locked ... if they change a little,
 	 *	it doesn't really matter.
+	 *
+	 *	Pages sitting on the per-cpu free lists are free too, but
+	 *	only to their own processor: once the global queues run
+	 *	low, have them drained back.
 	 */
-	if ((vm_page_free_count < vm_page_free_min) ||
-	     ((vm_page_free_count < vm_page_free_target) &&
+	if (vm_page_free_count < vm_page_free_min && vm_page_cpu_free_count != 0)
+		vm_pageout_cpu_drain_request();
+
+	if ((vm_page_free_count + vm_page_cpu_free_count < vm_page_free_min) ||
+	     ((vm_page_free_count + vm_page_cpu_free_count < vm_page_free_target) &&
 	      ((vm_page_inactive_count + vm_page_speculative_count) < vm_page_inactive_min)))
 	         thread_wakeup((event_t) &vm_page_free_wanted);
 
@@ -2062,6 +2075,132 @@ return_page_from_cpu_list:
 	return mem;
 }
 
+/*
+ *	vm_page_release_to_cpu:
+ *
+ *	Try to return a page to the current processor's
+ *	free list (the one vm_page_grab() refills from the
+ *	global color queues) without taking the
+ *	vm_page_queue_free_lock.  Pages on that list are
+ *	counted in vm_page_cpu_free_count rather than
+ *	vm_page_free_count, so this is only done while nobody
+ *	is waiting for memory and the free count is above
+ *	vm_page_free_target... the reserved pool never sees
+ *	them, and vm_page_cpu_cache_drain() returns them to
+ *	the global queues when memory runs short.
+ *	The list is bounded by vm_page_cpu_cache_limit: once
+ *	it overflows, the oldest half is handed back to the
+ *	global free queues in a single vm_page_free_list() batch.
+ *
+ *	Returns FALSE if the caller must release the page
+ *	to the global free queues itself.
+ */
+unsigned int	vm_page_cpu_cache_limit = 64;
+unsigned int	vm_page_cpu_cache_released = 0;
+unsigned int	vm_page_cpu_cache_drained = 0;
+unsigned int	vm_page_cpu_free_count = 0;
+
+static boolean_t
+vm_page_release_to_cpu(
+	vm_page_t	mem)
+{
+	processor_t	processor;
+	vm_page_t	drain_q = VM_PAGE_NULL;
+	vm_page_t	last;
+	unsigned int	keep;
+	unsigned int	drained = 0;
+
+	if (vm_page_cpu_cache_limit == 0 ||
+	    vm_page_free_target == 0 ||		/* pageout targets not set up yet */
+	    mem->lopage == TRUE || vm_lopage_refill == TRUE ||
+	    vm_page_free_wanted || vm_page_free_wanted_privileged ||
+	    vm_page_free_count < vm_page_free_target)
+		return FALSE;
+
+	assert(!mem->free);
+	assert(mem->busy);
+	assert(!mem->laundry);
+	assert(mem->object == VM_OBJECT_NULL);
+	assert(mem->pageq.next == NULL &&
+	       mem->pageq.prev == NULL);
+
+	disable_preemption();
+
+	processor = current_processor();
+
+	mem->pageq.next = (queue_entry_t) PROCESSOR_DATA(processor, free_pages);
+	PROCESSOR_DATA(processor, free_pages) = mem;
+
+	if (++PROCESSOR_DATA(processor, free_pages_count) > vm_page_cpu_cache_limit) {
+		/*
+		 * keep the most recently released (cache warm)
+		 * half, drain the rest
+		 */
+		keep = vm_page_cpu_cache_limit / 2;
+
+		if (keep == 0) {
+			drain_q = mem;
+			PROCESSOR_DATA(processor, free_pages) = NULL;
+		} else {
+			for (last = mem; --keep; last = (vm_page_t) last->pageq.next)
+				;
+			drain_q = (vm_page_t) last->pageq.next;
+			last->pageq.next = NULL;
+		}
+		drained = PROCESSOR_DATA(processor, free_pages_count) - vm_page_cpu_cache_limit / 2;
+		PROCESSOR_DATA(processor, free_pages_count) = vm_page_cpu_cache_limit / 2;
+	}
+	vm_page_cpu_cache_released++;
+
+	enable_preemption();
+
+	OSAddAtomic(1 - (int)drained, &vm_page_cpu_free_count);
+
+	if (drain_q != VM_PAGE_NULL) {
+		vm_page_cpu_cache_drained += drained;
+		vm_page_free_list(drain_q, FALSE);
+	}
+
+	return TRUE;
+}
+
+/*
+ *	vm_page_cpu_cache_drain:
+ *
+ *	Return every page on the current processor's free
+ *	list to the global free queues.  The lists are only
+ *	touched by their own processor, so under memory
+ *	pressure vm_pageout_garbage_collect() runs this on
+ *	each processor in turn... that way pages don't sit
+ *	on idle processors while the others run short.
+ */
+void
+vm_page_cpu_cache_drain(void)
+{
+	processor_t	processor;
+	vm_page_t	drain_q;
+	unsigned int	count;
+
+	disable_preemption();
+
+	processor = current_processor();
+
+	drain_q = PROCESSOR_DATA(processor, free_pages);
+	count = PROCESSOR_DATA(processor, free_pages_count);
+	PROCESSOR_DATA(processor, free_pages) = NULL;
+	PROCESSOR_DATA(processor, free_pages_count) = 0;
+
+	enable_preemption();
+
+	if (drain_q == VM_PAGE_NULL)
+		return;
+
+	OSAddAtomic(-(int)count, &vm_page_cpu_free_count);
+	vm_page_cpu_cache_drained += count;
+
+	vm_page_free_list(drain_q, FALSE);
+}
+
 /*
  *	vm_page_release:
  *
@@ -2085,6 +2224,9 @@ vm_page_release(
 
 	pmap_clear_noencrypt(mem->phys_page);
 
+	if (vm_page_release_to_cpu(mem) == TRUE)
+		return;
+
 	lck_mtx_lock_spin(&vm_page_queue_free_lock);
 #if DEBUG
 	if (mem->free)
@@ -3277,35 +3419,18 @@ vm_page_reactivate_all_throttled(void)
 
 
 /*
- * move pages from the indicated local queue to the global active queue
- * its ok to fail if we're below the hard limit and force == FALSE
- * the nolocks == TRUE case is to allow this function to be run on
- * the hibernate path
+ * splice the contents of a local queue onto the head of the
+ * global active queue... both the page queues lock and the
+ * local queue's lock must be held
  */
-
-void
-vm_page_reactivate_local(uint32_t lid, boolean_t force, boolean_t nolocks)
+static void
+vm_page_local_q_transfer(struct vpl *lq, uint32_t lid)
 {
-	struct vpl	*lq;
 	vm_page_t	first_local, last_local;
 	vm_page_t	first_active;
 	vm_page_t	m;
 	uint32_t	count = 0;
 
-	if (vm_page_local_q == NULL)
-		return;
-
-	lq = &vm_page_local_q[lid].vpl_un.vpl;
-
-	if (nolocks == FALSE) {
-		if (lq->vpl_count < vm_page_local_q_hard_limit && force == FALSE) {
-			if ( !vm_page_trylockspin_queues())
-				return;
-		} else
-			vm_page_lockspin_queues();
-
-		VPL_LOCK(&lq->vpl_lock);
-	}
 	if (lq->vpl_count) {
 		/*
 		 * Switch "local" pages to "active".
@@ -3363,6 +3488,36 @@ vm_page_reactivate_local(uint32_t lid, boolean_t force, boolean_t nolocks)
 		lq->vpl_external_count = 0;
 	}
 	assert(queue_empty(&lq->vpl_queue));
+}
+
+
+/*
+ * move pages from the indicated local queue to the global active queue
+ * its ok to fail if we're below the hard limit and force == FALSE
+ * the nolocks == TRUE case is to allow this function to be run on
+ * the hibernate path
+ */
+
+void
+vm_page_reactivate_local(uint32_t lid, boolean_t force, boolean_t nolocks)
+{
+	struct vpl	*lq;
+
+	if (vm_page_local_q == NULL)
+		return;
+
+	lq = &vm_page_local_q[lid].vpl_un.vpl;
+
+	if (nolocks == FALSE) {
+		if (lq->vpl_count < vm_page_local_q_hard_limit && force == FALSE) {
+			if ( !vm_page_trylockspin_queues())
+				return;
+		} else
+			vm_page_lockspin_queues();
+
+		VPL_LOCK(&lq->vpl_lock);
+	}
+	vm_page_local_q_transfer(lq, lid);
 
 	if (nolocks == FALSE) {
 		VPL_UNLOCK(&lq->vpl_lock);
@@ -3370,6 +3525,46 @@ vm_page_reactivate_local(uint32_t lid, boolean_t force, boolean_t nolocks)
 	}
 }
 
+
+/*
+ * move the pages parked on every processor's local queue
+ * to the global active queue in one pass, so that
+ * vm_pageout_scan can see them... called with the page
+ * queues lock held, which is the expensive part of
+ * vm_page_reactivate_local() and which the caller
+ * already has.  Returns the number of pages moved.
+ */
+unsigned int vm_page_local_q_drained = 0;
+
+uint32_t
+vm_page_reactivate_all_local(void)
+{
+	struct vpl	*lq;
+	uint32_t	lid;
+	uint32_t	moved = 0;
+
+	if (vm_page_local_q == NULL)
+		return 0;
+#if DEBUG
+	lck_mtx_assert(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+#endif
+	for (lid = 0; lid < vm_page_local_q_count; lid++) {
+
+		lq = &vm_page_local_q[lid].vpl_un.vpl;
+
+		if (lq->vpl_count == 0)
+			continue;
+
+		VPL_LOCK(&lq->vpl_lock);
+		moved += lq->vpl_count;
+		vm_page_local_q_transfer(lq, lid);
+		VPL_UNLOCK(&lq->vpl_lock);
+	}
+	vm_page_local_q_drained += moved;
+
+	return moved;
+}
+
 /*
  *	vm_page_part_zero_fill:
  *
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2013 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Transparent superpages for anonymous memory.
+ *
+ * When enabled (boot-arg or sysctl "vm.transparent_superpages"), zero-fill
+ * faults that complete a naturally aligned 2MB block of an eligible
+ * anonymous mapping post a hint to the superpage collapse thread.  The
+ * thread checks that every base page of the block is resident and
+ * quiescent, migrates them into a physically contiguous, aligned run if
+ * they aren't already, maps them all and asks the pmap layer to replace
+ * the page table with a single 2MB mapping.
+ *
+ * Demotion is entirely up to the pmap layer: any operation that needs a
+ * base pte (partial unmap, protect, pageout/compression, reference bit
+ * sampling...) transparently demotes the block back to 4K mappings.
+ */
+
+#include <mach/mach_types.h>
+#include <kern/kern_types.h>
+#include <kern/locks.h>
+#include <kern/sched_prim.h>
+#include <kern/thread.h>
+#include <vm/cpm.h>
+#include <vm/pmap.h>
+#include <vm/vm_fault.h>
+#include <vm/vm_map.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+#include <vm/vm_pageout.h>
+#include <vm/vm_protos.h>
+#include <pexpert/pexpert.h>
+#include <sys/kdebug.h>
+
+int		vm_transparent_superpages = 0;
+
+unsigned int	vm_superpage_hints = 0;
+unsigned int	vm_superpage_hints_dropped = 0;
+unsigned int	vm_superpage_collapses = 0;
+unsigned int	vm_superpage_collapse_copied = 0;
+unsigned int	vm_superpage_collapse_failures = 0;
+unsigned int	vm_superpage_collapse_nomem = 0;
+
+#if MACHINE_PMAP_PROMOTE_SUPERPAGE
+
+#define VM_SUPERPAGE_HINT_MAX	64
+
+struct vm_superpage_hint {
+	vm_map_t	map;
+	vm_map_offset_t	start;
+};
+
+static struct vm_superpage_hint	vm_superpage_hint_q[VM_SUPERPAGE_HINT_MAX];
+static unsigned int		vm_superpage_hint_head = 0;
+static unsigned int		vm_superpage_hint_count = 0;
+
+decl_simple_lock_data(static, vm_superpage_hint_lock)
+
+static void	vm_superpage_collapse_thread(void);
+static kern_return_t vm_superpage_collapse(vm_map_t map, vm_map_offset_t start);
+
+
+/*
+ * A map entry can back a transparent superpage if it maps the whole
+ * aligned block from a private anonymous object that nothing else
+ * (copy-on-write, wiring, explicit superpages) has claimed.
+ */
+static boolean_t
+vm_superpage_entry_eligible(
+	vm_map_entry_t	entry,
+	vm_map_offset_t	start)
+{
+	vm_object_t	object;
+
+	if (entry->is_sub_map ||
+	    entry->needs_copy ||
+	    entry->in_transition ||
+	    entry->superpage_size ||
+	    entry->wired_count ||
+	    entry->user_wired_count ||
+	    entry->vme_start > start ||
+	    entry->vme_end < start + SUPERPAGE_SIZE)
+		return FALSE;
+
+	object = entry->object.vm_object;
+
+	if (object == VM_OBJECT_NULL ||
+	    !object->internal ||
+	    object->private ||
+	    object->phys_contiguous ||
+	    object->purgable != VM_PURGABLE_DENY)
+		return FALSE;
+
+	return TRUE;
+}
+
+/*
+ * Every base page of the block must be resident and idle.  Sets
+ * "contiguous" if they already form an aligned physical run.
+ * The object must be locked.
+ */
+static boolean_t
+vm_superpage_object_ready(
+	vm_object_t		object,
+	vm_object_offset_t	offset,
+	boolean_t		*contiguous)
+{
+	vm_page_t	m;
+	ppnum_t		first_pn = 0;
+	unsigned int	i;
+
+	if (!object->alive ||
+	    object->terminating ||
+	    object->copy != VM_OBJECT_NULL ||
+	    object->resident_page_count < SUPERPAGE_NBASEPAGES)
+		return FALSE;
+
+	*contiguous = TRUE;
+
+	for (i = 0; i < SUPERPAGE_NBASEPAGES; i++) {
+		m = vm_page_lookup(object, offset + ptoa_64(i));
+
+		if (m == VM_PAGE_NULL ||
+		    m->busy || m->unusual || m->absent || m->error ||
+		    m->cleaning || m->laundry || m->pageout ||
+		    m->encrypted || m->fictitious || m->private ||
+		    m->overwriting || VM_PAGE_WIRED(m))
+			return FALSE;
+
+		if (i == 0) {
+			first_pn = m->phys_page;
+			if (first_pn & (SUPERPAGE_NBASEPAGES - 1))
+				*contiguous = FALSE;
+		} else if (m->phys_page != first_pn + i)
+			*contiguous = FALSE;
+	}
+	return TRUE;
+}
+
+
+/*
+ * Called from vm_fault() after a zero-fill fault on the last page of
+ * a 2MB block: queue the block for the collapse thread.
+ */
+void
+vm_superpage_fault_hint(
+	vm_map_t	map,
+	vm_map_offset_t	vaddr)
+{
+	vm_map_offset_t	start;
+	unsigned int	i, slot;
+
+	start = SUPERPAGE_ROUND_DOWN(vaddr);
+
+	vm_map_reference(map);
+
+	simple_lock(&vm_superpage_hint_lock);
+
+	for (i = 0; i < vm_superpage_hint_count; i++) {
+		slot = (vm_superpage_hint_head + i) % VM_SUPERPAGE_HINT_MAX;
+
+		if (vm_superpage_hint_q[slot].map == map &&
+		    vm_superpage_hint_q[slot].start == start)
+			break;
+	}
+	if (i < vm_superpage_hint_count ||
+	    vm_superpage_hint_count == VM_SUPERPAGE_HINT_MAX) {
+		vm_superpage_hints_dropped++;
+		simple_unlock(&vm_superpage_hint_lock);
+
+		vm_map_deallocate(map);
+		return;
+	}
+	slot = (vm_superpage_hint_head + vm_superpage_hint_count) % VM_SUPERPAGE_HINT_MAX;
+	vm_superpage_hint_q[slot].map = map;
+	vm_superpage_hint_q[slot].start = start;
+	vm_superpage_hint_count++;
+	vm_superpage_hints++;
+
+	simple_unlock(&vm_superpage_hint_lock);
+
+	thread_wakeup((event_t) &vm_superpage_hint_count);
+}
+
+
+static kern_return_t
+vm_superpage_collapse(
+	vm_map_t	map,
+	vm_map_offset_t	start)
+{
+	vm_map_entry_t		entry;
+	vm_object_t		object;
+	vm_object_offset_t	offset;
+	vm_prot_t		prot;
+	vm_page_t		pages = VM_PAGE_NULL;
+	vm_page_t		m, new_m;
+	boolean_t		contiguous;
+	unsigned int		i, refmod_state;
+	int			type_of_fault;
+	kern_return_t		kr = KERN_FAILURE;
+
+	/*
+	 * First pass: don't bother allocating a contiguous run unless the
+	 * block is fully populated.
+	 */
+	vm_map_lock_read(map);
+
+	if (!vm_map_lookup_entry(map, start, &entry) ||
+	    !vm_superpage_entry_eligible(entry, start)) {
+		vm_map_unlock_read(map);
+		return KERN_FAILURE;
+	}
+	object = entry->object.vm_object;
+	offset = entry->offset + (start - entry->vme_start);
+
+	vm_object_lock_shared(object);
+
+	if (!vm_superpage_object_ready(object, offset, &contiguous)) {
+		vm_object_unlock(object);
+		vm_map_unlock_read(map);
+		return KERN_FAILURE;
+	}
+	vm_object_unlock(object);
+	vm_map_unlock_read(map);
+
+	if (!contiguous) {
+		/*
+		 * cpm_allocate() can't be called with the map or object
+		 * locked, so grab the run now and revalidate below.
+		 */
+		if (cpm_allocate(SUPERPAGE_SIZE, &pages, 0, SUPERPAGE_NBASEPAGES - 1, FALSE, 0) != KERN_SUCCESS) {
+			vm_superpage_collapse_nomem++;
+			return KERN_RESOURCE_SHORTAGE;
+		}
+	}
+
+	vm_map_lock_read(map);
+
+	if (!vm_map_lookup_entry(map, start, &entry) ||
+	    !vm_superpage_entry_eligible(entry, start))
+		goto unlock_map;
+
+	object = entry->object.vm_object;
+	offset = entry->offset + (start - entry->vme_start);
+	prot = entry->protection;
+
+	vm_object_lock(object);
+
+	if (!vm_superpage_object_ready(object, offset, &contiguous))
+		goto unlock_object;
+
+	if (!contiguous) {
+		if (pages == VM_PAGE_NULL)
+			goto unlock_object;
+
+		/*
+		 * Migrate the block into the contiguous run.  Each old
+		 * page is disconnected from every pmap first, so its
+		 * contents can't change while we copy it.
+		 */
+		for (i = 0; i < SUPERPAGE_NBASEPAGES; i++) {
+			m = vm_page_lookup(object, offset + ptoa_64(i));
+
+			new_m = pages;
+			pages = NEXT_PAGE(new_m);
+			*(NEXT_PAGE_PTR(new_m)) = VM_PAGE_NULL;
+
+			refmod_state = pmap_disconnect(m->phys_page);
+			pmap_copy_page(m->phys_page, new_m->phys_page);
+
+			new_m->busy = FALSE;
+			if (m->dirty || (refmod_state & VM_MEM_MODIFIED))
+				SET_PAGE_DIRTY(new_m, FALSE);
+			if (m->reference || (refmod_state & VM_MEM_REFERENCED))
+				new_m->reference = TRUE;
+
+			/* frees the old page */
+			vm_page_replace(new_m, object, offset + ptoa_64(i));
+		}
+		vm_superpage_collapse_copied++;
+	}
+
+	/*
+	 * Map every base page, then let the pmap collapse the page table.
+	 */
+	for (i = 0; i < SUPERPAGE_NBASEPAGES; i++) {
+		m = vm_page_lookup(object, offset + ptoa_64(i));
+
+		type_of_fault = DBG_CACHE_HIT_FAULT;
+		kr = vm_fault_enter(m, map->pmap, start + ptoa_64(i),
+				    prot, prot,
+				    FALSE, FALSE, FALSE, FALSE,
+				    NULL, &type_of_fault);
+		if (kr != KERN_SUCCESS)
+			break;
+	}
+	vm_object_unlock(object);
+
+	if (kr == KERN_SUCCESS) {
+		if (pmap_promote_superpage(map->pmap, start))
+			vm_superpage_collapses++;
+		else
+			kr = KERN_FAILURE;
+	}
+	vm_map_unlock_read(map);
+	goto done;
+
+unlock_object:
+	vm_object_unlock(object);
+unlock_map:
+	vm_map_unlock_read(map);
+done:
+	while ((m = pages) != VM_PAGE_NULL) {
+		pages = NEXT_PAGE(m);
+		*(NEXT_PAGE_PTR(m)) = VM_PAGE_NULL;
+		VM_PAGE_FREE(m);
+	}
+	return kr;
+}
+
+
+static void
+vm_superpage_collapse_thread(void)
+{
+	vm_map_t	map;
+	vm_map_offset_t	start;
+
+	for (;;) {
+		simple_lock(&vm_superpage_hint_lock);
+
+		if (vm_superpage_hint_count == 0) {
+			assert_wait((event_t) &vm_superpage_hint_count, THREAD_UNINT);
+			simple_unlock(&vm_superpage_hint_lock);
+
+			thread_block((thread_continue_t) vm_superpage_collapse_thread);
+			/*NOTREACHED*/
+		}
+		map = vm_superpage_hint_q[vm_superpage_hint_head].map;
+		start = vm_superpage_hint_q[vm_superpage_hint_head].start;
+		vm_superpage_hint_head = (vm_superpage_hint_head + 1) % VM_SUPERPAGE_HINT_MAX;
+		vm_superpage_hint_count--;
+
+		simple_unlock(&vm_superpage_hint_lock);
+
+		if (vm_transparent_superpages &&
+		    vm_superpage_collapse(map, start) != KERN_SUCCESS)
+			vm_superpage_collapse_failures++;
+
+		vm_map_deallocate(map);
+	}
+}
+
+
+void
+vm_superpage_init(void)
+{
+	thread_t	thread;
+
+	PE_parse_boot_argn("transparent_superpages", &vm_transparent_superpages,
+			   sizeof (vm_transparent_superpages));
+
+	simple_lock_init(&vm_superpage_hint_lock, 0);
+
+	if (kernel_thread_start_priority((thread_continue_t) vm_superpage_collapse_thread, NULL,
+					 BASEPRI_DEFAULT, &thread) != KERN_SUCCESS)
+		panic("vm_superpage_collapse_thread: create failed");
+
+	thread_deallocate(thread);
+}
+
+#else /* MACHINE_PMAP_PROMOTE_SUPERPAGE */
+
+void
+vm_superpage_fault_hint(
+	__unused vm_map_t	map,
+	__unused vm_map_offset_t vaddr)
+{
+}
+
+void
+vm_superpage_init(void)
+{
+}
+
+#endif /* MACHINE_PMAP_PROMOTE_SUPERPAGE */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <i386/asm.h>
+
+/*
+ * One's complement checksum kernels.
+ *
+ * Each routine returns the sum of the little-endian 32-bit words in a
+ * buffer whose length is a non-zero multiple of 64 bytes, as a 64-bit
+ * value; folding that down to 16 bits (and any byte swap for an odd
+ * starting offset) is left to the caller, as with the scalar loops in
+ * bsd/netinet.  Words are zero-extended into 64-bit lanes, so lanes
+ * cannot carry out for any length we are handed.
+ *
+ * The vector registers used are saved on the stack and restored on the
+ * way out, since they may hold a thread's live user state.  The caller
+ * must keep interrupts off and CR0.TS clear across the call; see
+ * ml_cksum_simd().
+ */
+
+/*
+ * uint64_t in_cksum_sse2(const void *buf, size_t len)
+ */
+ENTRY(in_cksum_sse2)
+	pushq	%rbp
+	movq	%rsp, %rbp
+	subq	$(6*16), %rsp
+	andq	$-16, %rsp
+	movdqa	%xmm0, 0*16(%rsp)
+	movdqa	%xmm1, 1*16(%rsp)
+	movdqa	%xmm2, 2*16(%rsp)
+	movdqa	%xmm3, 3*16(%rsp)
+	movdqa	%xmm4, 4*16(%rsp)
+	movdqa	%xmm5, 5*16(%rsp)
+
+	pxor	%xmm0, %xmm0		/* zero, for unpacking */
+	pxor	%xmm1, %xmm1		/* accumulators */
+	pxor	%xmm2, %xmm2
+1:
+	movdqu	0(%rdi), %xmm3
+	movdqu	16(%rdi), %xmm5
+	movdqa	%xmm3, %xmm4
+	punpckldq %xmm0, %xmm3
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm3, %xmm1
+	paddq	%xmm4, %xmm2
+	movdqa	%xmm5, %xmm4
+	punpckldq %xmm0, %xmm5
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm5, %xmm1
+	paddq	%xmm4, %xmm2
+	movdqu	32(%rdi), %xmm3
+	movdqu	48(%rdi), %xmm5
+	movdqa	%xmm3, %xmm4
+	punpckldq %xmm0, %xmm3
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm3, %xmm1
+	paddq	%xmm4, %xmm2
+	movdqa	%xmm5, %xmm4
+	punpckldq %xmm0, %xmm5
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm5, %xmm1
+	paddq	%xmm4, %xmm2
+	addq	$64, %rdi
+	subq	$64, %rsi
+	jnz	1b
+
+	paddq	%xmm2, %xmm1
+	movq	%xmm1, %rax
+	punpckhqdq %xmm1, %xmm1
+	movq	%xmm1, %rdx
+	addq	%rdx, %rax
+
+	movdqa	0*16(%rsp), %xmm0
+	movdqa	1*16(%rsp), %xmm1
+	movdqa	2*16(%rsp), %xmm2
+	movdqa	3*16(%rsp), %xmm3
+	movdqa	4*16(%rsp), %xmm4
+	movdqa	5*16(%rsp), %xmm5
+	movq	%rbp, %rsp
+	popq	%rbp
+	ret
+
+/*
+ * uint64_t in_cksum_copy_sse2(const void *src, void *dst, size_t len)
+ */
+ENTRY(in_cksum_copy_sse2)
+	pushq	%rbp
+	movq	%rsp, %rbp
+	subq	$(6*16), %rsp
+	andq	$-16, %rsp
+	movdqa	%xmm0, 0*16(%rsp)
+	movdqa	%xmm1, 1*16(%rsp)
+	movdqa	%xmm2, 2*16(%rsp)
+	movdqa	%xmm3, 3*16(%rsp)
+	movdqa	%xmm4, 4*16(%rsp)
+	movdqa	%xmm5, 5*16(%rsp)
+
+	pxor	%xmm0, %xmm0
+	pxor	%xmm1, %xmm1
+	pxor	%xmm2, %xmm2
+1:
+	movdqu	0(%rdi), %xmm3
+	movdqu	16(%rdi), %xmm5
+	movdqu	%xmm3, 0(%rsi)
+	movdqu	%xmm5, 16(%rsi)
+	movdqa	%xmm3, %xmm4
+	punpckldq %xmm0, %xmm3
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm3, %xmm1
+	paddq	%xmm4, %xmm2
+	movdqa	%xmm5, %xmm4
+	punpckldq %xmm0, %xmm5
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm5, %xmm1
+	paddq	%xmm4, %xmm2
+	movdqu	32(%rdi), %xmm3
+	movdqu	48(%rdi), %xmm5
+	movdqu	%xmm3, 32(%rsi)
+	movdqu	%xmm5, 48(%rsi)
+	movdqa	%xmm3, %xmm4
+	punpckldq %xmm0, %xmm3
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm3, %xmm1
+	paddq	%xmm4, %xmm2
+	movdqa	%xmm5, %xmm4
+	punpckldq %xmm0, %xmm5
+	punpckhdq %xmm0, %xmm4
+	paddq	%xmm5, %xmm1
+	paddq	%xmm4, %xmm2
+	addq	$64, %rdi
+	addq	$64, %rsi
+	subq	$64, %rdx
+	jnz	1b
+
+	paddq	%xmm2, %xmm1
+	movq	%xmm1, %rax
+	punpckhqdq %xmm1, %xmm1
+	movq	%xmm1, %rdx
+	addq	%rdx, %rax
+
+	movdqa	0*16(%rsp), %xmm0
+	movdqa	1*16(%rsp), %xmm1
+	movdqa	2*16(%rsp), %xmm2
+	movdqa	3*16(%rsp), %xmm3
+	movdqa	4*16(%rsp), %xmm4
+	movdqa	5*16(%rsp), %xmm5
+	movq	%rbp, %rsp
+	popq	%rbp
+	ret
+
+/*
+ * uint64_t in_cksum_avx2(const void *buf, size_t len)
+ *
+ * The full ymm registers are saved, so no vzeroupper on the way out;
+ * it would discard the upper halves we just restored.
+ */
+ENTRY(in_cksum_avx2)
+	pushq	%rbp
+	movq	%rsp, %rbp
+	subq	$(6*32), %rsp
+	andq	$-32, %rsp
+	vmovdqa	%ymm0, 0*32(%rsp)
+	vmovdqa	%ymm1, 1*32(%rsp)
+	vmovdqa	%ymm2, 2*32(%rsp)
+	vmovdqa	%ymm3, 3*32(%rsp)
+	vmovdqa	%ymm4, 4*32(%rsp)
+	vmovdqa	%ymm5, 5*32(%rsp)
+
+	vpxor	%ymm0, %ymm0, %ymm0	/* accumulators */
+	vpxor	%ymm1, %ymm1, %ymm1
+1:
+	vpmovzxdq 0(%rdi), %ymm2
+	vpmovzxdq 16(%rdi), %ymm3
+	vpmovzxdq 32(%rdi), %ymm4
+	vpmovzxdq 48(%rdi), %ymm5
+	vpaddq	%ymm2, %ymm0, %ymm0
+	vpaddq	%ymm3, %ymm1, %ymm1
+	vpaddq	%ymm4, %ymm0, %ymm0
+	vpaddq	%ymm5, %ymm1, %ymm1
+	addq	$64, %rdi
+	subq	$64, %rsi
+	jnz	1b
+
+	vpaddq	%ymm1, %ymm0, %ymm0
+	vextracti128 $1, %ymm0, %xmm1
+	vpaddq	%xmm1, %xmm0, %xmm0
+	vmovq	%xmm0, %rax
+	vpextrq	$1, %xmm0, %rdx
+	addq	%rdx, %rax
+
+	vmovdqa	0*32(%rsp), %ymm0
+	vmovdqa	1*32(%rsp), %ymm1
+	vmovdqa	2*32(%rsp), %ymm2
+	vmovdqa	3*32(%rsp), %ymm3
+	vmovdqa	4*32(%rsp), %ymm4
+	vmovdqa	5*32(%rsp), %ymm5
+	movq	%rbp, %rsp
+	popq	%rbp
+	ret
+
+/*
+ * uint64_t in_cksum_copy_avx2(const void *src, void *dst, size_t len)
+ */
+ENTRY(in_cksum_copy_avx2)
+	pushq	%rbp
+	movq	%rsp, %rbp
+	subq	$(6*32), %rsp
+	andq	$-32, %rsp
+	vmovdqa	%ymm0, 0*32(%rsp)
+	vmovdqa	%ymm1, 1*32(%rsp)
+	vmovdqa	%ymm2, 2*32(%rsp)
+	vmovdqa	%ymm3, 3*32(%rsp)
+	vmovdqa	%ymm4, 4*32(%rsp)
+	vmovdqa	%ymm5, 5*32(%rsp)
+
+	vpxor	%ymm0, %ymm0, %ymm0
+	vpxor	%ymm1, %ymm1, %ymm1
+1:
+	vmovdqu	0(%rdi), %ymm2
+	vmovdqu	32(%rdi), %ymm3
+	vmovdqu	%ymm2, 0(%rsi)
+	vmovdqu	%ymm3, 32(%rsi)
+	vpmovzxdq %xmm2, %ymm4
+	vextracti128 $1, %ymm2, %xmm2
+	vpmovzxdq %xmm2, %ymm2
+	vpmovzxdq %xmm3, %ymm5
+	vextracti128 $1, %ymm3, %xmm3
+	vpmovzxdq %xmm3, %ymm3
+	vpaddq	%ymm4, %ymm0, %ymm0
+	vpaddq	%ymm2, %ymm1, %ymm1
+	vpaddq	%ymm5, %ymm0, %ymm0
+	vpaddq	%ymm3, %ymm1, %ymm1
+	addq	$64, %rdi
+	addq	$64, %rsi
+	subq	$64, %rdx
+	jnz	1b
+
+	vpaddq	%ymm1, %ymm0, %ymm0
+	vextracti128 $1, %ymm0, %xmm1
+	vpaddq	%xmm1, %xmm0, %xmm0
+	vmovq	%xmm0, %rax
+	vpextrq	$1, %xmm0, %rdx
+	addq	%rdx, %rax
+
+	vmovdqa	0*32(%rsp), %ymm0
+	vmovdqa	1*32(%rsp), %ymm1
+	vmovdqa	2*32(%rsp), %ymm2
+	vmovdqa	3*32(%rsp), %ymm3
+	vmovdqa	4*32(%rsp), %ymm4
+	vmovdqa	5*32(%rsp), %ymm5
+	movq	%rbp, %rsp
+	popq	%rbp
+	ret
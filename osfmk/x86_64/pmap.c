@@ -292,6 +292,13 @@ extern void			*KPTphys;
 
 boolean_t pmap_smep_enabled = FALSE;
 
+/*
+ * Kernel mappings are entered with the global bit set, so that they
+ * survive CR3 reloads, and kernel pmap invalidations flush globally.
+ * Decided once in pmap_bootstrap().
+ */
+boolean_t pmap_kernel_global_pages = FALSE;
+
 void
 pmap_cpu_init(void)
 {
@@ -311,6 +318,8 @@ pmap_cpu_init(void)
 	cdp->cpu_tlb_invalid = FALSE;
 	cdp->cpu_task_map = TASK_MAP_64BIT;
 	pmap_pcid_configure();
+	if (pmap_kernel_global_pages)
+		set_cr4(get_cr4() | CR4_PGE);
 	if (cpuid_leaf7_features() & CPUID_LEAF7_FEATURE_SMEP) {
 		boolean_t nsmep;
 		if (!PE_parse_boot_argn("-pmap_smep_disable", &nsmep, sizeof(nsmep))) {
@@ -476,6 +485,23 @@ pmap_bootstrap(
 				  &no_shared_cr3, sizeof (no_shared_cr3));
 	if (no_shared_cr3)
 		kprintf("Kernel not sharing user map\n");
+
+	/*
+	 * Without PCID (e.g. on AMD parts that don't report it) every
+	 * address space switch otherwise discards the kernel's TLB
+	 * entries along with the user's.  Global pages are meaningless
+	 * when the kernel runs on its own CR3, so stay off in that case.
+	 */
+	{
+		boolean_t nglobal = FALSE;
+
+		if (!no_shared_cr3 &&
+		    !PE_parse_boot_argn("-pmap_global_disable", &nglobal, sizeof (nglobal))) {
+			pmap_kernel_global_pages = TRUE;
+			set_cr4(get_cr4() | CR4_PGE);
+			printf("PMAP: kernel global pages enabled\n");
+		}
+	}
 		
 #ifdef	PMAP_TRACES
 	if (PE_parse_boot_argn("-pmap_trace", &pmap_trace, sizeof (pmap_trace))) {
@@ -744,6 +770,8 @@ pmap_init(void)
 	    4096 * 3 /* LCM x86_64*/, "pv_list");
 	zone_change(pv_hashed_list_zone, Z_NOENCRYPT, TRUE);
 
+	pmap_superpage_init();
+
 	/* create pv entries for kernel pages mapped by low level
 	   startup code.  these have to exist so we can pmap_remove()
 	   e.g. kext pages from the middle of our addr space */
@@ -1103,7 +1131,7 @@ pmap_lowmem_finalize(void)
 	}
 	
 	splx(spl);
-	if (pmap_pcid_ncpus)
+	if (pmap_pcid_ncpus || pmap_kernel_global_pages)
 		tlb_flush_global();
 	else
 		flush_tlb_raw();
@@ -1321,6 +1349,9 @@ pmap_destroy(pmap_t	p)
 	 */
 	int inuse_ptepages = 0;
 
+	if (p->pm_superpage_promotions != p->pm_superpage_demotions)
+		pmap_superpage_purge(p);
+
 	zfree(pmap_anchor_zone, p->pm_pml4);
 
 	inuse_ptepages += p->pm_obj_pml4->resident_page_count;
@@ -1430,6 +1461,7 @@ pmap_protect_options(
 			lva = eva;
 		pde = pmap_pde(map, sva);
 		if (pde && (*pde & INTEL_PTE_VALID)) {
+			pmap_pde_demote(map, sva, pde);
 			if (*pde & INTEL_PTE_PS) {
 				/* superpage */
 				spte = pde;
@@ -2329,7 +2361,8 @@ pmap_flush_tlbs(pmap_t	pmap, vm_map_offset_t startv, vm_map_offset_t endv, int o
 			need_global_flush = TRUE;
 		pmap_pcid_invalidate_all_cpus(pmap);
 		mfence();
-	}
+	} else if (pmap_kernel_global_pages && (pmap == kernel_pmap))
+		need_global_flush = TRUE;
 	for (cpu = 0, cpu_bit = 1; cpu < real_ncpus; cpu++, cpu_bit <<= 1) {
 		if (!cpu_datap(cpu)->cpu_running)
 			continue;
@@ -2402,6 +2435,8 @@ pmap_flush_tlbs(pmap_t	pmap, vm_map_offset_t startv, vm_map_offset_t endv, int o
 			else
 				flush_tlb_raw();
 		}
+		else if (need_global_flush)
+			tlb_flush_global();
 		else
 			flush_tlb_raw();
 	}
@@ -2475,6 +2510,10 @@ process_pmap_updates(void)
 			flush_tlb_raw();
 		}
 	}
+	else if (cpu_datap(ccpu)->cpu_tlb_invalid_global) {
+		cpu_datap(ccpu)->cpu_tlb_invalid = FALSE;
+		tlb_flush_global();
+	}
 	else {
 		current_cpu_datap()->cpu_tlb_invalid = FALSE;
 		flush_tlb_raw();
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <mach/mach.h>
 #include <mach/host_info.h>
+#include <sys/sysctl.h>
 
 /*
  *	lockstat.c
@@ -55,6 +56,12 @@
  *	locks, such as mutexes, incremented if the owner of the mutex
  *	wasn't active on another processor at the time of the lock
  *	attempt. This indicates that no adaptive spin occurred.
+ *
+ *	Spin, Max Spin, Max Hold (currently implemented only on
+ *	i386/x86_64, in microseconds): total and longest time spent
+ *	adaptively spinning on a contended mutex of the group, and the
+ *	longest time any mutex of the group was held. The maxima are
+ *	since boot, even when deltas are displayed.
  */
 
 /*
@@ -84,6 +91,19 @@ mach_port_t host_control;
 lockgroup_info_t	*lockgroup_info, *lockgroup_start, *lockgroup_deltas;
 unsigned int		count;
 
+#if defined(__i386__) || defined(__x86_64__)
+uint64_t		tsc_frequency;
+
+/* Mutex timing statistics are kept in TSC ticks */
+static double
+tsc_to_us(uint64_t tsc)
+{
+	if (tsc_frequency == 0)
+		return 0.0;
+	return (double)tsc * 1e6 / (double)tsc_frequency;
+}
+#endif
+
 unsigned int		gDebug = 1;
 
 int
@@ -101,6 +121,15 @@ main(int argc, char **argv)
 
 	host_control = mach_host_self();  
 
+#if defined(__i386__) || defined(__x86_64__)
+	{
+		size_t	len = sizeof(tsc_frequency);
+
+		if (sysctlbyname("machdep.tsc.frequency", &tsc_frequency, &len, NULL, 0) != 0)
+			tsc_frequency = 0;
+	}
+#endif
+
 	kr = host_lockgroup_info(host_control, &lockgroup_info, &count);
 
 	if (kr != KERN_SUCCESS)
@@ -330,7 +359,7 @@ void
 print_mutex_hdr(void)
 {
 #if defined(__i386__) || defined(__x86_64__)
-	printf("Mutex lock attempts  Misses      Waits Direct Waits Name\n");
+	printf("Mutex lock attempts  Misses      Waits Direct Waits    Spin(us) MaxSpin(us) MaxHold(us) Name\n");
 #else
         printf("     mutex locks           misses            waits   name\n");
 #endif
@@ -345,6 +374,8 @@ print_mutex(int requested, lockgroup_info_t *lockgroup)
 		printf("%16lld ", curptr->lock_mtx_util_cnt);
 #if defined(__i386__) || defined(__x86_64__)
 		printf("%10lld %10lld %10lld   ", curptr->lock_mtx_miss_cnt,  curptr->lock_mtx_wait_cnt, curptr->lock_mtx_held_cnt);
+		printf("%11.1f %11.1f %11.1f ", tsc_to_us(curptr->lock_mtx_wait_cum),
+		    tsc_to_us(curptr->lock_mtx_wait_max), tsc_to_us(curptr->lock_mtx_held_max));
 #else
 		printf("%16lld %16lld   ", curptr->lock_mtx_miss_cnt,  curptr->lock_mtx_wait_cnt);
 #endif
@@ -443,6 +474,12 @@ get_lockgroup_deltas(void)
 		lockgroup_deltas[i].lock_mtx_held_cnt =
 		    lockgroup_info[i].lock_mtx_held_cnt -
 		    lockgroup_start[i].lock_mtx_held_cnt;
+		lockgroup_deltas[i].lock_mtx_held_cum =
+		    lockgroup_info[i].lock_mtx_held_cum -
+		    lockgroup_start[i].lock_mtx_held_cum;
+		lockgroup_deltas[i].lock_mtx_wait_cum =
+		    lockgroup_info[i].lock_mtx_wait_cum -
+		    lockgroup_start[i].lock_mtx_wait_cum;
 		lockgroup_deltas[i].lock_rw_util_cnt =
 		    lockgroup_info[i].lock_rw_util_cnt -
 		    lockgroup_start[i].lock_rw_util_cnt;
@@ -0,0 +1,207 @@
+/*
+ * Measure kqueue throughput with many busy descriptors.
+ *
+ * N (default 1000) socketpairs are registered for EVFILT_READ on one
+ * kqueue.  We first time registration and removal of all of them,
+ * BATCH changes per kevent64() call:
+ *
+ *	add:	 EV_ADD of every read end
+ *	delete:	 EV_DELETE of every read end
+ *
+ * Then, with the knotes registered again, W (default 4) writer
+ * threads each hammer their share of the write ends with one-byte
+ * writes while the main thread collects up to BATCH events per
+ * kevent64() call and drains each readable socket.  This is the
+ * activation-versus-scan contention case: producers are posting
+ * knotes on the kqueue while it is being scanned.  We report
+ * events and writes per second and the mean events per call.
+ */
+
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mach/mach_time.h>
+
+#define BATCH	64
+
+static int	kq;
+static int	nsockets = 1000;
+static int	nwriters = 4;
+static int	seconds = 5;
+static int	(*pairs)[2];
+
+static volatile int	done;
+static uint64_t		*writes;	/* per writer */
+
+static mach_timebase_info_data_t	timebase;
+
+static uint64_t
+abs_to_ns(uint64_t abs)
+{
+	return abs * timebase.numer / timebase.denom;
+}
+
+/*
+ * Apply "flags" to every read end, BATCH changes per kevent64() call.
+ * Returns elapsed nanoseconds.
+ */
+static uint64_t
+apply_all(uint16_t flags)
+{
+	struct kevent64_s	changes[BATCH];
+	uint64_t		start;
+	int			i, n = 0;
+
+	start = mach_absolute_time();
+
+	for (i = 0; i < nsockets; i++) {
+		EV_SET64(&changes[n], pairs[i][0], EVFILT_READ, flags, 0, 0,
+			 i, 0, 0);
+		if (++n == BATCH || i == nsockets - 1) {
+			if (kevent64(kq, changes, n, NULL, 0, 0, NULL) != 0)
+				err(1, "kevent64");
+			n = 0;
+		}
+	}
+	return abs_to_ns(mach_absolute_time() - start);
+}
+
+static void *
+writer(void *arg)
+{
+	int		id = (int)(long)arg;
+	unsigned int	seed = (unsigned int)id;
+	/* our share of the sockets: id, id + nwriters, ... */
+	int		share = (nsockets - id + nwriters - 1) / nwriters;
+	int		i;
+	char		c = 'x';
+
+	while (!done) {
+		i = id + nwriters * (rand_r(&seed) % share);
+		if (write(pairs[i][1], &c, 1) == 1)
+			writes[id]++;
+		else if (errno != EAGAIN && errno != ENOBUFS)
+			err(1, "write");
+	}
+	return NULL;
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n sockets] [-w writers] [-s seconds]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct kevent64_s	events[BATCH];
+	struct timespec		timeout = { 0, 100 * 1000 * 1000 };
+	pthread_t		*threads;
+	uint64_t		add, delete, start, end, deadline;
+	uint64_t		nevents = 0, ncalls = 0, nwrites = 0;
+	char			buf[512];
+	double			secs;
+	int			ch, i, n;
+
+	while ((ch = getopt(argc, argv, "n:w:s:")) != -1) {
+		switch (ch) {
+		case 'n':
+			nsockets = atoi(optarg);
+			break;
+		case 'w':
+			nwriters = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nsockets <= 0 || nwriters <= 0 || nwriters > nsockets ||
+	    seconds <= 0)
+		usage(argv[0]);
+
+	mach_timebase_info(&timebase);
+
+	if ((pairs = calloc(nsockets, sizeof (*pairs))) == NULL ||
+	    (threads = calloc(nwriters, sizeof (*threads))) == NULL ||
+	    (writes = calloc(nwriters, sizeof (*writes))) == NULL)
+		err(1, "calloc");
+	for (i = 0; i < nsockets; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) != 0)
+			err(1, "socketpair (raise the descriptor limit?)");
+		if (fcntl(pairs[i][0], F_SETFL, O_NONBLOCK) != 0 ||
+		    fcntl(pairs[i][1], F_SETFL, O_NONBLOCK) != 0)
+			err(1, "fcntl");
+	}
+
+	if ((kq = kqueue()) < 0)
+		err(1, "kqueue");
+
+	add = apply_all(EV_ADD);
+	delete = apply_all(EV_DELETE);
+	(void) apply_all(EV_ADD);
+
+	for (i = 0; i < nwriters; i++) {
+		if (pthread_create(&threads[i], NULL, writer, (void *)(long)i) != 0)
+			err(1, "pthread_create");
+	}
+
+	start = mach_absolute_time();
+	deadline = start + (uint64_t)seconds * 1000000000ULL *
+	    timebase.denom / timebase.numer;
+	do {
+		n = kevent64(kq, NULL, 0, events, BATCH, 0, &timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err(1, "kevent64");
+		}
+		ncalls++;
+		nevents += n;
+		for (i = 0; i < n; i++) {
+			int s = pairs[events[i].udata][0];
+
+			while (read(s, buf, sizeof (buf)) == sizeof (buf))
+				;
+		}
+	} while ((end = mach_absolute_time()) < deadline);
+
+	done = 1;
+	for (i = 0; i < nwriters; i++) {
+		if (pthread_join(threads[i], NULL) != 0)
+			err(1, "pthread_join");
+		nwrites += writes[i];
+	}
+
+	secs = abs_to_ns(end - start) / 1e9;
+	printf("%d sockets, %d writers, %d seconds\n", nsockets, nwriters,
+	       seconds);
+	printf("%-8s %8d knotes %10.1f ns/op %12.0f ops/s\n", "add",
+	       nsockets, (double)add / nsockets, nsockets * 1e9 / (double)add);
+	printf("%-8s %8d knotes %10.1f ns/op %12.0f ops/s\n", "delete",
+	       nsockets, (double)delete / nsockets,
+	       nsockets * 1e9 / (double)delete);
+	printf("%-8s %12.0f events/s %12.0f writes/s %6.1f events/call\n",
+	       "scan", nevents / secs, nwrites / secs,
+	       ncalls ? (double)nevents / ncalls : 0.0);
+
+	close(kq);
+	for (i = 0; i < nsockets; i++) {
+		close(pairs[i][0]);
+		close(pairs[i][1]);
+	}
+	exit(EXIT_SUCCESS);
+}
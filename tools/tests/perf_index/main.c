@@ -13,7 +13,8 @@ static const stress_test_t *stress_tests[] =
 {&cpu_test, &memory_test, &syscall_test, &fault_test, &zfod_test,
   &file_local_create_test, &file_local_write_test, &file_local_read_test,
   &file_ram_create_test, &file_ram_read_test, &file_ram_write_test, &iperf_test,
-  &compile_test
+  &compile_test, &sendfile_test, &udp_msg_test, &udp_mmsg_test,
+  &tcp_connect_test
 };
 
 static int num_threads;
@@ -42,6 +42,10 @@ extern const stress_test_t file_ram_write_test;
 extern const stress_test_t file_ram_read_test;
 extern const stress_test_t iperf_test;
 extern const stress_test_t compile_test;
+extern const stress_test_t sendfile_test;
+extern const stress_test_t udp_msg_test;
+extern const stress_test_t udp_mmsg_test;
+extern const stress_test_t tcp_connect_test;
 
 DECL_VALIDATE(no_validate);
 DECL_VALIDATE(validate_iperf);
@@ -57,6 +61,10 @@ DECL_INIT(stress_file_ram_read_init);
 DECL_INIT(stress_file_ram_write_init);
 DECL_INIT(compile_init);
 DECL_INIT(stress_general_init);
+DECL_INIT(stress_sendfile_init);
+DECL_INIT(stress_udp_msg_init);
+DECL_INIT(stress_udp_mmsg_init);
+DECL_INIT(stress_tcp_connect_init);
 
 DECL_TEST(stress_memory);
 DECL_TEST(stress_cpu);
@@ -72,6 +80,9 @@ DECL_TEST(stress_file_ram_write);
 DECL_TEST(iperf);
 DECL_TEST(compile);
 DECL_TEST(stress_general);
+DECL_TEST(stress_sendfile);
+DECL_TEST(stress_udp);
+DECL_TEST(stress_tcp_connect);
 
 DECL_CLEANUP(stress_general_cleanup);
 DECL_CLEANUP(stress_file_local_create_cleanup);
@@ -81,6 +92,9 @@ DECL_CLEANUP(stress_file_ram_create_cleanup);
 DECL_CLEANUP(stress_file_ram_read_cleanup);
 DECL_CLEANUP(stress_file_ram_write_cleanup);
 DECL_CLEANUP(compile_cleanup);
+DECL_CLEANUP(stress_sendfile_cleanup);
+DECL_CLEANUP(stress_udp_cleanup);
+DECL_CLEANUP(stress_tcp_connect_cleanup);
 
 void stress_file_create(const char *fs_path, int thread_id, int num_threads, long long length);
 
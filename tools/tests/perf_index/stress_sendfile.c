@@ -0,0 +1,151 @@
+#include <fcntl.h>
+#include "perf_index.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <mach/mach_time.h>
+
+/*
+ * Each thread serves a resident file over its own loopback TCP
+ * connection with sendfile(2), while a helper thread drains the other
+ * end.  Besides the usual elapsed time, reports the bytes per CPU cycle
+ * each sending thread achieved, averaged over the threads, which is
+ * what the copy (or lack of it) in sendfile shows up in, and the
+ * aggregate bytes per second over wall-clock time, from the first
+ * thread to start to the last one to finish.
+ *
+ * Compare kern.ipc.sendfile_zerocopy=1 against =0.
+ */
+
+#define SENDFILE_FILE_SIZE 16777216L
+#define SENDFILE_CHUNK 1048576L
+
+const stress_test_t sendfile_test = {"sendfile", &stress_sendfile_init, &stress_sendfile, &stress_sendfile_cleanup, &no_validate};
+
+static char filepath[MAXPATHLEN];
+static int listen_sock;
+static struct sockaddr_in listen_addr;
+
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long total_bytes;
+static double total_bytes_per_cycle;
+static int total_runs;
+static uint64_t first_start, last_end;
+static uint64_t cpu_freq;
+static mach_timebase_info_data_t timebase;
+
+static void *drain(void *arg) {
+  int sock = (int)(intptr_t)arg;
+  char buff[65536];
+
+  while(recv(sock, buff, sizeof(buff), 0) > 0);
+  return NULL;
+}
+
+DECL_INIT(stress_sendfile_init) {
+  char buff[65536];
+  socklen_t addrlen = sizeof(listen_addr);
+  size_t freq_size = sizeof(cpu_freq);
+  long long left;
+  int fd;
+
+  total_bytes = 0;
+  total_bytes_per_cycle = 0;
+  total_runs = 0;
+  first_start = UINT64_MAX;
+  last_end = 0;
+  mach_timebase_info(&timebase);
+  if(sysctlbyname("hw.cpufrequency", &cpu_freq, &freq_size, NULL, 0) != 0)
+    cpu_freq = 0;
+
+  snprintf(filepath, sizeof(filepath), "/tmp/perf_index_sendfile.%d", getpid());
+  fd = open(filepath, O_CREAT | O_EXCL | O_RDWR, 0644);
+  assert(fd > 0);
+  memset(buff, 'x', sizeof(buff));
+  for(left = SENDFILE_FILE_SIZE; left > 0; left -= sizeof(buff))
+    assert(write(fd, buff, sizeof(buff)) == sizeof(buff));
+  /* Make sure the whole file is resident before we start timing */
+  assert(lseek(fd, 0, SEEK_SET) == 0);
+  while(read(fd, buff, sizeof(buff)) > 0);
+  close(fd);
+
+  listen_sock = socket(PF_INET, SOCK_STREAM, 0);
+  assert(listen_sock != -1);
+  bzero(&listen_addr, sizeof(listen_addr));
+  listen_addr.sin_family = AF_INET;
+  listen_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listen_addr.sin_port = 0;
+  assert(bind(listen_sock, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) == 0);
+  assert(getsockname(listen_sock, (struct sockaddr *)&listen_addr, &addrlen) == 0);
+  assert(listen(listen_sock, num_threads) == 0);
+}
+
+DECL_TEST(stress_sendfile) {
+  pthread_t drainer;
+  uint64_t start, end;
+  double cycles;
+  long long left, sent = 0;
+  off_t offset = 0, len;
+  int fd, sock, peer;
+
+  fd = open(filepath, O_RDONLY);
+  assert(fd > 0);
+  sock = socket(PF_INET, SOCK_STREAM, 0);
+  assert(sock != -1);
+  assert(connect(sock, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) == 0);
+  peer = accept(listen_sock, NULL, NULL);
+  assert(peer != -1);
+  assert(pthread_create(&drainer, NULL, drain, (void *)(intptr_t)peer) == 0);
+
+  start = mach_absolute_time();
+  for(left = length; left > 0; left -= len) {
+    len = left < SENDFILE_CHUNK ? left : SENDFILE_CHUNK;
+    if(offset + len > SENDFILE_FILE_SIZE)
+      offset = 0;
+    if(sendfile(fd, sock, offset, &len, NULL, 0) != 0)
+      assert(errno == EINTR || errno == EAGAIN);
+    offset += len;
+    sent += len;
+  }
+  end = mach_absolute_time();
+
+  close(sock);
+  pthread_join(drainer, NULL);
+  close(peer);
+  close(fd);
+
+  cycles = (double)(end - start) * timebase.numer / timebase.denom * cpu_freq / 1e9;
+
+  pthread_mutex_lock(&totals_lock);
+  total_bytes += sent;
+  if(cycles > 0) {
+    total_bytes_per_cycle += sent / cycles;
+    total_runs++;
+  }
+  if(start < first_start)
+    first_start = start;
+  if(end > last_end)
+    last_end = end;
+  pthread_mutex_unlock(&totals_lock);
+}
+
+DECL_CLEANUP(stress_sendfile_cleanup) {
+  double seconds;
+
+  close(listen_sock);
+  assert(unlink(filepath) >= 0);
+
+  if(last_end <= first_start)
+    return;
+  seconds = (double)(last_end - first_start) * timebase.numer / timebase.denom / 1e9;
+  /* stdout is reserved for the elapsed time */
+  fprintf(stderr, "sendfile: %d threads, %lld bytes, %.0f bytes/s", num_threads,
+    total_bytes, total_bytes / seconds);
+  if(total_runs > 0)
+    fprintf(stderr, ", %.3f bytes/cycle per thread", total_bytes_per_cycle / total_runs);
+  fprintf(stderr, "\n");
+}
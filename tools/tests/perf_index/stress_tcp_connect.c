@@ -0,0 +1,132 @@
+#include "perf_index.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <mach/mach_time.h>
+
+/*
+ * Each thread connects to and disconnects from its own loopback
+ * listener as fast as it can while a helper thread accepts and closes
+ * the other end.  Every connection inserts, rehashes and removes PCBs
+ * and every segment looks one up, so this mostly measures how well
+ * the TCP PCB hash scales with the thread count.  Besides the usual
+ * elapsed time, reports aggregate connects and accepts per second of
+ * wall-clock time, taken from the first thread to start to the last
+ * one to finish; compare runs at several thread counts, e.g.
+ *
+ *	for n in 1 2 4 8; do perf_index tcp_connect $n 200000; done
+ *
+ * Clients close with a zero linger time so that the test doesn't run
+ * out of ephemeral ports to TIME_WAIT.
+ */
+
+const stress_test_t tcp_connect_test = {"tcp_connect", &stress_tcp_connect_init, &stress_tcp_connect, &stress_tcp_connect_cleanup, &no_validate};
+
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long total_connected, total_accepted;
+static uint64_t first_start, last_end;
+
+typedef struct {
+  int sock;
+  volatile int done;
+  long long accepted;
+} acceptor_args_t;
+
+static void *acceptor(void *arg) {
+  acceptor_args_t *args = (acceptor_args_t *)arg;
+  int sock;
+
+  for(;;) {
+    sock = accept(args->sock, NULL, NULL);
+    if(sock >= 0) {
+      close(sock);
+      args->accepted++;
+      continue;
+    }
+    /* The receive timeout lets us notice the connector is finished */
+    assert(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+      errno == ECONNABORTED);
+    if(args->done)
+      break;
+  }
+  return NULL;
+}
+
+DECL_INIT(stress_tcp_connect_init) {
+  total_connected = total_accepted = 0;
+  first_start = UINT64_MAX;
+  last_end = 0;
+}
+
+DECL_TEST(stress_tcp_connect) {
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  struct timeval timeout = { 0, 100000 };
+  struct linger linger = { 1, 0 };
+  acceptor_args_t args;
+  pthread_t acceptor_thread;
+  uint64_t start, end;
+  long long connected = 0;
+  int sock, on = 1;
+
+  args.sock = socket(PF_INET, SOCK_STREAM, 0);
+  assert(args.sock != -1);
+  args.done = 0;
+  args.accepted = 0;
+  bzero(&addr, sizeof(addr));
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(setsockopt(args.sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0);
+  assert(setsockopt(args.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0);
+  assert(bind(args.sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  assert(getsockname(args.sock, (struct sockaddr *)&addr, &addrlen) == 0);
+  assert(listen(args.sock, 128) == 0);
+  assert(pthread_create(&acceptor_thread, NULL, acceptor, &args) == 0);
+
+  start = mach_absolute_time();
+  while(connected < length) {
+    sock = socket(PF_INET, SOCK_STREAM, 0);
+    assert(sock != -1);
+    assert(setsockopt(sock, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger)) == 0);
+    if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      connected++;
+    } else {
+      /* A full backlog shows up as a refused or timed out connect */
+      assert(errno == ECONNREFUSED || errno == ETIMEDOUT || errno == EINTR ||
+        errno == EADDRNOTAVAIL);
+    }
+    close(sock);
+  }
+  end = mach_absolute_time();
+
+  args.done = 1;
+  pthread_join(acceptor_thread, NULL);
+  close(args.sock);
+
+  pthread_mutex_lock(&totals_lock);
+  total_connected += connected;
+  total_accepted += args.accepted;
+  if(start < first_start)
+    first_start = start;
+  if(end > last_end)
+    last_end = end;
+  pthread_mutex_unlock(&totals_lock);
+}
+
+DECL_CLEANUP(stress_tcp_connect_cleanup) {
+  mach_timebase_info_data_t timebase;
+  double seconds;
+
+  mach_timebase_info(&timebase);
+  if(last_end <= first_start)
+    return;
+  seconds = (double)(last_end - first_start) * timebase.numer / timebase.denom / 1e9;
+  /* stdout is reserved for the elapsed time */
+  fprintf(stderr, "tcp_connect: %d threads, %lld connected, %lld accepted, %.0f connects/s, %.0f accepts/s\n",
+    num_threads, total_connected, total_accepted,
+    total_connected / seconds, total_accepted / seconds);
+}
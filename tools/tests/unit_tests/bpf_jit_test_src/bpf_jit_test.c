@@ -0,0 +1,542 @@
+/*
+ * File: bpf_jit_test.c
+ * Test Description: Differential test for the x86_64 BPF JIT.  The
+ * interpreter (bsd/net/bpf_filter.c) and the JIT (bsd/net/bpf_jitter.c
+ * and bsd/dev/i386/bpf_jit_machdep.c) are both compiled into this
+ * test.  Every filter program is run over every packet by both, and
+ * the results must match.  The programs are a set of tcpdump-generated
+ * filters plus randomly generated ones that exercise every opcode,
+ * including out-of-bounds loads and division by zero.  Packets come
+ * from the pcap files named on the command line, or are synthesized
+ * if there are none, and each one is also presented truncated to
+ * exercise the bounds checks.  Finally the tcpdump filters are timed
+ * on both engines.
+ * Usage: bpf_jit_test [-n random_programs] [-s seed] [file.pcap ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <net/bpf.h>
+#include <net/bpf_jitter.h>
+
+#define	MAXPKT		2048
+#define	MAXPKTS		4096
+#define	NSYNTH		1024
+#define	NTRUNC		4		/* truncated copies of each packet */
+#define	MAXRANDINSNS	64
+#define	BENCH_PASSES	200
+
+extern u_int	bpf_filter(const struct bpf_insn *, u_char *, u_int, u_int);
+
+struct packet {
+	u_int	caplen;
+	u_int	wirelen;
+	u_char	data[MAXPKT];
+};
+
+static struct packet	packets[MAXPKTS];
+static int		npackets;
+
+/*
+ * tcpdump -dd output for DLT_EN10MB, plus a few hand-written programs
+ * for the opcodes tcpdump rarely uses.
+ */
+static struct bpf_insn f_ip[] = {
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x800, 0, 1),
+	BPF_STMT(BPF_RET+BPF_K, 65535),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+};
+
+static struct bpf_insn f_tcp_port_80[] = {
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x86dd, 0, 6),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 6, 0, 15),
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 54),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 80, 12, 0),
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 56),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 80, 10, 11),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x800, 0, 10),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 6, 0, 8),
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, 0x1fff, 6, 0),
+	BPF_STMT(BPF_LDX+BPF_B+BPF_MSH, 14),
+	BPF_STMT(BPF_LD+BPF_H+BPF_IND, 14),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 80, 2, 0),
+	BPF_STMT(BPF_LD+BPF_H+BPF_IND, 16),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 80, 0, 1),
+	BPF_STMT(BPF_RET+BPF_K, 262144),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+};
+
+static struct bpf_insn f_udp_dst_53[] = {
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x800, 0, 8),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 17, 0, 6),
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, 0x1fff, 4, 0),
+	BPF_STMT(BPF_LDX+BPF_B+BPF_MSH, 14),
+	BPF_STMT(BPF_LD+BPF_H+BPF_IND, 16),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 53, 0, 1),
+	BPF_STMT(BPF_RET+BPF_K, 262144),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+};
+
+static struct bpf_insn f_tcp_syn[] = {
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x800, 0, 8),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 6, 0, 6),
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, 0x1fff, 4, 0),
+	BPF_STMT(BPF_LDX+BPF_B+BPF_MSH, 14),
+	BPF_STMT(BPF_LD+BPF_B+BPF_IND, 27),
+	BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, 0x02, 0, 1),
+	BPF_STMT(BPF_RET+BPF_K, 262144),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+};
+
+/* TCP payload length, via scratch memory; accept if nonzero */
+static struct bpf_insn f_tcp_payload[] = {
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x800, 0, 19),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 6, 0, 17),
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 16),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 14),
+	BPF_STMT(BPF_ALU+BPF_AND+BPF_K, 0xf),
+	BPF_STMT(BPF_ALU+BPF_LSH+BPF_K, 2),
+	BPF_STMT(BPF_MISC+BPF_TAX, 0),
+	BPF_STMT(BPF_LD+BPF_MEM, 0),
+	BPF_STMT(BPF_ALU+BPF_SUB+BPF_X, 0),
+	BPF_STMT(BPF_ST, 1),
+	BPF_STMT(BPF_LDX+BPF_B+BPF_MSH, 14),
+	BPF_STMT(BPF_LD+BPF_B+BPF_IND, 26),
+	BPF_STMT(BPF_ALU+BPF_AND+BPF_K, 0xf0),
+	BPF_STMT(BPF_ALU+BPF_RSH+BPF_K, 2),
+	BPF_STMT(BPF_MISC+BPF_TAX, 0),
+	BPF_STMT(BPF_LD+BPF_MEM, 1),
+	BPF_STMT(BPF_ALU+BPF_SUB+BPF_X, 0),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0, 0, 1),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+	BPF_STMT(BPF_RET+BPF_A, 0),
+};
+
+/* long unicast frames, snapped to a quarter of their length */
+static struct bpf_insn f_len[] = {
+	BPF_STMT(BPF_LD+BPF_W+BPF_LEN, 0),
+	BPF_JUMP(BPF_JMP+BPF_JGT+BPF_K, 100, 0, 6),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 0),
+	BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, 1, 4, 0),
+	BPF_STMT(BPF_LDX+BPF_W+BPF_LEN, 0),
+	BPF_STMT(BPF_MISC+BPF_TXA, 0),
+	BPF_STMT(BPF_ALU+BPF_DIV+BPF_K, 4),
+	BPF_STMT(BPF_RET+BPF_A, 0),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+};
+
+static struct bpf_insn f_ip6_tcp[] = {
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x86dd, 0, 3),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 6, 0, 1),
+	BPF_STMT(BPF_RET+BPF_K, 262144),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+};
+
+#define	FILTER(f)	{ #f, f, sizeof (f) / sizeof (f[0]) }
+
+static struct {
+	const char	*name;
+	struct bpf_insn	*insns;
+	int		len;
+} filters[] = {
+	FILTER(f_ip),
+	FILTER(f_tcp_port_80),
+	FILTER(f_udp_dst_53),
+	FILTER(f_tcp_syn),
+	FILTER(f_tcp_payload),
+	FILTER(f_len),
+	FILTER(f_ip6_tcp),
+};
+#define	NFILTERS	(sizeof (filters) / sizeof (filters[0]))
+
+static uint32_t
+rand32(void)
+{
+	return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
+
+/* mostly within a frame, sometimes just past it, rarely anywhere */
+static uint32_t
+rand_offset(void)
+{
+	switch (random() % 8) {
+	case 0:
+		return (rand32());
+	case 1:
+		return (MAXPKT - 8 + random() % 16);
+	case 2:
+		return (0xfffffff0 + random() % 16);
+	default:
+		return (random() % 80);
+	}
+}
+
+static const uint16_t ld_codes[] = {
+	BPF_LD+BPF_W+BPF_ABS, BPF_LD+BPF_H+BPF_ABS, BPF_LD+BPF_B+BPF_ABS,
+	BPF_LD+BPF_W+BPF_IND, BPF_LD+BPF_H+BPF_IND, BPF_LD+BPF_B+BPF_IND,
+	BPF_LDX+BPF_B+BPF_MSH,
+};
+
+static const uint16_t alu_ops[] = {
+	BPF_ADD, BPF_SUB, BPF_MUL, BPF_DIV, BPF_AND, BPF_OR, BPF_LSH, BPF_RSH,
+};
+
+static const uint16_t jmp_ops[] = {
+	BPF_JGT, BPF_JGE, BPF_JEQ, BPF_JSET,
+};
+
+/*
+ * A random program that bpf_validate() would accept: known opcodes,
+ * in-range scratch memory and jumps, no constant division by zero,
+ * and a return at the end.
+ */
+static int
+random_program(struct bpf_insn *prog)
+{
+	int n = 1 + random() % MAXRANDINSNS;
+	int i, room;
+	struct bpf_insn *p;
+
+	for (i = 0; i < n - 1; i++) {
+		p = &prog[i];
+		p->jt = p->jf = 0;
+		p->k = 0;
+		/* instructions left after this one, less the return */
+		room = n - i - 2;
+
+		switch (random() % 10) {
+		case 0:
+		case 1:
+			p->code = ld_codes[random() % 7];
+			p->k = rand_offset();
+			break;
+		case 2:
+			switch (random() % 8) {
+			case 0: p->code = BPF_LD+BPF_IMM; p->k = rand32(); break;
+			case 1: p->code = BPF_LDX+BPF_IMM; p->k = random() % 64; break;
+			case 2: p->code = BPF_LD+BPF_MEM; p->k = random() % BPF_MEMWORDS; break;
+			case 3: p->code = BPF_LDX+BPF_MEM; p->k = random() % BPF_MEMWORDS; break;
+			case 4: p->code = BPF_ST; p->k = random() % BPF_MEMWORDS; break;
+			case 5: p->code = BPF_STX; p->k = random() % BPF_MEMWORDS; break;
+			case 6: p->code = BPF_LD+BPF_W+BPF_LEN; break;
+			default: p->code = BPF_LDX+BPF_W+BPF_LEN; break;
+			}
+			break;
+		case 3:
+		case 4:
+			p->code = BPF_ALU + alu_ops[random() % 8] +
+			    ((random() & 1) ? BPF_X : BPF_K);
+			p->k = (random() & 1) ? random() % 40 : rand32();
+			if (p->code == BPF_ALU+BPF_DIV+BPF_K && p->k == 0)
+				p->k = 1;
+			break;
+		case 5:
+			switch (random() % 3) {
+			case 0: p->code = BPF_ALU+BPF_NEG; break;
+			case 1: p->code = BPF_MISC+BPF_TAX; break;
+			default: p->code = BPF_MISC+BPF_TXA; break;
+			}
+			break;
+		case 6:
+		case 7:
+		case 8:
+			p->code = BPF_JMP + jmp_ops[random() % 4] +
+			    ((random() & 1) ? BPF_X : BPF_K);
+			p->k = (random() & 1) ? random() % 4 : rand32();
+			if (room > 0) {
+				p->jt = random() % (MIN(room, 255) + 1);
+				p->jf = random() % (MIN(room, 255) + 1);
+			}
+			break;
+		default:
+			if (room > 0 && (random() & 1)) {
+				p->code = BPF_JMP+BPF_JA;
+				p->k = random() % (room + 1);
+			} else {
+				p->code = (random() & 1) ? BPF_RET+BPF_A : BPF_RET+BPF_K;
+				p->k = rand32();
+			}
+			break;
+		}
+	}
+	prog[n - 1].code = (random() & 1) ? BPF_RET+BPF_A : BPF_RET+BPF_K;
+	prog[n - 1].jt = prog[n - 1].jf = 0;
+	prog[n - 1].k = rand32();
+	return (n);
+}
+
+static void
+add_packet(const u_char *data, u_int caplen, u_int wirelen)
+{
+	struct packet *pkt;
+
+	if (npackets == MAXPKTS)
+		return;
+	pkt = &packets[npackets++];
+	pkt->caplen = MIN(caplen, MAXPKT);
+	pkt->wirelen = wirelen;
+	memcpy(pkt->data, data, pkt->caplen);
+}
+
+static uint32_t
+swap32(uint32_t v)
+{
+	return ((v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) |
+	    (v << 24));
+}
+
+/* classic pcap format, either byte order, micro- or nanosecond stamps */
+static int
+read_pcap(const char *path)
+{
+	uint32_t hdr[6], rec[4];
+	u_char buf[65536];
+	int swapped;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		perror(path);
+		return (-1);
+	}
+	if (fread(hdr, sizeof (hdr), 1, f) != 1)
+		goto bad;
+	if (hdr[0] == 0xa1b2c3d4 || hdr[0] == 0xa1b23c4d)
+		swapped = 0;
+	else if (hdr[0] == 0xd4c3b2a1 || hdr[0] == 0x4d3cb2a1)
+		swapped = 1;
+	else
+		goto bad;
+
+	while (fread(rec, sizeof (rec), 1, f) == 1) {
+		uint32_t caplen = swapped ? swap32(rec[2]) : rec[2];
+		uint32_t wirelen = swapped ? swap32(rec[3]) : rec[3];
+
+		if (caplen > sizeof (buf) || fread(buf, caplen, 1, f) != 1)
+			goto bad;
+		add_packet(buf, caplen, wirelen);
+	}
+	fclose(f);
+	return (0);
+bad:
+	fprintf(stderr, "%s: not a pcap file, or truncated\n", path);
+	fclose(f);
+	return (-1);
+}
+
+/*
+ * Random frames, most of them with enough of an Ethernet/IPv4 or IPv6
+ * header and TCP/UDP ports to take the filters down their longer paths.
+ */
+static void
+synthesize_packets(void)
+{
+	static const uint16_t ports[] = { 53, 80, 443, 8080 };
+	u_char buf[MAXPKT];
+	u_int len, i, hl;
+	int n;
+
+	for (n = 0; n < NSYNTH; n++) {
+		len = random() % 1515;
+		for (i = 0; i < len; i++)
+			buf[i] = random();
+		if (len >= 64) {
+			switch (random() % 4) {
+			case 0:
+			case 1:
+				/* IPv4, random header length, rarely a fragment */
+				buf[12] = 0x08; buf[13] = 0x00;
+				hl = 5 + random() % 3;
+				buf[14] = 0x40 | hl;
+				buf[16] = (len - 14) >> 8;
+				buf[17] = (len - 14) & 0xff;
+				buf[20] = (random() % 8) == 0 ? 0x20 : 0x40;
+				buf[21] = 0;
+				buf[23] = (random() & 1) ? 6 : 17;
+				buf[14 + hl * 4 + 2] = 0;
+				buf[14 + hl * 4 + 3] = ports[random() % 4];
+				buf[14 + hl * 4 + 12] = (5 + random() % 3) << 4;
+				break;
+			case 2:
+				/* IPv6 */
+				buf[12] = 0x86; buf[13] = 0xdd;
+				buf[20] = (random() & 1) ? 6 : 17;
+				buf[56] = 0;
+				buf[57] = ports[random() % 4];
+				break;
+			default:
+				break;
+			}
+		}
+		add_packet(buf, len, len + ((random() % 4) == 0 ? random() % 64 : 0));
+	}
+}
+
+static u_int	jit_result, interp_result;
+
+/* run both engines on every packet and its truncations */
+static int
+compare(const char *name, struct bpf_insn *prog, int len)
+{
+	bpf_jit_filter *jit;
+	struct packet *pkt;
+	u_int buflen;
+	int i, t, failed = 0;
+
+	if ((jit = bpf_jitter(prog, len)) == NULL) {
+		printf("FAIL: %s: not compiled\n", name);
+		return (1);
+	}
+	for (i = 0; i < npackets && !failed; i++) {
+		pkt = &packets[i];
+		for (t = 0; t <= NTRUNC && !failed; t++) {
+			buflen = t == 0 ? pkt->caplen :
+			    (u_int)random() % (pkt->caplen + 1);
+			interp_result = bpf_filter(prog, pkt->data,
+			    pkt->wirelen, buflen);
+			jit_result = jit->func(pkt->data, pkt->wirelen, buflen);
+			if (jit_result != interp_result) {
+				printf("FAIL: %s: packet %d (%u of %u bytes): "
+				    "interpreter %u, jit %u\n", name, i, buflen,
+				    pkt->wirelen, interp_result, jit_result);
+				failed = 1;
+			}
+		}
+	}
+	if (failed) {
+		for (i = 0; i < len; i++)
+			printf("\t{ 0x%02x, %3u, %3u, 0x%08x },\n", prog[i].code,
+			    prog[i].jt, prog[i].jf, prog[i].k);
+	}
+	bpf_destroy_jit_filter(jit);
+	return (failed);
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+benchmark(void)
+{
+	bpf_jit_filter *jit;
+	struct packet *pkt;
+	uint64_t start, interp_ns, jit_ns, count;
+	volatile u_int sink = 0;
+	u_int f;
+	int pass, i;
+
+	count = (uint64_t)BENCH_PASSES * npackets;
+	for (f = 0; f < NFILTERS; f++) {
+		if ((jit = bpf_jitter(filters[f].insns, filters[f].len)) == NULL)
+			continue;
+
+		start = now_ns();
+		for (pass = 0; pass < BENCH_PASSES; pass++) {
+			for (i = 0, pkt = packets; i < npackets; i++, pkt++)
+				sink += bpf_filter(filters[f].insns, pkt->data,
+				    pkt->wirelen, pkt->caplen);
+		}
+		interp_ns = now_ns() - start;
+
+		start = now_ns();
+		for (pass = 0; pass < BENCH_PASSES; pass++) {
+			for (i = 0, pkt = packets; i < npackets; i++, pkt++)
+				sink += jit->func(pkt->data, pkt->wirelen,
+				    pkt->caplen);
+		}
+		jit_ns = now_ns() - start;
+
+		printf("%-16s interpreter %6.1f ns/pkt  jit %6.1f ns/pkt  (%.1fx)\n",
+		    filters[f].name, (double)interp_ns / count,
+		    (double)jit_ns / count,
+		    jit_ns ? (double)interp_ns / jit_ns : 0.0);
+		bpf_destroy_jit_filter(jit);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bpf_insn prog[MAXRANDINSNS];
+	unsigned int seed = (unsigned int)time(NULL);
+	int nrandom = 20000;
+	int ch, i, len, failed = 0;
+	char name[32];
+
+	while ((ch = getopt(argc, argv, "n:s:")) != -1) {
+		switch (ch) {
+		case 'n':
+			nrandom = atoi(optarg);
+			break;
+		case 's':
+			seed = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n random_programs] "
+			    "[-s seed] [file.pcap ...]\n", argv[0]);
+			return (1);
+		}
+	}
+	printf("seed %u\n", seed);
+	srandom(seed);
+
+	for (i = optind; i < argc; i++) {
+		if (read_pcap(argv[i]) != 0)
+			return (1);
+	}
+	if (npackets == 0)
+		synthesize_packets();
+	printf("%d packets\n", npackets);
+
+	for (i = 0; i < (int)NFILTERS; i++)
+		failed |= compare(filters[i].name, filters[i].insns,
+		    filters[i].len);
+
+	/* the random programs see only a sample of the packets */
+	if (npackets > 64)
+		npackets = 64;
+	for (i = 0; i < nrandom && !failed; i++) {
+		len = random_program(prog);
+		snprintf(name, sizeof (name), "random program %d", i);
+		failed |= compare(name, prog, len);
+	}
+
+	if (!failed) {
+		if (optind == argc) {
+			npackets = 0;
+			synthesize_packets();
+		} else {
+			npackets = MAXPKTS;
+		}
+		benchmark();
+	}
+
+	printf("%s\n", failed ? "FAILED" : "PASSED");
+	return (failed);
+}
@@ -0,0 +1,2 @@
+/* The kernel's JIT interface isn't installed; use it from the tree */
+#include "../../../../../bsd/net/bpf_jitter.h"
@@ -0,0 +1,322 @@
+/*
+ * File: in_cksum_simd_test.c
+ * Test Description: Differential test and throughput benchmark for the
+ * x86_64 vector one's complement checksum kernels in
+ * osfmk/x86_64/in_cksum_simd.s, which are linked in directly.  Random
+ * buffers of random lengths and alignments are summed by the kernels
+ * (with the same head/tail handling as b_sum16() and b_sum16_copy() in
+ * the kernel) and by a byte-at-a-time reference; the copy variants must
+ * also reproduce the source exactly without writing past the end.  The
+ * benchmark then compares the kernels against the scalar 64-bit loop
+ * from bsd/netinet/in_cksum.c.
+ * Usage: in_cksum_simd_test [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define	MAXLEN		65536
+#define	BENCH_BYTES	(1ULL << 30)
+#define	SIMD_MIN	256	/* ML_CKSUM_SIMD_SPAN_MIN */
+
+extern uint64_t	in_cksum_sse2(const void *, size_t);
+extern uint64_t	in_cksum_avx2(const void *, size_t);
+extern uint64_t	in_cksum_copy_sse2(const void *, void *, size_t);
+extern uint64_t	in_cksum_copy_avx2(const void *, void *, size_t);
+
+typedef uint64_t (*sum_func_t)(const void *, size_t);
+typedef uint64_t (*copy_func_t)(const void *, void *, size_t);
+
+static uint8_t	src[MAXLEN + 64], dst[MAXLEN + 64 + 1];
+
+/* RFC 1071, a little-endian 16-bit word at a time */
+static uint16_t
+ref_sum16(const uint8_t *p, size_t len)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += p[i] | (p[i + 1] << 8);
+	if (len & 1)
+		sum += p[len - 1];
+	while (sum >> 16)
+		sum = (sum >> 16) + (sum & 0xffff);
+	return (sum);
+}
+
+/* The 64-bit in_cksumdata() from bsd/netinet/in_cksum.c, sans SIMD */
+static uint16_t
+scalar_sum16(const void *buf, int mlen)
+{
+	uint64_t sum, partial;
+	unsigned int final_acc;
+	uint8_t *data = (void *)buf;
+	int needs_swap, started_on_odd;
+
+	needs_swap = 0;
+	started_on_odd = 0;
+	sum = 0;
+	partial = 0;
+
+	if ((uintptr_t)data & 1) {
+		started_on_odd = !started_on_odd;
+		partial = *data << 8;
+		++data;
+		--mlen;
+	}
+	needs_swap = started_on_odd;
+	if ((uintptr_t)data & 2) {
+		if (mlen < 2)
+			goto trailing_bytes;
+		partial += *(uint16_t *)(void *)data;
+		data += 2;
+		mlen -= 2;
+	}
+	while (mlen >= 64) {
+		__builtin_prefetch(data + 32);
+		__builtin_prefetch(data + 64);
+		partial += *(uint32_t *)(void *)data;
+		partial += *(uint32_t *)(void *)(data + 4);
+		partial += *(uint32_t *)(void *)(data + 8);
+		partial += *(uint32_t *)(void *)(data + 12);
+		partial += *(uint32_t *)(void *)(data + 16);
+		partial += *(uint32_t *)(void *)(data + 20);
+		partial += *(uint32_t *)(void *)(data + 24);
+		partial += *(uint32_t *)(void *)(data + 28);
+		partial += *(uint32_t *)(void *)(data + 32);
+		partial += *(uint32_t *)(void *)(data + 36);
+		partial += *(uint32_t *)(void *)(data + 40);
+		partial += *(uint32_t *)(void *)(data + 44);
+		partial += *(uint32_t *)(void *)(data + 48);
+		partial += *(uint32_t *)(void *)(data + 52);
+		partial += *(uint32_t *)(void *)(data + 56);
+		partial += *(uint32_t *)(void *)(data + 60);
+		data += 64;
+		mlen -= 64;
+		if (partial & (3ULL << 62)) {
+			if (needs_swap)
+				partial = (partial << 8) + (partial >> 56);
+			sum += (partial >> 32);
+			sum += (partial & 0xffffffff);
+			partial = 0;
+		}
+	}
+	if (mlen & 32) {
+		partial += *(uint32_t *)(void *)data;
+		partial += *(uint32_t *)(void *)(data + 4);
+		partial += *(uint32_t *)(void *)(data + 8);
+		partial += *(uint32_t *)(void *)(data + 12);
+		partial += *(uint32_t *)(void *)(data + 16);
+		partial += *(uint32_t *)(void *)(data + 20);
+		partial += *(uint32_t *)(void *)(data + 24);
+		partial += *(uint32_t *)(void *)(data + 28);
+		data += 32;
+	}
+	if (mlen & 16) {
+		partial += *(uint32_t *)(void *)data;
+		partial += *(uint32_t *)(void *)(data + 4);
+		partial += *(uint32_t *)(void *)(data + 8);
+		partial += *(uint32_t *)(void *)(data + 12);
+		data += 16;
+	}
+	if (mlen & 8) {
+		partial += *(uint32_t *)(void *)data;
+		partial += *(uint32_t *)(void *)(data + 4);
+		data += 8;
+	}
+	if (mlen & 4) {
+		partial += *(uint32_t *)(void *)data;
+		data += 4;
+	}
+	if (mlen & 2) {
+		partial += *(uint16_t *)(void *)data;
+		data += 2;
+	}
+trailing_bytes:
+	if (mlen & 1) {
+		partial += *data;
+		started_on_odd = !started_on_odd;
+	}
+
+	if (needs_swap)
+		partial = (partial << 8) + (partial >> 56);
+	sum += (partial >> 32) + (partial & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+
+	final_acc = (sum >> 48) + ((sum >> 32) & 0xffff) +
+	    ((sum >> 16) & 0xffff) + (sum & 0xffff);
+	final_acc = (final_acc >> 16) + (final_acc & 0xffff);
+	final_acc = (final_acc >> 16) + (final_acc & 0xffff);
+
+	return (final_acc);
+}
+
+static uint16_t
+fold(uint64_t sum)
+{
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	while (sum >> 16)
+		sum = (sum >> 16) + (sum & 0xffff);
+	return (sum);
+}
+
+/* As b_sum16(): vector kernel for the bulk, scalar for the tail */
+static uint16_t
+simd_sum16(sum_func_t f, const uint8_t *p, size_t len)
+{
+	size_t done = 0;
+	uint64_t sum = 0;
+
+	if (len >= SIMD_MIN) {
+		done = len & ~(size_t)63;
+		sum = f(p, done);
+	}
+	if (len > done)
+		sum += scalar_sum16(p + done, (int)(len - done));
+	return (fold(sum));
+}
+
+/* As b_sum16_copy() */
+static uint16_t
+simd_copy_sum16(copy_func_t f, const uint8_t *s, uint8_t *d, size_t len)
+{
+	size_t done = 0;
+	uint64_t sum = 0;
+
+	if (len >= SIMD_MIN) {
+		done = len & ~(size_t)63;
+		sum = f(s, d, done);
+	}
+	if (len > done) {
+		memcpy(d + done, s + done, len - done);
+		sum += scalar_sum16(d + done, (int)(len - done));
+	}
+	return (fold(sum));
+}
+
+/* 0 and 0xffff are the same one's complement number */
+static int
+same16(uint16_t a, uint16_t b)
+{
+	return (a == b || (a == 0 && b == 0xffff) || (a == 0xffff && b == 0));
+}
+
+static int
+check(const char *name, sum_func_t f, copy_func_t cf, int iterations)
+{
+	int i, failed = 0;
+
+	for (i = 0; i < iterations && !failed; i++) {
+		size_t len, soff, doff;
+		uint16_t expect, got;
+
+		/* Bias toward lengths around the vector cutover */
+		len = (i & 1) ? (size_t)(random() % 1024) : (size_t)(random() % MAXLEN);
+		soff = random() % 64;
+		doff = random() % 64;
+		if (i % 7 == 0)
+			memset(src + soff, 0xff, len);	/* carry-heavy */
+		else
+			arc4random_buf(src + soff, len);
+
+		expect = ref_sum16(src + soff, len);
+		got = simd_sum16(f, src + soff, len);
+		if (!same16(got, expect)) {
+			printf("%s: len %zu align %zu: sum 0x%04x, expected 0x%04x\n",
+			    name, len, soff, got, expect);
+			failed = 1;
+		}
+
+		memset(dst, 0x5a, sizeof (dst));
+		got = simd_copy_sum16(cf, src + soff, dst + doff, len);
+		if (!same16(got, expect)) {
+			printf("%s copy: len %zu align %zu/%zu: sum 0x%04x, expected 0x%04x\n",
+			    name, len, soff, doff, got, expect);
+			failed = 1;
+		}
+		if (memcmp(dst + doff, src + soff, len) != 0 ||
+		    dst[doff + len] != 0x5a) {
+			printf("%s copy: len %zu align %zu/%zu: bad copy\n",
+			    name, len, soff, doff);
+			failed = 1;
+		}
+	}
+	printf("[%s] %s differential test, %d iterations\n",
+	    failed ? "FAIL" : "PASS", name, i);
+	return (failed);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static volatile uint64_t sink;
+
+static void
+bench(const char *name, sum_func_t f, copy_func_t cf, size_t len)
+{
+	uint64_t n, reps = BENCH_BYTES / len;
+	double t;
+
+	arc4random_buf(src, len);
+	t = now();
+	for (n = 0; n < reps; n++)
+		sink += (f == NULL) ? scalar_sum16(src, (int)len) :
+		    simd_sum16(f, src, len);
+	t = now() - t;
+	printf("%-8s sum  %6zu bytes: %6.2f GB/s\n", name, len,
+	    reps * len / t / 1e9);
+
+	t = now();
+	for (n = 0; n < reps; n++) {
+		if (cf == NULL) {
+			memcpy(dst, src, len);
+			sink += scalar_sum16(dst, (int)len);
+		} else
+			sink += simd_copy_sum16(cf, src, dst, len);
+	}
+	t = now() - t;
+	printf("%-8s copy %6zu bytes: %6.2f GB/s\n", name, len,
+	    reps * len / t / 1e9);
+}
+
+int
+main(int argc, const char **argv)
+{
+	static const size_t sizes[] = { 256, 512, 1024, 1500, 2048, 4096, 9000, 65536 };
+	int iterations = 100000, failed = 0, avx2;
+	unsigned int i;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	srandom(getpid());
+
+	__builtin_cpu_init();
+	avx2 = __builtin_cpu_supports("avx2");
+
+	failed |= check("sse2", in_cksum_sse2, in_cksum_copy_sse2, iterations);
+	if (avx2)
+		failed |= check("avx2", in_cksum_avx2, in_cksum_copy_avx2, iterations);
+	else
+		printf("avx2 not supported, skipped\n");
+	if (failed)
+		return (1);
+
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		bench("scalar", NULL, NULL, sizes[i]);
+		bench("sse2", in_cksum_sse2, in_cksum_copy_sse2, sizes[i]);
+		if (avx2)
+			bench("avx2", in_cksum_avx2, in_cksum_copy_avx2, sizes[i]);
+	}
+	return (0);
+}
@@ -0,0 +1,238 @@
+/*
+ * File: reuseport_lb_test.c
+ * Test Description: Checks that SO_REUSEPORT_LB spreads flows across a
+ * group of sockets bound to the same loopback address and port.  For
+ * UDP, datagrams from many client ports must each arrive on exactly one
+ * group member, every member must get some, and a second datagram from
+ * the same client must land on the same member as the first.  For TCP,
+ * connections from many clients must be accepted by every listener.
+ * Usage: reuseport_lb_test [members] [clients]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef SO_REUSEPORT_LB
+#define	SO_REUSEPORT_LB	0x1109
+#endif
+
+#define	MAX_MEMBERS	16
+#define	MAX_CLIENTS	1024
+
+static int	nmembers = 4;
+static int	nclients = 128;
+
+static int
+member_socket(int type, struct sockaddr_in *sin)
+{
+	socklen_t len = sizeof (*sin);
+	int s, on = 1;
+
+	if ((s = socket(PF_INET, type, 0)) < 0) {
+		perror("socket");
+		exit(1);
+	}
+	if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof (on)) < 0 ||
+	    setsockopt(s, SOL_SOCKET, SO_REUSEPORT_LB, &on, sizeof (on)) < 0) {
+		perror("setsockopt");
+		exit(1);
+	}
+	if (bind(s, (struct sockaddr *)sin, sizeof (*sin)) < 0) {
+		perror("bind");
+		exit(1);
+	}
+	/* The first member picks the port for the rest */
+	if (getsockname(s, (struct sockaddr *)sin, &len) < 0) {
+		perror("getsockname");
+		exit(1);
+	}
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	return (s);
+}
+
+static int
+check_spread(const char *what, int *counts, int total)
+{
+	int i, sum = 0, failed = 0;
+
+	printf("%s:", what);
+	for (i = 0; i < nmembers; i++) {
+		printf(" %d", counts[i]);
+		sum += counts[i];
+		if (counts[i] == 0)
+			failed = 1;
+	}
+	printf(" (%d of %d)\n", sum, total);
+	if (sum != total) {
+		printf("FAIL: %s: expected %d, got %d\n", what, total, sum);
+		return (1);
+	}
+	if (failed) {
+		printf("FAIL: %s: a member got nothing\n", what);
+		return (1);
+	}
+	return (0);
+}
+
+/* Which member has a datagram waiting, or -1 */
+static int
+udp_receive(int *members)
+{
+	struct pollfd pfd[MAX_MEMBERS];
+	char buf[16];
+	int i;
+
+	for (i = 0; i < nmembers; i++) {
+		pfd[i].fd = members[i];
+		pfd[i].events = POLLIN;
+		pfd[i].revents = 0;
+	}
+	if (poll(pfd, nmembers, 1000) <= 0)
+		return (-1);
+	for (i = 0; i < nmembers; i++) {
+		if ((pfd[i].revents & POLLIN) &&
+		    recv(members[i], buf, sizeof (buf), 0) > 0)
+			return (i);
+	}
+	return (-1);
+}
+
+static int
+test_udp(void)
+{
+	struct sockaddr_in sin;
+	int members[MAX_MEMBERS], counts[MAX_MEMBERS];
+	int clients[MAX_CLIENTS], first[MAX_CLIENTS];
+	int i, m, failed = 0;
+
+	bzero(&sin, sizeof (sin));
+	sin.sin_len = sizeof (sin);
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	for (i = 0; i < nmembers; i++) {
+		members[i] = member_socket(SOCK_DGRAM, &sin);
+		counts[i] = 0;
+	}
+
+	for (i = 0; i < nclients; i++) {
+		if ((clients[i] = socket(PF_INET, SOCK_DGRAM, 0)) < 0 ||
+		    connect(clients[i], (struct sockaddr *)&sin,
+		    sizeof (sin)) < 0) {
+			perror("udp client");
+			exit(1);
+		}
+		if (send(clients[i], "x", 1, 0) != 1) {
+			perror("send");
+			exit(1);
+		}
+		if ((m = udp_receive(members)) < 0) {
+			printf("FAIL: udp: datagram %d lost\n", i);
+			exit(1);
+		}
+		first[i] = m;
+		counts[m]++;
+	}
+	failed |= check_spread("udp", counts, nclients);
+
+	/* Each flow must stick to its member */
+	for (i = 0; i < nclients; i++) {
+		if (send(clients[i], "y", 1, 0) != 1) {
+			perror("send");
+			exit(1);
+		}
+		if ((m = udp_receive(members)) != first[i]) {
+			printf("FAIL: udp: client %d moved from member %d to %d\n",
+			    i, first[i], m);
+			failed = 1;
+		}
+		close(clients[i]);
+	}
+
+	for (i = 0; i < nmembers; i++)
+		close(members[i]);
+	return (failed);
+}
+
+static int
+test_tcp(void)
+{
+	struct sockaddr_in sin;
+	int members[MAX_MEMBERS], counts[MAX_MEMBERS];
+	int clients[MAX_CLIENTS];
+	int i, s, accepted, tries, failed;
+
+	bzero(&sin, sizeof (sin));
+	sin.sin_len = sizeof (sin);
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	for (i = 0; i < nmembers; i++) {
+		members[i] = member_socket(SOCK_STREAM, &sin);
+		if (listen(members[i], nclients) < 0) {
+			perror("listen");
+			exit(1);
+		}
+		counts[i] = 0;
+	}
+
+	for (i = 0; i < nclients; i++) {
+		if ((clients[i] = socket(PF_INET, SOCK_STREAM, 0)) < 0 ||
+		    connect(clients[i], (struct sockaddr *)&sin,
+		    sizeof (sin)) < 0) {
+			perror("tcp client");
+			exit(1);
+		}
+	}
+
+	/* Connections complete asynchronously; give them a moment */
+	for (accepted = 0, tries = 0; accepted < nclients && tries < 100;
+	    tries++) {
+		for (i = 0; i < nmembers; i++) {
+			while ((s = accept(members[i], NULL, NULL)) >= 0) {
+				counts[i]++;
+				accepted++;
+				close(s);
+			}
+		}
+		if (accepted < nclients)
+			usleep(10000);
+	}
+	failed = check_spread("tcp", counts, nclients);
+
+	for (i = 0; i < nclients; i++)
+		close(clients[i]);
+	for (i = 0; i < nmembers; i++)
+		close(members[i]);
+	return (failed);
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	if (argc > 1)
+		nmembers = atoi(argv[1]);
+	if (argc > 2)
+		nclients = atoi(argv[2]);
+	if (nmembers < 1 || nmembers > MAX_MEMBERS ||
+	    nclients < 1 || nclients > MAX_CLIENTS) {
+		fprintf(stderr, "Usage: %s [members (1-%d)] [clients (1-%d)]\n",
+		    argv[0], MAX_MEMBERS, MAX_CLIENTS);
+		return (1);
+	}
+
+	failed |= test_udp();
+	failed |= test_tcp();
+
+	printf("%s\n", failed ? "FAILED" : "PASSED");
+	return (failed);
+}